@@ -0,0 +1,546 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ * 
+ * iman-bench: Times the parser and lookup hot paths over a corpus and reports the results as JSON
+ */
+
+#include "../iman.h"
+#include "../iman_mapping.h"
+#include "../iman_lookup.h"
+#include "../parser/iman_diagnostics.h"
+#include "../parser/iman_lexer.h"
+#include "../parser/iman_arena.h"
+#include "../parser/iman_symbols.h"
+#include "../parser/iman_reference.h"
+#include "../parser/iman_form_parser.h"
+#include "../parser/iman_binary_writer.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define IMAN_BENCH_INSN_FILENAME "instruction.iman"
+#define IMAN_BENCH_MAX_PATH 1024
+#define IMAN_BENCH_MAX_NAME 64
+
+/* In process harnesses keep their fastest run, the spawned ones are long enough to run once */
+#define IMAN_BENCH_RUNS 3
+
+#define IMAN_BENCH_WRITER_BUFFER (1 << 20)
+#define IMAN_BENCH_WRITER_PASSES 64
+
+struct iman_bench_result {
+    const char *name;
+    
+    /* Lines, forms, puts, lookups or processes, whatever one operation of the harness is */
+    uint64_t operations;
+    uint64_t bytes;
+    double seconds;
+};
+
+struct iman_bench_form {
+    const char *line;
+    unsigned int length;
+    unsigned int line_number;
+    unsigned int base_column;
+};
+
+struct iman_bench {
+    const char *source_dir;
+    const char *source_path;
+    const char *work_dir;
+    const char *arch;
+    const char *intel_path;
+    const char *parser_path;
+    const char *intelf2i_path;
+    
+    struct iman_mapping source;
+    
+    struct iman_bench_form *forms;
+    unsigned int form_count;
+    unsigned int longest_form;
+};
+
+static int iman_bench_lexer(struct iman_bench *bench, struct iman_bench_result *result);
+static int iman_bench_parse_form(struct iman_bench *bench, struct iman_bench_result *result);
+static int iman_bench_binary_writer(struct iman_bench *bench, struct iman_bench_result *result);
+static int iman_bench_build_table(struct iman_bench *bench, struct iman_bench_result *result);
+static int iman_bench_lookup(struct iman_bench *bench, struct iman_bench_result *result);
+static int iman_bench_intelf2i(struct iman_bench *bench, struct iman_bench_result *result);
+static int iman_bench_collect_forms(struct iman_bench *bench);
+static int iman_bench_spawn(char * const *arguments, const char *input_path);
+static double iman_bench_now(void);
+static void iman_bench_print_result(FILE *output, const struct iman_bench_result *result, int last);
+static void iman_bench_print_string(FILE *output, const char *text);
+
+struct iman_bench_harness {
+    const char *name;
+    
+    int (*run)(struct iman_bench *bench, struct iman_bench_result *result);
+};
+
+/* Lookups read the table the build harness writes, so the order matters */
+static const struct iman_bench_harness iman_bench_harnesses[] = {
+    { "lexer_read_line",     &iman_bench_lexer          },
+    { "parse_form",          &iman_bench_parse_form     },
+    { "binary_writer_put",   &iman_bench_binary_writer  },
+    { "build_table",         &iman_bench_build_table    },
+    { "lookup_find",         &iman_bench_lookup         },
+    { "intelf2i_convert",    &iman_bench_intelf2i       },
+    
+    { NULL, NULL }
+};
+
+int main(int argc, char **argv) {
+    struct iman_bench_result results[sizeof(iman_bench_harnesses) / sizeof(iman_bench_harnesses[0])];
+    char path_buffer[IMAN_BENCH_MAX_PATH];
+    struct iman_bench bench;
+    struct stat info;
+    const char *output_path = NULL;
+    FILE *output = stdout;
+    unsigned int count, x;
+    int first = 1;
+    
+    if (argc > 2 && (strcmp(argv[1], "-o") == 0 || strcmp(argv[1], "--output") == 0)) {
+        output_path = argv[2];
+        first = 3;
+    }
+    
+    if (argc - first != 6) {
+        printf("Usage: %s [-o|--output results.json] sourcedir arch workdir intel.txt iman-parser intelf2i\n"
+            "Times the lexer, form parser, binary writer, a full build, lookups and intelf2i\n"
+            "over sourcedir/arch/" IMAN_BENCH_INSN_FILENAME " and intel.txt, printing the results as JSON.\n",
+            argc > 0 ? argv[0] : "iman-bench"
+        );
+        
+        return -1;
+    }
+    
+    memset(&bench, 0, sizeof(bench));
+    bench.source_dir = argv[first];
+    bench.arch = argv[first + 1];
+    bench.work_dir = argv[first + 2];
+    bench.intel_path = argv[first + 3];
+    bench.parser_path = argv[first + 4];
+    bench.intelf2i_path = argv[first + 5];
+    
+    if (snprintf(path_buffer, IMAN_BENCH_MAX_PATH, "%s/%s/" IMAN_BENCH_INSN_FILENAME, bench.source_dir, bench.arch) >= IMAN_BENCH_MAX_PATH) {
+        fprintf(stderr, "Error: specified path %s was too long\n", bench.source_dir);
+        return -1;
+    }
+    
+    bench.source_path = path_buffer;
+    
+    /* Form errors would be printed for every run, they are counted as failures instead */
+    iman_diagnostic_initialise(IMAN_DIAGNOSTIC_QUIET);
+    
+    if (iman_mapping_open(&bench.source, bench.source_path, IMAN_MAPPING_ACCESS_SEQUENTIAL) != IMAN_TRUE ||
+        stat(bench.intel_path, &info) != 0) {
+        fprintf(stderr, "Error: unable to open the corpus %s or %s\n", bench.source_path, bench.intel_path);
+        iman_mapping_close(&bench.source);
+        return -1;
+    }
+    
+    if (iman_bench_collect_forms(&bench) != IMAN_TRUE) {
+        fprintf(stderr, "Error: out of memory\n");
+        iman_mapping_close(&bench.source);
+        return -1;
+    }
+    
+    for (count = 0; iman_bench_harnesses[count].name != NULL; ++count) {
+        memset(&results[count], 0, sizeof(results[count]));
+        results[count].name = iman_bench_harnesses[count].name;
+        
+        if (iman_bench_harnesses[count].run(&bench, &results[count]) != IMAN_TRUE) {
+            fprintf(stderr, "Error: the %s benchmark failed\n", iman_bench_harnesses[count].name);
+            free(bench.forms);
+            iman_mapping_close(&bench.source);
+            return -2;
+        }
+    }
+    
+    if (output_path != NULL && (output = fopen(output_path, "w")) == NULL) {
+        fprintf(stderr, "Error: unable to open output file %s\n", output_path);
+        free(bench.forms);
+        iman_mapping_close(&bench.source);
+        return -1;
+    }
+    
+    fprintf(output, "{\n    \"corpus\": {\n        \"source\": ");
+    iman_bench_print_string(output, bench.source_path);
+    fprintf(output, ",\n        \"source_bytes\": %lu,\n        \"forms\": %u,\n        \"intel\": ", (unsigned long)bench.source.size, bench.form_count);
+    iman_bench_print_string(output, bench.intel_path);
+    fprintf(output, ",\n        \"intel_bytes\": %lu\n    },\n    \"results\": [\n", (unsigned long)info.st_size);
+    
+    for (x = 0; x < count; ++x) {
+        iman_bench_print_result(output, &results[x], x + 1 == count ? IMAN_TRUE : IMAN_FALSE);
+    }
+    
+    fprintf(output, "    ]\n}\n");
+    
+    free(bench.forms);
+    iman_mapping_close(&bench.source);
+    
+    if (output != stdout && fclose(output) != 0) {
+        fprintf(stderr, "Error: unable to write %s\n", output_path);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/* One operation is a line, read the way the parser reads them */
+static int iman_bench_lexer(struct iman_bench *bench, struct iman_bench_result *result) {
+    unsigned int run;
+    
+    for (run = 0; run < IMAN_BENCH_RUNS; ++run) {
+        struct iman_lexer lexer;
+        uint64_t lines = 0;
+        double start = iman_bench_now(), seconds;
+        
+        iman_lexer_open_span(&lexer, (const char *)bench->source.data, bench->source.size, 1);
+        
+        while (iman_lexer_expect_line_start(&lexer) == IMAN_TRUE) {
+            const char *line;
+            unsigned int length;
+            
+            iman_lexer_consume_remaining(&lexer, &line, &length);
+            lines++;
+        }
+        
+        seconds = iman_bench_now() - start;
+        iman_lexer_close(&lexer);
+        
+        if (run == 0 || seconds < result->seconds) {
+            result->seconds = seconds;
+            result->operations = lines;
+            result->bytes = bench->source.size;
+        }
+    }
+    
+    return IMAN_TRUE;
+}
+
+/* Every form line is copied out first, as the parser does, since parsing writes into the line */
+static int iman_bench_parse_form(struct iman_bench *bench, struct iman_bench_result *result) {
+    struct iman_symbol_table symbols;
+    struct iman_reference_form_definition form;
+    char *scratch = malloc(bench->longest_form + 1);
+    unsigned int run, x;
+    
+    if (scratch == NULL)
+        return IMAN_FALSE;
+    
+    iman_symbol_table_initialise(&symbols);
+    
+    for (run = 0; run < IMAN_BENCH_RUNS; ++run) {
+        uint64_t bytes = 0;
+        double start = iman_bench_now(), seconds;
+        
+        for (x = 0; x < bench->form_count; ++x) {
+            const struct iman_bench_form *line = &bench->forms[x];
+            
+            memcpy(scratch, line->line, line->length);
+            scratch[line->length] = '\0';
+            memset(&form, 0, sizeof(form));
+            
+            if (iman_parse_form(scratch, line->line_number, line->base_column, &symbols, &form) != IMAN_TRUE) {
+                fprintf(stderr, "Error (L%u): this instruction form couldn't be parsed.\n", line->line_number);
+                iman_symbol_table_release(&symbols);
+                free(scratch);
+                return IMAN_FALSE;
+            }
+            
+            bytes += line->length;
+        }
+        
+        seconds = iman_bench_now() - start;
+        
+        if (run == 0 || seconds < result->seconds) {
+            result->seconds = seconds;
+            result->operations = bench->form_count;
+            result->bytes = bytes;
+        }
+    }
+    
+    iman_symbol_table_release(&symbols);
+    free(scratch);
+    return IMAN_TRUE;
+}
+
+/* Fills a buffer with records shaped like the form records the writer puts, one operation per put */
+static int iman_bench_binary_writer(struct iman_bench *bench, struct iman_bench_result *result) {
+    struct iman_binary_writer writer;
+    char *buffer = malloc(IMAN_BENCH_WRITER_BUFFER);
+    unsigned int run, pass;
+    
+    IMAN_UNUSED(bench);
+    
+    if (buffer == NULL)
+        return IMAN_FALSE;
+    
+    for (run = 0; run < IMAN_BENCH_RUNS; ++run) {
+        uint64_t puts = 0, bytes = 0;
+        double start = iman_bench_now(), seconds;
+        
+        for (pass = 0; pass < IMAN_BENCH_WRITER_PASSES; ++pass) {
+            uint32_t value = pass;
+            
+            iman_binary_writer_initialise(&writer, buffer, IMAN_BENCH_WRITER_BUFFER);
+            
+            while (writer.error_state == 0 && writer.length - writer.position >= 32) {
+                iman_binary_writer_put_uint32(&writer, value++);
+                iman_binary_writer_put_uint16(&writer, (uint16_t)value);
+                iman_binary_writer_put_uint8(&writer, (uint8_t)value);
+                iman_binary_writer_put_fixed_string(&writer, "adc", 8);
+                iman_binary_writer_put_bytes(&writer, &value, sizeof(value));
+                iman_binary_writer_pad(&writer, 4);
+                puts += 6;
+            }
+            
+            bytes += writer.position;
+        }
+        
+        seconds = iman_bench_now() - start;
+        
+        if (run == 0 || seconds < result->seconds) {
+            result->seconds = seconds;
+            result->operations = puts;
+            result->bytes = bytes;
+        }
+    }
+    
+    free(buffer);
+    return IMAN_TRUE;
+}
+
+/* A full, non-incremental iman-parser run, process start up included */
+static int iman_bench_build_table(struct iman_bench *bench, struct iman_bench_result *result) {
+    char *arguments[7];
+    double start;
+    
+    arguments[0] = (char *)bench->parser_path;
+    arguments[1] = "-q";
+    arguments[2] = "-f";
+    arguments[3] = (char *)bench->source_dir;
+    arguments[4] = (char *)bench->arch;
+    arguments[5] = (char *)bench->work_dir;
+    arguments[6] = NULL;
+    
+    start = iman_bench_now();
+    
+    if (iman_bench_spawn(arguments, NULL) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    result->seconds = iman_bench_now() - start;
+    result->operations = 1;
+    result->bytes = bench->source.size;
+    return IMAN_TRUE;
+}
+
+/* Looks up the first alias of every block by name, inflating its block each time */
+static int iman_bench_lookup(struct iman_bench *bench, struct iman_bench_result *result) {
+    struct iman_lookup lookup;
+    struct iman_lookup_entry entry;
+    char (*names)[IMAN_BENCH_MAX_NAME];
+    uint32_t block_count, x;
+    unsigned int run;
+    
+    if (iman_lookup_open(&lookup, bench->work_dir, bench->arch) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    block_count = lookup.block_count;
+    names = malloc((size_t)(block_count + 1) * sizeof(*names));
+    
+    if (names == NULL) {
+        iman_lookup_close(&lookup);
+        return IMAN_FALSE;
+    }
+    
+    for (x = 0; x < block_count; ++x) {
+        const char *name;
+        uint32_t length;
+        
+        if (iman_lookup_block_name(&lookup, x, &name, &length) != IMAN_TRUE || length >= IMAN_BENCH_MAX_NAME) {
+            free(names);
+            iman_lookup_close(&lookup);
+            return IMAN_FALSE;
+        }
+        
+        memcpy(names[x], name, length);
+        names[x][length] = '\0';
+    }
+    
+    for (run = 0; run < IMAN_BENCH_RUNS; ++run) {
+        uint64_t bytes = 0;
+        double start = iman_bench_now(), seconds;
+        
+        for (x = 0; x < block_count; ++x) {
+            if (iman_lookup_find(&lookup, names[x], &entry) != IMAN_TRUE) {
+                fprintf(stderr, "Error: no entry for %s\n", names[x]);
+                free(names);
+                iman_lookup_close(&lookup);
+                return IMAN_FALSE;
+            }
+            
+            bytes += entry.length;
+        }
+        
+        seconds = iman_bench_now() - start;
+        
+        if (run == 0 || seconds < result->seconds) {
+            result->seconds = seconds;
+            result->operations = block_count;
+            result->bytes = bytes;
+        }
+    }
+    
+    free(names);
+    iman_lookup_close(&lookup);
+    return IMAN_TRUE;
+}
+
+static int iman_bench_intelf2i(struct iman_bench *bench, struct iman_bench_result *result) {
+    char *arguments[2];
+    struct stat info;
+    double start;
+    
+    arguments[0] = (char *)bench->intelf2i_path;
+    arguments[1] = NULL;
+    
+    if (stat(bench->intel_path, &info) != 0)
+        return IMAN_FALSE;
+    
+    start = iman_bench_now();
+    
+    if (iman_bench_spawn(arguments, bench->intel_path) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    result->seconds = iman_bench_now() - start;
+    result->operations = 1;
+    result->bytes = (uint64_t)info.st_size;
+    return IMAN_TRUE;
+}
+
+/* Form lines are found up front so the form harness times nothing but the form parser */
+static int iman_bench_collect_forms(struct iman_bench *bench) {
+    const char *data = (const char *)bench->source.data;
+    unsigned int capacity = 0, line = 1;
+    size_t offset = 0;
+    
+    while (offset < bench->source.size) {
+        const char *newline = memchr(&data[offset], '\n', bench->source.size - offset);
+        size_t end = newline != NULL ? (size_t)(newline - data) : bench->source.size;
+        size_t start = offset;
+        
+        for (; start < end && data[start] == '\t'; ++start)
+            ;
+        
+        if (start > offset && start < end && data[start] == '[') {
+            if (bench->form_count >= capacity) {
+                unsigned int new_capacity = capacity ? capacity * 2 : 1024;
+                struct iman_bench_form *new_forms = realloc(bench->forms, new_capacity * sizeof(*new_forms));
+                
+                if (new_forms == NULL)
+                    return IMAN_FALSE;
+                
+                bench->forms = new_forms;
+                capacity = new_capacity;
+            }
+            
+            bench->forms[bench->form_count].line = &data[start];
+            bench->forms[bench->form_count].length = (unsigned int)(end - start);
+            bench->forms[bench->form_count].line_number = line;
+            bench->forms[bench->form_count].base_column = (unsigned int)(start - offset) + 1;
+            
+            if (end - start > bench->longest_form)
+                bench->longest_form = (unsigned int)(end - start);
+            
+            bench->form_count++;
+        }
+        
+        offset = end + 1;
+        line++;
+    }
+    
+    return IMAN_TRUE;
+}
+
+/* Runs a tool to completion with its output thrown away, reading input_path on stdin when given */
+static int iman_bench_spawn(char * const *arguments, const char *input_path) {
+    int status;
+    pid_t child;
+    
+    fflush(stdout);
+    child = fork();
+    
+    if (child < 0)
+        return IMAN_FALSE;
+    
+    if (child == 0) {
+        int output = open("/dev/null", O_WRONLY);
+        
+        if (input_path != NULL) {
+            int input = open(input_path, O_RDONLY);
+            
+            if (input < 0 || dup2(input, STDIN_FILENO) < 0)
+                _exit(127);
+            
+            close(input);
+        }
+        
+        if (output < 0 || dup2(output, STDOUT_FILENO) < 0)
+            _exit(127);
+        
+        close(output);
+        execv(arguments[0], arguments);
+        _exit(127);
+    }
+    
+    if (waitpid(child, &status, 0) != child)
+        return IMAN_FALSE;
+    
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? IMAN_TRUE : IMAN_FALSE;
+}
+
+static double iman_bench_now(void) {
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static void iman_bench_print_result(FILE *output, const struct iman_bench_result *result, int last) {
+    double seconds = result->seconds > 0 ? result->seconds : 1e-9;
+    
+    fprintf(output, "        { \"name\": ");
+    iman_bench_print_string(output, result->name);
+    fprintf(output, ", \"operations\": %lu, \"bytes\": %lu, \"seconds\": %.6f, \"mb_per_s\": %.2f, \"ns_per_op\": %.1f }%s\n",
+        (unsigned long)result->operations,
+        (unsigned long)result->bytes,
+        result->seconds,
+        (double)result->bytes / seconds / 1e6,
+        result->operations != 0 ? seconds * 1e9 / (double)result->operations : 0.0,
+        last == IMAN_TRUE ? "" : ","
+    );
+}
+
+/* Paths are the only strings that aren't known up front, so only quotes, backslashes and controls need escaping */
+static void iman_bench_print_string(FILE *output, const char *text) {
+    fputc('"', output);
+    
+    for (; *text != '\0'; ++text) {
+        unsigned char c = (unsigned char)*text;
+        
+        if (c == '"' || c == '\\')
+            fprintf(output, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(output, "\\u%04x", c);
+        else
+            fputc(c, output);
+    }
+    
+    fputc('"', output);
+}
\ No newline at end of file
@@ -0,0 +1,500 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ * 
+ * iman-corpus: Generates large synthetic corpora for the benchmarks, either an instruction.iman built from
+ * varied copies of a real reference or tab separated Intel form table text for intelf2i
+ */
+
+#include "../iman.h"
+#include "../iman_mapping.h"
+
+#define IMAN_CORPUS_OUTPUT_BUFFER (1 << 20)
+#define IMAN_CORPUS_INTEL_ROWS 4096
+#define IMAN_CORPUS_MAX_SCALE 100000
+#define IMAN_CORPUS_MAX_FORMS 1000
+#define IMAN_CORPUS_MAX_WORDS 256
+#define IMAN_CORPUS_MAX_OPERANDS 16
+
+struct iman_corpus_span {
+    const char *data;
+    size_t length;
+};
+
+/* Operand lists of every form in the source, grouped by how many operands they have */
+struct iman_corpus_operands {
+    struct iman_corpus_span *lists;
+    size_t count;
+    size_t starts[IMAN_CORPUS_MAX_OPERANDS + 2];
+};
+
+static int iman_corpus_write_reference(FILE *output, const struct iman_mapping *source, unsigned int scale, unsigned int forms);
+static void iman_corpus_write_header(FILE *output, const char *line, size_t length, unsigned int copy);
+static void iman_corpus_write_form(FILE *output, const char *line, size_t length, const struct iman_corpus_operands *operands, uint64_t *state);
+static void iman_corpus_write_shuffled(FILE *output, const char *text, size_t length, uint64_t *state);
+static int iman_corpus_split_form(const char *line, size_t length, struct iman_corpus_span *operands, struct iman_corpus_span *description);
+static unsigned int iman_corpus_count_operands(const struct iman_corpus_span *list);
+static int iman_corpus_collect_operands(struct iman_corpus_operands *operands, const struct iman_mapping *source);
+static int iman_corpus_compare_operands(const void *left, const void *right);
+static int iman_corpus_is_form(const char *line, size_t length);
+static int iman_corpus_write_intel(FILE *output, unsigned int scale);
+static void iman_corpus_write_intel_row(FILE *output, const char *row, uint64_t *state);
+static uint32_t iman_corpus_random(uint64_t *state);
+static int iman_corpus_parse_count(const char *text, unsigned int maximum, unsigned int *pcount);
+
+/* Rows in the shapes the SDM tables come in, from one byte opcodes to EVEX forms with masks and broadcasts */
+static const char * const iman_corpus_intel_rows[] = {
+    "37\tAAA\tNP\tInvalid\tValid\tASCII adjust AL after addition.",
+    "80 /2 ib\tADC r/m8, imm8\tMI\tValid\tValid\tAdd with carry imm8 to r/m8.",
+    "11 /r\tADC r/m32, r32\tMR\tValid\tValid\tAdd with CF r32 to r/m32.",
+    "REX.W + 15 id\tADC RAX, imm32\tI\tValid\tN.E.\tAdd with carry imm32 sign extended to 64-bits to RAX.",
+    "REX.W + 03 /r\tADD r64, r/m64\tRM\tValid\tN.E.\tAdd r/m64 to r64.",
+    "0F BC /r\tBSF r16, r/m16\tRM\tValid\tValid\tBit scan forward on r/m16.",
+    "F6 /6\tDIV r/m8\tM\tValid\tValid\tUnsigned divide AX by r/m8, with result stored in AL = Quotient, AH = Remainder.",
+    "C8 iw 00\tENTER imm16, 0\tII\tValid\tValid\tCreate a stack frame for a procedure.",
+    "0F AF /r\tIMUL r32, r/m32\tRM\tValid\tValid\tdoubleword register = doubleword register * r/m32.",
+    "6B /r ib\tIMUL r16, r/m16, imm8\tRMI\tValid\tValid\tword register = r/m16 * sign-extended immediate byte.",
+    "REX.W + B8+ rd io\tMOV r64, imm64\tOI\tValid\tN.E.\tMove imm64 to r64.",
+    "VEX.256.66.0F38.W0 18 /r\tVBROADCASTSS ymm1, m32\tRM\tValid\tValid\tBroadcast single-precision floating-point element in mem to eight locations in ymm1.",
+    "EVEX.512.66.0F38.W0 B8 /r\tVFMADD231PS zmm1 {k1}{z}, zmm2, zmm3/m512/m32bcst{er}\tA\tValid\tValid\tMultiply packed single-precision floating-point values from zmm2 and zmm3/m512/m32bcst, add to zmm1 and put result in zmm1.",
+    "EVEX.128.F3.0F.W1 6F /r\tVMOVDQU64 xmm1 {k1}{z}, xmm2/m128\tA\tValid\tValid\tMove unaligned packed quadword integer values from xmm2/m128 to xmm1 using writemask k1."
+};
+
+/* An operand from one of these is swapped for any other of the same group, so rows keep their shape */
+static const char * const iman_corpus_intel_operands[][5] = {
+    { "r8", "r16", "r32", "r64", NULL },
+    { "r/m8", "r/m16", "r/m32", "r/m64", NULL },
+    { "imm8", "imm16", "imm32", NULL, NULL },
+    { "xmm1", "ymm1", "zmm1", NULL, NULL },
+    { "xmm2", "ymm2", "zmm2", NULL, NULL },
+    { "m32", "m64", "m128", "m256", "m512" }
+};
+
+int main(int argc, char **argv) {
+    struct iman_mapping source;
+    unsigned int scale, forms = 1;
+    int first = 1, intel = IMAN_FALSE, result;
+    FILE *output;
+    
+    for (; first < argc && argv[first][0] == '-'; ++first) {
+        if (strcmp(argv[first], "-i") == 0 || strcmp(argv[first], "--intel") == 0) {
+            intel = IMAN_TRUE;
+        } else if ((strcmp(argv[first], "-f") == 0 || strcmp(argv[first], "--forms") == 0) && first + 1 < argc) {
+            if (iman_corpus_parse_count(argv[++first], IMAN_CORPUS_MAX_FORMS, &forms) != IMAN_TRUE) {
+                printf("Error: the form multiplier must be between 1 and %u\n", IMAN_CORPUS_MAX_FORMS);
+                return -1;
+            }
+        } else {
+            break;
+        }
+    }
+    
+    if (argc - first != (intel == IMAN_TRUE ? 2 : 3)) {
+        printf("Usage: %s [-f|--forms count] scale instruction.iman output\n"
+            "       %s -i|--intel scale output\n"
+            "Writes a reference made of scale copies of every block, each form repeated count times. Copies past\n"
+            "the first rename their blocks, shuffle the words of every description and resample form operands.\n"
+            "With --intel, writes scale * %u rows of Intel form table text for intelf2i, varied from %u row shapes.\n",
+            argc > 0 ? argv[0] : "iman-corpus", argc > 0 ? argv[0] : "iman-corpus", IMAN_CORPUS_INTEL_ROWS,
+            (unsigned int)(sizeof(iman_corpus_intel_rows) / sizeof(iman_corpus_intel_rows[0]))
+        );
+        
+        return -1;
+    }
+    
+    if (iman_corpus_parse_count(argv[first], IMAN_CORPUS_MAX_SCALE, &scale) != IMAN_TRUE) {
+        printf("Error: the scale must be between 1 and %u\n", IMAN_CORPUS_MAX_SCALE);
+        return -1;
+    }
+    
+    if (intel == IMAN_FALSE && iman_mapping_open(&source, argv[first + 1], IMAN_MAPPING_ACCESS_SEQUENTIAL) != IMAN_TRUE) {
+        printf("Error: unable to open source file %s\n", argv[first + 1]);
+        return -1;
+    }
+    
+    output = fopen(argv[argc - 1], "w");
+    
+    if (output == NULL) {
+        printf("Error: unable to open output file %s\n", argv[argc - 1]);
+        
+        if (intel == IMAN_FALSE)
+            iman_mapping_close(&source);
+        
+        return -1;
+    }
+    
+    setvbuf(output, NULL, _IOFBF, IMAN_CORPUS_OUTPUT_BUFFER);
+    
+    if (intel == IMAN_TRUE) {
+        result = iman_corpus_write_intel(output, scale);
+    } else {
+        result = iman_corpus_write_reference(output, &source, scale, forms);
+        iman_mapping_close(&source);
+    }
+    
+    if (fclose(output) != 0 || result != IMAN_TRUE) {
+        printf("Error: unable to write %s\n", argv[argc - 1]);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/*
+ * The first copy is the source as it is. Later ones rename the block headers so the names stay unique, shuffle
+ * the words of each description line and give every form another form's operand list of the same length, so
+ * copies don't compress or index any better than distinct text would. Repeated forms are varied the same way.
+ */
+static int iman_corpus_write_reference(FILE *output, const struct iman_mapping *source, unsigned int scale, unsigned int forms) {
+    const char *data = (const char *)source->data;
+    struct iman_corpus_operands operands;
+    unsigned int copy, x;
+    
+    if (iman_corpus_collect_operands(&operands, source) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    for (copy = 0; copy < scale; ++copy) {
+        uint64_t state = 0x9E3779B97F4A7C15ULL * (copy + 1);
+        int description = IMAN_FALSE;
+        size_t offset = 0;
+        
+        while (offset < source->size) {
+            const char *newline = memchr(&data[offset], '\n', source->size - offset);
+            size_t end = newline != NULL ? (size_t)(newline - data) : source->size;
+            size_t length = end - offset;
+            
+            if (length != 0 && data[offset] != '\t') {
+                iman_corpus_write_header(output, &data[offset], length, copy);
+            } else if (iman_corpus_is_form(&data[offset], length) == IMAN_TRUE) {
+                for (x = 0; x < forms; ++x) {
+                    if (copy == 0 && x == 0) {
+                        fwrite(&data[offset], 1, length, output);
+                        fputc('\n', output);
+                    } else {
+                        iman_corpus_write_form(output, &data[offset], length, &operands, &state);
+                    }
+                }
+            } else if (copy != 0 && description == IMAN_TRUE && length > 1 && data[offset + 1] == '\t') {
+                iman_corpus_write_shuffled(output, &data[offset], length, &state);
+                fputc('\n', output);
+            } else {
+                fwrite(&data[offset], 1, length, output);
+                fputc('\n', output);
+            }
+            
+            /* A section name sits one tab in, its text two */
+            if (length > 1 && data[offset] == '\t' && data[offset + 1] != '\t')
+                description = length == 12 && memcmp(&data[offset + 1], "description", 11) == 0 ? IMAN_TRUE : IMAN_FALSE;
+            
+            offset = end + 1;
+        }
+        
+        /* Keeps the last block of one copy apart from the first block of the next */
+        fputc('\n', output);
+    }
+    
+    free(operands.lists);
+    return ferror(output) ? IMAN_FALSE : IMAN_TRUE;
+}
+
+/* Copies past the first get every alias prefixed with s<copy>, which no real mnemonic starts with */
+static void iman_corpus_write_header(FILE *output, const char *line, size_t length, unsigned int copy) {
+    const char *title = memchr(line, '=', length);
+    size_t names_length = title != NULL ? (size_t)(title - line) : length;
+    size_t x;
+    
+    if (copy != 0)
+        fprintf(output, "s%u", copy);
+    
+    for (x = 0; x < names_length; ++x) {
+        fputc(line[x], output);
+        
+        if (line[x] == '/' && copy != 0)
+            fprintf(output, "s%u", copy);
+    }
+    
+    fwrite(&line[names_length], 1, length - names_length, output);
+    fputc('\n', output);
+}
+
+/* Operands are drawn from forms with as many of them, so @n references in the description still resolve */
+static void iman_corpus_write_form(FILE *output, const char *line, size_t length, const struct iman_corpus_operands *operands, uint64_t *state) {
+    struct iman_corpus_span list, description;
+    const struct iman_corpus_span *choice;
+    size_t first, count;
+    unsigned int operand_count;
+    
+    if (iman_corpus_split_form(line, length, &list, &description) != IMAN_TRUE) {
+        fwrite(line, 1, length, output);
+        fputc('\n', output);
+        return;
+    }
+    
+    operand_count = iman_corpus_count_operands(&list);
+    first = operands->starts[operand_count];
+    count = operands->starts[operand_count + 1] - first;
+    choice = count != 0 ? &operands->lists[first + iman_corpus_random(state) % count] : &list;
+    
+    fwrite(line, 1, (size_t)(list.data - line), output);
+    fwrite(choice->data, 1, choice->length, output);
+    fwrite(list.data + list.length, 1, (size_t)(description.data - (list.data + list.length)), output);
+    iman_corpus_write_shuffled(output, description.data, description.length, state);
+    fwrite(description.data + description.length, 1, length - (size_t)(description.data + description.length - line), output);
+    fputc('\n', output);
+}
+
+/* Leading tabs stay put; words holding brackets keep their places so any pairs in the text still nest */
+static void iman_corpus_write_shuffled(FILE *output, const char *text, size_t length, uint64_t *state) {
+    struct iman_corpus_span words[IMAN_CORPUS_MAX_WORDS];
+    unsigned int movable[IMAN_CORPUS_MAX_WORDS];
+    unsigned int word_count = 0, movable_count = 0, x;
+    size_t offset = 0;
+    
+    while (offset < length && text[offset] == '\t')
+        fputc(text[offset++], output);
+    
+    while (offset < length && word_count < IMAN_CORPUS_MAX_WORDS) {
+        size_t start;
+        
+        while (offset < length && text[offset] == ' ')
+            offset++;
+        
+        if (offset == length)
+            break;
+        
+        for (start = offset; offset < length && text[offset] != ' '; ++offset)
+            ;
+        
+        words[word_count].data = &text[start];
+        words[word_count].length = offset - start;
+        
+        while (start < offset && strchr("()[]{}", text[start]) == NULL)
+            start++;
+        
+        if (start == offset)
+            movable[movable_count++] = word_count;
+        
+        word_count++;
+    }
+    
+    for (x = movable_count; x > 1; --x) {
+        unsigned int y = iman_corpus_random(state) % x;
+        struct iman_corpus_span swap = words[movable[x - 1]];
+        
+        words[movable[x - 1]] = words[movable[y]];
+        words[movable[y]] = swap;
+    }
+    
+    for (x = 0; x < word_count; ++x) {
+        if (x != 0)
+            fputc(' ', output);
+        
+        fwrite(words[x].data, 1, words[x].length, output);
+    }
+    
+    /* A line with more words than fit keeps the rest in order */
+    if (offset < length) {
+        fputc(' ', output);
+        fwrite(&text[offset], 1, length - offset, output);
+    }
+}
+
+/*
+ * Finds the operand list, the second field with its parentheses, and the description, the text of the last field.
+ * Only the description may hold parentheses of its own, so it runs to the last one on the line.
+ */
+static int iman_corpus_split_form(const char *line, size_t length, struct iman_corpus_span *operands, struct iman_corpus_span *description) {
+    const char *end = line + length, *position = memchr(line, '[', length), *close;
+    unsigned int field;
+    
+    for (field = 0; position != NULL && field < 7; ++field) {
+        position = memchr(position, '(', (size_t)(end - position));
+        
+        if (position == NULL)
+            return IMAN_FALSE;
+        
+        close = memchr(position, ')', (size_t)(end - position));
+        
+        if (close == NULL)
+            return IMAN_FALSE;
+        
+        if (field == 1) {
+            operands->data = position;
+            operands->length = (size_t)(close - position) + 1;
+        }
+        
+        position = close + 1;
+    }
+    
+    if (position == NULL || (position = memchr(position, '(', (size_t)(end - position))) == NULL)
+        return IMAN_FALSE;
+    
+    for (close = end - 1; close > position && *close != ')'; --close)
+        ;
+    
+    if (close == position)
+        return IMAN_FALSE;
+    
+    description->data = position + 1;
+    description->length = (size_t)(close - position) - 1;
+    return IMAN_TRUE;
+}
+
+static unsigned int iman_corpus_count_operands(const struct iman_corpus_span *list) {
+    unsigned int count = 0;
+    size_t x;
+    
+    for (x = 1; x + 1 < list->length; ++x) {
+        if (list->data[x] == ',')
+            count++;
+        else if (list->data[x] != ' ' && count == 0)
+            count = 1;
+    }
+    
+    return count < IMAN_CORPUS_MAX_OPERANDS ? count : IMAN_CORPUS_MAX_OPERANDS;
+}
+
+static int iman_corpus_collect_operands(struct iman_corpus_operands *operands, const struct iman_mapping *source) {
+    const char *data = (const char *)source->data;
+    size_t offset = 0, size = 0, x;
+    unsigned int count;
+    
+    memset(operands, 0, sizeof(*operands));
+    
+    while (offset < source->size) {
+        const char *newline = memchr(&data[offset], '\n', source->size - offset);
+        size_t end = newline != NULL ? (size_t)(newline - data) : source->size;
+        struct iman_corpus_span description;
+        
+        if (iman_corpus_is_form(&data[offset], end - offset) == IMAN_TRUE) {
+            if (operands->count == size) {
+                struct iman_corpus_span *lists = realloc(operands->lists, (size ? size * 2 : 256) * sizeof(*lists));
+                
+                if (lists == NULL) {
+                    free(operands->lists);
+                    return IMAN_FALSE;
+                }
+                
+                operands->lists = lists;
+                size = size ? size * 2 : 256;
+            }
+            
+            if (iman_corpus_split_form(&data[offset], end - offset, &operands->lists[operands->count], &description) == IMAN_TRUE)
+                operands->count++;
+        }
+        
+        offset = end + 1;
+    }
+    
+    qsort(operands->lists, operands->count, sizeof(*operands->lists), &iman_corpus_compare_operands);
+    
+    /* starts[n] is the first list with n operands, starts[n + 1] one past the last */
+    for (count = 0, x = 0; count <= IMAN_CORPUS_MAX_OPERANDS + 1; ++count) {
+        while (x < operands->count && iman_corpus_count_operands(&operands->lists[x]) < count)
+            x++;
+        
+        operands->starts[count] = x;
+    }
+    
+    return IMAN_TRUE;
+}
+
+static int iman_corpus_compare_operands(const void *left, const void *right) {
+    unsigned int a = iman_corpus_count_operands(left), b = iman_corpus_count_operands(right);
+    const struct iman_corpus_span *left_list = left, *right_list = right;
+    
+    if (a != b)
+        return a < b ? -1 : 1;
+    
+    return left_list->data < right_list->data ? -1 : (left_list->data > right_list->data ? 1 : 0);
+}
+
+static int iman_corpus_is_form(const char *line, size_t length) {
+    size_t x;
+    
+    for (x = 0; x < length && line[x] == '\t'; ++x)
+        ;
+    
+    return x < length && line[x] == '[' ? IMAN_TRUE : IMAN_FALSE;
+}
+
+static int iman_corpus_write_intel(FILE *output, unsigned int scale) {
+    unsigned int row_count = sizeof(iman_corpus_intel_rows) / sizeof(iman_corpus_intel_rows[0]);
+    unsigned long rows = (unsigned long)scale * IMAN_CORPUS_INTEL_ROWS, x;
+    
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    
+    /* The first pass over the shapes is verbatim, later rows resample operands and shuffle the description */
+    for (x = 0; x < rows; ++x) {
+        if (x < row_count) {
+            fputs(iman_corpus_intel_rows[x], output);
+            fputc('\n', output);
+        } else {
+            iman_corpus_write_intel_row(output, iman_corpus_intel_rows[x % row_count], &state);
+        }
+    }
+    
+    return ferror(output) ? IMAN_FALSE : IMAN_TRUE;
+}
+
+/* Opcode, instruction, operand encoding, 64-bit mode, compatibility mode then the description, tab separated */
+static void iman_corpus_write_intel_row(FILE *output, const char *row, uint64_t *state) {
+    const char *instruction = strchr(row, '\t') + 1, *encoding = strchr(instruction, '\t'), *description = strrchr(row, '\t') + 1;
+    const char *position = instruction;
+    unsigned int group_count = sizeof(iman_corpus_intel_operands) / sizeof(iman_corpus_intel_operands[0]);
+    
+    fwrite(row, 1, (size_t)(instruction - row), output);
+    
+    /* The mnemonic and anything not in a group, such as masks and memory forms, is copied as it is */
+    while (position < encoding) {
+        size_t length = strcspn(position, " ,\t");
+        const char *replacement = NULL;
+        unsigned int group, member, members;
+        
+        for (group = 0; replacement == NULL && group < group_count; ++group) {
+            for (members = 0; members < 5 && iman_corpus_intel_operands[group][members] != NULL; ++members)
+                ;
+            
+            for (member = 0; member < members; ++member) {
+                if (strlen(iman_corpus_intel_operands[group][member]) == length && memcmp(iman_corpus_intel_operands[group][member], position, length) == 0) {
+                    replacement = iman_corpus_intel_operands[group][iman_corpus_random(state) % members];
+                    break;
+                }
+            }
+        }
+        
+        if (replacement != NULL)
+            fputs(replacement, output);
+        else
+            fwrite(position, 1, length, output);
+        
+        position += length;
+        
+        if (position < encoding)
+            fputc(*position++, output);
+    }
+    
+    fwrite(encoding, 1, (size_t)(description - encoding), output);
+    iman_corpus_write_shuffled(output, description, strlen(description), state);
+    fputc('\n', output);
+}
+
+/* xorshift64, so every run writes the same corpus */
+static uint32_t iman_corpus_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    
+    return (uint32_t)(*state >> 32);
+}
+
+static int iman_corpus_parse_count(const char *text, unsigned int maximum, unsigned int *pcount) {
+    char *end;
+    unsigned long value = strtoul(text, &end, 10);
+    
+    if (*text == '\0' || *end != '\0' || value == 0 || value > maximum)
+        return IMAN_FALSE;
+    
+    *pcount = (unsigned int)value;
+    return IMAN_TRUE;
+}
\ No newline at end of file
@@ -5,13 +5,58 @@
 
 #include "iman.h"
 #include "iman_options.h"
+#include "iman_mapping.h"
+#include "iman_lookup.h"
+#include "iman_search.h"
+#include "iman_query.h"
+#include "iman_server.h"
 #include "parser/iman_lexer.h"
 #include "parser/iman_reference.h"
 #include "parser/iman_parser.h"
 
+#define IMAN_BATCH_BASE_NAMES 256
+#define IMAN_BATCH_OUTPUT_BUFFER 65536
+
+struct iman_batch_name {
+    char *name;
+    
+    int found;
+    uint32_t block_index;
+    uint32_t block_offset;
+    
+    /* Span of the rendered block in the batch output, shared by every name of the block */
+    size_t output_offset;
+    size_t output_length;
+};
+
+/* Sort key for reading the table front to back, carried with the name it belongs to */
+struct iman_batch_order {
+    uint32_t block_offset;
+    size_t index;
+};
+
+struct iman_batch {
+    struct iman_batch_name *names;
+    size_t count;
+    size_t size;
+};
+
+static int iman_print_documentation(struct iman_options *options);
+static int iman_print_completions(struct iman_options *options);
+static int iman_print_search_results(struct iman_options *options);
+static int iman_print_facet_results(struct iman_options *options);
+static int iman_print_batch(struct iman_options *options);
+static int iman_read_batch_names(struct iman_options *options, struct iman_batch *batch);
+static int iman_add_batch_name(struct iman_batch *batch, char *name);
+static int iman_compare_batch_offsets(const void *left, const void *right);
+
 int main(int argc, char **argv) 
 {
     struct iman_options options = { 0 };
+    const char *socket_path;
+    int result;
+    
+    iman_set_default_options(&options);
     
     if (iman_parse_arguments(argc, argv, &options) != IMAN_TRUE) {
         iman_print_usage(argv[0]);
@@ -19,9 +64,30 @@ int main(int argc, char **argv)
         return -1;
     }
     
+    /* A resident server answers without this process mapping anything */
+    socket_path = getenv(IMAN_SOCKET_ENVIRONMENT);
+    
+    if (socket_path != NULL && *socket_path != '\0' && iman_client_query(socket_path, &options, &result) == IMAN_TRUE)
+        return result;
+    
     switch(options.mode) {
         case IMAN_OUTPUT_MODE_DOC:
-            break;
+            return iman_print_documentation(&options);
+        
+        case IMAN_OUTPUT_MODE_COMPLETE:
+            return iman_print_completions(&options);
+        
+        case IMAN_OUTPUT_MODE_SEARCH:
+            return iman_print_search_results(&options);
+        
+        case IMAN_OUTPUT_MODE_FACETS:
+            return iman_print_facet_results(&options);
+        
+        case IMAN_OUTPUT_MODE_BATCH:
+            return iman_print_batch(&options);
+        
+        case IMAN_OUTPUT_MODE_SERVE:
+            return iman_serve(options.socket_path, options.reference_dir, options.architecture) == IMAN_TRUE ? 0 : -1;
         
         case IMAN_OUTPUT_MODE_TO_ENGLISH:
             puts("Error: this feature hasn't been implemented.");
@@ -32,4 +98,272 @@ int main(int argc, char **argv)
     }
     
     return 0;
+}
+
+static int iman_print_documentation(struct iman_options *options)
+{
+    struct iman_query_context context;
+    int x, result = 0;
+    
+    if (iman_query_open(&context, options->reference_dir, options->architecture) != IMAN_TRUE) {
+        return -1;
+    }
+    
+    for (x = 0; x < options->input_body.count; ++x) {
+        if (iman_query_document(stdout, &context, options->input_body.args[x]) != IMAN_TRUE)
+            result = -2;
+    }
+    
+    iman_query_close(&context);
+    return result;
+}
+
+static int iman_print_completions(struct iman_options *options)
+{
+    struct iman_query_context context;
+    int x, result = 0;
+    
+    if (iman_query_open(&context, options->reference_dir, options->architecture) != IMAN_TRUE) {
+        return -1;
+    }
+    
+    for (x = 0; x < options->input_body.count; ++x) {
+        if (iman_query_complete(stdout, &context, options->input_body.args[x]) != IMAN_TRUE) {
+            result = -2;
+            break;
+        }
+    }
+    
+    iman_query_close(&context);
+    return result;
+}
+
+static int iman_print_search_results(struct iman_options *options)
+{
+    struct iman_query_context context;
+    int x, result = 0;
+    
+    if (iman_query_open(&context, options->reference_dir, options->architecture) != IMAN_TRUE) {
+        return -1;
+    }
+    
+    for (x = 0; x < options->input_body.count; ++x) {
+        if (iman_query_search(stdout, &context, options->input_body.args[x]) != IMAN_TRUE)
+            result = -2;
+    }
+    
+    iman_query_close(&context);
+    return result;
+}
+
+static int iman_print_facet_results(struct iman_options *options)
+{
+    struct iman_query_context context;
+    int result = 0;
+    
+    if (iman_query_open(&context, options->reference_dir, options->architecture) != IMAN_TRUE) {
+        return -1;
+    }
+    
+    if (iman_query_facets(stdout, &context, options->facets.entries, options->facets.count, options->input_body.args, options->input_body.count) != IMAN_TRUE)
+        result = -2;
+    
+    iman_query_close(&context);
+    return result;
+}
+
+/*
+ * Names come from stdin, one per line. Every block is inflated once, in table order, and the output is
+ * then written in the order the names were given with a single write per name.
+ */
+static int iman_print_batch(struct iman_options *options)
+{
+    static char output_buffer[IMAN_BATCH_OUTPUT_BUFFER];
+    struct iman_query_context context;
+    struct iman_batch batch = { 0 };
+    struct iman_batch_order *order = NULL;
+    size_t order_count = 0, x;
+    char *rendered = NULL;
+    size_t rendered_size = 0;
+    FILE *stream = NULL;
+    int result = 0;
+    
+    if (iman_query_open(&context, options->reference_dir, options->architecture) != IMAN_TRUE) {
+        return -1;
+    }
+    
+    if (iman_read_batch_names(options, &batch) != IMAN_TRUE) {
+        puts("Error: unable to read instruction names from stdin");
+        result = -1;
+        goto done;
+    }
+    
+    order = malloc((batch.count + 1) * sizeof(*order));
+    stream = open_memstream(&rendered, &rendered_size);
+    
+    if (order == NULL || stream == NULL) {
+        result = -1;
+        goto done;
+    }
+    
+    for (x = 0; x < batch.count; ++x) {
+        struct iman_lookup_entry entry;
+        
+        if (iman_lookup_locate(&context.lookup, batch.names[x].name, &entry) != IMAN_TRUE)
+            continue;
+        
+        batch.names[x].found = IMAN_TRUE;
+        batch.names[x].block_index = entry.block_index;
+        batch.names[x].block_offset = entry.block_offset;
+        order[order_count].block_offset = entry.block_offset;
+        order[order_count].index = x;
+        order_count++;
+    }
+    
+    qsort(order, order_count, sizeof(*order), &iman_compare_batch_offsets);
+    
+    /* The table is now read front to back, so read-ahead helps rather than hurts */
+    iman_mapping_advise(&context.lookup.table, IMAN_MAPPING_ACCESS_SEQUENTIAL);
+    
+    for (x = 0; x < order_count; ++x) {
+        struct iman_batch_name *name = &batch.names[order[x].index];
+        struct iman_lookup_entry entry;
+        
+        if (x > 0 && order[x - 1].block_offset == order[x].block_offset) {
+            const struct iman_batch_name *previous = &batch.names[order[x - 1].index];
+            
+            name->found = previous->found;
+            name->output_offset = previous->output_offset;
+            name->output_length = previous->output_length;
+            continue;
+        }
+        
+        if (iman_lookup_read_block(&context.lookup, name->block_index, &entry) != IMAN_TRUE) {
+            name->found = IMAN_FALSE;
+            continue;
+        }
+        
+        name->output_offset = (size_t)ftell(stream);
+        iman_query_write_entry(stream, &context.lookup, &entry);
+        name->output_length = (size_t)ftell(stream) - name->output_offset;
+    }
+    
+    if (fclose(stream) != 0) {
+        stream = NULL;
+        result = -1;
+        goto done;
+    }
+    
+    stream = NULL;
+    setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
+    
+    for (x = 0; x < batch.count; ++x) {
+        if (batch.names[x].found != IMAN_TRUE) {
+            printf("Error: no reference entry for %s\n", batch.names[x].name);
+            result = -2;
+            continue;
+        }
+        
+        fwrite(&rendered[batch.names[x].output_offset], batch.names[x].output_length, 1, stdout);
+    }
+    
+done:
+    if (stream != NULL)
+        fclose(stream);
+    
+    for (x = 0; x < batch.count; ++x) {
+        free(batch.names[x].name);
+    }
+    
+    fflush(stdout);
+    free(rendered);
+    free(order);
+    free(batch.names);
+    iman_query_close(&context);
+    return result;
+}
+
+/* Names on the command line come first, then every non-blank line of stdin with surrounding space removed */
+static int iman_read_batch_names(struct iman_options *options, struct iman_batch *batch)
+{
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t length;
+    int x;
+    
+    for (x = 0; x < options->input_body.count; ++x) {
+        char *name = malloc(strlen(options->input_body.args[x]) + 1);
+        
+        if (name == NULL)
+            return IMAN_FALSE;
+        
+        strcpy(name, options->input_body.args[x]);
+        
+        if (iman_add_batch_name(batch, name) != IMAN_TRUE)
+            return IMAN_FALSE;
+    }
+    
+    while ((length = getline(&line, &line_size, stdin)) != -1) {
+        char *start = line, *name;
+        
+        while (length > 0 && isspace((unsigned char)line[length - 1])) {
+            line[--length] = '\0';
+        }
+        
+        while (isspace((unsigned char)*start)) {
+            start++;
+        }
+        
+        if (*start == '\0')
+            continue;
+        
+        name = malloc(strlen(start) + 1);
+        
+        if (name == NULL) {
+            free(line);
+            return IMAN_FALSE;
+        }
+        
+        strcpy(name, start);
+        
+        if (iman_add_batch_name(batch, name) != IMAN_TRUE) {
+            free(line);
+            return IMAN_FALSE;
+        }
+    }
+    
+    free(line);
+    return ferror(stdin) ? IMAN_FALSE : IMAN_TRUE;
+}
+
+static int iman_add_batch_name(struct iman_batch *batch, char *name)
+{
+    if (batch->count >= batch->size) {
+        size_t new_size = batch->size ? batch->size * 2 : IMAN_BATCH_BASE_NAMES;
+        struct iman_batch_name *names = realloc(batch->names, new_size * sizeof(*names));
+        
+        if (names == NULL) {
+            free(name);
+            return IMAN_FALSE;
+        }
+        
+        batch->names = names;
+        batch->size = new_size;
+    }
+    
+    memset(&batch->names[batch->count], 0, sizeof(*batch->names));
+    batch->names[batch->count].name = name;
+    batch->count++;
+    return IMAN_TRUE;
+}
+
+static int iman_compare_batch_offsets(const void *left, const void *right)
+{
+    const struct iman_batch_order *a = left;
+    const struct iman_batch_order *b = right;
+    
+    if (a->block_offset != b->block_offset)
+        return a->block_offset < b->block_offset ? -1 : 1;
+    
+    return a->index < b->index ? -1 : (a->index > b->index ? 1 : 0);
 }
\ No newline at end of file
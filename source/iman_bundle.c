@@ -0,0 +1,126 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "iman.h"
+#include "iman_mapping.h"
+#include "iman_bundle.h"
+
+#define IMAN_MAX_PATH 1024
+
+/*
+ * A reference directory's bundle, mapped once and kept for the life of the process since lookups borrow from it.
+ * A directory without one is remembered too, so it isn't looked for again.
+ */
+struct iman_bundle {
+    char *ref_dir;
+    
+    struct iman_mapping file;
+    uint32_t file_count;
+    
+    struct iman_bundle *next;
+};
+
+static struct iman_bundle *iman_bundle_find(const char *ref_dir);
+static struct iman_bundle *iman_bundle_load(const char *ref_dir);
+static uint32_t iman_bundle_kind(const char *extension);
+static uint32_t iman_read_uint32(const unsigned char *data);
+
+static struct iman_bundle *iman_bundles = NULL;
+
+/*
+ * Hands out one architecture's file from the bundle in ref_dir as a borrowed slice of the bundle mapping.
+ * Only the directory at the front is read here, the slice's pages are faulted in by whoever reads them.
+ */
+int iman_bundle_open(struct iman_mapping *mapping, const char *ref_dir, const char *arch_name, const char *extension) {
+    struct iman_bundle *bundle = iman_bundle_find(ref_dir);
+    uint32_t kind = iman_bundle_kind(extension), x;
+    const unsigned char *entry;
+    
+    if (bundle == NULL || bundle->file.data == NULL || kind == 0 || strlen(arch_name) >= IMAN_BUNDLE_MAX_ARCHITECTURE)
+        return IMAN_FALSE;
+    
+    entry = bundle->file.data + IMAN_INDEX_HEADER_SIZE;
+    
+    for (x = 0; x < bundle->file_count; ++x, entry += IMAN_BUNDLE_ENTRY_SIZE) {
+        uint32_t offset, size;
+        
+        if (iman_read_uint32(entry + IMAN_BUNDLE_MAX_ARCHITECTURE) != kind || strncmp((const char *)entry, arch_name, IMAN_BUNDLE_MAX_ARCHITECTURE) != 0)
+            continue;
+        
+        offset = iman_read_uint32(entry + IMAN_BUNDLE_MAX_ARCHITECTURE + 4);
+        size = iman_read_uint32(entry + IMAN_BUNDLE_MAX_ARCHITECTURE + 8);
+        
+        if ((uint64_t)offset + size > bundle->file.size)
+            return IMAN_FALSE;
+        
+        iman_mapping_borrow(mapping, bundle->file.data + offset, size);
+        return IMAN_TRUE;
+    }
+    
+    return IMAN_FALSE;
+}
+
+static struct iman_bundle *iman_bundle_find(const char *ref_dir) {
+    struct iman_bundle *bundle;
+    
+    for (bundle = iman_bundles; bundle != NULL; bundle = bundle->next) {
+        if (strcmp(bundle->ref_dir, ref_dir) == 0)
+            return bundle;
+    }
+    
+    return iman_bundle_load(ref_dir);
+}
+
+static struct iman_bundle *iman_bundle_load(const char *ref_dir) {
+    char path_buffer[IMAN_MAX_PATH];
+    struct iman_bundle *bundle = calloc(1, sizeof(*bundle));
+    size_t length = strlen(ref_dir);
+    
+    if (bundle == NULL)
+        return NULL;
+    
+    bundle->ref_dir = malloc(length + 1);
+    
+    if (bundle->ref_dir == NULL) {
+        free(bundle);
+        return NULL;
+    }
+    
+    memcpy(bundle->ref_dir, ref_dir, length + 1);
+    
+    /* Missing or not a bundle this version understands, either way the separate files are used */
+    if (snprintf(path_buffer, IMAN_MAX_PATH, "%s/" IMAN_REF_BUNDLE_FILE, ref_dir) < IMAN_MAX_PATH &&
+        iman_mapping_open(&bundle->file, path_buffer, IMAN_MAPPING_ACCESS_RANDOM) == IMAN_TRUE) {
+        const unsigned char *data = bundle->file.data;
+        
+        if (bundle->file.size < IMAN_INDEX_HEADER_SIZE || iman_read_uint32(data) != IMAN_BUNDLE_MAGIC || iman_read_uint32(data + 4) != IMAN_INDEX_VERSION ||
+            (uint64_t)IMAN_INDEX_HEADER_SIZE + (uint64_t)iman_read_uint32(data + 8) * IMAN_BUNDLE_ENTRY_SIZE > bundle->file.size) {
+            iman_mapping_close(&bundle->file);
+        } else {
+            bundle->file_count = iman_read_uint32(data + 8);
+        }
+    }
+    
+    bundle->next = iman_bundles;
+    iman_bundles = bundle;
+    return bundle;
+}
+
+static uint32_t iman_bundle_kind(const char *extension) {
+    if (strcmp(extension, IMAN_REF_INDEX_EXT) == 0)
+        return IMAN_BUNDLE_KIND_INDEX;
+    
+    if (strcmp(extension, IMAN_REF_TABLE_EXT) == 0)
+        return IMAN_BUNDLE_KIND_TABLE;
+    
+    if (strcmp(extension, IMAN_REF_SEARCH_EXT) == 0)
+        return IMAN_BUNDLE_KIND_SEARCH;
+    
+    return 0;
+}
+
+static uint32_t iman_read_uint32(const unsigned char *data) {
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
\ No newline at end of file
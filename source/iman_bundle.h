@@ -0,0 +1,11 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_BUNDLE_H
+#define _IMAN_BUNDLE_H
+
+int iman_bundle_open(struct iman_mapping *mapping, const char *ref_dir, const char *arch_name, const char *extension);
+
+#endif
\ No newline at end of file
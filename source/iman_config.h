@@ -8,9 +8,164 @@
 
 #define IMAN_REF_TABLE_EXT ".table"
 #define IMAN_REF_INDEX_EXT ".index"
+#define IMAN_REF_MANIFEST_EXT ".manifest"
+#define IMAN_REF_SEARCH_EXT ".search"
+
+/* Where iman looks for <arch>.index and <arch>.table, overridden by the build */
+#ifndef IMAN_REF_DIRECTORY
+#define IMAN_REF_DIRECTORY "/usr/local/share/iman"
+#endif
 
 #define IMAN_FIELD_ID_DESCRIPTION (IMAN_FOURCC('D', 'E', 'S', 'C'))
+#define IMAN_FIELD_ID_FORMS (IMAN_FOURCC('F', 'O', 'R', 'M'))
+
+/* Table file: per block, compressed size and uncompressed size then the raw deflate stream */
+#define IMAN_TABLE_BLOCK_HEADER_SIZE 8
+
+/* Block fields: id, length, then the data padded so the next field starts aligned */
+#define IMAN_TABLE_FIELD_HEADER_SIZE 8
+#define IMAN_TABLE_FIELD_ALIGNMENT 4
+
+/* Forms field: form count, offset of the text heap from the field start, then the records */
+#define IMAN_FORMS_HEADER_SIZE 8
+
+/*
+ * Form record, text offsets index the forms text heap and type ids the index symbol table:
+ *   u16 mnemonic, u16 opcode, u16 description, u16 width,
+ *   u8 mode bits, u8 feature count, u8 operand count, u8 clobber count,
+ *   u16 operands[4], u16 clobbers[4], u16 features[4]
+ */
+#define IMAN_FORM_RECORD_SIZE 36
+#define IMAN_FORM_MAX_OPERANDS 4
+#define IMAN_FORM_MAX_CLOBBERS 4
+#define IMAN_FORM_MAX_FEATURES 4
+
+#define IMAN_FORM_MODE_64 0x1
+#define IMAN_FORM_MODE_32 0x2
+#define IMAN_FORM_MODE_16 0x4
+#define IMAN_TABLE_COMPRESSION_DEFLATE 1
+
+/* Preset dictionary shared by every block, it has to leave room in the 32K window for the block itself */
+#define IMAN_TABLE_DICTIONARY_SIZE 16384
+
+/* Index file: header, section directory, then 16-byte aligned sections */
+#define IMAN_INDEX_MAGIC (IMAN_FOURCC('I', 'M', 'N', 'X'))
+#define IMAN_INDEX_VERSION 5
+#define IMAN_INDEX_HEADER_SIZE 16
+#define IMAN_INDEX_SECTION_ENTRY_SIZE 16
+#define IMAN_INDEX_SECTION_ALIGNMENT 16
+
+#define IMAN_SECTION_ID_NAME_HASH (IMAN_FOURCC('N', 'H', 'S', 'H'))
+#define IMAN_SECTION_ID_NAME_HEAP (IMAN_FOURCC('N', 'A', 'M', 'E'))
+#define IMAN_SECTION_ID_TABLE_INFO (IMAN_FOURCC('T', 'I', 'N', 'F'))
+#define IMAN_SECTION_ID_DICTIONARY (IMAN_FOURCC('D', 'I', 'C', 'T'))
+#define IMAN_SECTION_ID_SYMBOLS (IMAN_FOURCC('S', 'Y', 'M', 'B'))
+#define IMAN_SECTION_ID_NAME_TRIE (IMAN_FOURCC('T', 'R', 'I', 'E'))
+#define IMAN_SECTION_ID_BLOCK_DIRECTORY (IMAN_FOURCC('B', 'D', 'I', 'R'))
+
+/* Block directory section: per block, table offset, name heap offset and length of its first alias */
+#define IMAN_BLOCK_DIRECTORY_ENTRY_SIZE 12
+
+/* Table info section: compression method, largest uncompressed block, reserved x2 */
+#define IMAN_TABLE_INFO_SIZE 16
+
+/* Symbol section: symbol count, offset of the text from the section start; u32 text offset per id; text */
+#define IMAN_SYMBOLS_HEADER_SIZE 8
+
+/* Build manifest: same layout as the index, only read back by iman-parser for incremental rebuilds */
+#define IMAN_MANIFEST_MAGIC (IMAN_FOURCC('I', 'M', 'N', 'M'))
+#define IMAN_SECTION_ID_BLOCKS (IMAN_FOURCC('B', 'L', 'K', 'S'))
+
+/* Search file: same layout as the index, a trigram posting list per description trigram */
+#define IMAN_SEARCH_MAGIC (IMAN_FOURCC('I', 'M', 'N', 'S'))
+#define IMAN_SECTION_ID_SEARCH_KEYS (IMAN_FOURCC('G', 'K', 'E', 'Y'))
+#define IMAN_SECTION_ID_SEARCH_POSTINGS (IMAN_FOURCC('G', 'P', 'S', 'T'))
+
+/*
+ * Search key, sorted by trigram: u32 lowercased trigram (first byte lowest) with the bitmap flag, u32 posting offset, u32 block count.
+ * A posting list is either LEB128 block index deltas or, when that would be larger, a bitmap over every block.
+ */
+#define IMAN_SEARCH_KEY_SIZE 12
+#define IMAN_SEARCH_KEY_BITMAP 0x80000000u
+
+/* Facets in the search file: form bitmaps per mode, width, operand type and feature, forms numbered across blocks in source order */
+#define IMAN_SECTION_ID_FACET_KEYS (IMAN_FOURCC('F', 'K', 'E', 'Y'))
+#define IMAN_SECTION_ID_FACET_BITMAPS (IMAN_FOURCC('F', 'B', 'M', 'P'))
+#define IMAN_SECTION_ID_FACET_BLOCKS (IMAN_FOURCC('F', 'B', 'L', 'K'))
+
+/* Facet key, sorted by kind then value: u32 kind, u32 value (mode bits, width or symbol id), u32 bitmap offset, u32 form count */
+#define IMAN_FACET_KEY_SIZE 16
+#define IMAN_FACET_KIND_MODE 1
+#define IMAN_FACET_KIND_WIDTH 2
+#define IMAN_FACET_KIND_OPERAND 3
+#define IMAN_FACET_KIND_FEATURE 4
+
+/*
+ * Facet bitmap: u32 container count, then per 65536 forms sharing their upper bits
+ *   u16 upper bits, u16 container type, u32 form count, then sorted u16 lower bits padded to 4 or an 8K bitmap
+ * Blocks section: u32 first form of every block, plus the form count.
+ */
+#define IMAN_FACET_CONTAINER_HEADER_SIZE 8
+#define IMAN_FACET_CONTAINER_ARRAY 0
+#define IMAN_FACET_CONTAINER_BITMAP 1
+#define IMAN_FACET_CONTAINER_ARRAY_LIMIT 4096
+#define IMAN_FACET_CONTAINER_BITMAP_SIZE 8192
+
+/* Manifest block: u64 source hash, table offset, table size including the header, uncompressed size, name offset, name count, reserved */
+#define IMAN_MANIFEST_BLOCK_SIZE 32
+
+/* Name hash section: key count, bucket count, seed, reserved; displacements; slots */
+#define IMAN_NAME_HASH_HEADER_SIZE 16
+#define IMAN_NAME_HASH_SLOT_SIZE 16
+#define IMAN_NAME_HASH_BUCKET_SIZE 4
+
+/*
+ * Name trie section: node count, reserved; then nodes in preorder, children sorted without regard to case:
+ *   u32 end of the node's subtree, u32 label offset into the name heap, u8 label length, u8 flags, u16 name length
+ * A terminal node's name is the name length bytes ending where its label ends.
+ */
+#define IMAN_NAME_TRIE_HEADER_SIZE 8
+#define IMAN_NAME_TRIE_NODE_SIZE 12
+#define IMAN_NAME_TRIE_TERMINAL 0x1
+
+/*
+ * Bundle: every installed architecture's index, table and search file in one, so iman opens and maps a single file.
+ * Header as the index (magic, version, file count, reserved), then per file:
+ *   char[16] architecture, NUL padded, u32 file kind, u32 offset, u32 size, u32 reserved
+ * Files start on page boundaries, an architecture's pages are only faulted in once it is queried.
+ */
+#define IMAN_REF_BUNDLE_FILE "reference.bundle"
+#define IMAN_BUNDLE_MAGIC (IMAN_FOURCC('I', 'M', 'N', 'B'))
+#define IMAN_BUNDLE_ENTRY_SIZE 32
+#define IMAN_BUNDLE_MAX_ARCHITECTURE 16
+#define IMAN_BUNDLE_ALIGNMENT 4096
+
+#define IMAN_BUNDLE_KIND_INDEX (IMAN_FOURCC('I', 'N', 'D', 'X'))
+#define IMAN_BUNDLE_KIND_TABLE (IMAN_FOURCC('T', 'A', 'B', 'L'))
+#define IMAN_BUNDLE_KIND_SEARCH (IMAN_FOURCC('S', 'R', 'C', 'H'))
+
+/* Where iman looks for a query server started with --serve, answering locally when there isn't one */
+#define IMAN_SOCKET_ENVIRONMENT "IMAN_SOCKET"
+
+/*
+ * Query protocol: every request and reply is a u32 body length then the body.
+ * Request body: u8 query type, the reference directory and architecture, then the query arguments, all NUL terminated.
+ * Facet query arguments lead with their u8 facet kind, or the name marker for an instruction name.
+ * Reply body: u8 status, then the text iman would have printed.
+ */
+#define IMAN_PROTOCOL_HEADER_SIZE 4
+#define IMAN_PROTOCOL_MAX_REQUEST 65536
+#define IMAN_PROTOCOL_MAX_ARGUMENTS 1024
+
+#define IMAN_QUERY_DOCUMENT 1
+#define IMAN_QUERY_COMPLETE 2
+#define IMAN_QUERY_SEARCH 3
+#define IMAN_QUERY_FACETS 4
+#define IMAN_QUERY_FACET_NAME 0xFF
 
-#define IMAN_INDEX_NAME_WIDTH 12
+/* Unavailable means the server doesn't hold the reference asked for and the client has to answer for itself */
+#define IMAN_QUERY_STATUS_OK 0
+#define IMAN_QUERY_STATUS_FAILED 1
+#define IMAN_QUERY_STATUS_UNAVAILABLE 2
 
 #endif
\ No newline at end of file
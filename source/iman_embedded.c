@@ -0,0 +1,45 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "iman.h"
+#include "iman_mapping.h"
+#include "iman_embedded.h"
+
+/* Hands out the built in copy of a reference file, only ever for the default directory so -r still reads files */
+int iman_embedded_open(struct iman_mapping *mapping, const char *ref_dir, const char *arch_name, const char *extension) {
+#ifdef IMAN_EMBEDDED_REFERENCE
+    unsigned int x;
+    
+    if (strcmp(ref_dir, IMAN_REF_DIRECTORY) != 0)
+        return IMAN_FALSE;
+    
+    for (x = 0; x < iman_embedded_reference_count; ++x) {
+        const struct iman_embedded_reference *reference = &iman_embedded_references[x];
+        const struct iman_embedded_file *file;
+        
+        if (strcmp(reference->architecture, arch_name) != 0)
+            continue;
+        
+        if (strcmp(extension, IMAN_REF_INDEX_EXT) == 0)
+            file = &reference->index;
+        else if (strcmp(extension, IMAN_REF_TABLE_EXT) == 0)
+            file = &reference->table;
+        else if (strcmp(extension, IMAN_REF_SEARCH_EXT) == 0)
+            file = &reference->search;
+        else
+            return IMAN_FALSE;
+        
+        iman_mapping_borrow(mapping, file->data, file->size);
+        return IMAN_TRUE;
+    }
+#else
+    IMAN_UNUSED(mapping);
+    IMAN_UNUSED(ref_dir);
+    IMAN_UNUSED(arch_name);
+    IMAN_UNUSED(extension);
+#endif
+    
+    return IMAN_FALSE;
+}
\ No newline at end of file
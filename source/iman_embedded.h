@@ -0,0 +1,28 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_EMBEDDED_H
+#define _IMAN_EMBEDDED_H
+
+struct iman_embedded_file {
+    const unsigned char *data;
+    size_t size;
+};
+
+/* One architecture's reference files, generated by iman-parser --embed */
+struct iman_embedded_reference {
+    const char *architecture;
+    
+    struct iman_embedded_file index;
+    struct iman_embedded_file table;
+    struct iman_embedded_file search;
+};
+
+extern const struct iman_embedded_reference iman_embedded_references[];
+extern const unsigned int iman_embedded_reference_count;
+
+int iman_embedded_open(struct iman_mapping *mapping, const char *ref_dir, const char *arch_name, const char *extension);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,64 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "iman.h"
+#include "iman_hash.h"
+
+#define IMAN_HASH_FNV_OFFSET 0xCBF29CE484222325ULL
+#define IMAN_HASH_FNV_PRIME 0x100000001B3ULL
+#define IMAN_HASH_GOLDEN 0x9E3779B97F4A7C15ULL
+
+static uint64_t iman_hash_mix(uint64_t value);
+
+uint64_t iman_hash_name(const char *name, size_t length) {
+    uint64_t hash = IMAN_HASH_FNV_OFFSET;
+    size_t x;
+    
+    for (x = 0; x < length; ++x) {
+        unsigned char c = (unsigned char)name[x];
+        
+        if (c >= 'A' && c <= 'Z')
+            c |= 0x20;
+        
+        hash ^= c;
+        hash *= IMAN_HASH_FNV_PRIME;
+    }
+    
+    return iman_hash_mix(hash);
+}
+
+uint64_t iman_hash_data(const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    uint64_t hash = IMAN_HASH_FNV_OFFSET;
+    size_t x;
+    
+    for (x = 0; x < length; ++x) {
+        hash ^= bytes[x];
+        hash *= IMAN_HASH_FNV_PRIME;
+    }
+    
+    return iman_hash_mix(hash ^ length);
+}
+
+uint32_t iman_hash_bucket(uint64_t hash, uint32_t bucket_count) {
+    return (uint32_t)((hash >> 32) % bucket_count);
+}
+
+uint32_t iman_hash_slot(uint64_t hash, uint32_t seed, uint32_t displacement, uint32_t slot_count) {
+    uint64_t value = hash ^ ((uint64_t)seed << 32 | displacement) * IMAN_HASH_GOLDEN;
+    
+    return (uint32_t)(iman_hash_mix(value) % slot_count);
+}
+
+/* splitmix64 finaliser */
+static uint64_t iman_hash_mix(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xBF58476D1CE4E5B9ULL;
+    value ^= value >> 27;
+    value *= 0x94D049BB133111EBULL;
+    value ^= value >> 31;
+    
+    return value;
+}
\ No newline at end of file
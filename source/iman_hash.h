@@ -0,0 +1,19 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_HASH_H
+#define _IMAN_HASH_H
+
+/* Case-insensitive hash of an instruction name, shared by iman-parser and iman */
+uint64_t iman_hash_name(const char *name, size_t length);
+
+/* Case-sensitive hash of arbitrary bytes, used to spot unchanged source blocks between builds */
+uint64_t iman_hash_data(const void *data, size_t length);
+
+uint32_t iman_hash_bucket(uint64_t hash, uint32_t bucket_count);
+
+uint32_t iman_hash_slot(uint64_t hash, uint32_t seed, uint32_t displacement, uint32_t slot_count);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,531 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "iman.h"
+#include "iman_hash.h"
+#include "iman_mapping.h"
+#include "iman_embedded.h"
+#include "iman_bundle.h"
+#include "iman_lookup.h"
+#include <zlib.h>
+
+#define IMAN_MAX_PATH 1024
+
+static int iman_lookup_load_index(struct iman_lookup *lookup);
+static int iman_lookup_find_slot(const struct iman_lookup *lookup, const char *name, struct iman_lookup_entry *entry);
+static int iman_lookup_load_block(struct iman_lookup *lookup, struct iman_lookup_entry *entry);
+static int iman_lookup_inflate_block(struct iman_lookup *lookup, uint32_t offset, uint32_t *psize);
+static const unsigned char *iman_lookup_find_field(const unsigned char *data, uint32_t size, uint32_t id, uint32_t *plength);
+static const unsigned char *iman_lookup_find_section(const struct iman_lookup *lookup, uint32_t id, uint32_t *size);
+static int iman_lookup_load_forms(const unsigned char *data, uint32_t size, struct iman_lookup_entry *entry);
+static const char *iman_lookup_form_text(const struct iman_lookup_entry *entry, uint32_t offset);
+static uint32_t iman_lookup_trie_end(const struct iman_lookup *lookup, uint32_t node);
+static const char *iman_lookup_trie_label(const struct iman_lookup *lookup, uint32_t node, uint32_t *plength);
+static uint32_t iman_read_uint32(const unsigned char *data);
+static uint16_t iman_read_uint16(const unsigned char *data);
+
+int iman_lookup_open(struct iman_lookup *lookup, const char *ref_dir, const char *arch_name) {
+    char path_buffer[IMAN_MAX_PATH];
+    
+    memset(lookup, 0, sizeof(*lookup));
+    
+    if (snprintf(path_buffer, IMAN_MAX_PATH, "%s/%s" IMAN_REF_INDEX_EXT, ref_dir, arch_name) >= IMAN_MAX_PATH) {
+        puts("Error: reference index path is too long");
+        return IMAN_FALSE;
+    }
+    
+    /* A reference built into the binary stands in for the installed files without opening anything, then a bundle holding every architecture */
+    if (iman_embedded_open(&lookup->index, ref_dir, arch_name, IMAN_REF_INDEX_EXT) != IMAN_TRUE &&
+        iman_bundle_open(&lookup->index, ref_dir, arch_name, IMAN_REF_INDEX_EXT) != IMAN_TRUE &&
+        iman_mapping_open(&lookup->index, path_buffer, IMAN_MAPPING_ACCESS_RANDOM) != IMAN_TRUE) {
+        printf("Error: unable to map the reference index %s\n", path_buffer);
+        return IMAN_FALSE;
+    }
+    
+    if (iman_lookup_load_index(lookup) != IMAN_TRUE) {
+        printf("Error: %s is not a valid reference index\n", path_buffer);
+        iman_mapping_close(&lookup->index);
+        return IMAN_FALSE;
+    }
+    
+    if (snprintf(path_buffer, IMAN_MAX_PATH, "%s/%s" IMAN_REF_TABLE_EXT, ref_dir, arch_name) >= IMAN_MAX_PATH) {
+        puts("Error: reference table path is too long");
+        iman_mapping_close(&lookup->index);
+        return IMAN_FALSE;
+    }
+    
+    if (iman_embedded_open(&lookup->table, ref_dir, arch_name, IMAN_REF_TABLE_EXT) != IMAN_TRUE &&
+        iman_bundle_open(&lookup->table, ref_dir, arch_name, IMAN_REF_TABLE_EXT) != IMAN_TRUE &&
+        iman_mapping_open(&lookup->table, path_buffer, IMAN_MAPPING_ACCESS_RANDOM) != IMAN_TRUE) {
+        printf("Error: unable to map the reference table %s\n", path_buffer);
+        iman_mapping_close(&lookup->index);
+        return IMAN_FALSE;
+    }
+    
+    lookup->inflater = calloc(1, sizeof(z_stream));
+    lookup->scratch.data = malloc(lookup->scratch.size + 1);
+    
+    if (lookup->inflater == NULL || lookup->scratch.data == NULL || inflateInit2(lookup->inflater, -MAX_WBITS) != Z_OK) {
+        puts("Error: unable to initialise the table decompressor");
+        free(lookup->inflater);
+        lookup->inflater = NULL;
+        iman_lookup_close(lookup);
+        return IMAN_FALSE;
+    }
+    
+    return IMAN_TRUE;
+}
+
+void iman_lookup_close(struct iman_lookup *lookup) {
+    if (lookup->inflater != NULL) {
+        inflateEnd(lookup->inflater);
+        free(lookup->inflater);
+        lookup->inflater = NULL;
+    }
+    
+    free(lookup->scratch.data);
+    lookup->scratch.data = NULL;
+    
+    iman_mapping_close(&lookup->index);
+    iman_mapping_close(&lookup->table);
+}
+
+int iman_lookup_find(struct iman_lookup *lookup, const char *name, struct iman_lookup_entry *entry) {
+    memset(&entry->forms, 0, sizeof(entry->forms));
+    
+    if (iman_lookup_find_slot(lookup, name, entry) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    return iman_lookup_load_block(lookup, entry);
+}
+
+/* Only finds the name's block, nothing is inflated */
+int iman_lookup_locate(const struct iman_lookup *lookup, const char *name, struct iman_lookup_entry *entry) {
+    memset(entry, 0, sizeof(*entry));
+    
+    return iman_lookup_find_slot(lookup, name, entry);
+}
+
+int iman_lookup_read_block(struct iman_lookup *lookup, uint32_t block_index, struct iman_lookup_entry *entry) {
+    memset(entry, 0, sizeof(*entry));
+    
+    if (lookup->block_directory == NULL || block_index >= lookup->block_count)
+        return IMAN_FALSE;
+    
+    entry->block_index = block_index;
+    entry->block_offset = iman_read_uint32(lookup->block_directory + (size_t)block_index * IMAN_BLOCK_DIRECTORY_ENTRY_SIZE);
+    
+    return iman_lookup_load_block(lookup, entry);
+}
+
+int iman_lookup_block_name(const struct iman_lookup *lookup, uint32_t block_index, const char **pname, uint32_t *plength) {
+    const unsigned char *record;
+    uint32_t offset, length;
+    
+    if (lookup->block_directory == NULL || block_index >= lookup->block_count)
+        return IMAN_FALSE;
+    
+    record = lookup->block_directory + (size_t)block_index * IMAN_BLOCK_DIRECTORY_ENTRY_SIZE;
+    offset = iman_read_uint32(record + 4);
+    length = iman_read_uint32(record + 8);
+    
+    if ((uint64_t)offset + length > lookup->name_heap.size)
+        return IMAN_FALSE;
+    
+    *pname = lookup->name_heap.data + offset;
+    *plength = length;
+    return IMAN_TRUE;
+}
+
+/* Inflates the entry's block into scratch and points the entry at its fields */
+static int iman_lookup_load_block(struct iman_lookup *lookup, struct iman_lookup_entry *entry) {
+    const unsigned char *description;
+    uint32_t block_size, length;
+    
+    if (iman_lookup_inflate_block(lookup, entry->block_offset, &block_size) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    description = iman_lookup_find_field(lookup->scratch.data, block_size, IMAN_FIELD_ID_DESCRIPTION, &length);
+    
+    if (description == NULL || length == 0)
+        return IMAN_FALSE;
+    
+    /* The stored length includes the terminating NUL; the text lives in scratch until the next lookup */
+    entry->description = (const char *)description;
+    entry->length = length - 1;
+    
+    return iman_lookup_load_forms(lookup->scratch.data, block_size, entry);
+}
+
+int iman_lookup_read_form(const struct iman_lookup *lookup, const struct iman_lookup_entry *entry, uint32_t index, struct iman_lookup_form *form) {
+    const unsigned char *record;
+    unsigned int x;
+    
+    if (index >= entry->forms.count)
+        return IMAN_FALSE;
+    
+    record = entry->forms.records + (size_t)index * IMAN_FORM_RECORD_SIZE;
+    
+    form->mnemonic = iman_lookup_form_text(entry, iman_read_uint16(record));
+    form->opcode = iman_lookup_form_text(entry, iman_read_uint16(record + 2));
+    form->description = iman_lookup_form_text(entry, iman_read_uint16(record + 4));
+    form->width = iman_read_uint16(record + 6);
+    form->modes = record[8];
+    form->feature_count = record[9];
+    form->operand_count = record[10];
+    form->clobber_count = record[11];
+    
+    if (form->operand_count > IMAN_FORM_MAX_OPERANDS || form->clobber_count > IMAN_FORM_MAX_CLOBBERS || form->feature_count > IMAN_FORM_MAX_FEATURES)
+        return IMAN_FALSE;
+    
+    for (x = 0; x < IMAN_FORM_MAX_OPERANDS; ++x) {
+        form->operand_ids[x] = iman_read_uint16(record + 12 + 2 * x);
+        form->operands[x] = x < form->operand_count ? iman_lookup_symbol(lookup, form->operand_ids[x]) : NULL;
+    }
+    
+    for (x = 0; x < IMAN_FORM_MAX_CLOBBERS; ++x) {
+        form->clobber_ids[x] = iman_read_uint16(record + 20 + 2 * x);
+        form->clobbers[x] = x < form->clobber_count ? iman_lookup_symbol(lookup, form->clobber_ids[x]) : NULL;
+    }
+    
+    for (x = 0; x < IMAN_FORM_MAX_FEATURES; ++x) {
+        form->feature_ids[x] = iman_read_uint16(record + 28 + 2 * x);
+        form->features[x] = x < form->feature_count ? iman_lookup_symbol(lookup, form->feature_ids[x]) : NULL;
+    }
+    
+    return form->mnemonic != NULL && form->opcode != NULL && form->description != NULL ? IMAN_TRUE : IMAN_FALSE;
+}
+
+/* Walks the trie along the prefix, the matches are then the terminal nodes of one subtree in sorted order */
+int iman_lookup_complete(const struct iman_lookup *lookup, const char *prefix, size_t length, struct iman_lookup_completion *completion) {
+    uint32_t node = 0;
+    size_t matched = 0;
+    
+    completion->next = 0;
+    completion->end = 0;
+    
+    if (lookup->name_trie.node_count == 0)
+        return IMAN_FALSE;
+    
+    while (matched < length) {
+        uint32_t end = iman_lookup_trie_end(lookup, node), child, label_length = 0, x;
+        const char *label = NULL;
+        
+        for (child = node + 1; child < end; child = iman_lookup_trie_end(lookup, child)) {
+            label = iman_lookup_trie_label(lookup, child, &label_length);
+            
+            if (label != NULL && tolower((unsigned char)label[0]) == tolower((unsigned char)prefix[matched]))
+                break;
+        }
+        
+        /* Nothing starts with this prefix */
+        if (child >= end)
+            return IMAN_TRUE;
+        
+        for (x = 0; x < label_length && matched < length; ++x, ++matched) {
+            if (tolower((unsigned char)label[x]) != tolower((unsigned char)prefix[matched]))
+                return IMAN_TRUE;
+        }
+        
+        node = child;
+    }
+    
+    completion->next = node;
+    completion->end = iman_lookup_trie_end(lookup, node);
+    return IMAN_TRUE;
+}
+
+int iman_lookup_next_completion(const struct iman_lookup *lookup, struct iman_lookup_completion *completion, const char **pname, uint32_t *plength) {
+    while (completion->next < completion->end) {
+        uint32_t node = completion->next++, label_length, name_length;
+        const unsigned char *record = lookup->name_trie.nodes + (size_t)node * IMAN_NAME_TRIE_NODE_SIZE;
+        const char *label;
+        
+        if ((record[9] & IMAN_NAME_TRIE_TERMINAL) == 0)
+            continue;
+        
+        label = iman_lookup_trie_label(lookup, node, &label_length);
+        name_length = iman_read_uint16(record + 10);
+        
+        if (label == NULL || (size_t)(label + label_length - lookup->name_heap.data) < name_length)
+            continue;
+        
+        *pname = label + label_length - name_length;
+        *plength = name_length;
+        return IMAN_TRUE;
+    }
+    
+    return IMAN_FALSE;
+}
+
+const char *iman_lookup_symbol(const struct iman_lookup *lookup, uint16_t id) {
+    uint32_t offset;
+    
+    if (id >= lookup->symbols.count)
+        return NULL;
+    
+    offset = iman_read_uint32(lookup->symbols.offsets + 4 * (size_t)id);
+    
+    if (offset >= lookup->symbols.text_size || memchr(lookup->symbols.text + offset, '\0', lookup->symbols.text_size - offset) == NULL)
+        return NULL;
+    
+    return lookup->symbols.text + offset;
+}
+
+static int iman_lookup_load_forms(const unsigned char *data, uint32_t size, struct iman_lookup_entry *entry) {
+    const unsigned char *forms;
+    uint32_t length, count, text_offset;
+    
+    forms = iman_lookup_find_field(data, size, IMAN_FIELD_ID_FORMS, &length);
+    
+    /* Not every block has forms */
+    if (forms == NULL)
+        return IMAN_TRUE;
+    
+    if (length < IMAN_FORMS_HEADER_SIZE)
+        return IMAN_FALSE;
+    
+    count = iman_read_uint32(forms);
+    text_offset = iman_read_uint32(forms + 4);
+    
+    if (text_offset > length || (uint64_t)IMAN_FORMS_HEADER_SIZE + (uint64_t)count * IMAN_FORM_RECORD_SIZE > text_offset)
+        return IMAN_FALSE;
+    
+    entry->forms.records = forms + IMAN_FORMS_HEADER_SIZE;
+    entry->forms.count = count;
+    entry->forms.text = (const char *)forms + text_offset;
+    entry->forms.text_size = length - text_offset;
+    
+    return IMAN_TRUE;
+}
+
+/* NULL for anything that doesn't land on a terminated string inside the heap */
+static const char *iman_lookup_form_text(const struct iman_lookup_entry *entry, uint32_t offset) {
+    if (offset >= entry->forms.text_size || memchr(entry->forms.text + offset, '\0', entry->forms.text_size - offset) == NULL)
+        return NULL;
+    
+    return entry->forms.text + offset;
+}
+
+static int iman_lookup_find_slot(const struct iman_lookup *lookup, const char *name, struct iman_lookup_entry *entry) {
+    const unsigned char *slot;
+    uint64_t hash;
+    uint32_t displacement, name_offset, name_length, x;
+    size_t query_length = strlen(name);
+    
+    if (lookup->names.key_count == 0)
+        return IMAN_FALSE;
+    
+    hash = iman_hash_name(name, query_length);
+    displacement = iman_read_uint32(lookup->names.displacements + iman_hash_bucket(hash, lookup->names.bucket_count) * IMAN_NAME_HASH_BUCKET_SIZE);
+    slot = lookup->names.slots + iman_hash_slot(hash, lookup->names.seed, displacement, lookup->names.key_count) * IMAN_NAME_HASH_SLOT_SIZE;
+    
+    name_offset = iman_read_uint32(slot);
+    name_length = iman_read_uint32(slot + 4);
+    
+    /* The hash is perfect only over known names, anything else has to be rejected here */
+    if (name_length != query_length || (size_t)name_offset + name_length > lookup->name_heap.size)
+        return IMAN_FALSE;
+    
+    for (x = 0; x < name_length; ++x) {
+        if (tolower((unsigned char)lookup->name_heap.data[name_offset + x]) != tolower((unsigned char)name[x]))
+            return IMAN_FALSE;
+    }
+    
+    entry->block_offset = iman_read_uint32(slot + 8);
+    entry->block_index = iman_read_uint32(slot + 12);
+    
+    return IMAN_TRUE;
+}
+
+static int iman_lookup_inflate_block(struct iman_lookup *lookup, uint32_t offset, uint32_t *psize) {
+    uint32_t compressed_size, uncompressed_size;
+    
+    if ((size_t)offset + IMAN_TABLE_BLOCK_HEADER_SIZE > lookup->table.size)
+        return IMAN_FALSE;
+    
+    compressed_size = iman_read_uint32(lookup->table.data + offset);
+    uncompressed_size = iman_read_uint32(lookup->table.data + offset + 4);
+    
+    if ((size_t)offset + IMAN_TABLE_BLOCK_HEADER_SIZE + compressed_size > lookup->table.size || uncompressed_size > lookup->scratch.size)
+        return IMAN_FALSE;
+    
+    if (inflateReset(lookup->inflater) != Z_OK)
+        return IMAN_FALSE;
+    
+    /* Raw streams take the dictionary up front rather than asking for it */
+    if (lookup->dictionary.size != 0 && inflateSetDictionary(lookup->inflater, lookup->dictionary.data, lookup->dictionary.size) != Z_OK)
+        return IMAN_FALSE;
+    
+    lookup->inflater->next_in = (Bytef *)(lookup->table.data + offset + IMAN_TABLE_BLOCK_HEADER_SIZE);
+    lookup->inflater->avail_in = compressed_size;
+    lookup->inflater->next_out = lookup->scratch.data;
+    lookup->inflater->avail_out = uncompressed_size;
+    
+    if (inflate(lookup->inflater, Z_FINISH) != Z_STREAM_END || lookup->inflater->avail_out != 0)
+        return IMAN_FALSE;
+    
+    *psize = uncompressed_size;
+    return IMAN_TRUE;
+}
+
+static const unsigned char *iman_lookup_find_field(const unsigned char *data, uint32_t size, uint32_t id, uint32_t *plength) {
+    uint32_t offset = 0;
+    
+    while (offset + IMAN_TABLE_FIELD_HEADER_SIZE <= size) {
+        uint32_t field_id = iman_read_uint32(data + offset);
+        uint32_t length = iman_read_uint32(data + offset + 4);
+        
+        offset += IMAN_TABLE_FIELD_HEADER_SIZE;
+        
+        if (length > size - offset)
+            return NULL;
+        
+        if (field_id == id) {
+            *plength = length;
+            return data + offset;
+        }
+        
+        /* Fields start aligned, so skip the padding after this one as well */
+        offset += (length + IMAN_TABLE_FIELD_ALIGNMENT - 1) & ~(uint32_t)(IMAN_TABLE_FIELD_ALIGNMENT - 1);
+    }
+    
+    return NULL;
+}
+
+static int iman_lookup_load_index(struct iman_lookup *lookup) {
+    const unsigned char *hash_section, *heap_section, *table_info, *symbols, *trie;
+    uint32_t hash_size, heap_size, table_info_size, slots_offset, symbols_size, trie_size, directory_size;
+    
+    if (lookup->index.size < IMAN_INDEX_HEADER_SIZE)
+        return IMAN_FALSE;
+    
+    if (iman_read_uint32(lookup->index.data) != IMAN_INDEX_MAGIC || iman_read_uint32(lookup->index.data + 4) != IMAN_INDEX_VERSION)
+        return IMAN_FALSE;
+    
+    lookup->block_count = iman_read_uint32(lookup->index.data + 12);
+    
+    hash_section = iman_lookup_find_section(lookup, IMAN_SECTION_ID_NAME_HASH, &hash_size);
+    heap_section = iman_lookup_find_section(lookup, IMAN_SECTION_ID_NAME_HEAP, &heap_size);
+    
+    if (hash_section == NULL || heap_section == NULL || hash_size < IMAN_NAME_HASH_HEADER_SIZE)
+        return IMAN_FALSE;
+    
+    lookup->names.key_count = iman_read_uint32(hash_section);
+    lookup->names.bucket_count = iman_read_uint32(hash_section + 4);
+    lookup->names.seed = iman_read_uint32(hash_section + 8);
+    
+    slots_offset = IMAN_NAME_HASH_HEADER_SIZE + lookup->names.bucket_count * IMAN_NAME_HASH_BUCKET_SIZE;
+    slots_offset = (slots_offset + IMAN_NAME_HASH_SLOT_SIZE - 1) & ~(uint32_t)(IMAN_NAME_HASH_SLOT_SIZE - 1);
+    
+    if (lookup->names.bucket_count == 0 || (uint64_t)slots_offset + (uint64_t)lookup->names.key_count * IMAN_NAME_HASH_SLOT_SIZE > hash_size)
+        return IMAN_FALSE;
+    
+    lookup->names.displacements = hash_section + IMAN_NAME_HASH_HEADER_SIZE;
+    lookup->names.slots = hash_section + slots_offset;
+    
+    lookup->name_heap.data = (const char *)heap_section;
+    lookup->name_heap.size = heap_size;
+    
+    table_info = iman_lookup_find_section(lookup, IMAN_SECTION_ID_TABLE_INFO, &table_info_size);
+    
+    if (table_info == NULL || table_info_size < IMAN_TABLE_INFO_SIZE || iman_read_uint32(table_info) != IMAN_TABLE_COMPRESSION_DEFLATE)
+        return IMAN_FALSE;
+    
+    lookup->scratch.size = iman_read_uint32(table_info + 4);
+    
+    /* The dictionary is optional, a tiny corpus doesn't get one */
+    lookup->dictionary.data = iman_lookup_find_section(lookup, IMAN_SECTION_ID_DICTIONARY, &lookup->dictionary.size);
+    
+    if (lookup->dictionary.data == NULL)
+        lookup->dictionary.size = 0;
+    
+    /* Only search needs the block directory */
+    lookup->block_directory = iman_lookup_find_section(lookup, IMAN_SECTION_ID_BLOCK_DIRECTORY, &directory_size);
+    
+    if (lookup->block_directory != NULL && (uint64_t)lookup->block_count * IMAN_BLOCK_DIRECTORY_ENTRY_SIZE > directory_size)
+        return IMAN_FALSE;
+    
+    /* Only completion needs the trie, an index without one still answers lookups */
+    trie = iman_lookup_find_section(lookup, IMAN_SECTION_ID_NAME_TRIE, &trie_size);
+    
+    if (trie != NULL && trie_size >= IMAN_NAME_TRIE_HEADER_SIZE) {
+        uint32_t node_count = iman_read_uint32(trie);
+        
+        if ((uint64_t)IMAN_NAME_TRIE_HEADER_SIZE + (uint64_t)node_count * IMAN_NAME_TRIE_NODE_SIZE > trie_size)
+            return IMAN_FALSE;
+        
+        lookup->name_trie.node_count = node_count;
+        lookup->name_trie.nodes = trie + IMAN_NAME_TRIE_HEADER_SIZE;
+    }
+    
+    /* The symbol section is optional, without it every type id resolves to NULL */
+    symbols = iman_lookup_find_section(lookup, IMAN_SECTION_ID_SYMBOLS, &symbols_size);
+    
+    if (symbols != NULL && symbols_size >= IMAN_SYMBOLS_HEADER_SIZE) {
+        uint32_t count = iman_read_uint32(symbols), text_offset = iman_read_uint32(symbols + 4);
+        
+        if (text_offset > symbols_size || (uint64_t)IMAN_SYMBOLS_HEADER_SIZE + (uint64_t)count * 4 > text_offset)
+            return IMAN_FALSE;
+        
+        lookup->symbols.count = count;
+        lookup->symbols.offsets = symbols + IMAN_SYMBOLS_HEADER_SIZE;
+        lookup->symbols.text = (const char *)symbols + text_offset;
+        lookup->symbols.text_size = symbols_size - text_offset;
+    }
+    
+    return IMAN_TRUE;
+}
+
+static const unsigned char *iman_lookup_find_section(const struct iman_lookup *lookup, uint32_t id, uint32_t *size) {
+    uint32_t count = iman_read_uint32(lookup->index.data + 8), x;
+    const unsigned char *entry = lookup->index.data + IMAN_INDEX_HEADER_SIZE;
+    
+    if ((uint64_t)IMAN_INDEX_HEADER_SIZE + (uint64_t)count * IMAN_INDEX_SECTION_ENTRY_SIZE > lookup->index.size)
+        return NULL;
+    
+    for (x = 0; x < count; ++x, entry += IMAN_INDEX_SECTION_ENTRY_SIZE) {
+        uint32_t offset = iman_read_uint32(entry + 4);
+        
+        if (iman_read_uint32(entry) != id)
+            continue;
+        
+        *size = iman_read_uint32(entry + 8);
+        
+        if ((uint64_t)offset + *size > lookup->index.size)
+            return NULL;
+        
+        return lookup->index.data + offset;
+    }
+    
+    return NULL;
+}
+
+/* A corrupt subtree end is clamped so every walk still moves forward and stops */
+static uint32_t iman_lookup_trie_end(const struct iman_lookup *lookup, uint32_t node) {
+    uint32_t end = iman_read_uint32(lookup->name_trie.nodes + (size_t)node * IMAN_NAME_TRIE_NODE_SIZE);
+    
+    return end > node && end <= lookup->name_trie.node_count ? end : lookup->name_trie.node_count;
+}
+
+static const char *iman_lookup_trie_label(const struct iman_lookup *lookup, uint32_t node, uint32_t *plength) {
+    const unsigned char *record = lookup->name_trie.nodes + (size_t)node * IMAN_NAME_TRIE_NODE_SIZE;
+    uint32_t offset = iman_read_uint32(record + 4);
+    
+    *plength = record[8];
+    
+    if ((uint64_t)offset + *plength > lookup->name_heap.size)
+        return NULL;
+    
+    return lookup->name_heap.data + offset;
+}
+
+static uint32_t iman_read_uint32(const unsigned char *data) {
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static uint16_t iman_read_uint16(const unsigned char *data) {
+    return (uint16_t)(data[0] | data[1] << 8);
+}
\ No newline at end of file
@@ -0,0 +1,127 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_LOOKUP_H
+#define _IMAN_LOOKUP_H
+
+struct iman_lookup {
+    struct iman_mapping index;
+    struct iman_mapping table;
+    
+    uint32_t block_count;
+    
+    struct {
+        uint32_t key_count;
+        uint32_t bucket_count;
+        uint32_t seed;
+        
+        const unsigned char *displacements;
+        const unsigned char *slots;
+    } names;
+    
+    struct {
+        const char *data;
+        uint32_t size;
+    } name_heap;
+    
+    /* Table offset and first alias of every block, in source order */
+    const unsigned char *block_directory;
+    
+    /* Preorder radix trie over the names, spans of the name heap */
+    struct {
+        uint32_t node_count;
+        const unsigned char *nodes;
+    } name_trie;
+    
+    /* Operand, clobber and feature names, referred to by id from every form record */
+    struct {
+        uint32_t count;
+        const unsigned char *offsets;
+        const char *text;
+        uint32_t text_size;
+    } symbols;
+    
+    /* Preset dictionary shared by every table block, mapped in place */
+    struct {
+        const unsigned char *data;
+        uint32_t size;
+    } dictionary;
+    
+    /* Inflate state and a scratch block sized to the largest block, both set up once at open */
+    struct z_stream_s *inflater;
+    
+    struct {
+        unsigned char *data;
+        uint32_t size;
+    } scratch;
+};
+
+struct iman_lookup_entry {
+    uint32_t block_offset;
+    uint32_t block_index;
+    
+    const char *description;
+    size_t length;
+    
+    /* Fixed size form records and their text heap, read in place from the inflated block */
+    struct {
+        const unsigned char *records;
+        uint32_t count;
+        
+        const char *text;
+        uint32_t text_size;
+    } forms;
+};
+
+/* A run of trie nodes, every terminal node in it is a match */
+struct iman_lookup_completion {
+    uint32_t next;
+    uint32_t end;
+};
+
+struct iman_lookup_form {
+    const char *mnemonic;
+    const char *opcode;
+    const char *description;
+    
+    /* Zero when the form doesn't have a fixed width */
+    unsigned int width;
+    unsigned int modes;
+    
+    /* Names are resolved from the ids, NULL when an id is outside the symbol section */
+    unsigned int operand_count;
+    uint16_t operand_ids[IMAN_FORM_MAX_OPERANDS];
+    const char *operands[IMAN_FORM_MAX_OPERANDS];
+    
+    unsigned int clobber_count;
+    uint16_t clobber_ids[IMAN_FORM_MAX_CLOBBERS];
+    const char *clobbers[IMAN_FORM_MAX_CLOBBERS];
+    
+    unsigned int feature_count;
+    uint16_t feature_ids[IMAN_FORM_MAX_FEATURES];
+    const char *features[IMAN_FORM_MAX_FEATURES];
+};
+
+int iman_lookup_open(struct iman_lookup *lookup, const char *ref_dir, const char *arch_name);
+
+void iman_lookup_close(struct iman_lookup *lookup);
+
+int iman_lookup_find(struct iman_lookup *lookup, const char *name, struct iman_lookup_entry *entry);
+
+int iman_lookup_locate(const struct iman_lookup *lookup, const char *name, struct iman_lookup_entry *entry);
+
+int iman_lookup_read_block(struct iman_lookup *lookup, uint32_t block_index, struct iman_lookup_entry *entry);
+
+int iman_lookup_block_name(const struct iman_lookup *lookup, uint32_t block_index, const char **pname, uint32_t *plength);
+
+int iman_lookup_complete(const struct iman_lookup *lookup, const char *prefix, size_t length, struct iman_lookup_completion *completion);
+
+int iman_lookup_next_completion(const struct iman_lookup *lookup, struct iman_lookup_completion *completion, const char **pname, uint32_t *plength);
+
+const char *iman_lookup_symbol(const struct iman_lookup *lookup, uint16_t id);
+
+int iman_lookup_read_form(const struct iman_lookup *lookup, const struct iman_lookup_entry *entry, uint32_t index, struct iman_lookup_form *form);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,72 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "iman.h"
+#include "iman_mapping.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+int iman_mapping_open(struct iman_mapping *mapping, const char *path, enum iman_mapping_access access) {
+    struct stat info;
+    void *data;
+    int fd;
+    
+    mapping->data = NULL;
+    mapping->size = 0;
+    mapping->borrowed = IMAN_FALSE;
+    
+    fd = open(path, O_RDONLY);
+    
+    if (fd < 0)
+        return IMAN_FALSE;
+    
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return IMAN_FALSE;
+    }
+    
+    /* An empty file is valid, there is just nothing to map */
+    if (info.st_size == 0) {
+        close(fd);
+        return IMAN_TRUE;
+    }
+    
+    data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    
+    if (data == MAP_FAILED)
+        return IMAN_FALSE;
+    
+    /* Lookups jump straight to one record, read-ahead would only page in unrelated blocks */
+    posix_madvise(data, (size_t)info.st_size, access == IMAN_MAPPING_ACCESS_RANDOM ? POSIX_MADV_RANDOM : POSIX_MADV_SEQUENTIAL);
+    
+    mapping->data = data;
+    mapping->size = (size_t)info.st_size;
+    return IMAN_TRUE;
+}
+
+void iman_mapping_borrow(struct iman_mapping *mapping, const unsigned char *data, size_t size) {
+    mapping->data = data;
+    mapping->size = size;
+    mapping->borrowed = IMAN_TRUE;
+}
+
+void iman_mapping_advise(struct iman_mapping *mapping, enum iman_mapping_access access) {
+    if (mapping->data != NULL && mapping->borrowed != IMAN_TRUE)
+        posix_madvise((void *)mapping->data, mapping->size, access == IMAN_MAPPING_ACCESS_RANDOM ? POSIX_MADV_RANDOM : POSIX_MADV_SEQUENTIAL);
+}
+
+void iman_mapping_close(struct iman_mapping *mapping) {
+    if (mapping->data != NULL) {
+        if (mapping->borrowed != IMAN_TRUE)
+            munmap((void *)mapping->data, mapping->size);
+        
+        mapping->data = NULL;
+        mapping->size = 0;
+        mapping->borrowed = IMAN_FALSE;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_MAPPING_H
+#define _IMAN_MAPPING_H
+
+enum iman_mapping_access {
+    IMAN_MAPPING_ACCESS_RANDOM = 0,
+    IMAN_MAPPING_ACCESS_SEQUENTIAL
+};
+
+struct iman_mapping {
+    const unsigned char *data;
+    size_t size;
+    
+    /* Data owned by someone else, such as a reference built into the binary, is never unmapped */
+    int borrowed;
+};
+
+int iman_mapping_open(struct iman_mapping *mapping, const char *path, enum iman_mapping_access access);
+
+void iman_mapping_borrow(struct iman_mapping *mapping, const unsigned char *data, size_t size);
+
+void iman_mapping_advise(struct iman_mapping *mapping, enum iman_mapping_access access);
+
+void iman_mapping_close(struct iman_mapping *mapping);
+
+#endif
\ No newline at end of file
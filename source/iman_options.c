@@ -20,19 +20,39 @@ static int iman_process_input(int right_args, char **argv, struct iman_options *
 
 static int iman_option_arch_handler(int right_args, char ***pargv, struct iman_options *options);
 static int iman_option_english_handler(int right_args, char ***pargv, struct iman_options *options);
+static int iman_option_ref_dir_handler(int right_args, char ***pargv, struct iman_options *options);
+static int iman_option_complete_handler(int right_args, char ***pargv, struct iman_options *options);
+static int iman_option_search_handler(int right_args, char ***pargv, struct iman_options *options);
+static int iman_option_mode_handler(int right_args, char ***pargv, struct iman_options *options);
+static int iman_option_width_handler(int right_args, char ***pargv, struct iman_options *options);
+static int iman_option_operand_handler(int right_args, char ***pargv, struct iman_options *options);
+static int iman_option_feature_handler(int right_args, char ***pargv, struct iman_options *options);
+static int iman_option_batch_handler(int right_args, char ***pargv, struct iman_options *options);
+static int iman_option_serve_handler(int right_args, char ***pargv, struct iman_options *options);
+static int iman_add_facet_filter(int right_args, char ***pargv, struct iman_options *options, unsigned int kind);
 
 static const char * iman_default_architecture_name = "intel";
 
 static const struct iman_option_definition iman_command_line_options[] = {
     { "--arch",    "-a", "-arch, -a <architecture>: Sets the target architecture",   &iman_option_arch_handler      },
     { "--english", "-e", "-english, -e: Describes the instruction in plain English", &iman_option_english_handler   },
-
+    { "--ref-dir", "-r", "-ref-dir, -r <directory>: Sets the reference table directory", &iman_option_ref_dir_handler },
+    { "--complete", "-c", "-complete, -c: Lists every instruction name starting with the given prefixes", &iman_option_complete_handler },
+    { "--search",  "-s", "-search, -s: Lists the instructions whose description matches each extended regular expression", &iman_option_search_handler },
+    { "--mode",    "-m", "-mode, -m <64|32|16>: Lists the forms valid in any of the comma separated modes", &iman_option_mode_handler },
+    { "--width",   "-w", "-width, -w <bits>: Lists the forms with any of the comma separated operand widths", &iman_option_width_handler },
+    { "--operand", "-o", "-operand, -o <type>: Lists the forms taking any of the comma separated operand types, a trailing * matches a prefix", &iman_option_operand_handler },
+    { "--feature", "-f", "-feature, -f <feature>: Lists the forms needing any of the comma separated CPUID features, a leading ! excludes them instead", &iman_option_feature_handler },
+    { "--batch",   "-b", "-batch, -b: Reads instruction names from stdin, one per line, and documents them all in one pass", &iman_option_batch_handler },
+    { "--serve",   "-S", "-serve, -S <socket>: Keeps the reference open and answers queries on a Unix socket, used by iman when " IMAN_SOCKET_ENVIRONMENT " names it", &iman_option_serve_handler },
+    
     { NULL, NULL, NULL, NULL }
 };
 
 void iman_set_default_options(struct iman_options *options)
 {
     options->architecture = iman_default_architecture_name;
+    options->reference_dir = IMAN_REF_DIRECTORY;
     options->mode = IMAN_OUTPUT_MODE_DOC;
 }
 
@@ -73,7 +93,8 @@ int iman_parse_arguments(int argc, char **argv, struct iman_options *options)
         }
     }
     
-    return IMAN_FALSE;
+    /* Facet filters are a query of their own, a batch reads its names from stdin and a server takes them from clients */
+    return options->mode == IMAN_OUTPUT_MODE_FACETS || options->mode == IMAN_OUTPUT_MODE_BATCH || options->mode == IMAN_OUTPUT_MODE_SERVE ? IMAN_TRUE : IMAN_FALSE;
 }
 
 static int iman_process_argument(int right_args, char ***pargv, struct iman_options *options) 
@@ -118,9 +139,117 @@ static int iman_option_arch_handler(int right_args, char ***pargv, struct iman_o
 static int iman_option_english_handler(int right_args, char ***pargv, struct iman_options *options)
 {
     IMAN_UNUSED(right_args);
-
+    
     options->mode = IMAN_OUTPUT_MODE_TO_ENGLISH;
     
     *pargv = *pargv + 1;
     return IMAN_TRUE;
+}
+
+static int iman_option_ref_dir_handler(int right_args, char ***pargv, struct iman_options *options)
+{
+    char **argv = *pargv;
+    
+    if (right_args < 1) {
+        printf("%s expects a directory.\n", *argv);
+        
+        return IMAN_FALSE;
+    }
+    
+    options->reference_dir = argv[1];
+    
+    *pargv = &argv[2];
+    return IMAN_TRUE;
+}
+
+static int iman_option_complete_handler(int right_args, char ***pargv, struct iman_options *options)
+{
+    IMAN_UNUSED(right_args);
+    
+    options->mode = IMAN_OUTPUT_MODE_COMPLETE;
+    
+    *pargv = *pargv + 1;
+    return IMAN_TRUE;
+}
+
+static int iman_option_search_handler(int right_args, char ***pargv, struct iman_options *options)
+{
+    IMAN_UNUSED(right_args);
+    
+    options->mode = IMAN_OUTPUT_MODE_SEARCH;
+    
+    *pargv = *pargv + 1;
+    return IMAN_TRUE;
+}
+
+static int iman_option_mode_handler(int right_args, char ***pargv, struct iman_options *options)
+{
+    return iman_add_facet_filter(right_args, pargv, options, IMAN_FACET_KIND_MODE);
+}
+
+static int iman_option_width_handler(int right_args, char ***pargv, struct iman_options *options)
+{
+    return iman_add_facet_filter(right_args, pargv, options, IMAN_FACET_KIND_WIDTH);
+}
+
+static int iman_option_operand_handler(int right_args, char ***pargv, struct iman_options *options)
+{
+    return iman_add_facet_filter(right_args, pargv, options, IMAN_FACET_KIND_OPERAND);
+}
+
+static int iman_option_feature_handler(int right_args, char ***pargv, struct iman_options *options)
+{
+    return iman_add_facet_filter(right_args, pargv, options, IMAN_FACET_KIND_FEATURE);
+}
+
+static int iman_option_batch_handler(int right_args, char ***pargv, struct iman_options *options)
+{
+    IMAN_UNUSED(right_args);
+    
+    options->mode = IMAN_OUTPUT_MODE_BATCH;
+    
+    *pargv = *pargv + 1;
+    return IMAN_TRUE;
+}
+
+static int iman_option_serve_handler(int right_args, char ***pargv, struct iman_options *options)
+{
+    char **argv = *pargv;
+    
+    if (right_args < 1) {
+        printf("%s expects a socket path.\n", *argv);
+        
+        return IMAN_FALSE;
+    }
+    
+    options->mode = IMAN_OUTPUT_MODE_SERVE;
+    options->socket_path = argv[1];
+    
+    *pargv = &argv[2];
+    return IMAN_TRUE;
+}
+
+static int iman_add_facet_filter(int right_args, char ***pargv, struct iman_options *options, unsigned int kind)
+{
+    char **argv = *pargv;
+    
+    if (right_args < 1) {
+        printf("%s expects a comma separated list of values.\n", *argv);
+        
+        return IMAN_FALSE;
+    }
+    
+    if (options->facets.count >= IMAN_MAX_FACET_FILTERS) {
+        printf("At most %d facet filters can be given.\n", IMAN_MAX_FACET_FILTERS);
+        
+        return IMAN_FALSE;
+    }
+    
+    options->facets.entries[options->facets.count].kind = kind;
+    options->facets.entries[options->facets.count].values = argv[1];
+    options->facets.count++;
+    options->mode = IMAN_OUTPUT_MODE_FACETS;
+    
+    *pargv = &argv[2];
+    return IMAN_TRUE;
 }
\ No newline at end of file
@@ -8,14 +8,36 @@
 
 enum iman_output_mode {
     IMAN_OUTPUT_MODE_DOC = 0,
-    IMAN_OUTPUT_MODE_TO_ENGLISH
+    IMAN_OUTPUT_MODE_TO_ENGLISH,
+    IMAN_OUTPUT_MODE_COMPLETE,
+    IMAN_OUTPUT_MODE_SEARCH,
+    IMAN_OUTPUT_MODE_FACETS,
+    IMAN_OUTPUT_MODE_BATCH,
+    IMAN_OUTPUT_MODE_SERVE
+};
+
+#define IMAN_MAX_FACET_FILTERS 16
+
+struct iman_facet_filter {
+    unsigned int kind;
+    const char *values;
 };
 
 struct iman_options {
     const char *architecture;
+    const char *reference_dir;
     
     enum iman_output_mode mode;
     
+    /* Where --serve listens */
+    const char *socket_path;
+    
+    /* A form has to pass every facet filter given */
+    struct {
+        int count;
+        struct iman_facet_filter entries[IMAN_MAX_FACET_FILTERS];
+    } facets;
+    
     struct {
         int count;
         char **args;
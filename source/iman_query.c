@@ -0,0 +1,212 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "iman.h"
+#include "iman_options.h"
+#include "iman_mapping.h"
+#include "iman_lookup.h"
+#include "iman_search.h"
+#include "iman_query.h"
+
+#define IMAN_FORM_SIGNATURE_SIZE 128
+
+#define IMAN_QUERY_SEARCH_CLOSED 0
+#define IMAN_QUERY_SEARCH_OPEN 1
+#define IMAN_QUERY_SEARCH_MISSING 2
+
+static const struct iman_search *iman_query_open_search(struct iman_query_context *context);
+static void iman_format_signature(const struct iman_lookup_form *form, char *signature, size_t size);
+static void iman_write_form_description(FILE *output, const struct iman_lookup_form *form);
+
+int iman_query_open(struct iman_query_context *context, const char *ref_dir, const char *arch_name) {
+    memset(context, 0, sizeof(*context));
+    
+    context->reference_dir = ref_dir;
+    context->architecture = arch_name;
+    
+    return iman_lookup_open(&context->lookup, ref_dir, arch_name);
+}
+
+void iman_query_close(struct iman_query_context *context) {
+    if (context->search_state == IMAN_QUERY_SEARCH_OPEN)
+        iman_search_close(&context->search);
+    
+    iman_lookup_close(&context->lookup);
+}
+
+int iman_query_document(FILE *output, struct iman_query_context *context, const char *name) {
+    struct iman_lookup_entry entry;
+    
+    if (iman_lookup_find(&context->lookup, name, &entry) != IMAN_TRUE) {
+        fprintf(output, "Error: no reference entry for %s\n", name);
+        return IMAN_FALSE;
+    }
+    
+    iman_query_write_entry(output, &context->lookup, &entry);
+    return IMAN_TRUE;
+}
+
+/* One name per line in sorted order, meant to be read by shell completion */
+int iman_query_complete(FILE *output, struct iman_query_context *context, const char *prefix) {
+    struct iman_lookup_completion completion;
+    const char *name;
+    uint32_t length;
+    
+    if (iman_lookup_complete(&context->lookup, prefix, strlen(prefix), &completion) != IMAN_TRUE) {
+        fputs("Error: the reference index has no completion data\n", output);
+        return IMAN_FALSE;
+    }
+    
+    while (iman_lookup_next_completion(&context->lookup, &completion, &name, &length) == IMAN_TRUE) {
+        fwrite(name, length, 1, output);
+        fputc('\n', output);
+    }
+    
+    return IMAN_TRUE;
+}
+
+/* Each matching block is listed once, under its first name */
+int iman_query_search(FILE *output, struct iman_query_context *context, const char *pattern) {
+    const struct iman_search *search = iman_query_open_search(context);
+    struct iman_search_query query;
+    uint32_t block, length;
+    const char *name;
+    
+    if (search == NULL || iman_search_prepare(search, pattern, &query, output) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    while (iman_search_next(search, &context->lookup, &query, &block) == IMAN_TRUE) {
+        if (iman_lookup_block_name(&context->lookup, block, &name, &length) == IMAN_TRUE) {
+            fwrite(name, length, 1, output);
+            fputc('\n', output);
+        }
+    }
+    
+    iman_search_release(&query);
+    return IMAN_TRUE;
+}
+
+/* Every filter has to hold, instruction names narrow the query down to their own forms */
+int iman_query_facets(FILE *output, struct iman_query_context *context, const struct iman_facet_filter *filters, int filter_count, char *const *names, int name_count) {
+    const struct iman_search *search = iman_query_open_search(context);
+    struct iman_lookup_entry entry;
+    struct iman_facet_query query;
+    uint32_t *blocks = NULL, block, index, loaded = UINT32_MAX;
+    int x, result = IMAN_FALSE;
+    
+    if (search == NULL || iman_facet_query_begin(search, &query, output) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    for (x = 0; x < filter_count; ++x) {
+        if (iman_facet_query_filter(search, &context->lookup, &query, filters[x].kind, filters[x].values, output) != IMAN_TRUE)
+            goto done;
+    }
+    
+    if (name_count > 0) {
+        blocks = malloc((size_t)name_count * sizeof(uint32_t));
+        
+        if (blocks == NULL)
+            goto done;
+        
+        for (x = 0; x < name_count; ++x) {
+            if (iman_lookup_locate(&context->lookup, names[x], &entry) != IMAN_TRUE) {
+                fprintf(output, "Error: no reference entry for %s\n", names[x]);
+                goto done;
+            }
+            
+            blocks[x] = entry.block_index;
+        }
+    }
+    
+    while (iman_facet_query_next(search, &query, &block, &index) == IMAN_TRUE) {
+        char signature[IMAN_FORM_SIGNATURE_SIZE];
+        struct iman_lookup_form form;
+        
+        for (x = 0; x < name_count && blocks[x] != block; ++x);
+        
+        if (name_count > 0 && x == name_count)
+            continue;
+        
+        /* Forms of one block are consecutive, it's only inflated once */
+        if (block != loaded) {
+            if (iman_lookup_read_block(&context->lookup, block, &entry) != IMAN_TRUE)
+                continue;
+            
+            loaded = block;
+        }
+        
+        if (iman_lookup_read_form(&context->lookup, &entry, index, &form) != IMAN_TRUE)
+            continue;
+        
+        iman_format_signature(&form, signature, sizeof(signature));
+        fprintf(output, "%-28s %s\n", signature, form.opcode);
+    }
+    
+    result = IMAN_TRUE;
+
+done:
+    free(blocks);
+    iman_facet_query_release(&query);
+    return result;
+}
+
+/* The forms table followed by the description */
+void iman_query_write_entry(FILE *output, const struct iman_lookup *lookup, const struct iman_lookup_entry *entry) {
+    uint32_t x;
+    
+    for (x = 0; x < entry->forms.count; ++x) {
+        char signature[IMAN_FORM_SIGNATURE_SIZE];
+        struct iman_lookup_form form;
+        
+        if (iman_lookup_read_form(lookup, entry, x, &form) != IMAN_TRUE)
+            continue;
+        
+        iman_format_signature(&form, signature, sizeof(signature));
+        fprintf(output, "    %-24s %-24s ", signature, form.opcode);
+        iman_write_form_description(output, &form);
+        fputc('\n', output);
+    }
+    
+    if (entry->forms.count != 0)
+        fputc('\n', output);
+    
+    fwrite(entry->description, entry->length, 1, output);
+}
+
+/* Lookups by name never need the search file, so it's mapped on first use and only once */
+static const struct iman_search *iman_query_open_search(struct iman_query_context *context) {
+    if (context->search_state == IMAN_QUERY_SEARCH_CLOSED)
+        context->search_state = iman_search_open(&context->search, context->reference_dir, context->architecture) == IMAN_TRUE ? IMAN_QUERY_SEARCH_OPEN : IMAN_QUERY_SEARCH_MISSING;
+    
+    return context->search_state == IMAN_QUERY_SEARCH_OPEN ? &context->search : NULL;
+}
+
+static void iman_format_signature(const struct iman_lookup_form *form, char *signature, size_t size) {
+    unsigned int operand;
+    size_t length = (size_t)snprintf(signature, size, "%s", form->mnemonic);
+    
+    for (operand = 0; operand < form->operand_count && length < size; ++operand) {
+        length += (size_t)snprintf(&signature[length], size - length, operand == 0 ? " %s" : ", %s", 
+            form->operands[operand] != NULL ? form->operands[operand] : "?"
+        );
+    }
+}
+
+/* Form descriptions refer to their operands as @0, @1 and so on */
+static void iman_write_form_description(FILE *output, const struct iman_lookup_form *form) {
+    const char *text;
+    
+    for (text = form->description; *text != '\0'; ++text) {
+        unsigned int operand = (unsigned int)(text[1] - '0');
+        
+        if (text[0] == '@' && text[1] >= '0' && text[1] <= '9' && operand < form->operand_count && form->operands[operand] != NULL) {
+            fputs(form->operands[operand], output);
+            ++text;
+            continue;
+        }
+        
+        fputc(*text, output);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_QUERY_H
+#define _IMAN_QUERY_H
+
+/* One architecture's reference kept open across queries, the search file is only mapped once a query needs it */
+struct iman_query_context {
+    const char *reference_dir;
+    const char *architecture;
+    
+    struct iman_lookup lookup;
+    
+    struct iman_search search;
+    int search_state;
+};
+
+int iman_query_open(struct iman_query_context *context, const char *ref_dir, const char *arch_name);
+
+void iman_query_close(struct iman_query_context *context);
+
+int iman_query_document(FILE *output, struct iman_query_context *context, const char *name);
+
+int iman_query_complete(FILE *output, struct iman_query_context *context, const char *prefix);
+
+int iman_query_search(FILE *output, struct iman_query_context *context, const char *pattern);
+
+int iman_query_facets(FILE *output, struct iman_query_context *context, const struct iman_facet_filter *filters, int filter_count, char *const *names, int name_count);
+
+void iman_query_write_entry(FILE *output, const struct iman_lookup *lookup, const struct iman_lookup_entry *entry);
+
+#endif
\ No newline at end of file
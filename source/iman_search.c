@@ -0,0 +1,697 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "iman.h"
+#include "iman_mapping.h"
+#include "iman_embedded.h"
+#include "iman_bundle.h"
+#include "iman_lookup.h"
+#include "iman_search.h"
+
+#define IMAN_MAX_PATH 1024
+#define IMAN_SEARCH_MAX_TRIGRAMS 64
+#define IMAN_SEARCH_MAX_RUN 256
+
+struct iman_search_key {
+    uint32_t flags;
+    uint32_t offset;
+    uint32_t count;
+};
+
+static unsigned int iman_search_trigrams(const char *pattern, uint32_t *trigrams, unsigned int capacity);
+static unsigned int iman_search_add_run(const char *run, size_t length, uint32_t *trigrams, unsigned int count, unsigned int capacity);
+static int iman_search_has_alternation(const char *pattern);
+static const char *iman_search_skip_group(const char *pattern);
+static const char *iman_search_skip_bracket(const char *pattern);
+static int iman_search_find_key(const struct iman_search *search, uint32_t trigram, struct iman_search_key *key);
+static int iman_search_intersect(const struct iman_search *search, const struct iman_search_key *key, unsigned char *candidates, unsigned char *scratch);
+static int iman_facet_match(const struct iman_search *search, const struct iman_lookup *lookup, unsigned int kind, const char *value, size_t length, uint64_t *words);
+static int iman_facet_match_name(const char *name, const char *value, size_t length);
+static uint32_t iman_facet_lower_bound(const struct iman_search *search, uint32_t kind, uint32_t value);
+static int iman_facet_union(const struct iman_search *search, uint32_t key, uint64_t *words);
+static const unsigned char *iman_search_find_section(const struct iman_search *search, uint32_t id, uint32_t *psize);
+static uint32_t iman_read_uint32(const unsigned char *data);
+static uint16_t iman_read_uint16(const unsigned char *data);
+
+int iman_search_open(struct iman_search *search, const char *ref_dir, const char *arch_name) {
+    char path_buffer[IMAN_MAX_PATH];
+    uint32_t keys_size, blocks_size;
+    
+    memset(search, 0, sizeof(*search));
+    
+    if (snprintf(path_buffer, IMAN_MAX_PATH, "%s/%s" IMAN_REF_SEARCH_EXT, ref_dir, arch_name) >= IMAN_MAX_PATH) {
+        puts("Error: search index path is too long");
+        return IMAN_FALSE;
+    }
+    
+    if (iman_embedded_open(&search->file, ref_dir, arch_name, IMAN_REF_SEARCH_EXT) != IMAN_TRUE &&
+        iman_bundle_open(&search->file, ref_dir, arch_name, IMAN_REF_SEARCH_EXT) != IMAN_TRUE &&
+        iman_mapping_open(&search->file, path_buffer, IMAN_MAPPING_ACCESS_RANDOM) != IMAN_TRUE) {
+        printf("Error: unable to map the search index %s\n", path_buffer);
+        return IMAN_FALSE;
+    }
+    
+    if (search->file.size < IMAN_INDEX_HEADER_SIZE || iman_read_uint32(search->file.data) != IMAN_SEARCH_MAGIC || iman_read_uint32(search->file.data + 4) != IMAN_INDEX_VERSION) {
+        printf("Error: %s is not a search index this version of iman understands\n", path_buffer);
+        iman_search_close(search);
+        return IMAN_FALSE;
+    }
+    
+    search->block_count = iman_read_uint32(search->file.data + 12);
+    search->keys = iman_search_find_section(search, IMAN_SECTION_ID_SEARCH_KEYS, &keys_size);
+    search->postings = iman_search_find_section(search, IMAN_SECTION_ID_SEARCH_POSTINGS, &search->postings_size);
+    search->key_count = keys_size / IMAN_SEARCH_KEY_SIZE;
+    
+    if (search->keys == NULL || search->postings == NULL) {
+        printf("Error: the search index %s is damaged\n", path_buffer);
+        iman_search_close(search);
+        return IMAN_FALSE;
+    }
+    
+    /* Facets are optional, the blocks section has to cover every block for them to be usable */
+    search->facets.keys = iman_search_find_section(search, IMAN_SECTION_ID_FACET_KEYS, &keys_size);
+    search->facets.bitmaps = iman_search_find_section(search, IMAN_SECTION_ID_FACET_BITMAPS, &search->facets.bitmaps_size);
+    search->facets.blocks = iman_search_find_section(search, IMAN_SECTION_ID_FACET_BLOCKS, &blocks_size);
+    
+    if (search->facets.keys != NULL && search->facets.bitmaps != NULL && search->facets.blocks != NULL && blocks_size / 4 == (uint64_t)search->block_count + 1) {
+        search->facets.key_count = keys_size / IMAN_FACET_KEY_SIZE;
+        search->facets.form_count = iman_read_uint32(search->facets.blocks + (size_t)search->block_count * 4);
+    } else {
+        memset(&search->facets, 0, sizeof(search->facets));
+    }
+    
+    return IMAN_TRUE;
+}
+
+void iman_search_close(struct iman_search *search) {
+    iman_mapping_close(&search->file);
+}
+
+/* Problems with the pattern are reported on errors, alongside the query's own output */
+int iman_search_prepare(const struct iman_search *search, const char *pattern, struct iman_search_query *query, FILE *errors) {
+    uint32_t trigrams[IMAN_SEARCH_MAX_TRIGRAMS];
+    struct iman_search_key keys[IMAN_SEARCH_MAX_TRIGRAMS];
+    size_t bitmap_size = (search->block_count + 7) / 8;
+    unsigned char *scratch;
+    unsigned int count, x, y;
+    int error;
+    
+    memset(query, 0, sizeof(*query));
+    error = regcomp(&query->regex, pattern, REG_EXTENDED | REG_ICASE | REG_NOSUB);
+    
+    if (error != 0) {
+        char message[256];
+        
+        regerror(error, &query->regex, message, sizeof(message));
+        fprintf(errors, "Error: invalid search pattern %s: %s\n", pattern, message);
+        return IMAN_FALSE;
+    }
+    
+    query->candidates = malloc(bitmap_size + 1);
+    scratch = malloc(bitmap_size + 1);
+    
+    if (query->candidates == NULL || scratch == NULL) {
+        free(scratch);
+        iman_search_release(query);
+        return IMAN_FALSE;
+    }
+    
+    /* Without a literal of three characters every block is a candidate */
+    memset(query->candidates, 0xFF, bitmap_size);
+    count = iman_search_trigrams(pattern, trigrams, IMAN_SEARCH_MAX_TRIGRAMS);
+    
+    for (x = 0; x < count; ++x) {
+        if (iman_search_find_key(search, trigrams[x], &keys[x]) != IMAN_TRUE) {
+            memset(query->candidates, 0, bitmap_size);
+            count = 0;
+            break;
+        }
+    }
+    
+    /* Rarest first, the candidate set only ever shrinks */
+    for (x = 1; x < count; ++x) {
+        struct iman_search_key key = keys[x];
+        
+        for (y = x; y > 0 && keys[y - 1].count > key.count; --y) {
+            keys[y] = keys[y - 1];
+        }
+        
+        keys[y] = key;
+    }
+    
+    for (x = 0; x < count; ++x) {
+        if (iman_search_intersect(search, &keys[x], query->candidates, scratch) != IMAN_TRUE)
+            break;
+    }
+    
+    free(scratch);
+    return IMAN_TRUE;
+}
+
+int iman_search_next(const struct iman_search *search, struct iman_lookup *lookup, struct iman_search_query *query, uint32_t *pblock) {
+    while (query->next < search->block_count) {
+        uint32_t block = query->next++;
+        struct iman_lookup_entry entry;
+        
+        if ((query->candidates[block / 8] & (1 << (block % 8))) == 0)
+            continue;
+        
+        /* The description is NUL terminated in the inflated block */
+        if (iman_lookup_read_block(lookup, block, &entry) != IMAN_TRUE)
+            continue;
+        
+        if (regexec(&query->regex, entry.description, 0, NULL, 0) == 0) {
+            *pblock = block;
+            return IMAN_TRUE;
+        }
+    }
+    
+    return IMAN_FALSE;
+}
+
+void iman_search_release(struct iman_search_query *query) {
+    regfree(&query->regex);
+    free(query->candidates);
+    query->candidates = NULL;
+}
+
+int iman_facet_query_begin(const struct iman_search *search, struct iman_facet_query *query, FILE *errors) {
+    uint32_t forms = search->facets.form_count;
+    
+    memset(query, 0, sizeof(*query));
+    
+    if (search->facets.key_count == 0) {
+        fputs("Error: the search index has no facet data\n", errors);
+        return IMAN_FALSE;
+    }
+    
+    query->word_count = (forms + 63) / 64;
+    query->forms = malloc(((size_t)query->word_count + 1) * sizeof(uint64_t));
+    query->matches = malloc(((size_t)query->word_count + 1) * sizeof(uint64_t));
+    
+    if (query->forms == NULL || query->matches == NULL) {
+        iman_facet_query_release(query);
+        return IMAN_FALSE;
+    }
+    
+    /* Every form to begin with, the bits past the last one stay clear */
+    memset(query->forms, 0xFF, (size_t)query->word_count * sizeof(uint64_t));
+    
+    if (forms % 64 != 0)
+        query->forms[query->word_count - 1] = ((uint64_t)1 << (forms % 64)) - 1;
+    
+    return IMAN_TRUE;
+}
+
+/*
+ * Keeps the forms with any of the comma separated values, or with none of them after a leading '!'.
+ * Operand and feature names are matched without regard to case and a trailing '*' matches a prefix.
+ */
+int iman_facet_query_filter(const struct iman_search *search, const struct iman_lookup *lookup, struct iman_facet_query *query, unsigned int kind, const char *values, FILE *errors) {
+    int exclude = values[0] == '!' ? IMAN_TRUE : IMAN_FALSE;
+    const char *value = exclude ? values + 1 : values;
+    uint32_t x;
+    
+    memset(query->matches, 0, (size_t)query->word_count * sizeof(uint64_t));
+    
+    while (*value != '\0') {
+        size_t length = strcspn(value, ",");
+        
+        if (length != 0 && iman_facet_match(search, lookup, kind, value, length, query->matches) != IMAN_TRUE) {
+            fprintf(errors, "Error: %.*s is not a valid facet value\n", (int)length, value);
+            return IMAN_FALSE;
+        }
+        
+        value += length;
+        
+        if (*value == ',')
+            value++;
+    }
+    
+    for (x = 0; x < query->word_count; ++x) {
+        query->forms[x] &= exclude ? ~query->matches[x] : query->matches[x];
+    }
+    
+    return IMAN_TRUE;
+}
+
+/* Forms come back in source order, as a block and the form's index within it */
+int iman_facet_query_next(const struct iman_search *search, struct iman_facet_query *query, uint32_t *pblock, uint32_t *pform) {
+    while (query->next < search->facets.form_count) {
+        uint32_t form = query->next, word = form / 64;
+        uint64_t bits = query->forms[word] >> (form % 64);
+        
+        if (bits == 0) {
+            query->next = (word + 1) * 64;
+            continue;
+        }
+        
+        while ((bits & 1) == 0) {
+            bits >>= 1;
+            form++;
+        }
+        
+        query->next = form + 1;
+        
+        while (query->block < search->block_count && iman_read_uint32(search->facets.blocks + ((size_t)query->block + 1) * 4) <= form) {
+            query->block++;
+        }
+        
+        if (query->block >= search->block_count)
+            return IMAN_FALSE;
+        
+        *pblock = query->block;
+        *pform = form - iman_read_uint32(search->facets.blocks + (size_t)query->block * 4);
+        return IMAN_TRUE;
+    }
+    
+    return IMAN_FALSE;
+}
+
+void iman_facet_query_release(struct iman_facet_query *query) {
+    free(query->forms);
+    free(query->matches);
+    query->forms = NULL;
+    query->matches = NULL;
+}
+
+/*
+ * Collects the trigrams of every literal run the pattern can't match without.
+ * Anything optional or repeated, groups and bracket expressions just end the current run.
+ */
+static unsigned int iman_search_trigrams(const char *pattern, uint32_t *trigrams, unsigned int capacity) {
+    char run[IMAN_SEARCH_MAX_RUN];
+    size_t run_length = 0;
+    unsigned int count = 0;
+    const char *p = pattern;
+    
+    /* With top level alternation no single literal is required */
+    if (iman_search_has_alternation(pattern) == IMAN_TRUE)
+        return 0;
+    
+    while (*p != '\0') {
+        char literal;
+        
+        switch (*p) {
+            case '(':
+                count = iman_search_add_run(run, run_length, trigrams, count, capacity);
+                run_length = 0;
+                p = iman_search_skip_group(p);
+                continue;
+            
+            case '[':
+                count = iman_search_add_run(run, run_length, trigrams, count, capacity);
+                run_length = 0;
+                p = iman_search_skip_bracket(p);
+                continue;
+            
+            case '*':
+            case '?':
+            case '{':
+                /* The previous character may not appear at all */
+                if (run_length > 0)
+                    run_length--;
+                
+                count = iman_search_add_run(run, run_length, trigrams, count, capacity);
+                run_length = 0;
+                
+                if (*p == '{') {
+                    while (*p != '\0' && *p != '}') {
+                        p++;
+                    }
+                }
+                
+                if (*p != '\0')
+                    p++;
+                
+                continue;
+            
+            case '\\':
+                /* Escaped letters and digits are classes or anchors, anything else stands for itself */
+                if (p[1] == '\0' || isalnum((unsigned char)p[1])) {
+                    count = iman_search_add_run(run, run_length, trigrams, count, capacity);
+                    run_length = 0;
+                    p += p[1] == '\0' ? 1 : 2;
+                    continue;
+                }
+                
+                literal = p[1];
+                p += 2;
+                break;
+            
+            case '+':
+            case '.':
+            case '^':
+            case '$':
+            case ')':
+                count = iman_search_add_run(run, run_length, trigrams, count, capacity);
+                run_length = 0;
+                p++;
+                continue;
+            
+            default:
+                literal = *p++;
+                break;
+        }
+        
+        if (run_length == IMAN_SEARCH_MAX_RUN) {
+            count = iman_search_add_run(run, run_length, trigrams, count, capacity);
+            run_length = 0;
+        }
+        
+        run[run_length++] = literal;
+    }
+    
+    return iman_search_add_run(run, run_length, trigrams, count, capacity);
+}
+
+static unsigned int iman_search_add_run(const char *run, size_t length, uint32_t *trigrams, unsigned int count, unsigned int capacity) {
+    size_t x;
+    
+    for (x = 0; x + 2 < length && count < capacity; ++x) {
+        uint32_t trigram = (uint32_t)tolower((unsigned char)run[x]) |
+            (uint32_t)tolower((unsigned char)run[x + 1]) << 8 |
+            (uint32_t)tolower((unsigned char)run[x + 2]) << 16;
+        unsigned int y;
+        
+        for (y = 0; y < count && trigrams[y] != trigram; ++y);
+        
+        if (y == count)
+            trigrams[count++] = trigram;
+    }
+    
+    return count;
+}
+
+static int iman_search_has_alternation(const char *pattern) {
+    const char *p = pattern;
+    
+    while (*p != '\0') {
+        if (*p == '|')
+            return IMAN_TRUE;
+        
+        if (*p == '(') {
+            p = iman_search_skip_group(p);
+        } else if (*p == '[') {
+            p = iman_search_skip_bracket(p);
+        } else {
+            p += p[0] == '\\' && p[1] != '\0' ? 2 : 1;
+        }
+    }
+    
+    return IMAN_FALSE;
+}
+
+/* Returns the character after the group's closing parenthesis */
+static const char *iman_search_skip_group(const char *pattern) {
+    const char *p = pattern + 1;
+    unsigned int depth = 1;
+    
+    while (*p != '\0' && depth > 0) {
+        if (*p == '[') {
+            p = iman_search_skip_bracket(p);
+            continue;
+        }
+        
+        if (*p == '\\' && p[1] != '\0') {
+            p += 2;
+            continue;
+        }
+        
+        if (*p == '(')
+            depth++;
+        else if (*p == ')')
+            depth--;
+        
+        p++;
+    }
+    
+    return p;
+}
+
+/* Returns the character after the bracket expression, a leading ']' is part of the set */
+static const char *iman_search_skip_bracket(const char *pattern) {
+    const char *p = pattern + 1;
+    
+    if (*p == '^')
+        p++;
+    
+    if (*p == ']')
+        p++;
+    
+    while (*p != '\0' && *p != ']') {
+        /* [:class:], [=equivalence=] and [.collating.] may contain a ']' of their own */
+        if (*p == '[' && (p[1] == ':' || p[1] == '=' || p[1] == '.')) {
+            char delimiter = p[1];
+            
+            for (p += 2; *p != '\0' && !(p[0] == delimiter && p[1] == ']'); ++p);
+            
+            if (*p != '\0')
+                p += 2;
+            
+            continue;
+        }
+        
+        p++;
+    }
+    
+    return *p != '\0' ? p + 1 : p;
+}
+
+static int iman_search_find_key(const struct iman_search *search, uint32_t trigram, struct iman_search_key *key) {
+    uint32_t low = 0, high = search->key_count;
+    
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        const unsigned char *record = search->keys + (size_t)middle * IMAN_SEARCH_KEY_SIZE;
+        uint32_t flags = iman_read_uint32(record), value = flags & 0xFFFFFF;
+        
+        if (value < trigram) {
+            low = middle + 1;
+        } else if (value > trigram) {
+            high = middle;
+        } else {
+            key->flags = flags;
+            key->offset = iman_read_uint32(record + 4);
+            key->count = iman_read_uint32(record + 8);
+            return IMAN_TRUE;
+        }
+    }
+    
+    return IMAN_FALSE;
+}
+
+/* Narrows the candidates down to the blocks in one posting list, FALSE once nothing is left */
+static int iman_search_intersect(const struct iman_search *search, const struct iman_search_key *key, unsigned char *candidates, unsigned char *scratch) {
+    size_t bitmap_size = (search->block_count + 7) / 8, x;
+    const unsigned char *postings = search->postings + key->offset;
+    unsigned char any = 0;
+    
+    if (key->offset > search->postings_size)
+        return IMAN_FALSE;
+    
+    if (key->flags & IMAN_SEARCH_KEY_BITMAP) {
+        if (bitmap_size > search->postings_size - key->offset)
+            return IMAN_FALSE;
+        
+        memcpy(scratch, postings, bitmap_size);
+    } else {
+        size_t position = 0, available = search->postings_size - key->offset;
+        uint32_t block = 0, index;
+        
+        memset(scratch, 0, bitmap_size);
+        
+        for (index = 0; index < key->count; ++index) {
+            uint32_t delta = 0;
+            unsigned int shift = 0;
+            
+            do {
+                if (position >= available || shift > 28)
+                    return IMAN_FALSE;
+                
+                delta |= (uint32_t)(postings[position] & 0x7F) << shift;
+                shift += 7;
+            } while (postings[position++] & 0x80);
+            
+            block = index == 0 ? delta : block + delta;
+            
+            if (block < search->block_count)
+                scratch[block / 8] |= (unsigned char)(1 << (block % 8));
+        }
+    }
+    
+    for (x = 0; x < bitmap_size; ++x) {
+        candidates[x] &= scratch[x];
+        any |= candidates[x];
+    }
+    
+    return any != 0 ? IMAN_TRUE : IMAN_FALSE;
+}
+
+/* Adds the forms of one facet value to the words, FALSE when the value can't be a value of that facet */
+static int iman_facet_match(const struct iman_search *search, const struct iman_lookup *lookup, unsigned int kind, const char *value, size_t length, uint64_t *words) {
+    uint32_t key;
+    
+    if (kind == IMAN_FACET_KIND_MODE || kind == IMAN_FACET_KIND_WIDTH) {
+        char number[16];
+        char *end;
+        unsigned long parsed;
+        
+        if (length >= sizeof(number))
+            return IMAN_FALSE;
+        
+        memcpy(number, value, length);
+        number[length] = '\0';
+        parsed = strtoul(number, &end, 10);
+        
+        if (*end != '\0' || !isdigit((unsigned char)number[0]) || (kind == IMAN_FACET_KIND_MODE && parsed != 64 && parsed != 32 && parsed != 16))
+            return IMAN_FALSE;
+        
+        key = iman_facet_lower_bound(search, kind, (uint32_t)parsed);
+        
+        if (key < search->facets.key_count && iman_read_uint32(search->facets.keys + (size_t)key * IMAN_FACET_KEY_SIZE + 4) == parsed &&
+            iman_read_uint32(search->facets.keys + (size_t)key * IMAN_FACET_KEY_SIZE) == kind)
+            return iman_facet_union(search, key, words);
+        
+        return IMAN_TRUE;
+    }
+    
+    /* Names aren't sorted by id, every value of the facet is compared */
+    for (key = iman_facet_lower_bound(search, kind, 0); key < search->facets.key_count; ++key) {
+        const unsigned char *record = search->facets.keys + (size_t)key * IMAN_FACET_KEY_SIZE;
+        const char *name;
+        
+        if (iman_read_uint32(record) != kind)
+            break;
+        
+        name = iman_lookup_symbol(lookup, (uint16_t)iman_read_uint32(record + 4));
+        
+        if (name != NULL && iman_facet_match_name(name, value, length) == IMAN_TRUE && iman_facet_union(search, key, words) != IMAN_TRUE)
+            return IMAN_FALSE;
+    }
+    
+    return IMAN_TRUE;
+}
+
+static int iman_facet_match_name(const char *name, const char *value, size_t length) {
+    size_t x;
+    int prefix = length > 0 && value[length - 1] == '*' ? IMAN_TRUE : IMAN_FALSE;
+    
+    if (prefix)
+        length--;
+    
+    for (x = 0; x < length; ++x) {
+        if (name[x] == '\0' || tolower((unsigned char)name[x]) != tolower((unsigned char)value[x]))
+            return IMAN_FALSE;
+    }
+    
+    return prefix || name[length] == '\0' ? IMAN_TRUE : IMAN_FALSE;
+}
+
+/* First key not below (kind, value) */
+static uint32_t iman_facet_lower_bound(const struct iman_search *search, uint32_t kind, uint32_t value) {
+    uint32_t low = 0, high = search->facets.key_count;
+    
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        const unsigned char *record = search->facets.keys + (size_t)middle * IMAN_FACET_KEY_SIZE;
+        uint32_t middle_kind = iman_read_uint32(record), middle_value = iman_read_uint32(record + 4);
+        
+        if (middle_kind < kind || (middle_kind == kind && middle_value < value)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    
+    return low;
+}
+
+static int iman_facet_union(const struct iman_search *search, uint32_t key, uint64_t *words) {
+    const unsigned char *record = search->facets.keys + (size_t)key * IMAN_FACET_KEY_SIZE;
+    uint32_t offset = iman_read_uint32(record + 8), size = search->facets.bitmaps_size, container_count, x, y;
+    uint32_t word_count = (search->facets.form_count + 63) / 64;
+    
+    if (offset > size || size - offset < 4)
+        return IMAN_FALSE;
+    
+    container_count = iman_read_uint32(search->facets.bitmaps + offset);
+    offset += 4;
+    
+    for (x = 0; x < container_count; ++x) {
+        const unsigned char *container = search->facets.bitmaps + offset;
+        uint32_t upper, type, count;
+        
+        if (size - offset < IMAN_FACET_CONTAINER_HEADER_SIZE)
+            return IMAN_FALSE;
+        
+        upper = iman_read_uint16(container);
+        type = iman_read_uint16(container + 2);
+        count = iman_read_uint32(container + 4);
+        offset += IMAN_FACET_CONTAINER_HEADER_SIZE;
+        container += IMAN_FACET_CONTAINER_HEADER_SIZE;
+        
+        if (type == IMAN_FACET_CONTAINER_BITMAP) {
+            uint32_t base = upper * (65536 / 64);
+            
+            if (size - offset < IMAN_FACET_CONTAINER_BITMAP_SIZE)
+                return IMAN_FALSE;
+            
+            for (y = 0; y < 65536 / 64 && base + y < word_count; ++y) {
+                const unsigned char *bytes = container + y * 8;
+                
+                words[base + y] |= (uint64_t)iman_read_uint32(bytes) | (uint64_t)iman_read_uint32(bytes + 4) << 32;
+            }
+            
+            offset += IMAN_FACET_CONTAINER_BITMAP_SIZE;
+        } else {
+            if ((uint64_t)count * 2 > size - offset)
+                return IMAN_FALSE;
+            
+            for (y = 0; y < count; ++y) {
+                uint32_t form = upper << 16 | iman_read_uint16(container + y * 2);
+                
+                if (form < search->facets.form_count)
+                    words[form / 64] |= (uint64_t)1 << (form % 64);
+            }
+            
+            offset += (count * 2 + 3) & ~(uint32_t)3;
+        }
+    }
+    
+    return IMAN_TRUE;
+}
+
+static const unsigned char *iman_search_find_section(const struct iman_search *search, uint32_t id, uint32_t *psize) {
+    uint32_t count = iman_read_uint32(search->file.data + 8), x;
+    const unsigned char *entry = search->file.data + IMAN_INDEX_HEADER_SIZE;
+    
+    if ((uint64_t)IMAN_INDEX_HEADER_SIZE + (uint64_t)count * IMAN_INDEX_SECTION_ENTRY_SIZE > search->file.size)
+        return NULL;
+    
+    for (x = 0; x < count; ++x, entry += IMAN_INDEX_SECTION_ENTRY_SIZE) {
+        uint32_t offset = iman_read_uint32(entry + 4);
+        
+        if (iman_read_uint32(entry) != id)
+            continue;
+        
+        *psize = iman_read_uint32(entry + 8);
+        
+        if ((uint64_t)offset + *psize > search->file.size)
+            return NULL;
+        
+        return search->file.data + offset;
+    }
+    
+    return NULL;
+}
+
+static uint32_t iman_read_uint32(const unsigned char *data) {
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static uint16_t iman_read_uint16(const unsigned char *data) {
+    return (uint16_t)(data[0] | data[1] << 8);
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_SEARCH_H
+#define _IMAN_SEARCH_H
+
+#include <regex.h>
+
+/* The trigram posting lists written next to the table, mapped in place */
+struct iman_search {
+    struct iman_mapping file;
+    uint32_t block_count;
+    
+    uint32_t key_count;
+    const unsigned char *keys;
+    
+    const unsigned char *postings;
+    uint32_t postings_size;
+    
+    /* Form bitmaps per facet value and the first form of every block, empty in a file without facets */
+    struct {
+        uint32_t key_count;
+        const unsigned char *keys;
+        
+        const unsigned char *bitmaps;
+        uint32_t bitmaps_size;
+        
+        const unsigned char *blocks;
+        uint32_t form_count;
+    } facets;
+};
+
+/* Candidate blocks from the postings, each one confirmed against the regular expression in turn */
+struct iman_search_query {
+    regex_t regex;
+    unsigned char *candidates;
+    uint32_t next;
+};
+
+/* One bit per form, narrowed by each filter in turn */
+struct iman_facet_query {
+    uint64_t *forms;
+    uint64_t *matches;
+    uint32_t word_count;
+    
+    uint32_t next;
+    uint32_t block;
+};
+
+int iman_search_open(struct iman_search *search, const char *ref_dir, const char *arch_name);
+
+void iman_search_close(struct iman_search *search);
+
+int iman_search_prepare(const struct iman_search *search, const char *pattern, struct iman_search_query *query, FILE *errors);
+
+int iman_search_next(const struct iman_search *search, struct iman_lookup *lookup, struct iman_search_query *query, uint32_t *pblock);
+
+void iman_search_release(struct iman_search_query *query);
+
+int iman_facet_query_begin(const struct iman_search *search, struct iman_facet_query *query, FILE *errors);
+
+int iman_facet_query_filter(const struct iman_search *search, const struct iman_lookup *lookup, struct iman_facet_query *query, unsigned int kind, const char *values, FILE *errors);
+
+int iman_facet_query_next(const struct iman_search *search, struct iman_facet_query *query, uint32_t *pblock, uint32_t *pform);
+
+void iman_facet_query_release(struct iman_facet_query *query);
+
+#endif
\ No newline at end of file
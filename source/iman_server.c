@@ -0,0 +1,665 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "iman.h"
+#include "iman_options.h"
+#include "iman_mapping.h"
+#include "iman_lookup.h"
+#include "iman_search.h"
+#include "iman_query.h"
+#include "iman_server.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#define IMAN_MAX_PATH 1024
+#define IMAN_SERVER_MAX_CLIENTS 256
+#define IMAN_SERVER_READ_SIZE 16384
+
+/* A client's replies are only read for once the ones already queued have mostly gone out */
+#define IMAN_SERVER_MAX_PENDING (1024 * 1024)
+
+/* A wedged server costs the client this long per connect, read or write before it answers locally instead */
+#define IMAN_CLIENT_TIMEOUT_SECONDS 2
+
+struct iman_server_buffer {
+    char *data;
+    size_t length;
+    size_t size;
+};
+
+/* Rebuilds rename fresh files over the old ones, so a different inode or modification time means a new reference */
+struct iman_server_stamp {
+    dev_t device;
+    ino_t inode;
+    time_t modified;
+};
+
+/* The index and search files of the architecture, then the bundle, whichever of them exist */
+#define IMAN_SERVER_STAMP_COUNT 3
+
+struct iman_server_client {
+    int fd;
+    
+    struct iman_server_buffer input;
+    
+    struct iman_server_buffer output;
+    size_t output_sent;
+};
+
+static int iman_server_listen(const char *socket_path);
+static void iman_server_stamp(struct iman_server_stamp *stamps, const char *ref_dir, const char *arch_name);
+static void iman_server_refresh(struct iman_query_context *context, struct iman_server_stamp *stamps);
+static int iman_server_accept(int listener, struct iman_server_client *clients, unsigned int *pcount);
+static int iman_server_read(struct iman_query_context *context, struct iman_server_client *client);
+static int iman_server_write(struct iman_server_client *client);
+static int iman_server_answer(struct iman_query_context *context, struct iman_server_client *client, const char *request, uint32_t length);
+static uint8_t iman_server_run_query(FILE *output, struct iman_query_context *context, uint8_t type, char **args, int arg_count);
+static void iman_server_close_client(struct iman_server_client *client);
+static void iman_server_stop(int signal_number);
+static int iman_client_build_request(const struct iman_options *options, struct iman_server_buffer *request);
+static int iman_client_exchange(const char *socket_path, const struct iman_server_buffer *request, struct iman_server_buffer *response);
+static int iman_buffer_append(struct iman_server_buffer *buffer, const void *data, size_t length);
+static int iman_buffer_append_uint32(struct iman_server_buffer *buffer, uint32_t value);
+static uint32_t iman_read_uint32(const unsigned char *data);
+static int iman_set_nonblocking(int fd);
+
+static volatile sig_atomic_t iman_server_stopping;
+
+/*
+ * Answers queries from any number of clients with one poll loop, the reference stays mapped between them.
+ * Runs until interrupted, then removes the socket.
+ */
+int iman_serve(const char *socket_path, const char *ref_dir, const char *arch_name) {
+    static struct iman_server_client clients[IMAN_SERVER_MAX_CLIENTS];
+    static struct pollfd descriptors[IMAN_SERVER_MAX_CLIENTS + 1];
+    struct iman_server_stamp stamps[IMAN_SERVER_STAMP_COUNT];
+    struct iman_query_context context;
+    struct sigaction action;
+    char *canonical_dir;
+    unsigned int client_count = 0, x;
+    int listener, result = IMAN_TRUE;
+    
+    /* Clients send their directory resolved the same way, so any spelling of it finds this server */
+    canonical_dir = realpath(ref_dir, NULL);
+    
+    /* Taken before opening, a rebuild landing in between is then picked up on the first connection */
+    iman_server_stamp(stamps, canonical_dir != NULL ? canonical_dir : ref_dir, arch_name);
+    
+    if (iman_query_open(&context, canonical_dir != NULL ? canonical_dir : ref_dir, arch_name) != IMAN_TRUE) {
+        free(canonical_dir);
+        return IMAN_FALSE;
+    }
+    
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, NULL);
+    
+    action.sa_handler = &iman_server_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    
+    listener = iman_server_listen(socket_path);
+    
+    if (listener < 0) {
+        iman_query_close(&context);
+        free(canonical_dir);
+        return IMAN_FALSE;
+    }
+    
+    printf("Info: serving %s from %s on %s\n", arch_name, ref_dir, socket_path);
+    fflush(stdout);
+    
+    while (!iman_server_stopping) {
+        descriptors[0].fd = listener;
+        descriptors[0].events = client_count < IMAN_SERVER_MAX_CLIENTS ? POLLIN : 0;
+        
+        for (x = 0; x < client_count; ++x) {
+            size_t pending = clients[x].output.length - clients[x].output_sent;
+            
+            descriptors[x + 1].fd = clients[x].fd;
+            descriptors[x + 1].events = (short)((pending < IMAN_SERVER_MAX_PENDING ? POLLIN : 0) | (pending != 0 ? POLLOUT : 0));
+            descriptors[x + 1].revents = 0;
+        }
+        
+        if (poll(descriptors, client_count + 1, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            
+            perror("poll");
+            result = IMAN_FALSE;
+            break;
+        }
+        
+        /* iman connects once per query, so a new connection is the only time the reference needs checking */
+        if (descriptors[0].revents & POLLIN)
+            iman_server_refresh(&context, stamps);
+        
+        /* Clients that go away are swapped with the last one, so walk backwards */
+        for (x = client_count; x > 0; --x) {
+            struct iman_server_client *client = &clients[x - 1];
+            short events = descriptors[x].revents;
+            int keep = IMAN_TRUE;
+            
+            if (events & (POLLIN | POLLHUP | POLLERR))
+                keep = iman_server_read(&context, client);
+            
+            if (keep && (events & POLLOUT))
+                keep = iman_server_write(client);
+            
+            if (!keep) {
+                iman_server_close_client(client);
+                clients[x - 1] = clients[--client_count];
+            }
+        }
+        
+        if (descriptors[0].revents & POLLIN)
+            iman_server_accept(listener, clients, &client_count);
+    }
+    
+    for (x = 0; x < client_count; ++x) {
+        iman_server_close_client(&clients[x]);
+    }
+    
+    close(listener);
+    unlink(socket_path);
+    iman_query_close(&context);
+    free(canonical_dir);
+    return result;
+}
+
+/*
+ * Sends the query to a server when one is listening, FALSE when it should be answered here instead:
+ * no server, a server for another reference, or a mode the protocol doesn't carry.
+ */
+int iman_client_query(const char *socket_path, const struct iman_options *options, int *presult) {
+    struct iman_server_buffer request = { 0 }, response = { 0 };
+    struct sigaction action;
+    int result = IMAN_FALSE;
+    
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, NULL);
+    
+    if (iman_client_build_request(options, &request) != IMAN_TRUE)
+        goto done;
+    
+    if (iman_client_exchange(socket_path, &request, &response) != IMAN_TRUE || response.length < 1)
+        goto done;
+    
+    if ((uint8_t)response.data[0] == IMAN_QUERY_STATUS_UNAVAILABLE)
+        goto done;
+    
+    fwrite(&response.data[1], response.length - 1, 1, stdout);
+    *presult = (uint8_t)response.data[0] == IMAN_QUERY_STATUS_OK ? 0 : -2;
+    result = IMAN_TRUE;
+
+done:
+    free(request.data);
+    free(response.data);
+    return result;
+}
+
+static int iman_server_listen(const char *socket_path) {
+    struct sockaddr_un address;
+    struct stat info;
+    int listener;
+    
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        printf("Error: socket path %s is too long\n", socket_path);
+        return -1;
+    }
+    
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+    
+    /* A socket left behind by a server that didn't exit cleanly is replaced, anything else is left alone */
+    if (lstat(socket_path, &info) == 0 && S_ISSOCK(info.st_mode))
+        unlink(socket_path);
+    
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0 || iman_set_nonblocking(listener) != IMAN_TRUE) {
+        printf("Error: unable to listen on %s: %s\n", socket_path, strerror(errno));
+        
+        if (listener >= 0)
+            close(listener);
+        
+        return -1;
+    }
+    
+    return listener;
+}
+
+static void iman_server_stamp(struct iman_server_stamp *stamps, const char *ref_dir, const char *arch_name) {
+    char paths[IMAN_SERVER_STAMP_COUNT][IMAN_MAX_PATH];
+    int lengths[IMAN_SERVER_STAMP_COUNT];
+    struct stat info;
+    unsigned int x;
+    
+    lengths[0] = snprintf(paths[0], IMAN_MAX_PATH, "%s/%s" IMAN_REF_INDEX_EXT, ref_dir, arch_name);
+    lengths[1] = snprintf(paths[1], IMAN_MAX_PATH, "%s/%s" IMAN_REF_SEARCH_EXT, ref_dir, arch_name);
+    lengths[2] = snprintf(paths[2], IMAN_MAX_PATH, "%s/" IMAN_REF_BUNDLE_FILE, ref_dir);
+    
+    /* A file that's missing or can't be named stamps as zeroes, so it appearing later counts as a change */
+    for (x = 0; x < IMAN_SERVER_STAMP_COUNT; ++x) {
+        memset(&stamps[x], 0, sizeof(stamps[x]));
+        
+        if (lengths[x] < 0 || lengths[x] >= IMAN_MAX_PATH || stat(paths[x], &info) != 0)
+            continue;
+        
+        stamps[x].device = info.st_dev;
+        stamps[x].inode = info.st_ino;
+        stamps[x].modified = info.st_mtime;
+    }
+}
+
+/* Reopens the reference once it's been rebuilt, a reference that won't open yet keeps the old one until the next try */
+static void iman_server_refresh(struct iman_query_context *context, struct iman_server_stamp *stamps) {
+    struct iman_server_stamp current[IMAN_SERVER_STAMP_COUNT];
+    struct iman_query_context fresh;
+    unsigned int x;
+    
+    iman_server_stamp(current, context->reference_dir, context->architecture);
+    
+    for (x = 0; x < IMAN_SERVER_STAMP_COUNT; ++x) {
+        if (current[x].device != stamps[x].device || current[x].inode != stamps[x].inode || current[x].modified != stamps[x].modified)
+            break;
+    }
+    
+    if (x == IMAN_SERVER_STAMP_COUNT || iman_query_open(&fresh, context->reference_dir, context->architecture) != IMAN_TRUE)
+        return;
+    
+    /* Replies already queued were copied out, nothing still points into the old mappings */
+    iman_query_close(context);
+    *context = fresh;
+    memcpy(stamps, current, sizeof(current));
+    
+    printf("Info: reopened %s from %s\n", context->architecture, context->reference_dir);
+    fflush(stdout);
+}
+
+static int iman_server_accept(int listener, struct iman_server_client *clients, unsigned int *pcount) {
+    while (*pcount < IMAN_SERVER_MAX_CLIENTS) {
+        int fd = accept(listener, NULL, NULL);
+        
+        if (fd < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? IMAN_TRUE : IMAN_FALSE;
+        
+        if (iman_set_nonblocking(fd) != IMAN_TRUE) {
+            close(fd);
+            continue;
+        }
+        
+        memset(&clients[*pcount], 0, sizeof(clients[*pcount]));
+        clients[*pcount].fd = fd;
+        (*pcount)++;
+    }
+    
+    return IMAN_TRUE;
+}
+
+/* Reads what's available and answers every complete request in it, FALSE once the client has to go */
+static int iman_server_read(struct iman_query_context *context, struct iman_server_client *client) {
+    char buffer[IMAN_SERVER_READ_SIZE];
+    size_t consumed = 0;
+    ssize_t length = read(client->fd, buffer, sizeof(buffer));
+    
+    if (length < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? IMAN_TRUE : IMAN_FALSE;
+    
+    if (length == 0 || iman_buffer_append(&client->input, buffer, (size_t)length) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    while (client->input.length - consumed >= IMAN_PROTOCOL_HEADER_SIZE) {
+        uint32_t request_length = iman_read_uint32((const unsigned char *)&client->input.data[consumed]);
+        
+        if (request_length > IMAN_PROTOCOL_MAX_REQUEST)
+            return IMAN_FALSE;
+        
+        if (client->input.length - consumed - IMAN_PROTOCOL_HEADER_SIZE < request_length)
+            break;
+        
+        if (iman_server_answer(context, client, &client->input.data[consumed + IMAN_PROTOCOL_HEADER_SIZE], request_length) != IMAN_TRUE)
+            return IMAN_FALSE;
+        
+        consumed += IMAN_PROTOCOL_HEADER_SIZE + request_length;
+    }
+    
+    memmove(client->input.data, &client->input.data[consumed], client->input.length - consumed);
+    client->input.length -= consumed;
+    
+    /* Try to send straight away rather than waiting for another trip through poll */
+    return client->output.length != client->output_sent ? iman_server_write(client) : IMAN_TRUE;
+}
+
+static int iman_server_write(struct iman_server_client *client) {
+    while (client->output_sent < client->output.length) {
+        ssize_t written = write(client->fd, &client->output.data[client->output_sent], client->output.length - client->output_sent);
+        
+        if (written < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? IMAN_TRUE : IMAN_FALSE;
+        
+        client->output_sent += (size_t)written;
+    }
+    
+    client->output.length = 0;
+    client->output_sent = 0;
+    return IMAN_TRUE;
+}
+
+/* Splits the request into its NUL terminated arguments and queues the reply, FALSE for a malformed request */
+static int iman_server_answer(struct iman_query_context *context, struct iman_server_client *client, const char *request, uint32_t length) {
+    char *arguments, *args[IMAN_PROTOCOL_MAX_ARGUMENTS], *text = NULL;
+    size_t text_size = 0;
+    uint32_t position;
+    int arg_count = 0, result = IMAN_FALSE;
+    uint8_t status = IMAN_QUERY_STATUS_UNAVAILABLE;
+    FILE *output;
+    
+    if (length < 1 || (length > 1 && request[length - 1] != '\0'))
+        return IMAN_FALSE;
+    
+    arguments = malloc(length);
+    
+    if (arguments == NULL)
+        return IMAN_FALSE;
+    
+    memcpy(arguments, request + 1, length - 1);
+    
+    for (position = 0; position < length - 1; position += (uint32_t)strlen(&arguments[position]) + 1) {
+        if (arg_count == IMAN_PROTOCOL_MAX_ARGUMENTS)
+            goto done;
+        
+        args[arg_count++] = &arguments[position];
+    }
+    
+    output = open_memstream(&text, &text_size);
+    
+    if (output == NULL)
+        goto done;
+    
+    /* The first two arguments name the reference the client wants, it answers for itself when that isn't this one */
+    if (arg_count >= 2 && strcmp(args[0], context->reference_dir) == 0 && strcmp(args[1], context->architecture) == 0)
+        status = iman_server_run_query(output, context, (uint8_t)request[0], &args[2], arg_count - 2);
+    
+    if (fclose(output) != 0)
+        goto done;
+    
+    result = iman_buffer_append_uint32(&client->output, (uint32_t)text_size + 1) == IMAN_TRUE &&
+        iman_buffer_append(&client->output, &status, 1) == IMAN_TRUE &&
+        iman_buffer_append(&client->output, text, text_size) == IMAN_TRUE ? IMAN_TRUE : IMAN_FALSE;
+
+done:
+    free(text);
+    free(arguments);
+    return result;
+}
+
+static uint8_t iman_server_run_query(FILE *output, struct iman_query_context *context, uint8_t type, char **args, int arg_count) {
+    struct iman_facet_filter filters[IMAN_MAX_FACET_FILTERS];
+    char *names[IMAN_PROTOCOL_MAX_ARGUMENTS];
+    int filter_count = 0, name_count = 0, result = IMAN_TRUE, x;
+    
+    for (x = 0; x < arg_count; ++x) {
+        switch (type) {
+            case IMAN_QUERY_DOCUMENT:
+                result &= iman_query_document(output, context, args[x]);
+                break;
+            
+            case IMAN_QUERY_COMPLETE:
+                result &= iman_query_complete(output, context, args[x]);
+                break;
+            
+            case IMAN_QUERY_SEARCH:
+                result &= iman_query_search(output, context, args[x]);
+                break;
+            
+            case IMAN_QUERY_FACETS:
+                /* Each argument leads with its facet kind, or a marker for an instruction name */
+                if (args[x][0] == '\0') {
+                    return IMAN_QUERY_STATUS_FAILED;
+                } else if ((unsigned char)args[x][0] == IMAN_QUERY_FACET_NAME) {
+                    names[name_count++] = &args[x][1];
+                } else if (filter_count < IMAN_MAX_FACET_FILTERS) {
+                    filters[filter_count].kind = (unsigned char)args[x][0];
+                    filters[filter_count].values = &args[x][1];
+                    filter_count++;
+                } else {
+                    return IMAN_QUERY_STATUS_FAILED;
+                }
+                
+                break;
+            
+            default:
+                return IMAN_QUERY_STATUS_UNAVAILABLE;
+        }
+    }
+    
+    if (type == IMAN_QUERY_FACETS)
+        result = iman_query_facets(output, context, filters, filter_count, names, name_count);
+    
+    return result == IMAN_TRUE ? IMAN_QUERY_STATUS_OK : IMAN_QUERY_STATUS_FAILED;
+}
+
+static void iman_server_close_client(struct iman_server_client *client) {
+    close(client->fd);
+    free(client->input.data);
+    free(client->output.data);
+    memset(client, 0, sizeof(*client));
+}
+
+static void iman_server_stop(int signal_number) {
+    IMAN_UNUSED(signal_number);
+    
+    iman_server_stopping = 1;
+}
+
+static int iman_client_build_request(const struct iman_options *options, struct iman_server_buffer *request) {
+    char *canonical_dir;
+    const char *ref_dir;
+    uint8_t type;
+    int result, x;
+    
+    switch (options->mode) {
+        case IMAN_OUTPUT_MODE_DOC:
+            type = IMAN_QUERY_DOCUMENT;
+            break;
+        
+        case IMAN_OUTPUT_MODE_COMPLETE:
+            type = IMAN_QUERY_COMPLETE;
+            break;
+        
+        case IMAN_OUTPUT_MODE_SEARCH:
+            type = IMAN_QUERY_SEARCH;
+            break;
+        
+        case IMAN_OUTPUT_MODE_FACETS:
+            type = IMAN_QUERY_FACETS;
+            break;
+        
+        default:
+            return IMAN_FALSE;
+    }
+    
+    /* Relative paths, symlinks and trailing slashes would all miss the server's own spelling of the directory */
+    canonical_dir = realpath(options->reference_dir, NULL);
+    ref_dir = canonical_dir != NULL ? canonical_dir : options->reference_dir;
+    
+    /* The length is filled in once the body is complete */
+    result = iman_buffer_append_uint32(request, 0) == IMAN_TRUE && iman_buffer_append(request, &type, 1) == IMAN_TRUE &&
+        iman_buffer_append(request, ref_dir, strlen(ref_dir) + 1) == IMAN_TRUE &&
+        iman_buffer_append(request, options->architecture, strlen(options->architecture) + 1) == IMAN_TRUE ? IMAN_TRUE : IMAN_FALSE;
+    
+    free(canonical_dir);
+    
+    if (result != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    for (x = 0; type == IMAN_QUERY_FACETS && x < options->facets.count; ++x) {
+        uint8_t kind = (uint8_t)options->facets.entries[x].kind;
+        
+        if (iman_buffer_append(request, &kind, 1) != IMAN_TRUE ||
+            iman_buffer_append(request, options->facets.entries[x].values, strlen(options->facets.entries[x].values) + 1) != IMAN_TRUE)
+            return IMAN_FALSE;
+    }
+    
+    for (x = 0; x < options->input_body.count; ++x) {
+        uint8_t kind = IMAN_QUERY_FACET_NAME;
+        
+        if (type == IMAN_QUERY_FACETS && iman_buffer_append(request, &kind, 1) != IMAN_TRUE)
+            return IMAN_FALSE;
+        
+        if (iman_buffer_append(request, options->input_body.args[x], strlen(options->input_body.args[x]) + 1) != IMAN_TRUE)
+            return IMAN_FALSE;
+    }
+    
+    if (request->length - IMAN_PROTOCOL_HEADER_SIZE > IMAN_PROTOCOL_MAX_REQUEST)
+        return IMAN_FALSE;
+    
+    request->data[0] = (char)((request->length - IMAN_PROTOCOL_HEADER_SIZE) & 0xFF);
+    request->data[1] = (char)((request->length - IMAN_PROTOCOL_HEADER_SIZE) >> 8 & 0xFF);
+    request->data[2] = (char)((request->length - IMAN_PROTOCOL_HEADER_SIZE) >> 16 & 0xFF);
+    request->data[3] = (char)((request->length - IMAN_PROTOCOL_HEADER_SIZE) >> 24 & 0xFF);
+    return IMAN_TRUE;
+}
+
+/* Nothing is printed until the whole reply is in, so a failure part way can still be answered locally */
+static int iman_client_exchange(const char *socket_path, const struct iman_server_buffer *request, struct iman_server_buffer *response) {
+    struct sockaddr_un address;
+    struct timeval timeout;
+    unsigned char header[IMAN_PROTOCOL_HEADER_SIZE];
+    size_t position;
+    uint32_t length;
+    int fd, result = IMAN_FALSE;
+    
+    if (strlen(socket_path) >= sizeof(address.sun_path))
+        return IMAN_FALSE;
+    
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+    
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    
+    if (fd < 0)
+        return IMAN_FALSE;
+    
+    memset(&timeout, 0, sizeof(timeout));
+    timeout.tv_sec = IMAN_CLIENT_TIMEOUT_SECONDS;
+    
+    /* The send timeout also bounds connect on a server whose backlog is full */
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0 || setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) != 0 ||
+        connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+        goto done;
+    
+    for (position = 0; position < request->length;) {
+        ssize_t written = write(fd, &request->data[position], request->length - position);
+        
+        if (written <= 0) {
+            if (written < 0 && errno == EINTR)
+                continue;
+            
+            goto done;
+        }
+        
+        position += (size_t)written;
+    }
+    
+    for (position = 0; position < sizeof(header);) {
+        ssize_t received = read(fd, &header[position], sizeof(header) - position);
+        
+        if (received <= 0) {
+            if (received < 0 && errno == EINTR)
+                continue;
+            
+            goto done;
+        }
+        
+        position += (size_t)received;
+    }
+    
+    length = iman_read_uint32(header);
+    response->data = malloc((size_t)length + 1);
+    response->size = (size_t)length + 1;
+    
+    if (response->data == NULL)
+        goto done;
+    
+    while (response->length < length) {
+        ssize_t received = read(fd, &response->data[response->length], length - response->length);
+        
+        if (received <= 0) {
+            if (received < 0 && errno == EINTR)
+                continue;
+            
+            goto done;
+        }
+        
+        response->length += (size_t)received;
+    }
+    
+    result = IMAN_TRUE;
+
+done:
+    close(fd);
+    return result;
+}
+
+static int iman_buffer_append(struct iman_server_buffer *buffer, const void *data, size_t length) {
+    if (buffer->length + length > buffer->size) {
+        size_t new_size = buffer->size ? buffer->size : IMAN_SERVER_READ_SIZE;
+        char *new_data;
+        
+        while (new_size < buffer->length + length) {
+            new_size *= 2;
+        }
+        
+        new_data = realloc(buffer->data, new_size);
+        
+        if (new_data == NULL)
+            return IMAN_FALSE;
+        
+        buffer->data = new_data;
+        buffer->size = new_size;
+    }
+    
+    if (length != 0)
+        memcpy(&buffer->data[buffer->length], data, length);
+    
+    buffer->length += length;
+    return IMAN_TRUE;
+}
+
+static int iman_buffer_append_uint32(struct iman_server_buffer *buffer, uint32_t value) {
+    unsigned char data[4];
+    
+    data[0] = (unsigned char)(value & 0xFF);
+    data[1] = (unsigned char)(value >> 8 & 0xFF);
+    data[2] = (unsigned char)(value >> 16 & 0xFF);
+    data[3] = (unsigned char)(value >> 24 & 0xFF);
+    
+    return iman_buffer_append(buffer, data, sizeof(data));
+}
+
+static uint32_t iman_read_uint32(const unsigned char *data) {
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static int iman_set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0 ? IMAN_TRUE : IMAN_FALSE;
+}
\ No newline at end of file
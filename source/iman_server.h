@@ -0,0 +1,13 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_SERVER_H
+#define _IMAN_SERVER_H
+
+int iman_serve(const char *socket_path, const char *ref_dir, const char *arch_name);
+
+int iman_client_query(const char *socket_path, const struct iman_options *options, int *presult);
+
+#endif
\ No newline at end of file
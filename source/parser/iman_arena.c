@@ -0,0 +1,144 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "../iman.h"
+#include <stddef.h>
+#include "iman_arena.h"
+
+#define IMAN_ARENA_CHUNK_SIZE 65536
+#define IMAN_ARENA_ALIGNMENT 16
+
+struct iman_arena_chunk {
+    struct iman_arena_chunk *next;
+    
+    size_t size;
+    size_t used;
+    
+    /* Keeps data aligned for anything placed at the start of it */
+    union {
+        long double ld;
+        void *p;
+        uint64_t u;
+    } align;
+};
+
+static unsigned char *iman_arena_chunk_data(struct iman_arena_chunk *chunk);
+static struct iman_arena_chunk *iman_arena_next_chunk(struct iman_arena *arena, size_t size);
+
+void iman_arena_initialise(struct iman_arena *arena) {
+    memset(arena, 0, sizeof(*arena));
+}
+
+void *iman_arena_alloc(struct iman_arena *arena, size_t size) {
+    struct iman_arena_chunk *chunk = arena->current;
+    size_t aligned = (size + IMAN_ARENA_ALIGNMENT - 1) & ~(size_t)(IMAN_ARENA_ALIGNMENT - 1);
+    
+    if (aligned < size)
+        return NULL;
+    
+    if (chunk == NULL || chunk->size - chunk->used < aligned) {
+        chunk = iman_arena_next_chunk(arena, aligned);
+        
+        if (chunk == NULL)
+            return NULL;
+    }
+    
+    arena->last = iman_arena_chunk_data(chunk) + chunk->used;
+    chunk->used += aligned;
+    
+    return arena->last;
+}
+
+void *iman_arena_grow(struct iman_arena *arena, void *data, size_t old_size, size_t new_size) {
+    struct iman_arena_chunk *chunk = arena->current;
+    void *new_data;
+    
+    if (data != NULL && data == arena->last) {
+        size_t start = (size_t)((unsigned char *)data - iman_arena_chunk_data(chunk));
+        size_t aligned = (new_size + IMAN_ARENA_ALIGNMENT - 1) & ~(size_t)(IMAN_ARENA_ALIGNMENT - 1);
+        
+        /* Growing the newest allocation is just a matter of bumping further */
+        if (aligned >= new_size && chunk->size - start >= aligned) {
+            chunk->used = start + aligned;
+            return data;
+        }
+    }
+    
+    new_data = iman_arena_alloc(arena, new_size);
+    
+    if (new_data != NULL && data != NULL)
+        memcpy(new_data, data, old_size < new_size ? old_size : new_size);
+    
+    return new_data;
+}
+
+char *iman_arena_strndup(struct iman_arena *arena, const char *text, size_t length) {
+    char *copy = iman_arena_alloc(arena, length + 1);
+    
+    if (copy == NULL)
+        return NULL;
+    
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    
+    return copy;
+}
+
+void iman_arena_reset(struct iman_arena *arena) {
+    arena->current = arena->head;
+    arena->last = NULL;
+    
+    if (arena->current != NULL)
+        arena->current->used = 0;
+}
+
+void iman_arena_release(struct iman_arena *arena) {
+    struct iman_arena_chunk *chunk = arena->head;
+    
+    while (chunk != NULL) {
+        struct iman_arena_chunk *next = chunk->next;
+        
+        free(chunk);
+        chunk = next;
+    }
+    
+    memset(arena, 0, sizeof(*arena));
+}
+
+static unsigned char *iman_arena_chunk_data(struct iman_arena_chunk *chunk) {
+    return (unsigned char *)&chunk->align;
+}
+
+static struct iman_arena_chunk *iman_arena_next_chunk(struct iman_arena *arena, size_t size) {
+    struct iman_arena_chunk *chunk = arena->current != NULL ? arena->current->next : arena->head;
+    size_t chunk_size = size > IMAN_ARENA_CHUNK_SIZE ? size : IMAN_ARENA_CHUNK_SIZE;
+    
+    /* Reuse whatever the last reset left behind, if it's big enough */
+    if (chunk != NULL && chunk->size >= size) {
+        chunk->used = 0;
+        arena->current = chunk;
+        return chunk;
+    }
+    
+    chunk = malloc(offsetof(struct iman_arena_chunk, align) + chunk_size);
+    
+    if (chunk == NULL)
+        return NULL;
+    
+    chunk->size = chunk_size;
+    chunk->used = 0;
+    
+    /* Oversized requests slot in after the current chunk, ahead of any smaller spare ones */
+    if (arena->current != NULL) {
+        chunk->next = arena->current->next;
+        arena->current->next = chunk;
+    } else {
+        chunk->next = arena->head;
+        arena->head = chunk;
+    }
+    
+    arena->current = chunk;
+    return chunk;
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_ARENA_H
+#define _IMAN_ARENA_H
+
+struct iman_arena_chunk;
+
+/* Bump allocator: chunks are kept across resets, so a warmed up arena stops calling malloc */
+struct iman_arena {
+    struct iman_arena_chunk *head;
+    struct iman_arena_chunk *current;
+    
+    /* The most recent allocation, which is the only one that can grow in place */
+    void *last;
+};
+
+void iman_arena_initialise(struct iman_arena *arena);
+
+void *iman_arena_alloc(struct iman_arena *arena, size_t size);
+
+void *iman_arena_grow(struct iman_arena *arena, void *data, size_t old_size, size_t new_size);
+
+char *iman_arena_strndup(struct iman_arena *arena, const char *text, size_t length);
+
+void iman_arena_reset(struct iman_arena *arena);
+
+void iman_arena_release(struct iman_arena *arena);
+
+#endif
\ No newline at end of file
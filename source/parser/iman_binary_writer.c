@@ -39,4 +39,30 @@ void iman_binary_writer_put_uint32(struct iman_binary_writer *writer, uint32_t v
     buffer[3] = value >> 24;
     
     writer->position += sizeof(uint32_t);
+}
+
+void iman_binary_writer_put_uint16(struct iman_binary_writer *writer, uint16_t value) {
+    char *buffer = &writer->buffer[writer->position];
+    
+    buffer[0] = value >> 0;
+    buffer[1] = value >> 8;
+    
+    writer->position += sizeof(uint16_t);
+}
+
+void iman_binary_writer_put_uint8(struct iman_binary_writer *writer, uint8_t value) {
+    writer->buffer[writer->position++] = (char)value;
+}
+
+void iman_binary_writer_put_bytes(struct iman_binary_writer *writer, const void *data, size_t length) {
+    memcpy(&writer->buffer[writer->position], data, length);
+    writer->position += length;
+}
+
+/* Zero fills up to the next multiple of alignment, which has to be a power of two */
+void iman_binary_writer_pad(struct iman_binary_writer *writer, size_t alignment) {
+    size_t padded = (writer->position + alignment - 1) & ~(alignment - 1);
+    
+    memset(&writer->buffer[writer->position], 0, padded - writer->position);
+    writer->position = padded;
 }
\ No newline at end of file
@@ -21,4 +21,12 @@ void iman_binary_writer_put_fixed_string(struct iman_binary_writer *writer, cons
 
 void iman_binary_writer_put_uint32(struct iman_binary_writer *writer, uint32_t value);
 
+void iman_binary_writer_put_uint16(struct iman_binary_writer *writer, uint16_t value);
+
+void iman_binary_writer_put_uint8(struct iman_binary_writer *writer, uint8_t value);
+
+void iman_binary_writer_put_bytes(struct iman_binary_writer *writer, const void *data, size_t length);
+
+void iman_binary_writer_pad(struct iman_binary_writer *writer, size_t alignment);
+
 #endif
\ No newline at end of file
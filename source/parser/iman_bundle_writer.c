@@ -0,0 +1,265 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "../iman.h"
+#include "../iman_mapping.h"
+#include "iman_diagnostics.h"
+#include "iman_binary_writer.h"
+#include "iman_output.h"
+#include "iman_bundle_writer.h"
+#include <dirent.h>
+#include <unistd.h>
+
+#define IMAN_MAX_PATH 1024
+#define IMAN_BUNDLE_TEMP_EXT ".tmp"
+#define IMAN_BUNDLE_KINDS 3
+
+struct iman_bundle_file {
+    char architecture[IMAN_BUNDLE_MAX_ARCHITECTURE];
+    uint32_t kind;
+    
+    struct iman_mapping mapping;
+};
+
+struct iman_bundle_files {
+    struct iman_bundle_file *files;
+    unsigned int count;
+    unsigned int capacity;
+};
+
+static int iman_bundle_find_architectures(const char *target_dir, char **pnames, unsigned int *pcount);
+static int iman_bundle_add_architecture(struct iman_bundle_files *files, const char *target_dir, const char *arch_name);
+static int iman_bundle_write_files(struct iman_output *output, const struct iman_bundle_files *files);
+static void iman_bundle_close_files(struct iman_bundle_files *files);
+static int compare_names(const void *left, const void *right);
+
+static const char * const iman_bundle_extensions[IMAN_BUNDLE_KINDS] = { IMAN_REF_INDEX_EXT, IMAN_REF_TABLE_EXT, IMAN_REF_SEARCH_EXT };
+static const uint32_t iman_bundle_kinds[IMAN_BUNDLE_KINDS] = { IMAN_BUNDLE_KIND_INDEX, IMAN_BUNDLE_KIND_TABLE, IMAN_BUNDLE_KIND_SEARCH };
+
+/*
+ * Rewrites the bundle in target_dir from every architecture built there so far, so building each
+ * architecture in turn with --bundle leaves one file holding all of them.
+ */
+int iman_bundle_write(const char *target_dir) {
+    struct iman_bundle_files files;
+    struct iman_output output;
+    char path_buffer[IMAN_MAX_PATH], temp_path[IMAN_MAX_PATH + sizeof(IMAN_BUNDLE_TEMP_EXT)];
+    char *names = NULL;
+    unsigned int name_count = 0, x;
+    int result = IMAN_TRUE;
+    
+    memset(&files, 0, sizeof(files));
+    
+    if (iman_bundle_find_architectures(target_dir, &names, &name_count) != IMAN_TRUE) {
+        IMAN_ERROR("Error: unable to list the built architectures in %s\n", target_dir);
+        return IMAN_FALSE;
+    }
+    
+    for (x = 0; x < name_count && result == IMAN_TRUE; ++x) {
+        result = iman_bundle_add_architecture(&files, target_dir, &names[(size_t)x * IMAN_BUNDLE_MAX_ARCHITECTURE]);
+    }
+    
+    free(names);
+    
+    if (result != IMAN_TRUE) {
+        iman_bundle_close_files(&files);
+        return IMAN_FALSE;
+    }
+    
+    if (snprintf(path_buffer, IMAN_MAX_PATH, "%s/" IMAN_REF_BUNDLE_FILE, target_dir) >= IMAN_MAX_PATH ||
+        snprintf(temp_path, sizeof(temp_path), "%s" IMAN_BUNDLE_TEMP_EXT, path_buffer) >= (int)sizeof(temp_path) ||
+        iman_output_open(&output, temp_path) != IMAN_TRUE) {
+        IMAN_ERROR("Error: unable to open the reference bundle in %s\n", target_dir);
+        iman_bundle_close_files(&files);
+        return IMAN_FALSE;
+    }
+    
+    result = iman_bundle_write_files(&output, &files);
+    
+    if (iman_output_close(&output) != IMAN_TRUE)
+        result = IMAN_FALSE;
+    
+    if (result != IMAN_TRUE || rename(temp_path, path_buffer) != 0) {
+        IMAN_ERROR("Error: unable to write the reference bundle %s\n", path_buffer);
+        unlink(temp_path);
+        result = IMAN_FALSE;
+    } else {
+        IMAN_INFO("Info: reference bundle %s holds %u architecture(s)\n", path_buffer, name_count);
+    }
+    
+    iman_bundle_close_files(&files);
+    return result;
+}
+
+int iman_bundle_exists(const char *target_dir) {
+    char path_buffer[IMAN_MAX_PATH];
+    
+    if (snprintf(path_buffer, IMAN_MAX_PATH, "%s/" IMAN_REF_BUNDLE_FILE, target_dir) >= IMAN_MAX_PATH)
+        return IMAN_FALSE;
+    
+    return access(path_buffer, F_OK) == 0 ? IMAN_TRUE : IMAN_FALSE;
+}
+
+/* Every <arch>.index in the directory, as sorted fixed width names so the bundle comes out the same each time */
+static int iman_bundle_find_architectures(const char *target_dir, char **pnames, unsigned int *pcount) {
+    const size_t extension_length = strlen(IMAN_REF_INDEX_EXT);
+    unsigned int count = 0, capacity = 0;
+    char *names = NULL;
+    struct dirent *item;
+    DIR *directory = opendir(target_dir);
+    
+    if (directory == NULL)
+        return IMAN_FALSE;
+    
+    while ((item = readdir(directory)) != NULL) {
+        size_t length = strlen(item->d_name);
+        
+        if (length <= extension_length || strcmp(&item->d_name[length - extension_length], IMAN_REF_INDEX_EXT) != 0)
+            continue;
+        
+        length -= extension_length;
+        
+        if (length >= IMAN_BUNDLE_MAX_ARCHITECTURE) {
+            IMAN_INFO("Info: leaving %s out of the bundle, the architecture name is too long\n", item->d_name);
+            continue;
+        }
+        
+        if (count >= capacity) {
+            unsigned int new_capacity = capacity ? capacity * 2 : 8;
+            char *new_names = realloc(names, (size_t)new_capacity * IMAN_BUNDLE_MAX_ARCHITECTURE);
+            
+            if (new_names == NULL) {
+                free(names);
+                closedir(directory);
+                return IMAN_FALSE;
+            }
+            
+            names = new_names;
+            capacity = new_capacity;
+        }
+        
+        memset(&names[(size_t)count * IMAN_BUNDLE_MAX_ARCHITECTURE], 0, IMAN_BUNDLE_MAX_ARCHITECTURE);
+        memcpy(&names[(size_t)count * IMAN_BUNDLE_MAX_ARCHITECTURE], item->d_name, length);
+        ++count;
+    }
+    
+    closedir(directory);
+    
+    if (count > 1)
+        qsort(names, count, IMAN_BUNDLE_MAX_ARCHITECTURE, compare_names);
+    
+    *pnames = names;
+    *pcount = count;
+    return IMAN_TRUE;
+}
+
+/* The index and table have to be there, an architecture without a search file just can't be searched */
+static int iman_bundle_add_architecture(struct iman_bundle_files *files, const char *target_dir, const char *arch_name) {
+    char path_buffer[IMAN_MAX_PATH];
+    unsigned int x;
+    
+    for (x = 0; x < IMAN_BUNDLE_KINDS; ++x) {
+        struct iman_bundle_file *file;
+        
+        if (files->count >= files->capacity) {
+            unsigned int new_capacity = files->capacity ? files->capacity * 2 : 8;
+            struct iman_bundle_file *new_files = realloc(files->files, new_capacity * sizeof(*new_files));
+            
+            if (new_files == NULL) {
+                IMAN_ERROR("Error: out of memory while collecting the bundle\n");
+                return IMAN_FALSE;
+            }
+            
+            files->files = new_files;
+            files->capacity = new_capacity;
+        }
+        
+        file = &files->files[files->count];
+        memcpy(file->architecture, arch_name, IMAN_BUNDLE_MAX_ARCHITECTURE);
+        file->kind = iman_bundle_kinds[x];
+        
+        if (snprintf(path_buffer, IMAN_MAX_PATH, "%s/%s%s", target_dir, arch_name, iman_bundle_extensions[x]) >= IMAN_MAX_PATH ||
+            iman_mapping_open(&file->mapping, path_buffer, IMAN_MAPPING_ACCESS_SEQUENTIAL) != IMAN_TRUE) {
+            if (file->kind == IMAN_BUNDLE_KIND_SEARCH)
+                continue;
+            
+            IMAN_ERROR("Error: unable to read back %s to bundle it\n", path_buffer);
+            return IMAN_FALSE;
+        }
+        
+        files->count++;
+    }
+    
+    return IMAN_TRUE;
+}
+
+static int iman_bundle_write_files(struct iman_output *output, const struct iman_bundle_files *files) {
+    static const char padding[IMAN_BUNDLE_ALIGNMENT];
+    struct iman_binary_writer writer;
+    size_t header_size = IMAN_INDEX_HEADER_SIZE + (size_t)files->count * IMAN_BUNDLE_ENTRY_SIZE;
+    uint64_t offset = (header_size + IMAN_BUNDLE_ALIGNMENT - 1) & ~(uint64_t)(IMAN_BUNDLE_ALIGNMENT - 1);
+    char *header = malloc(header_size);
+    unsigned int x;
+    int result;
+    
+    if (header == NULL)
+        return IMAN_FALSE;
+    
+    iman_binary_writer_initialise(&writer, header, header_size);
+    iman_binary_writer_put_uint32(&writer, IMAN_BUNDLE_MAGIC);
+    iman_binary_writer_put_uint32(&writer, IMAN_INDEX_VERSION);
+    iman_binary_writer_put_uint32(&writer, files->count);
+    iman_binary_writer_put_uint32(&writer, 0);
+    
+    for (x = 0; x < files->count; ++x) {
+        const struct iman_bundle_file *file = &files->files[x];
+        
+        if (offset + file->mapping.size > UINT32_MAX) {
+            IMAN_ERROR("Error: the reference bundle would be larger than 4GB\n");
+            free(header);
+            return IMAN_FALSE;
+        }
+        
+        iman_binary_writer_put_fixed_string(&writer, file->architecture, IMAN_BUNDLE_MAX_ARCHITECTURE);
+        iman_binary_writer_put_uint32(&writer, file->kind);
+        iman_binary_writer_put_uint32(&writer, (uint32_t)offset);
+        iman_binary_writer_put_uint32(&writer, (uint32_t)file->mapping.size);
+        iman_binary_writer_put_uint32(&writer, 0);
+        
+        offset = (offset + file->mapping.size + IMAN_BUNDLE_ALIGNMENT - 1) & ~(uint64_t)(IMAN_BUNDLE_ALIGNMENT - 1);
+    }
+    
+    result = iman_output_write(output, header, header_size);
+    free(header);
+    
+    /* Every file starts on a page, padding out whatever came before it */
+    for (x = 0; x < files->count && result == IMAN_TRUE; ++x) {
+        const struct iman_bundle_file *file = &files->files[x];
+        size_t gap = (size_t)(IMAN_BUNDLE_ALIGNMENT - output->offset % IMAN_BUNDLE_ALIGNMENT) % IMAN_BUNDLE_ALIGNMENT;
+        
+        if (gap != 0)
+            result = iman_output_write(output, padding, gap);
+        
+        if (result == IMAN_TRUE && file->mapping.size != 0)
+            result = iman_output_write(output, file->mapping.data, file->mapping.size);
+    }
+    
+    return result;
+}
+
+static void iman_bundle_close_files(struct iman_bundle_files *files) {
+    unsigned int x;
+    
+    for (x = 0; x < files->count; ++x) {
+        iman_mapping_close(&files->files[x].mapping);
+    }
+    
+    free(files->files);
+    memset(files, 0, sizeof(*files));
+}
+
+static int compare_names(const void *left, const void *right) {
+    return strncmp(left, right, IMAN_BUNDLE_MAX_ARCHITECTURE);
+}
\ No newline at end of file
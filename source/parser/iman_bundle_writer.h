@@ -0,0 +1,13 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_BUNDLE_WRITER_H
+#define _IMAN_BUNDLE_WRITER_H
+
+int iman_bundle_write(const char *target_dir);
+
+int iman_bundle_exists(const char *target_dir);
+
+#endif
\ No newline at end of file
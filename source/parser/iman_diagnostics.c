@@ -0,0 +1,34 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "../iman.h"
+#include "iman_diagnostics.h"
+#include <stdarg.h>
+
+#define IMAN_DIAGNOSTIC_BUFFER_SIZE 65536
+
+enum iman_diagnostic_level iman_diagnostic_level = IMAN_DIAGNOSTIC_INFO;
+
+static char iman_diagnostic_buffer[IMAN_DIAGNOSTIC_BUFFER_SIZE];
+
+void iman_diagnostic_initialise(enum iman_diagnostic_level level) {
+    iman_diagnostic_level = level;
+    
+    /* stderr is unbuffered by default, which turns every trace line into a write */
+    setvbuf(stderr, iman_diagnostic_buffer, _IOFBF, sizeof(iman_diagnostic_buffer));
+}
+
+/* A single stdio call per message, stdio's own stream lock keeps worker threads from interleaving */
+void iman_diagnostic_print(const char *format, ...) {
+    va_list arguments;
+    
+    va_start(arguments, format);
+    vfprintf(stderr, format, arguments);
+    va_end(arguments);
+}
+
+void iman_diagnostic_flush(void) {
+    fflush(stderr);
+}
\ No newline at end of file
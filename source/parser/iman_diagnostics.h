@@ -0,0 +1,43 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_DIAGNOSTICS_H
+#define _IMAN_DIAGNOSTICS_H
+
+enum iman_diagnostic_level {
+    /* Errors only */
+    IMAN_DIAGNOSTIC_QUIET = 0,
+    
+    /* Plus warnings and a line per build phase */
+    IMAN_DIAGNOSTIC_INFO,
+    
+    /* Plus every block, term, field and line the parser reads */
+    IMAN_DIAGNOSTIC_TRACE
+};
+
+extern enum iman_diagnostic_level iman_diagnostic_level;
+
+/* The level is checked before any argument is evaluated, so a disabled trace line costs one compare */
+#define IMAN_ERROR(...) iman_diagnostic_print(__VA_ARGS__)
+
+#define IMAN_INFO(...) \
+    do { if (iman_diagnostic_level >= IMAN_DIAGNOSTIC_INFO) iman_diagnostic_print(__VA_ARGS__); } while (0)
+
+#define IMAN_TRACE(...) \
+    do { if (iman_diagnostic_level >= IMAN_DIAGNOSTIC_TRACE) iman_diagnostic_print(__VA_ARGS__); } while (0)
+
+#ifdef __GNUC__
+#define IMAN_DIAGNOSTIC_FORMAT __attribute__((format(printf, 1, 2)))
+#else
+#define IMAN_DIAGNOSTIC_FORMAT
+#endif
+
+void iman_diagnostic_initialise(enum iman_diagnostic_level level);
+
+void iman_diagnostic_print(const char *format, ...) IMAN_DIAGNOSTIC_FORMAT;
+
+void iman_diagnostic_flush(void);
+
+#endif
\ No newline at end of file
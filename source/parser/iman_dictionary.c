@@ -0,0 +1,148 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "../iman.h"
+#include "iman_diagnostics.h"
+#include "iman_dictionary.h"
+
+/* Segments are scored by the corpus frequency of the d-byte strings they contain */
+#define IMAN_DICTIONARY_DMER_SIZE 8
+#define IMAN_DICTIONARY_SEGMENT_SIZE 64
+#define IMAN_DICTIONARY_HASH_BITS 20
+#define IMAN_DICTIONARY_DMER_COUNT (IMAN_DICTIONARY_SEGMENT_SIZE - IMAN_DICTIONARY_DMER_SIZE + 1)
+
+struct iman_dictionary_segment {
+    size_t offset;
+    uint32_t score;
+};
+
+static uint32_t iman_dictionary_hash_dmer(const char *data);
+static uint32_t iman_dictionary_score(const char *data, const uint32_t *frequencies);
+static uint32_t iman_dictionary_weight(const char *data, const uint32_t *frequencies);
+static int iman_dictionary_compare_segments(const void *left, const void *right);
+
+int iman_dictionary_train(const char *corpus, size_t corpus_size, char *dictionary, uint32_t capacity, uint32_t *psize) {
+    struct iman_dictionary_segment *segments;
+    uint32_t *frequencies;
+    size_t position, epoch_size, epoch_count, epoch;
+    uint32_t segment_count = 0, size = 0, x;
+    
+    *psize = 0;
+    
+    if (corpus_size < IMAN_DICTIONARY_SEGMENT_SIZE || capacity < IMAN_DICTIONARY_SEGMENT_SIZE)
+        return IMAN_TRUE;
+    
+    epoch_count = capacity / IMAN_DICTIONARY_SEGMENT_SIZE;
+    epoch_size = corpus_size / epoch_count;
+    
+    /* A corpus smaller than the dictionary is its own best dictionary */
+    if (epoch_size < IMAN_DICTIONARY_SEGMENT_SIZE) {
+        size = corpus_size < capacity ? (uint32_t)corpus_size : capacity;
+        memcpy(dictionary, corpus + corpus_size - size, size);
+        *psize = size;
+        return IMAN_TRUE;
+    }
+    
+    frequencies = calloc((size_t)1 << IMAN_DICTIONARY_HASH_BITS, sizeof(uint32_t));
+    segments = calloc(epoch_count, sizeof(*segments));
+    
+    if (frequencies == NULL || segments == NULL) {
+        IMAN_ERROR("Error: out of memory while training the table dictionary\n");
+        free(frequencies);
+        free(segments);
+        return IMAN_FALSE;
+    }
+    
+    for (position = 0; position + IMAN_DICTIONARY_DMER_SIZE <= corpus_size; ++position) {
+        frequencies[iman_dictionary_hash_dmer(&corpus[position])]++;
+    }
+    
+    /* Pick the best segment of each epoch, then zero its d-mers so they aren't picked again */
+    for (epoch = 0; epoch < epoch_count; ++epoch) {
+        size_t start = epoch * epoch_size, end = start + epoch_size, best_offset = start;
+        uint32_t best_score = 0, score;
+        
+        if (end + IMAN_DICTIONARY_SEGMENT_SIZE > corpus_size)
+            end = corpus_size - IMAN_DICTIONARY_SEGMENT_SIZE;
+        
+        if (start >= end)
+            continue;
+        
+        score = iman_dictionary_score(&corpus[start], frequencies);
+        
+        /* Frequencies only change between epochs, so sliding the window just swaps the d-mer leaving for the one entering */
+        for (position = start; position < end; ++position) {
+            if (position != start) {
+                score -= iman_dictionary_weight(&corpus[position - 1], frequencies);
+                score += iman_dictionary_weight(&corpus[position + IMAN_DICTIONARY_DMER_COUNT - 1], frequencies);
+            }
+            
+            if (score > best_score) {
+                best_score = score;
+                best_offset = position;
+            }
+        }
+        
+        if (best_score == 0)
+            continue;
+        
+        for (x = 0; x < IMAN_DICTIONARY_DMER_COUNT; ++x) {
+            frequencies[iman_dictionary_hash_dmer(&corpus[best_offset + x])] = 0;
+        }
+        
+        segments[segment_count].offset = best_offset;
+        segments[segment_count].score = best_score;
+        segment_count++;
+    }
+    
+    qsort(segments, segment_count, sizeof(*segments), &iman_dictionary_compare_segments);
+    
+    for (x = 0; x < segment_count && size + IMAN_DICTIONARY_SEGMENT_SIZE <= capacity; ++x) {
+        memcpy(&dictionary[size], &corpus[segments[x].offset], IMAN_DICTIONARY_SEGMENT_SIZE);
+        size += IMAN_DICTIONARY_SEGMENT_SIZE;
+    }
+    
+    free(frequencies);
+    free(segments);
+    
+    *psize = size;
+    return IMAN_TRUE;
+}
+
+static uint32_t iman_dictionary_hash_dmer(const char *data) {
+    uint64_t value = 0;
+    
+    memcpy(&value, data, IMAN_DICTIONARY_DMER_SIZE);
+    
+    return (uint32_t)((value * 0x9E3779B97F4A7C15ULL) >> (64 - IMAN_DICTIONARY_HASH_BITS));
+}
+
+static uint32_t iman_dictionary_score(const char *data, const uint32_t *frequencies) {
+    uint32_t score = 0, x;
+    
+    for (x = 0; x < IMAN_DICTIONARY_DMER_COUNT; ++x) {
+        score += iman_dictionary_weight(&data[x], frequencies);
+    }
+    
+    return score;
+}
+
+/* Frequencies of one are unique text, worthless in a dictionary */
+static uint32_t iman_dictionary_weight(const char *data, const uint32_t *frequencies) {
+    uint32_t frequency = frequencies[iman_dictionary_hash_dmer(data)];
+    
+    return frequency > 1 ? frequency - 1 : 0;
+}
+
+/* Ascending score, so the strongest segments are appended last */
+static int iman_dictionary_compare_segments(const void *left, const void *right) {
+    const struct iman_dictionary_segment *a = left;
+    const struct iman_dictionary_segment *b = right;
+    
+    if (a->score != b->score)
+        return a->score < b->score ? -1 : 1;
+    
+    return a->offset < b->offset ? -1 : (a->offset > b->offset ? 1 : 0);
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_DICTIONARY_H
+#define _IMAN_DICTIONARY_H
+
+/* 
+ * Builds a deflate preset dictionary out of the most frequently repeated segments of a corpus.
+ * The most valuable segments end up at the end of the dictionary, closest to the compressed data.
+ */
+int iman_dictionary_train(const char *corpus, size_t corpus_size, char *dictionary, uint32_t capacity, uint32_t *psize);
+
+#endif
\ No newline at end of file
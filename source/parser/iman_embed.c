@@ -0,0 +1,145 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "../iman.h"
+#include "../iman_mapping.h"
+#include "iman_diagnostics.h"
+#include "iman_output.h"
+#include "iman_embed.h"
+#include <stdarg.h>
+#include <unistd.h>
+
+#define IMAN_MAX_PATH 1024
+#define IMAN_EMBED_TEMP_EXT ".tmp"
+#define IMAN_EMBED_MAX_IDENTIFIER 64
+#define IMAN_EMBED_LINE_BYTES 16
+
+/* Room for one line of array bytes, "0x00, " each plus the indent and newline */
+#define IMAN_EMBED_MAX_LINE (IMAN_EMBED_LINE_BYTES * 6 + 8)
+
+static int iman_embed_write_array(struct iman_output *output, const char *identifier, const char *suffix, const struct iman_mapping *file);
+static int iman_embed_printf(struct iman_output *output, const char *format, ...);
+
+static const char * const iman_embed_extensions[] = { IMAN_REF_INDEX_EXT, IMAN_REF_TABLE_EXT, IMAN_REF_SEARCH_EXT };
+static const char * const iman_embed_suffixes[] = { "index", "table", "search" };
+
+/*
+ * Writes a C source holding the freshly built index, table and search files of one architecture as
+ * const arrays, so the iman binary can be linked with its reference and never look for the files.
+ */
+int iman_embed_write(const char *source_path, const char *target_dir, const char *arch_name) {
+    struct iman_mapping files[3];
+    struct iman_output output;
+    char path_buffer[IMAN_MAX_PATH], temp_path[IMAN_MAX_PATH + sizeof(IMAN_EMBED_TEMP_EXT)];
+    char identifier[IMAN_EMBED_MAX_IDENTIFIER];
+    unsigned int x, y;
+    int result = IMAN_TRUE;
+    
+    /* The architecture name ends up in the array names */
+    for (x = 0; arch_name[x] != '\0' && x + 1 < IMAN_EMBED_MAX_IDENTIFIER; ++x) {
+        identifier[x] = isalnum((unsigned char)arch_name[x]) ? arch_name[x] : '_';
+    }
+    
+    identifier[x] = '\0';
+    
+    for (x = 0; x < 3; ++x) {
+        if (snprintf(path_buffer, IMAN_MAX_PATH, "%s/%s%s", target_dir, arch_name, iman_embed_extensions[x]) >= IMAN_MAX_PATH ||
+            iman_mapping_open(&files[x], path_buffer, IMAN_MAPPING_ACCESS_SEQUENTIAL) != IMAN_TRUE) {
+            IMAN_ERROR("Error: unable to read back %s to embed it\n", path_buffer);
+            
+            for (y = 0; y < x; ++y) {
+                iman_mapping_close(&files[y]);
+            }
+            
+            return IMAN_FALSE;
+        }
+    }
+    
+    if (snprintf(temp_path, sizeof(temp_path), "%s" IMAN_EMBED_TEMP_EXT, source_path) >= (int)sizeof(temp_path) ||
+        iman_output_open(&output, temp_path) != IMAN_TRUE) {
+        IMAN_ERROR("Error: unable to open embedded reference output file %s\n", source_path);
+        result = IMAN_FALSE;
+    } else {
+        result = iman_embed_printf(&output, "/* Generated by iman-parser from the %s reference, do not edit */\n\n"
+            "#include \"iman.h\"\n#include \"iman_mapping.h\"\n#include \"iman_embedded.h\"\n", arch_name);
+        
+        for (x = 0; x < 3 && result == IMAN_TRUE; ++x) {
+            result = iman_embed_write_array(&output, identifier, iman_embed_suffixes[x], &files[x]);
+        }
+        
+        if (result == IMAN_TRUE) {
+            result = iman_embed_printf(&output, "\nconst struct iman_embedded_reference iman_embedded_references[] = {\n"
+                "    { \"%s\", { iman_embedded_%s_index, %lu }, { iman_embedded_%s_table, %lu }, { iman_embedded_%s_search, %lu } }\n"
+                "};\n\nconst unsigned int iman_embedded_reference_count = 1;\n",
+                arch_name, identifier, (unsigned long)files[0].size, identifier, (unsigned long)files[1].size, identifier, (unsigned long)files[2].size);
+        }
+        
+        if (iman_output_close(&output) != IMAN_TRUE)
+            result = IMAN_FALSE;
+        
+        if (result != IMAN_TRUE || rename(temp_path, source_path) != 0) {
+            IMAN_ERROR("Error: unable to write the embedded reference %s\n", source_path);
+            unlink(temp_path);
+            result = IMAN_FALSE;
+        } else {
+            IMAN_INFO("Info: embedded reference is %s\n", source_path);
+        }
+    }
+    
+    for (x = 0; x < 3; ++x) {
+        iman_mapping_close(&files[x]);
+    }
+    
+    return result;
+}
+
+/* A trailing zero keeps the array legal when the file is empty, the recorded size leaves it out */
+static int iman_embed_write_array(struct iman_output *output, const char *identifier, const char *suffix, const struct iman_mapping *file) {
+    static const char digits[] = "0123456789abcdef";
+    size_t offset = 0;
+    
+    if (iman_embed_printf(output, "\nstatic const unsigned char iman_embedded_%s_%s[%lu] = {\n", identifier, suffix, (unsigned long)file->size + 1) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    while (offset < file->size) {
+        size_t end = offset + IMAN_EMBED_LINE_BYTES < file->size ? offset + IMAN_EMBED_LINE_BYTES : file->size;
+        char *line = iman_output_reserve(output, IMAN_EMBED_MAX_LINE);
+        size_t used = 4;
+        
+        if (line == NULL)
+            return IMAN_FALSE;
+        
+        memcpy(line, "    ", 4);
+        
+        for (; offset < end; ++offset) {
+            line[used++] = '0';
+            line[used++] = 'x';
+            line[used++] = digits[file->data[offset] >> 4];
+            line[used++] = digits[file->data[offset] & 0x0F];
+            line[used++] = ',';
+            line[used++] = ' ';
+        }
+        
+        line[used - 1] = '\n';
+        iman_output_commit(output, used);
+    }
+    
+    return iman_embed_printf(output, "    0x00\n};\n");
+}
+
+static int iman_embed_printf(struct iman_output *output, const char *format, ...) {
+    char buffer[IMAN_MAX_PATH];
+    va_list arguments;
+    int length;
+    
+    va_start(arguments, format);
+    length = vsnprintf(buffer, sizeof(buffer), format, arguments);
+    va_end(arguments);
+    
+    if (length < 0 || (size_t)length >= sizeof(buffer))
+        return IMAN_FALSE;
+    
+    return iman_output_write(output, buffer, (size_t)length);
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_EMBED_H
+#define _IMAN_EMBED_H
+
+int iman_embed_write(const char *source_path, const char *target_dir, const char *arch_name);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,262 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "../iman.h"
+#include "iman_diagnostics.h"
+#include "iman_binary_writer.h"
+#include "iman_facet.h"
+
+#define IMAN_FACET_BASE_PAIRS 1024
+
+/* One facet value held by one form, the key is the facet kind over its value */
+struct iman_facet_pair {
+    uint64_t key;
+    uint32_t form;
+};
+
+struct iman_facet_pairs {
+    struct iman_facet_pair *entries;
+    size_t count;
+    size_t size;
+};
+
+static int iman_facet_add_form(struct iman_facet_pairs *pairs, const unsigned char *record, uint32_t form);
+static int iman_facet_add_pair(struct iman_facet_pairs *pairs, uint32_t kind, uint32_t value, uint32_t form);
+static size_t iman_facet_bitmap_size(const struct iman_facet_pair *pairs, size_t count);
+static void iman_facet_put_bitmap(struct iman_binary_writer *binary_writer, const struct iman_facet_pair *pairs, size_t count, unsigned char *container);
+static size_t iman_facet_group_end(const struct iman_facet_pair *pairs, size_t begin, size_t count);
+static uint32_t iman_facet_read_uint32(const unsigned char *data);
+static uint16_t iman_facet_read_uint16(const unsigned char *data);
+static int iman_facet_compare(const void *left, const void *right);
+
+int iman_facet_index_build(struct iman_facet_index *index, const struct iman_facet_forms *forms, uint32_t block_count) {
+    struct iman_facet_pairs pairs;
+    struct iman_binary_writer binary_writer, key_writer;
+    unsigned char *container = NULL;
+    size_t begin, end, unique = 0;
+    uint32_t block, form = 0, x;
+    int result = IMAN_FALSE;
+    
+    memset(index, 0, sizeof(*index));
+    memset(&pairs, 0, sizeof(pairs));
+    
+    index->blocks_size = ((size_t)block_count + 1) * 4;
+    index->blocks = malloc(index->blocks_size);
+    
+    if (index->blocks == NULL)
+        goto done;
+    
+    iman_binary_writer_initialise(&binary_writer, index->blocks, index->blocks_size);
+    
+    /* Forms are numbered across every block in source order */
+    for (block = 0; block < block_count; ++block) {
+        const unsigned char *field = (const unsigned char *)forms[block].field;
+        uint32_t count = 0;
+        
+        iman_binary_writer_put_uint32(&binary_writer, form);
+        
+        if (field != NULL && forms[block].length >= IMAN_FORMS_HEADER_SIZE) {
+            count = iman_facet_read_uint32(field);
+            
+            if ((uint64_t)count * IMAN_FORM_RECORD_SIZE > forms[block].length - IMAN_FORMS_HEADER_SIZE)
+                count = 0;
+        }
+        
+        for (x = 0; x < count; ++x, ++form) {
+            if (iman_facet_add_form(&pairs, &field[IMAN_FORMS_HEADER_SIZE + (size_t)x * IMAN_FORM_RECORD_SIZE], form) != IMAN_TRUE)
+                goto done;
+        }
+    }
+    
+    iman_binary_writer_put_uint32(&binary_writer, form);
+    index->form_count = form;
+    
+    /* Sorted by facet then form, so each facet's forms arrive in increasing order */
+    qsort(pairs.entries, pairs.count, sizeof(*pairs.entries), &iman_facet_compare);
+    
+    for (begin = 0; begin < pairs.count; ++begin) {
+        if (unique == 0 || pairs.entries[begin].key != pairs.entries[unique - 1].key || pairs.entries[begin].form != pairs.entries[unique - 1].form)
+            pairs.entries[unique++] = pairs.entries[begin];
+    }
+    
+    pairs.count = unique;
+    
+    for (begin = 0; begin < pairs.count; begin = end) {
+        end = iman_facet_group_end(pairs.entries, begin, pairs.count);
+        index->bitmaps_size += iman_facet_bitmap_size(&pairs.entries[begin], end - begin);
+        index->key_count++;
+    }
+    
+    index->keys_size = (size_t)index->key_count * IMAN_FACET_KEY_SIZE;
+    index->keys = malloc(index->keys_size + 1);
+    index->bitmaps = malloc(index->bitmaps_size + 1);
+    container = malloc(IMAN_FACET_CONTAINER_BITMAP_SIZE);
+    
+    if (index->keys == NULL || index->bitmaps == NULL || container == NULL)
+        goto done;
+    
+    iman_binary_writer_initialise(&key_writer, index->keys, index->keys_size);
+    iman_binary_writer_initialise(&binary_writer, index->bitmaps, index->bitmaps_size);
+    
+    for (begin = 0; begin < pairs.count; begin = end) {
+        end = iman_facet_group_end(pairs.entries, begin, pairs.count);
+        
+        iman_binary_writer_put_uint32(&key_writer, (uint32_t)(pairs.entries[begin].key >> 32));
+        iman_binary_writer_put_uint32(&key_writer, (uint32_t)pairs.entries[begin].key);
+        iman_binary_writer_put_uint32(&key_writer, (uint32_t)binary_writer.position);
+        iman_binary_writer_put_uint32(&key_writer, (uint32_t)(end - begin));
+        
+        iman_facet_put_bitmap(&binary_writer, &pairs.entries[begin], end - begin, container);
+    }
+    
+    result = binary_writer.error_state == 0 && key_writer.error_state == 0 ? IMAN_TRUE : IMAN_FALSE;
+
+done:
+    if (result != IMAN_TRUE) {
+        IMAN_ERROR("Error: out of memory while building the facet index\n");
+        iman_facet_index_release(index);
+    }
+    
+    free(container);
+    free(pairs.entries);
+    return result;
+}
+
+void iman_facet_index_release(struct iman_facet_index *index) {
+    free(index->keys);
+    free(index->bitmaps);
+    free(index->blocks);
+    
+    memset(index, 0, sizeof(*index));
+}
+
+/* Every mode, the width, each operand type and each feature of one form record */
+static int iman_facet_add_form(struct iman_facet_pairs *pairs, const unsigned char *record, uint32_t form) {
+    static const uint32_t modes[][2] = {
+        { IMAN_FORM_MODE_64, 64 },
+        { IMAN_FORM_MODE_32, 32 },
+        { IMAN_FORM_MODE_16, 16 }
+    };
+    unsigned int feature_count = record[9], operand_count = record[10], x;
+    uint16_t width = iman_facet_read_uint16(record + 6);
+    
+    for (x = 0; x < sizeof(modes) / sizeof(modes[0]); ++x) {
+        if ((record[8] & modes[x][0]) != 0 && iman_facet_add_pair(pairs, IMAN_FACET_KIND_MODE, modes[x][1], form) != IMAN_TRUE)
+            return IMAN_FALSE;
+    }
+    
+    if (width != 0 && iman_facet_add_pair(pairs, IMAN_FACET_KIND_WIDTH, width, form) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    for (x = 0; x < operand_count && x < IMAN_FORM_MAX_OPERANDS; ++x) {
+        if (iman_facet_add_pair(pairs, IMAN_FACET_KIND_OPERAND, iman_facet_read_uint16(record + 12 + 2 * x), form) != IMAN_TRUE)
+            return IMAN_FALSE;
+    }
+    
+    for (x = 0; x < feature_count && x < IMAN_FORM_MAX_FEATURES; ++x) {
+        if (iman_facet_add_pair(pairs, IMAN_FACET_KIND_FEATURE, iman_facet_read_uint16(record + 28 + 2 * x), form) != IMAN_TRUE)
+            return IMAN_FALSE;
+    }
+    
+    return IMAN_TRUE;
+}
+
+static int iman_facet_add_pair(struct iman_facet_pairs *pairs, uint32_t kind, uint32_t value, uint32_t form) {
+    if (pairs->count >= pairs->size) {
+        size_t new_size = pairs->size ? pairs->size * 2 : IMAN_FACET_BASE_PAIRS;
+        struct iman_facet_pair *entries = realloc(pairs->entries, new_size * sizeof(*entries));
+        
+        if (entries == NULL)
+            return IMAN_FALSE;
+        
+        pairs->entries = entries;
+        pairs->size = new_size;
+    }
+    
+    pairs->entries[pairs->count].key = (uint64_t)kind << 32 | value;
+    pairs->entries[pairs->count].form = form;
+    pairs->count++;
+    return IMAN_TRUE;
+}
+
+/* Container count, then per run of forms sharing their upper 16 bits a header and either a sorted array or a full bitmap */
+static size_t iman_facet_bitmap_size(const struct iman_facet_pair *pairs, size_t count) {
+    size_t size = 4, begin, end;
+    
+    for (begin = 0; begin < count; begin = end) {
+        for (end = begin + 1; end < count && pairs[end].form >> 16 == pairs[begin].form >> 16; ++end);
+        
+        size += IMAN_FACET_CONTAINER_HEADER_SIZE;
+        size += end - begin > IMAN_FACET_CONTAINER_ARRAY_LIMIT ? IMAN_FACET_CONTAINER_BITMAP_SIZE : ((end - begin) * 2 + 3) & ~(size_t)3;
+    }
+    
+    return size;
+}
+
+static void iman_facet_put_bitmap(struct iman_binary_writer *binary_writer, const struct iman_facet_pair *pairs, size_t count, unsigned char *container) {
+    size_t begin, end, x;
+    uint32_t container_count = 0;
+    
+    for (begin = 0; begin < count; begin = end, ++container_count) {
+        for (end = begin + 1; end < count && pairs[end].form >> 16 == pairs[begin].form >> 16; ++end);
+    }
+    
+    iman_binary_writer_put_uint32(binary_writer, container_count);
+    
+    for (begin = 0; begin < count; begin = end) {
+        int dense;
+        
+        for (end = begin + 1; end < count && pairs[end].form >> 16 == pairs[begin].form >> 16; ++end);
+        
+        dense = end - begin > IMAN_FACET_CONTAINER_ARRAY_LIMIT ? IMAN_TRUE : IMAN_FALSE;
+        
+        iman_binary_writer_put_uint16(binary_writer, (uint16_t)(pairs[begin].form >> 16));
+        iman_binary_writer_put_uint16(binary_writer, dense ? IMAN_FACET_CONTAINER_BITMAP : IMAN_FACET_CONTAINER_ARRAY);
+        iman_binary_writer_put_uint32(binary_writer, (uint32_t)(end - begin));
+        
+        if (dense) {
+            memset(container, 0, IMAN_FACET_CONTAINER_BITMAP_SIZE);
+            
+            for (x = begin; x < end; ++x) {
+                container[(pairs[x].form & 0xFFFF) / 8] |= (unsigned char)(1 << (pairs[x].form % 8));
+            }
+            
+            iman_binary_writer_put_bytes(binary_writer, container, IMAN_FACET_CONTAINER_BITMAP_SIZE);
+        } else {
+            for (x = begin; x < end; ++x) {
+                iman_binary_writer_put_uint16(binary_writer, (uint16_t)(pairs[x].form & 0xFFFF));
+            }
+            
+            iman_binary_writer_pad(binary_writer, 4);
+        }
+    }
+}
+
+static size_t iman_facet_group_end(const struct iman_facet_pair *pairs, size_t begin, size_t count) {
+    size_t end = begin + 1;
+    
+    while (end < count && pairs[end].key == pairs[begin].key) {
+        end++;
+    }
+    
+    return end;
+}
+
+static uint32_t iman_facet_read_uint32(const unsigned char *data) {
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static uint16_t iman_facet_read_uint16(const unsigned char *data) {
+    return (uint16_t)(data[0] | data[1] << 8);
+}
+
+static int iman_facet_compare(const void *left, const void *right) {
+    const struct iman_facet_pair *a = left, *b = right;
+    
+    if (a->key != b->key)
+        return a->key < b->key ? -1 : 1;
+    
+    return a->form < b->form ? -1 : (a->form > b->form ? 1 : 0);
+}
\ No newline at end of file
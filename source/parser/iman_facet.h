@@ -0,0 +1,33 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_FACET_H
+#define _IMAN_FACET_H
+
+/* The forms field of one block, empty when the block has no forms */
+struct iman_facet_forms {
+    const char *field;
+    uint32_t length;
+};
+
+/* Serialised facet keys, their form bitmaps and the first form of every block */
+struct iman_facet_index {
+    char *keys;
+    size_t keys_size;
+    uint32_t key_count;
+    
+    char *bitmaps;
+    size_t bitmaps_size;
+    
+    char *blocks;
+    size_t blocks_size;
+    uint32_t form_count;
+};
+
+int iman_facet_index_build(struct iman_facet_index *index, const struct iman_facet_forms *forms, uint32_t block_count);
+
+void iman_facet_index_release(struct iman_facet_index *index);
+
+#endif
\ No newline at end of file
@@ -4,21 +4,78 @@
  */
 
 #include "../iman.h"
+#include "iman_diagnostics.h"
+#include "iman_symbols.h"
 #include "iman_reference.h"
 #include "iman_form_parser.h"
 
 #define IMAN_FORM_MAX_COLUMNS 8
+#define IMAN_FORM_MAX_TOKENS 64
+
+/* Columns whose contents are free text, taken whole rather than split into words */
+#define IMAN_FORM_OPCODE_COLUMN 6
+#define IMAN_FORM_DESCRIPTION_COLUMN 7
+
+#define IMAN_FORM_MODE16 0x1
+#define IMAN_FORM_MODE32 0x2
+#define IMAN_FORM_MODE64 0x4
+
+enum iman_form_class {
+    IMAN_FORM_CLASS_OTHER = 0,
+    IMAN_FORM_CLASS_BLANK,
+    IMAN_FORM_CLASS_WORD,
+    IMAN_FORM_CLASS_SYNTAX,
+    IMAN_FORM_CLASS_END
+};
+
+enum iman_form_token_type {
+    IMAN_FORM_TOKEN_WORD,
+    IMAN_FORM_TOKEN_TEXT,
+    IMAN_FORM_TOKEN_SYNTAX,
+    IMAN_FORM_TOKEN_INVALID,
+    IMAN_FORM_TOKEN_END
+};
+
+struct iman_form_token {
+    unsigned char type;
+    char syntax;
+    unsigned int column;
+    unsigned int length;
+};
 
 struct iman_form_lexer {
     char *line;
-    unsigned int column;
     unsigned int base_col;
+    unsigned int line_number;
+    
+    struct iman_symbol_table *symbols;
+    
+    /* The whole line is tokenised up front, the column parsers walk the tokens */
+    struct iman_form_token tokens[IMAN_FORM_MAX_TOKENS];
+    unsigned int token_count;
+    unsigned int token;
 };
 
+/* Widths and processor modes are both spelt as plain numbers */
+struct iman_form_number {
+    const char *text;
+    unsigned int length;
+    int width;
+    unsigned int mode;
+};
+
+static int iman_form_tokenise(struct iman_form_lexer *lexer);
+static int iman_form_push_token(struct iman_form_lexer *lexer, enum iman_form_token_type type, unsigned int column, unsigned int length);
+static int iman_form_free_text(struct iman_form_lexer *lexer, unsigned int *pcolumn, unsigned int form_column);
+static const struct iman_form_number *iman_form_lookup_number(const char *text, unsigned int length);
+
 static int iman_form_parse_column(struct iman_form_lexer *lexer, struct iman_reference_form_definition *form, unsigned int column);
-static void iman_form_lexer_skip_whitespace(struct iman_form_lexer *lexer);
+static unsigned int iman_form_lexer_column(const struct iman_form_lexer *lexer);
 static int iman_form_lexer_accept_syntax(struct iman_form_lexer *lexer, char syntax);
+static int iman_form_lexer_peek_syntax(struct iman_form_lexer *lexer, char syntax);
 static int iman_form_lexer_accept_text(struct iman_form_lexer *lexer, char **ptext, unsigned int *plength);
+static int iman_form_lexer_accept_free_text(struct iman_form_lexer *lexer, char **ptext, unsigned int *plength);
+static int iman_form_lexer_accept_symbol(struct iman_form_lexer *lexer, uint16_t *pid);
 
 static int iman_form_parse_insn_name(struct iman_form_lexer *lexer, struct iman_reference_form_definition *form);
 static int iman_form_parse_operands(struct iman_form_lexer *lexer, struct iman_reference_form_definition *form);
@@ -40,13 +97,54 @@ static int (* const iman_form_column_parsers[IMAN_FORM_MAX_COLUMNS])(struct iman
     iman_form_parse_description
 };
 
-int iman_parse_form(char *line, unsigned int base_column, struct iman_reference_form_definition *form) {
+#define O IMAN_FORM_CLASS_OTHER
+#define B IMAN_FORM_CLASS_BLANK
+#define W IMAN_FORM_CLASS_WORD
+#define S IMAN_FORM_CLASS_SYNTAX
+#define Z IMAN_FORM_CLASS_END
+
+/* Words are ASCII letters and digits, the same set isalnum gives in the C locale iman runs in */
+static const unsigned char iman_form_classes[256] = {
+    Z, O, O, O, O, O, O, O, O, B, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    B, O, O, O, O, O, O, O, S, S, O, O, S, O, O, O,
+    W, W, W, W, W, W, W, W, W, W, O, S, O, O, O, O,
+    O, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,
+    W, W, W, W, W, W, W, W, W, W, W, S, O, S, O, O,
+    O, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,
+    W, W, W, W, W, W, W, W, W, W, W, O, O, O, O, O
+};
+
+#undef O
+#undef B
+#undef W
+#undef S
+#undef Z
+
+/* Any power of two from a byte up to a full vector register is a width, three of them are also modes */
+static const struct iman_form_number iman_form_numbers[] = {
+    { "8",   1, 8,   0 },
+    { "16",  2, 16,  IMAN_FORM_MODE16 },
+    { "32",  2, 32,  IMAN_FORM_MODE32 },
+    { "64",  2, 64,  IMAN_FORM_MODE64 },
+    { "128", 3, 128, 0 },
+    { "256", 3, 256, 0 },
+    { "512", 3, 512, 0 }
+};
+
+int iman_parse_form(char *line, unsigned int line_number, unsigned int base_column, struct iman_symbol_table *symbols, struct iman_reference_form_definition *form) {
     struct iman_form_lexer lexer;
     unsigned int column_number = 0;
     
     lexer.line = line;
-    lexer.column = 0;
     lexer.base_col = base_column;
+    lexer.line_number = line_number;
+    lexer.symbols = symbols;
+    lexer.token_count = 0;
+    lexer.token = 0;
+    
+    if (iman_form_tokenise(&lexer) != IMAN_TRUE)
+        return IMAN_FALSE;
     
     if (iman_form_lexer_accept_syntax(&lexer, '[') != IMAN_TRUE) {
         return IMAN_FALSE;
@@ -66,10 +164,135 @@ int iman_parse_form(char *line, unsigned int base_column, struct iman_reference_
     return IMAN_TRUE;
 }
 
+/*
+ * One pass over the line, driven by the character class table. Opening parentheses are counted so the
+ * opcode and description columns can be taken as free text; tokenising stops at the closing bracket.
+ */
+static int iman_form_tokenise(struct iman_form_lexer *lexer) {
+    const unsigned char *line = (const unsigned char *)lexer->line;
+    unsigned int column = 0, form_column = 0;
+    
+    for (;;) {
+        unsigned int length = 0;
+        
+        switch (iman_form_classes[line[column]]) {
+            case IMAN_FORM_CLASS_BLANK:
+                while (iman_form_classes[line[column + length]] == IMAN_FORM_CLASS_BLANK)
+                    ++length;
+                
+                column += length;
+                break;
+            
+            case IMAN_FORM_CLASS_WORD:
+                while (iman_form_classes[line[column + length]] == IMAN_FORM_CLASS_WORD)
+                    ++length;
+                
+                if (iman_form_push_token(lexer, IMAN_FORM_TOKEN_WORD, column, length) != IMAN_TRUE)
+                    return IMAN_FALSE;
+                
+                column += length;
+                break;
+            
+            case IMAN_FORM_CLASS_SYNTAX:
+                if (iman_form_push_token(lexer, IMAN_FORM_TOKEN_SYNTAX, column, 1) != IMAN_TRUE)
+                    return IMAN_FALSE;
+                
+                if (line[column] == ']')
+                    return iman_form_push_token(lexer, IMAN_FORM_TOKEN_END, column + 1, 0);
+                
+                if (line[column++] == '(') {
+                    if (form_column == IMAN_FORM_OPCODE_COLUMN || form_column == IMAN_FORM_DESCRIPTION_COLUMN) {
+                        if (iman_form_free_text(lexer, &column, form_column) != IMAN_TRUE)
+                            return IMAN_FALSE;
+                    }
+                    
+                    ++form_column;
+                }
+                
+                break;
+            
+            case IMAN_FORM_CLASS_END:
+                return iman_form_push_token(lexer, IMAN_FORM_TOKEN_END, column, 0);
+            
+            default:
+                if (iman_form_push_token(lexer, IMAN_FORM_TOKEN_INVALID, column, 1) != IMAN_TRUE)
+                    return IMAN_FALSE;
+                
+                ++column;
+                break;
+        }
+    }
+}
+
+static int iman_form_push_token(struct iman_form_lexer *lexer, enum iman_form_token_type type, unsigned int column, unsigned int length) {
+    struct iman_form_token *token;
+    
+    /* The last slot is kept for the end token, so the parsers never walk off the array */
+    if (lexer->token_count >= IMAN_FORM_MAX_TOKENS - 1 && type != IMAN_FORM_TOKEN_END) {
+        IMAN_ERROR("Form error (L%u: C%u): too many tokens in a form definition, the maximum is %d\n", 
+               lexer->line_number, 
+               column + lexer->base_col,
+               IMAN_FORM_MAX_TOKENS - 1
+        );
+        
+        return IMAN_FALSE;
+    }
+    
+    token = &lexer->tokens[lexer->token_count++];
+    token->type = (unsigned char)type;
+    token->syntax = type == IMAN_FORM_TOKEN_SYNTAX ? lexer->line[column] : '\0';
+    token->column = column;
+    token->length = length;
+    return IMAN_TRUE;
+}
+
+/*
+ * Opcodes run up to the first closing parenthesis, descriptions up to the last one on the line, both
+ * without surrounding blanks. Moves the column on to that parenthesis; when there isn't one no text is
+ * taken, so the column parser can report it.
+ */
+static int iman_form_free_text(struct iman_form_lexer *lexer, unsigned int *pcolumn, unsigned int form_column) {
+    unsigned int column = *pcolumn, length;
+    const char *start, *close;
+    
+    while (lexer->line[column] == ' ' || lexer->line[column] == '\t')
+        ++column;
+    
+    start = &lexer->line[column];
+    close = form_column == IMAN_FORM_OPCODE_COLUMN ? strchr(start, ')') : strrchr(start, ')');
+    *pcolumn = column;
+    
+    if (close == NULL)
+        return IMAN_TRUE;
+    
+    length = (unsigned int)(close - start);
+    
+    while (length > 0 && (start[length - 1] == ' ' || start[length - 1] == '\t'))
+        --length;
+    
+    if (length != 0 && iman_form_push_token(lexer, IMAN_FORM_TOKEN_TEXT, column, length) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    *pcolumn = (unsigned int)(close - lexer->line);
+    return IMAN_TRUE;
+}
+
+static const struct iman_form_number *iman_form_lookup_number(const char *text, unsigned int length) {
+    size_t x;
+    
+    for (x = 0; x < sizeof(iman_form_numbers) / sizeof(iman_form_numbers[0]); ++x) {
+        if (iman_form_numbers[x].length == length && memcmp(iman_form_numbers[x].text, text, length) == 0)
+            return &iman_form_numbers[x];
+    }
+    
+    return NULL;
+}
+
 static int iman_form_parse_column(struct iman_form_lexer *lexer, struct iman_reference_form_definition *form, unsigned int column) {
     if (column >= IMAN_FORM_MAX_COLUMNS) {
-        printf("Form error, c %d: too many columns in a form definition, the maximum is %d\n", 
-               lexer->column + lexer->base_col,
+        IMAN_ERROR("Form error (L%u: C%u): too many columns in a form definition, the maximum is %d\n", 
+               lexer->line_number, 
+               iman_form_lexer_column(lexer) + lexer->base_col,
                IMAN_FORM_MAX_COLUMNS
         );
         
@@ -77,7 +300,7 @@ static int iman_form_parse_column(struct iman_form_lexer *lexer, struct iman_ref
     }
     
     if (iman_form_lexer_accept_syntax(lexer, '(') != IMAN_TRUE) {
-        printf("Form error, c %d: expected an opening parenthesis, did you add one too many commas?\n", lexer->column + lexer->base_col);
+        IMAN_ERROR("Form error (L%u: C%u): expected an opening parenthesis, did you add one too many commas?\n", lexer->line_number, iman_form_lexer_column(lexer) + lexer->base_col);
         
         return IMAN_FALSE;
     }
@@ -86,7 +309,7 @@ static int iman_form_parse_column(struct iman_form_lexer *lexer, struct iman_ref
         return IMAN_FALSE;
     
     if (iman_form_lexer_accept_syntax(lexer, ')') != IMAN_TRUE) {
-        printf("Form error, c %d: expected a closing parenthesis, did you add one too many commas?\n", lexer->column + lexer->base_col);
+        IMAN_ERROR("Form error (L%u: C%u): expected a closing parenthesis, did you add one too many commas?\n", lexer->line_number, iman_form_lexer_column(lexer) + lexer->base_col);
         
         return IMAN_FALSE;
     }
@@ -94,47 +317,68 @@ static int iman_form_parse_column(struct iman_form_lexer *lexer, struct iman_ref
     return IMAN_TRUE;
 }
 
-static void iman_form_lexer_skip_whitespace(struct iman_form_lexer *lexer) {
-    for(; lexer->line[lexer->column] != '\0'; ++lexer->column) {
-        char c = lexer->line[lexer->column];
-        if (c != '\t' && c != ' ')
-            return;
-    }
-    
-    return;
+/* Column of the next token, for diagnostics */
+static unsigned int iman_form_lexer_column(const struct iman_form_lexer *lexer) {
+    return lexer->tokens[lexer->token].column;
 }
 
 static int iman_form_lexer_accept_syntax(struct iman_form_lexer *lexer, char syntax) {
-    iman_form_lexer_skip_whitespace(lexer);
+    const struct iman_form_token *token = &lexer->tokens[lexer->token];
     
-    if (lexer->line[lexer->column] == syntax) {
-        ++lexer->column;
+    if (token->type == IMAN_FORM_TOKEN_SYNTAX && token->syntax == syntax) {
+        ++lexer->token;
         return IMAN_TRUE;
     }
     
     return IMAN_FALSE;
 }
 
-static int iman_form_lexer_accept_text(struct iman_form_lexer *lexer, char **ptext, unsigned int *plength) {
-    unsigned int length;
+static int iman_form_lexer_peek_syntax(struct iman_form_lexer *lexer, char syntax) {
+    const struct iman_form_token *token = &lexer->tokens[lexer->token];
     
-    iman_form_lexer_skip_whitespace(lexer);
+    return (token->type == IMAN_FORM_TOKEN_SYNTAX && token->syntax == syntax) ? IMAN_TRUE : IMAN_FALSE;
+}
+
+static int iman_form_lexer_accept_text(struct iman_form_lexer *lexer, char **ptext, unsigned int *plength) {
+    const struct iman_form_token *token = &lexer->tokens[lexer->token];
     
-    for(length = 0; lexer->line[lexer->column + length] != '\0'; ++length) {
-        char c = lexer->line[lexer->column + length];
-        
-        if (isalnum(c) == 0)
-            break;
+    if (token->type != IMAN_FORM_TOKEN_WORD) {
+        return IMAN_FALSE;
     }
     
-    if (length == 0) {
+    *plength = token->length;
+    *ptext = &lexer->line[token->column];
+    
+    ++lexer->token;
+    
+    return IMAN_TRUE;
+}
+
+static int iman_form_lexer_accept_free_text(struct iman_form_lexer *lexer, char **ptext, unsigned int *plength) {
+    const struct iman_form_token *token = &lexer->tokens[lexer->token];
+    
+    if (token->type != IMAN_FORM_TOKEN_TEXT)
         return IMAN_FALSE;
-    }
     
-    *plength = length;
-    *ptext = &lexer->line[lexer->column];
+    *plength = token->length;
+    *ptext = &lexer->line[token->column];
+    
+    ++lexer->token;
+    
+    return IMAN_TRUE;
+}
+
+static int iman_form_lexer_accept_symbol(struct iman_form_lexer *lexer, uint16_t *pid) {
+    unsigned int length = 0;
+    char *text = NULL;
+    
+    if (iman_form_lexer_accept_text(lexer, &text, &length) != IMAN_TRUE)
+        return IMAN_FALSE;
     
-    lexer->column += length;
+    if (iman_symbol_intern(lexer->symbols, text, length, pid) != IMAN_TRUE) {
+        IMAN_ERROR("Form error (L%u: C%u): unable to add %.*s to the symbol table.\n", lexer->line_number, (unsigned int)(text - lexer->line) + lexer->base_col, (int)length, text);
+        return IMAN_FALSE;
+    }
     
     return IMAN_TRUE;
 }
@@ -144,12 +388,12 @@ static int iman_form_parse_insn_name(struct iman_form_lexer *lexer, struct iman_
     char *text = NULL;
     
     if (iman_form_lexer_accept_text(lexer, &text, &length) != IMAN_TRUE) {
-        printf("Form error, c %d: expected an instruction mnemonic.\n", lexer->column + lexer->base_col);
+        IMAN_ERROR("Form error (L%u: C%u): expected an instruction mnemonic.\n", lexer->line_number, iman_form_lexer_column(lexer) + lexer->base_col);
         return IMAN_FALSE;
     }
     
-    memcpy(form->mnemonic, text, length);
-    form->mnemonic[length] = '\0';
+    form->mnemonic.text = text;
+    form->mnemonic.length = length;
     
     return IMAN_TRUE;
 }
@@ -157,36 +401,26 @@ static int iman_form_parse_insn_name(struct iman_form_lexer *lexer, struct iman_
 static int iman_form_parse_operands(struct iman_form_lexer *lexer, struct iman_reference_form_definition *form) {
     form->operand.count = 0;
     
+    /* Plenty of forms take no explicit operands */
+    if (iman_form_lexer_peek_syntax(lexer, ')') == IMAN_TRUE)
+        return IMAN_TRUE;
+    
     do {
-        unsigned int type_length = 0;
-        char *type_text = NULL;
-        
         if (form->operand.count >= IMAN_REFERENCE_MAX_OPERANDS) {
-            printf("Form error, c %d: too many operands, the maximum allowed is %d\n", 
-                   lexer->column + lexer->base_col, 
+            IMAN_ERROR("Form error (L%u: C%u): too many operands, the maximum allowed is %d\n", 
+                   lexer->line_number, 
+                   iman_form_lexer_column(lexer) + lexer->base_col, 
                    IMAN_REFERENCE_MAX_OPERANDS
             );
             
             return IMAN_FALSE;
         }
         
-        if (iman_form_lexer_accept_text(lexer, &type_text, &type_length) != IMAN_TRUE) {
-            printf("Form error, c %d: expected an operand type name\n", lexer->column + lexer->base_col);
-            return IMAN_FALSE;
-        }
-        
-        if (type_length + 1 >= IMAN_REFERENCE_OPERAND_LENGTH) {
-            printf("Form error, c %d: operand type exceeds the maximum allowable length, %d, with a length of: %u\n",
-                   lexer->column + lexer->base_col, 
-                   IMAN_REFERENCE_OPERAND_LENGTH - 1, 
-                   type_length
-            );
-            
+        if (iman_form_lexer_accept_symbol(lexer, &form->operand.type[form->operand.count]) != IMAN_TRUE) {
+            IMAN_ERROR("Form error (L%u: C%u): expected an operand type name\n", lexer->line_number, iman_form_lexer_column(lexer) + lexer->base_col);
             return IMAN_FALSE;
         }
         
-        memcpy(form->operand.type[form->operand.count], type_text, type_length);
-        form->operand.type[form->operand.count][type_length] = '\0';
         form->operand.count++;
     } while (iman_form_lexer_accept_syntax(lexer, ',') == IMAN_TRUE);
     
@@ -194,6 +428,7 @@ static int iman_form_parse_operands(struct iman_form_lexer *lexer, struct iman_r
 }
 
 static int iman_form_parse_width(struct iman_form_lexer *lexer, struct iman_reference_form_definition *form) {
+    const struct iman_form_number *number;
     unsigned int width_length = 0;
     char *width_text = NULL;
     
@@ -203,59 +438,39 @@ static int iman_form_parse_width(struct iman_form_lexer *lexer, struct iman_refe
         return IMAN_TRUE;
     }
     
-    if (width_length != 0) {
-        /* TODO: make this a sane implementation */
-        
-        if (strncmp(width_text, "64", width_length) == 0) {
-            form->width = 64;
-        } else if (strncmp(width_text, "32", width_length) == 0) {
-            form->width = 32;
-        } else if (strncmp(width_text, "16", width_length) == 0) {
-            form->width = 16;
-        } else if (strncmp(width_text, "8", width_length) == 0) {
-            form->width = 8;
-        } else {
-            printf("Form error, c %d: invalid instruction width specified.\n", lexer->column + lexer->base_col);
-            return IMAN_FALSE;
-        }
+    number = iman_form_lookup_number(width_text, width_length);
+    
+    if (number == NULL) {
+        IMAN_ERROR("Form error (L%u: C%u): invalid instruction width specified.\n", lexer->line_number, (unsigned int)(width_text - lexer->line) + lexer->base_col);
+        return IMAN_FALSE;
     }
     
+    form->width = number->width;
     return IMAN_TRUE;
 }
 
 static int iman_form_parse_clobbers(struct iman_form_lexer *lexer, struct iman_reference_form_definition *form) {
     form->clobber.count = 0;
     
+    if (iman_form_lexer_peek_syntax(lexer, ')') == IMAN_TRUE)
+        return IMAN_TRUE;
+    
     do {
-        unsigned int type_length = 0;
-        char *type_text = NULL;
-        
         if (form->clobber.count >= IMAN_REFERENCE_MAX_CLOBBERS) {
-            printf("Form error, c %d: too many clobbers, the maximum allowed is %d\n", 
-                   lexer->column + lexer->base_col, 
+            IMAN_ERROR("Form error (L%u: C%u): too many clobbers, the maximum allowed is %d\n", 
+                   lexer->line_number, 
+                   iman_form_lexer_column(lexer) + lexer->base_col, 
                    IMAN_REFERENCE_MAX_CLOBBERS
             );
             
             return IMAN_FALSE;
         }
         
-        if (iman_form_lexer_accept_text(lexer, &type_text, &type_length) != IMAN_TRUE) {
-            printf("Form error, c %d: expected a clobber type name\n", lexer->column + lexer->base_col);
+        if (iman_form_lexer_accept_symbol(lexer, &form->clobber.type[form->clobber.count]) != IMAN_TRUE) {
+            IMAN_ERROR("Form error (L%u: C%u): expected a clobber type name\n", lexer->line_number, iman_form_lexer_column(lexer) + lexer->base_col);
             return IMAN_FALSE;
         }
         
-        if (type_length + 1 >= IMAN_REFERENCE_OPERAND_LENGTH) {
-            printf("Form error, c %d: operand type exceeds the maximum allowable length, %d, with a length of: %u\n",
-                   lexer->column + lexer->base_col, 
-                   IMAN_REFERENCE_OPERAND_LENGTH - 1, 
-                   type_length
-            );
-            
-            return IMAN_FALSE;
-        }
-        
-        memcpy(form->clobber.type[form->clobber.count], type_text, type_length);
-        form->clobber.type[form->clobber.count][type_length] = '\0';
         form->clobber.count++;
     } while (iman_form_lexer_accept_syntax(lexer, ',') == IMAN_TRUE);
     
@@ -263,59 +478,47 @@ static int iman_form_parse_clobbers(struct iman_form_lexer *lexer, struct iman_r
 }
 
 static int iman_form_parse_architectures(struct iman_form_lexer *lexer, struct iman_reference_form_definition *form) {
-    form->feature.mode16 = form->feature.mode32 = form->feature.mode64 = 0;
+    unsigned int modes = 0;
     
     do {
+        const struct iman_form_number *number;
         unsigned int arch_length = 0;
         char *arch_name = NULL;
         
         if (iman_form_lexer_accept_text(lexer, &arch_name, &arch_length) != IMAN_TRUE)
             break;
         
-        if (strncmp(arch_name, "64", arch_length) == 0) {
-            form->feature.mode64 = 1;
-        } else if (strncmp(arch_name, "32", arch_length) == 0) {
-            form->feature.mode32 = 1;
-        } else if (strncmp(arch_name, "16", arch_length) == 0) {
-            form->feature.mode16 = 1;
-        } else {
-            printf("Form error, c %d: unrecognised architecture type name; expected 64, 32 or 16.\n", lexer->column + lexer->base_col);
+        number = iman_form_lookup_number(arch_name, arch_length);
+        
+        if (number == NULL || number->mode == 0) {
+            IMAN_ERROR("Form error (L%u: C%u): unrecognised architecture type name; expected 64, 32 or 16.\n", lexer->line_number, (unsigned int)(arch_name - lexer->line) + lexer->base_col);
             return IMAN_FALSE;
         }
+        
+        modes |= number->mode;
     } while (iman_form_lexer_accept_syntax(lexer, ';') == IMAN_TRUE);
     
+    form->feature.mode16 = (modes & IMAN_FORM_MODE16) != 0;
+    form->feature.mode32 = (modes & IMAN_FORM_MODE32) != 0;
+    form->feature.mode64 = (modes & IMAN_FORM_MODE64) != 0;
     return IMAN_TRUE;
 }
 
 static int iman_form_parse_features(struct iman_form_lexer *lexer, struct iman_reference_form_definition *form) {
     do {
-        unsigned int feature_length = 0;
-        char *feature_name = NULL;
-        
         if (form->feature.count >= IMAN_REFERENCE_MAX_FEATURES) {
-            printf("Form error, c %d: tried to add more than the allowed number of feature names %d.\n", 
-                   lexer->column + lexer->base_col,
+            IMAN_ERROR("Form error (L%u: C%u): tried to add more than the allowed number of feature names %d.\n", 
+                   lexer->line_number, 
+                   iman_form_lexer_column(lexer) + lexer->base_col,
                    IMAN_REFERENCE_MAX_FEATURES
             );
             
             return IMAN_FALSE;
         }
         
-        if (iman_form_lexer_accept_text(lexer, &feature_name, &feature_length) != IMAN_TRUE)
+        if (iman_form_lexer_accept_symbol(lexer, &form->feature.name[form->feature.count]) != IMAN_TRUE)
             break;
         
-        if (feature_length >= IMAN_REFERENCE_FEATURE_LENGTH) {
-            printf("Form error, c %d: feature name is longer than the maximum allowable %d.\n", 
-                   lexer->column + lexer->base_col,
-                   IMAN_REFERENCE_FEATURE_LENGTH - 1
-            );
-            
-            return IMAN_FALSE;
-        }
-        
-        memcpy(form->feature.name[form->feature.count], feature_name, feature_length);
-        
-        form->feature.name[form->feature.count][feature_length] = '\0';
         form->feature.count++;
         
     } while (iman_form_lexer_accept_syntax(lexer, ';') == IMAN_TRUE);
@@ -324,61 +527,31 @@ static int iman_form_parse_features(struct iman_form_lexer *lexer, struct iman_r
 }
 
 static int iman_form_parse_opcodes(struct iman_form_lexer *lexer, struct iman_reference_form_definition *form) {
-    unsigned int column;
-    
-    iman_form_lexer_skip_whitespace(lexer);
-    
-    for(column = 0; lexer->line[lexer->column + column] != ')'; ++column) {
-        if (lexer->line[lexer->column + column] == '\0') {
-            printf("Form error, c %d: expected either an opcode definition followed by a closing parenthesis.\n", lexer->column + lexer->base_col);
-            return IMAN_FALSE;
-        }
-    }
+    unsigned int length = 0;
+    char *text = NULL;
     
-    if (column <= 1) {
-        printf("Form error, c %d: expected either an opcode definition followed by a closing parenthesis.\n", lexer->column + lexer->base_col);
+    if (iman_form_lexer_accept_free_text(lexer, &text, &length) != IMAN_TRUE) {
+        IMAN_ERROR("Form error (L%u: C%u): expected either an opcode definition followed by a closing parenthesis.\n", lexer->line_number, iman_form_lexer_column(lexer) + lexer->base_col);
         return IMAN_FALSE;
     }
     
-    /* Back away from the closing parenthesis */
-    --column;
-    
-    if (column > IMAN_REFERENCE_MAX_OPCODE_SIZE) {
-        printf("Form error, c %d: this opcode definition exceeds the maximum allowable length of %d\n", 
-               lexer->column + lexer->base_col,
-               IMAN_REFERENCE_MAX_OPCODE_SIZE - 1
-        );
-        
-        return IMAN_FALSE;
-    }
-    
-    memcpy(form->opcode, &lexer->line[lexer->column], column);
-    form->opcode[column] = '\0';
-    lexer->column += column;
+    form->opcode.text = text;
+    form->opcode.length = length;
     return IMAN_TRUE;
 }
 
 static int iman_form_parse_description(struct iman_form_lexer *lexer, struct iman_reference_form_definition *form) {
-    unsigned int desc_length = 0;
-    char *desc_text = NULL;
-    
-    if (iman_form_lexer_accept_text(lexer, &desc_text, &desc_length) != IMAN_TRUE) {
-        printf("Form error, c %d: expected a description of this instruction form.\n", lexer->column + lexer->base_col);
-        return IMAN_FALSE;
-    }
+    unsigned int length = 0;
+    char *text = NULL;
     
-    if (desc_length >= IMAN_REFERENCE_MAX_DESCRIPTION) {
-        printf("Form error, c %d: description exceeds the maximum allowable length, %d, with a length of: %u\n",
-               lexer->column + lexer->base_col, 
-               IMAN_REFERENCE_MAX_DESCRIPTION - 1, 
-               desc_length
-        );
-        
+    /* Free text, so the tokeniser ran it up to the last closing parenthesis on the line rather than the first */
+    if (iman_form_lexer_accept_free_text(lexer, &text, &length) != IMAN_TRUE) {
+        IMAN_ERROR("Form error (L%u: C%u): expected a description of this instruction form.\n", lexer->line_number, iman_form_lexer_column(lexer) + lexer->base_col);
         return IMAN_FALSE;
     }
     
-    memcpy(form->description, desc_text, desc_length);
-    form->description[desc_length] = '\0';
+    form->description.text = text;
+    form->description.length = length;
     
     return IMAN_TRUE;
 }
\ No newline at end of file
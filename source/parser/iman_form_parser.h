@@ -6,6 +6,6 @@
 #ifndef _IMAN_FORM_PARSER_H
 #define _IMAN_FORM_PARSER_H
 
-int iman_parse_form(char *line, unsigned int base_column, struct iman_reference_form_definition *form);
+int iman_parse_form(char *line, unsigned int line_number, unsigned int base_column, struct iman_symbol_table *symbols, struct iman_reference_form_definition *form);
 
 #endif
\ No newline at end of file
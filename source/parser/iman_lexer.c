@@ -4,11 +4,37 @@
  */
 
 #include "../iman.h"
+#include "iman_diagnostics.h"
 #include "iman_lexer.h"
 
-#define IMAN_LEXER_DEFAULT_TEXTBLOCK_SIZE 4096
-
 static int iman_lexer_read_line(struct iman_lexer *lexer);
+static unsigned int iman_lexer_alnum_run(const struct iman_lexer *lexer);
+
+void iman_lexer_open_span(struct iman_lexer *lexer, const char *data, size_t size, unsigned int first_line) {
+    memset(lexer, 0, sizeof(*lexer));
+    
+    lexer->source.data = data;
+    lexer->source.size = size;
+    
+    /* read_line increments before handing out a line */
+    lexer->pos.line = first_line - 1;
+}
+
+void iman_lexer_close(struct iman_lexer *lexer) {
+    lexer->buffer.line = NULL;
+    lexer->buffer.length = 0;
+}
+
+int iman_lexer_is_eof(struct iman_lexer *lexer) {
+    return lexer->source.eof ? IMAN_TRUE : IMAN_FALSE;
+}
+
+void iman_lexer_skip_blank_lines(struct iman_lexer *lexer) {
+    while (lexer->pos.column >= lexer->buffer.length) {
+        if (iman_lexer_read_line(lexer) != IMAN_TRUE)
+            return;
+    }
+}
 
 int iman_lexer_expect_line_start(struct iman_lexer *lexer) {
     if (lexer->pos.column >= lexer->buffer.length) {
@@ -22,30 +48,16 @@ int iman_lexer_expect_line_start(struct iman_lexer *lexer) {
     return (lexer->pos.column <= lexer->pos.tabs) ? IMAN_TRUE : IMAN_FALSE;
 }
 
-int iman_lexer_expect_name(struct iman_lexer *lexer, char **name) {
-    unsigned int start_column, name_length;
-    char * new_text;
-    
-    for (start_column = lexer->pos.column; lexer->pos.column < lexer->buffer.length; ++lexer->pos.column) {
-        char c = lexer->buffer.line[lexer->pos.column];
-        
-        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
-            continue;
-        
-        break;
-    }
+int iman_lexer_expect_name(struct iman_lexer *lexer, const char **name, unsigned int *length) {
+    unsigned int run = iman_lexer_alnum_run(lexer);
     
-    if (lexer->pos.column == start_column) {
+    if (run == 0) {
         return IMAN_FALSE;
     }
     
-    name_length = lexer->pos.column - start_column;
-    
-    new_text = malloc(name_length + 1);
-    memcpy(new_text, &lexer->buffer.line[start_column], name_length);
-    new_text[name_length] = '\0';
-    
-    *name = new_text;
+    *name = &lexer->buffer.line[lexer->pos.column];
+    *length = run;
+    lexer->pos.column += run;
     return IMAN_TRUE;
 }
 
@@ -54,7 +66,7 @@ int iman_lexer_expect_indent(struct iman_lexer *lexer, unsigned int depth) {
     if (lexer->pos.column == 0) {
         unsigned int offset;
         
-        for(offset = 0; lexer->buffer.line[offset] == '\t'; ++offset)
+        for(offset = 0; offset < lexer->buffer.length && lexer->buffer.line[offset] == '\t'; ++offset)
             ;
         
         if (offset == depth) {
@@ -70,7 +82,7 @@ int iman_lexer_expect_indent(struct iman_lexer *lexer, unsigned int depth) {
 }
 
 int iman_lexer_accept_syntax(struct iman_lexer *lexer, char syntax) {
-    if (lexer->buffer.line[lexer->pos.column] == syntax) {
+    if (lexer->pos.column < lexer->buffer.length && lexer->buffer.line[lexer->pos.column] == syntax) {
         ++lexer->pos.column;
         return IMAN_TRUE;
     }
@@ -83,7 +95,7 @@ int iman_lexer_accept_indent(struct iman_lexer *lexer, unsigned int depth) {
         unsigned int offset;
         
         for(offset = 0; offset < depth; ++offset) {
-            if (lexer->buffer.line[offset] != '\t')
+            if (offset >= lexer->buffer.length || lexer->buffer.line[offset] != '\t')
                 return IMAN_FALSE;
             
         }
@@ -98,29 +110,21 @@ int iman_lexer_accept_indent(struct iman_lexer *lexer, unsigned int depth) {
     return IMAN_FALSE;
 }
 
-int iman_lexer_expect_keyword(struct iman_lexer *lexer, char **keyword, unsigned int *length) {
-    unsigned int start_column;
-    
-    for (start_column = lexer->pos.column; lexer->pos.column < lexer->buffer.length; ++lexer->pos.column) {
-        char c = lexer->buffer.line[lexer->pos.column];
-        
-        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
-            continue;
-        
-        break;
-    }
+int iman_lexer_expect_keyword(struct iman_lexer *lexer, const char **keyword, unsigned int *length) {
+    unsigned int run = iman_lexer_alnum_run(lexer);
     
-    if (lexer->pos.column == start_column) {
+    if (run == 0) {
         return IMAN_FALSE;
     }
     
-    *keyword = &lexer->buffer.line[start_column];
-    *length = lexer->pos.column - start_column;
+    *keyword = &lexer->buffer.line[lexer->pos.column];
+    *length = run;
+    lexer->pos.column += run;
     
     return IMAN_TRUE;
 }
 
-int iman_lexer_consume_remaining(struct iman_lexer *lexer, char **remaining, unsigned int *length) {
+int iman_lexer_consume_remaining(struct iman_lexer *lexer, const char **remaining, unsigned int *length) {
     *remaining = &lexer->buffer.line[lexer->pos.column];
     *length = lexer->buffer.length - lexer->pos.column;
     lexer->pos.column = lexer->buffer.length;
@@ -128,25 +132,55 @@ int iman_lexer_consume_remaining(struct iman_lexer *lexer, char **remaining, uns
 }
 
 static int iman_lexer_read_line(struct iman_lexer *lexer) {
-    unsigned int offset;
+    const char *start, *end, *newline;
     
     lexer->pos.column = 0;
     lexer->pos.tabs = 0;
     lexer->pos.line++;
     
-    if (fgets(lexer->buffer.line, IMAN_LEXER_MAX_LINE_LENGTH, lexer->source) == NULL) {
+    if (lexer->source.offset >= lexer->source.size) {
+        lexer->buffer.line = NULL;
+        lexer->buffer.length = 0;
+        lexer->source.eof = IMAN_TRUE;
         return IMAN_FALSE;
     }
     
-    for (offset = 0; offset < IMAN_LEXER_MAX_LINE_LENGTH; ++offset) {
-        if (lexer->buffer.line[offset] == '\n') {
-            lexer->buffer.line[offset] = '\0';
-            
-            lexer->buffer.length = offset;
-            return IMAN_TRUE;
-        }
+    start = lexer->source.data + lexer->source.offset;
+    end = lexer->source.data + lexer->source.size;
+    newline = memchr(start, '\n', (size_t)(end - start));
+    
+    /* The last line doesn't need a trailing newline */
+    if (newline == NULL)
+        newline = end;
+    
+    if ((size_t)(newline - start) > (unsigned int)-1) {
+        IMAN_ERROR("Error (L%u): this line is too long to be lexed.\n", lexer->pos.line);
+        return IMAN_FALSE;
     }
     
-    /* TODO: Make a fuss about being larger than the maximum line length */
-    return IMAN_FALSE;
+    lexer->buffer.line = start;
+    lexer->buffer.length = (unsigned int)(newline - start);
+    lexer->source.offset = (size_t)(newline - lexer->source.data) + 1;
+    
+    return IMAN_TRUE;
+}
+
+/* Names and keywords are runs of ASCII letters and digits */
+static unsigned int iman_lexer_alnum_run(const struct iman_lexer *lexer) {
+    const char *data = &lexer->buffer.line[lexer->pos.column];
+    unsigned int available, run;
+    
+    if (lexer->pos.column >= lexer->buffer.length)
+        return 0;
+    
+    available = lexer->buffer.length - lexer->pos.column;
+    
+    for (run = 0; run < available; ++run) {
+        char c = data[run];
+        
+        if ((c < 'a' || c > 'z') && (c < 'A' || c > 'Z') && (c < '0' || c > '9'))
+            break;
+    }
+    
+    return run;
 }
\ No newline at end of file
@@ -6,10 +6,14 @@
 #ifndef _IMAN_LEXER_H
 #define _IMAN_LEXER_H
 
-#define IMAN_LEXER_MAX_LINE_LENGTH 2048
-
 struct iman_lexer {
-    FILE *source;
+    /* Lines are handed out as spans into the borrowed source */
+    struct {
+        const char *data;
+        size_t size;
+        size_t offset;
+        int eof;
+    } source;
     
     struct {
         unsigned int column;
@@ -19,17 +23,22 @@ struct iman_lexer {
     
     struct {
         unsigned int length;
-        char line[IMAN_LEXER_MAX_LINE_LENGTH];
+        const char *line;
     } buffer;
 };
 
+void iman_lexer_open_span(struct iman_lexer *lexer, const char *data, size_t size, unsigned int first_line);
+void iman_lexer_close(struct iman_lexer *lexer);
+int iman_lexer_is_eof(struct iman_lexer *lexer);
+void iman_lexer_skip_blank_lines(struct iman_lexer *lexer);
+
 int iman_lexer_expect_line_start(struct iman_lexer *lexer);
-int iman_lexer_expect_name(struct iman_lexer *lexer, char **name);
+int iman_lexer_expect_name(struct iman_lexer *lexer, const char **name, unsigned int *length);
 int iman_lexer_expect_indent(struct iman_lexer *lexer, unsigned int depth);
 int iman_lexer_accept_syntax(struct iman_lexer *lexer, char syntax);
 int iman_lexer_accept_indent(struct iman_lexer *lexer, unsigned int depth);
-int iman_lexer_expect_keyword(struct iman_lexer *lexer, char **keyword, unsigned int *length);
-int iman_lexer_consume_remaining(struct iman_lexer *lexer, char **remaining, unsigned int *length);
+int iman_lexer_expect_keyword(struct iman_lexer *lexer, const char **keyword, unsigned int *length);
+int iman_lexer_consume_remaining(struct iman_lexer *lexer, const char **remaining, unsigned int *length);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,233 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "../iman.h"
+#include "../iman_mapping.h"
+#include "iman_diagnostics.h"
+#include "iman_manifest.h"
+
+#define IMAN_MAX_PATH 1024
+
+static int iman_manifest_load(struct iman_manifest *manifest);
+static int iman_manifest_check_block(const struct iman_manifest *manifest, uint32_t index);
+static const unsigned char *iman_manifest_find_section(const struct iman_manifest *manifest, uint32_t id, uint32_t *psize);
+static int compare_keys(const void *left, const void *right);
+static uint32_t read_uint32(const unsigned char *data);
+
+int iman_manifest_open(struct iman_manifest *manifest, const char *target_dir, const char *arch_name) {
+    char path_buffer[IMAN_MAX_PATH];
+    
+    memset(manifest, 0, sizeof(*manifest));
+    
+    if (snprintf(path_buffer, IMAN_MAX_PATH, "%s/%s" IMAN_REF_MANIFEST_EXT, target_dir, arch_name) >= IMAN_MAX_PATH)
+        return IMAN_FALSE;
+    
+    /* No manifest just means there is nothing to reuse */
+    if (iman_mapping_open(&manifest->file, path_buffer, IMAN_MAPPING_ACCESS_SEQUENTIAL) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    if (snprintf(path_buffer, IMAN_MAX_PATH, "%s/%s" IMAN_REF_TABLE_EXT, target_dir, arch_name) >= IMAN_MAX_PATH ||
+        iman_mapping_open(&manifest->table, path_buffer, IMAN_MAPPING_ACCESS_RANDOM) != IMAN_TRUE) {
+        iman_mapping_close(&manifest->file);
+        return IMAN_FALSE;
+    }
+    
+    if (iman_manifest_load(manifest) != IMAN_TRUE) {
+        IMAN_INFO("Info: ignoring the previous build manifest, it doesn't match this version or its table\n");
+        iman_manifest_close(manifest);
+        return IMAN_FALSE;
+    }
+    
+    return IMAN_TRUE;
+}
+
+void iman_manifest_close(struct iman_manifest *manifest) {
+    free(manifest->keys);
+    iman_mapping_close(&manifest->table);
+    iman_mapping_close(&manifest->file);
+    
+    memset(manifest, 0, sizeof(*manifest));
+}
+
+int iman_manifest_find(const struct iman_manifest *manifest, uint64_t source_hash, struct iman_manifest_block *block) {
+    uint32_t low = 0, high = manifest->block_count;
+    
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        const struct iman_manifest_key *key = &manifest->keys[middle];
+        
+        if (key->hash < source_hash) {
+            low = middle + 1;
+        } else if (key->hash > source_hash) {
+            high = middle;
+        } else {
+            const unsigned char *entry = manifest->blocks + (size_t)key->index * IMAN_MANIFEST_BLOCK_SIZE;
+            
+            block->source_hash = key->hash;
+            block->table_entry = (const char *)manifest->table.data + read_uint32(entry + 8);
+            block->table_size = read_uint32(entry + 12);
+            block->payload_length = read_uint32(entry + 16);
+            block->names = manifest->names.data + read_uint32(entry + 20);
+            block->name_count = read_uint32(entry + 24);
+            return IMAN_TRUE;
+        }
+    }
+    
+    return IMAN_FALSE;
+}
+
+const char *iman_manifest_symbol(const struct iman_manifest *manifest, uint32_t id) {
+    uint32_t offset;
+    
+    if (id >= manifest->symbols.count)
+        return NULL;
+    
+    offset = read_uint32(manifest->symbols.offsets + 4 * (size_t)id);
+    
+    if (offset >= manifest->symbols.text_size || memchr(manifest->symbols.text + offset, '\0', manifest->symbols.text_size - offset) == NULL)
+        return NULL;
+    
+    return manifest->symbols.text + offset;
+}
+
+static int iman_manifest_load(struct iman_manifest *manifest) {
+    const unsigned char *section;
+    uint32_t size, x;
+    
+    if (manifest->file.size < IMAN_INDEX_HEADER_SIZE)
+        return IMAN_FALSE;
+    
+    /* The manifest is tied to the index version, a format change always means a full build */
+    if (read_uint32(manifest->file.data) != IMAN_MANIFEST_MAGIC || read_uint32(manifest->file.data + 4) != IMAN_INDEX_VERSION)
+        return IMAN_FALSE;
+    
+    manifest->block_count = read_uint32(manifest->file.data + 12);
+    
+    section = iman_manifest_find_section(manifest, IMAN_SECTION_ID_BLOCKS, &size);
+    
+    if (section == NULL || (uint64_t)manifest->block_count * IMAN_MANIFEST_BLOCK_SIZE > size)
+        return IMAN_FALSE;
+    
+    manifest->blocks = section;
+    
+    section = iman_manifest_find_section(manifest, IMAN_SECTION_ID_NAME_HEAP, &size);
+    
+    if (section == NULL)
+        return IMAN_FALSE;
+    
+    manifest->names.data = (const char *)section;
+    manifest->names.size = size;
+    
+    section = iman_manifest_find_section(manifest, IMAN_SECTION_ID_DICTIONARY, &size);
+    
+    if (section != NULL) {
+        manifest->dictionary.data = (const char *)section;
+        manifest->dictionary.size = size;
+    }
+    
+    section = iman_manifest_find_section(manifest, IMAN_SECTION_ID_SYMBOLS, &size);
+    
+    if (section != NULL && size >= IMAN_SYMBOLS_HEADER_SIZE) {
+        uint32_t count = read_uint32(section), text_offset = read_uint32(section + 4);
+        
+        if (text_offset > size || (uint64_t)IMAN_SYMBOLS_HEADER_SIZE + (uint64_t)count * 4 > text_offset)
+            return IMAN_FALSE;
+        
+        manifest->symbols.count = count;
+        manifest->symbols.offsets = section + IMAN_SYMBOLS_HEADER_SIZE;
+        manifest->symbols.text = (const char *)section + text_offset;
+        manifest->symbols.text_size = size - text_offset;
+    }
+    
+    /* Every block is checked up front, a manifest that disagrees with its table is thrown away whole */
+    for (x = 0; x < manifest->block_count; ++x) {
+        if (iman_manifest_check_block(manifest, x) != IMAN_TRUE)
+            return IMAN_FALSE;
+    }
+    
+    manifest->keys = malloc((manifest->block_count + 1) * sizeof(*manifest->keys));
+    
+    if (manifest->keys == NULL)
+        return IMAN_FALSE;
+    
+    for (x = 0; x < manifest->block_count; ++x) {
+        const unsigned char *entry = manifest->blocks + (size_t)x * IMAN_MANIFEST_BLOCK_SIZE;
+        
+        manifest->keys[x].hash = (uint64_t)read_uint32(entry) | (uint64_t)read_uint32(entry + 4) << 32;
+        manifest->keys[x].index = x;
+    }
+    
+    qsort(manifest->keys, manifest->block_count, sizeof(*manifest->keys), &compare_keys);
+    return IMAN_TRUE;
+}
+
+static int iman_manifest_check_block(const struct iman_manifest *manifest, uint32_t index) {
+    const unsigned char *entry = manifest->blocks + (size_t)index * IMAN_MANIFEST_BLOCK_SIZE;
+    uint32_t table_offset = read_uint32(entry + 8), table_size = read_uint32(entry + 12);
+    uint32_t name_offset = read_uint32(entry + 20), name_count = read_uint32(entry + 24), x;
+    const unsigned char *header;
+    
+    if (table_size < IMAN_TABLE_BLOCK_HEADER_SIZE || (uint64_t)table_offset + table_size > manifest->table.size)
+        return IMAN_FALSE;
+    
+    header = manifest->table.data + table_offset;
+    
+    if (read_uint32(header) + IMAN_TABLE_BLOCK_HEADER_SIZE != table_size || read_uint32(header + 4) != read_uint32(entry + 16))
+        return IMAN_FALSE;
+    
+    /* Names are NUL terminated, make sure each one ends inside the section */
+    for (x = 0; x < name_count; ++x) {
+        const char *end;
+        
+        if (name_offset >= manifest->names.size)
+            return IMAN_FALSE;
+        
+        end = memchr(manifest->names.data + name_offset, '\0', manifest->names.size - name_offset);
+        
+        if (end == NULL)
+            return IMAN_FALSE;
+        
+        name_offset = (uint32_t)(end - manifest->names.data) + 1;
+    }
+    
+    return IMAN_TRUE;
+}
+
+static const unsigned char *iman_manifest_find_section(const struct iman_manifest *manifest, uint32_t id, uint32_t *psize) {
+    uint32_t count = read_uint32(manifest->file.data + 8), x;
+    const unsigned char *entry = manifest->file.data + IMAN_INDEX_HEADER_SIZE;
+    
+    if ((uint64_t)IMAN_INDEX_HEADER_SIZE + (uint64_t)count * IMAN_INDEX_SECTION_ENTRY_SIZE > manifest->file.size)
+        return NULL;
+    
+    for (x = 0; x < count; ++x, entry += IMAN_INDEX_SECTION_ENTRY_SIZE) {
+        uint32_t offset = read_uint32(entry + 4);
+        
+        if (read_uint32(entry) != id)
+            continue;
+        
+        *psize = read_uint32(entry + 8);
+        
+        if ((uint64_t)offset + *psize > manifest->file.size)
+            return NULL;
+        
+        return manifest->file.data + offset;
+    }
+    
+    return NULL;
+}
+
+static int compare_keys(const void *left, const void *right) {
+    const struct iman_manifest_key *a = left, *b = right;
+    
+    if (a->hash != b->hash)
+        return a->hash < b->hash ? -1 : 1;
+    
+    return a->index < b->index ? -1 : (a->index > b->index ? 1 : 0);
+}
+
+static uint32_t read_uint32(const unsigned char *data) {
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
\ No newline at end of file
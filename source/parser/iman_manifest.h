@@ -0,0 +1,64 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_MANIFEST_H
+#define _IMAN_MANIFEST_H
+
+struct iman_manifest_key {
+    uint64_t hash;
+    uint32_t index;
+};
+
+/* The previous build's manifest and table, mapped so unchanged blocks can be copied across as they are */
+struct iman_manifest {
+    struct iman_mapping file;
+    struct iman_mapping table;
+    
+    uint32_t block_count;
+    const unsigned char *blocks;
+    
+    /* Block source hashes, sorted for lookup */
+    struct iman_manifest_key *keys;
+    
+    struct {
+        const char *data;
+        uint32_t size;
+    } names;
+    
+    struct {
+        const char *data;
+        uint32_t size;
+    } dictionary;
+    
+    struct {
+        uint32_t count;
+        const unsigned char *offsets;
+        const char *text;
+        uint32_t text_size;
+    } symbols;
+};
+
+struct iman_manifest_block {
+    uint64_t source_hash;
+    
+    /* The whole table entry, header included */
+    const char *table_entry;
+    uint32_t table_size;
+    uint32_t payload_length;
+    
+    /* Every alias of the block, each one NUL terminated */
+    const char *names;
+    uint32_t name_count;
+};
+
+int iman_manifest_open(struct iman_manifest *manifest, const char *target_dir, const char *arch_name);
+
+void iman_manifest_close(struct iman_manifest *manifest);
+
+int iman_manifest_find(const struct iman_manifest *manifest, uint64_t source_hash, struct iman_manifest_block *block);
+
+const char *iman_manifest_symbol(const struct iman_manifest *manifest, uint32_t id);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,164 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "../iman.h"
+#include "../iman_hash.h"
+#include "iman_diagnostics.h"
+#include "iman_name_hash.h"
+
+/* Average keys per bucket, larger means a smaller table but a longer build */
+#define IMAN_NAME_HASH_BUCKET_LOAD 4
+#define IMAN_NAME_HASH_MAX_DISPLACEMENT (1u << 24)
+#define IMAN_NAME_HASH_MAX_SEEDS 16
+
+static int iman_name_hash_try_seed(struct iman_name_hash *table, const uint64_t *hashes, uint32_t *bucket_start, uint32_t *bucket_keys, uint32_t *order, unsigned char *taken);
+static int iman_name_hash_place_bucket(struct iman_name_hash *table, const uint64_t *hashes, const uint32_t *keys, uint32_t key_count, unsigned char *taken, uint32_t bucket);
+
+int iman_name_hash_build(struct iman_name_hash *table, const uint64_t *hashes, uint32_t key_count) {
+    uint32_t *bucket_start = NULL, *bucket_keys = NULL, *order = NULL;
+    unsigned char *taken = NULL;
+    uint32_t seed;
+    int result = IMAN_FALSE;
+    
+    memset(table, 0, sizeof(*table));
+    
+    table->key_count = key_count;
+    table->bucket_count = key_count / IMAN_NAME_HASH_BUCKET_LOAD + 1;
+    
+    table->displacements = calloc(table->bucket_count, sizeof(uint32_t));
+    table->key_slots = calloc(key_count + 1, sizeof(uint32_t));
+    bucket_start = calloc(table->bucket_count + 1, sizeof(uint32_t));
+    bucket_keys = calloc(key_count + 1, sizeof(uint32_t));
+    order = calloc(table->bucket_count, sizeof(uint32_t));
+    taken = calloc(key_count + 1, 1);
+    
+    if (table->displacements == NULL || table->key_slots == NULL || bucket_start == NULL || bucket_keys == NULL || order == NULL || taken == NULL) {
+        IMAN_ERROR("Error: out of memory while building the name hash\n");
+        goto done;
+    }
+    
+    for (seed = 0; seed < IMAN_NAME_HASH_MAX_SEEDS; ++seed) {
+        table->seed = seed;
+        
+        if (iman_name_hash_try_seed(table, hashes, bucket_start, bucket_keys, order, taken) == IMAN_TRUE) {
+            result = IMAN_TRUE;
+            goto done;
+        }
+    }
+    
+    IMAN_ERROR("Error: unable to find a perfect hash for the name index\n");
+
+done:
+    free(bucket_start);
+    free(bucket_keys);
+    free(order);
+    free(taken);
+    
+    if (result != IMAN_TRUE)
+        iman_name_hash_release(table);
+    
+    return result;
+}
+
+void iman_name_hash_release(struct iman_name_hash *table) {
+    free(table->displacements);
+    free(table->key_slots);
+    
+    table->displacements = NULL;
+    table->key_slots = NULL;
+}
+
+static int iman_name_hash_try_seed(struct iman_name_hash *table, const uint64_t *hashes, uint32_t *bucket_start, uint32_t *bucket_keys, uint32_t *order, unsigned char *taken) {
+    uint32_t bucket, key, x, max_size = 0;
+    
+    memset(bucket_start, 0, (table->bucket_count + 1) * sizeof(uint32_t));
+    memset(taken, 0, table->key_count);
+    
+    /* Counting sort of the keys into their buckets */
+    for (key = 0; key < table->key_count; ++key) {
+        bucket_start[iman_hash_bucket(hashes[key], table->bucket_count) + 1]++;
+    }
+    
+    for (bucket = 0; bucket < table->bucket_count; ++bucket) {
+        uint32_t size = bucket_start[bucket + 1];
+        
+        if (size > max_size)
+            max_size = size;
+        
+        bucket_start[bucket + 1] += bucket_start[bucket];
+    }
+    
+    for (key = 0; key < table->key_count; ++key) {
+        bucket = iman_hash_bucket(hashes[key], table->bucket_count);
+        
+        /* bucket_start[bucket] is used as a fill cursor here and restored below */
+        bucket_keys[bucket_start[bucket]++] = key;
+    }
+    
+    for (bucket = table->bucket_count; bucket > 0; --bucket) {
+        bucket_start[bucket] = bucket_start[bucket - 1];
+    }
+    
+    bucket_start[0] = 0;
+    
+    /* Place the largest buckets first while the table is still mostly empty */
+    for (x = 0, key = max_size + 1; key > 0; --key) {
+        for (bucket = 0; bucket < table->bucket_count; ++bucket) {
+            if (bucket_start[bucket + 1] - bucket_start[bucket] == key - 1)
+                order[x++] = bucket;
+        }
+    }
+    
+    for (x = 0; x < table->bucket_count; ++x) {
+        uint32_t size;
+        
+        bucket = order[x];
+        size = bucket_start[bucket + 1] - bucket_start[bucket];
+        
+        if (size == 0) {
+            table->displacements[bucket] = 0;
+            continue;
+        }
+        
+        if (iman_name_hash_place_bucket(table, hashes, &bucket_keys[bucket_start[bucket]], size, taken, bucket) != IMAN_TRUE)
+            return IMAN_FALSE;
+    }
+    
+    return IMAN_TRUE;
+}
+
+static int iman_name_hash_place_bucket(struct iman_name_hash *table, const uint64_t *hashes, const uint32_t *keys, uint32_t key_count, unsigned char *taken, uint32_t bucket) {
+    uint32_t displacement, x, y;
+    
+    for (displacement = 0; displacement < IMAN_NAME_HASH_MAX_DISPLACEMENT; ++displacement) {
+        for (x = 0; x < key_count; ++x) {
+            uint32_t slot = iman_hash_slot(hashes[keys[x]], table->seed, displacement, table->key_count);
+            
+            if (taken[slot])
+                break;
+            
+            for (y = 0; y < x; ++y) {
+                if (table->key_slots[keys[y]] == slot)
+                    break;
+            }
+            
+            if (y != x)
+                break;
+            
+            table->key_slots[keys[x]] = slot;
+        }
+        
+        if (x == key_count) {
+            for (x = 0; x < key_count; ++x) {
+                taken[table->key_slots[keys[x]]] = 1;
+            }
+            
+            table->displacements[bucket] = displacement;
+            return IMAN_TRUE;
+        }
+    }
+    
+    return IMAN_FALSE;
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_NAME_HASH_H
+#define _IMAN_NAME_HASH_H
+
+/* CHD-style minimal perfect hash: one displacement per bucket, one slot per key */
+struct iman_name_hash {
+    uint32_t seed;
+    uint32_t key_count;
+    uint32_t bucket_count;
+    
+    uint32_t *displacements;
+    
+    /* Slot assigned to each key, in key order */
+    uint32_t *key_slots;
+};
+
+int iman_name_hash_build(struct iman_name_hash *table, const uint64_t *hashes, uint32_t key_count);
+
+void iman_name_hash_release(struct iman_name_hash *table);
+
+#endif
\ No newline at end of file
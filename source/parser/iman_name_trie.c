@@ -0,0 +1,145 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "../iman.h"
+#include "iman_diagnostics.h"
+#include "iman_name_trie.h"
+
+#define IMAN_NAME_TRIE_BASE_NODES 1024
+#define IMAN_NAME_TRIE_MAX_LABEL 255
+#define IMAN_NAME_TRIE_MAX_NAME 65535
+
+static int iman_name_trie_add_node(struct iman_name_trie *trie, const char *heap, const struct iman_name_trie_key *keys, uint32_t low, uint32_t high, uint32_t depth);
+static uint32_t iman_name_trie_common_prefix(const char *heap, const struct iman_name_trie_key *a, const struct iman_name_trie_key *b);
+static int iman_name_trie_compare(const void *left, const void *right);
+
+/* qsort has no context argument, the heap is only needed while sorting */
+static const char *iman_name_trie_sort_heap;
+
+int iman_name_trie_build(struct iman_name_trie *trie, const char *heap, struct iman_name_trie_key *keys, uint32_t key_count) {
+    uint32_t x, unique_count = 0;
+    
+    memset(trie, 0, sizeof(*trie));
+    
+    /* Sorted without regard to case, equal names keep the earliest definition */
+    iman_name_trie_sort_heap = heap;
+    qsort(keys, key_count, sizeof(*keys), &iman_name_trie_compare);
+    iman_name_trie_sort_heap = NULL;
+    
+    for (x = 0; x < key_count; ++x) {
+        if (keys[x].length > IMAN_NAME_TRIE_MAX_NAME) {
+            IMAN_ERROR("Error: name %.32s... is too long for the completion trie\n", &heap[keys[x].offset]);
+            return IMAN_FALSE;
+        }
+        
+        if (unique_count > 0 && keys[unique_count - 1].length == keys[x].length &&
+            iman_name_trie_common_prefix(heap, &keys[unique_count - 1], &keys[x]) == keys[x].length)
+            continue;
+        
+        keys[unique_count++] = keys[x];
+    }
+    
+    if (iman_name_trie_add_node(trie, heap, keys, 0, unique_count, 0) != IMAN_TRUE) {
+        IMAN_ERROR("Error: out of memory while building the completion trie\n");
+        iman_name_trie_release(trie);
+        return IMAN_FALSE;
+    }
+    
+    return IMAN_TRUE;
+}
+
+void iman_name_trie_release(struct iman_name_trie *trie) {
+    free(trie->nodes);
+    memset(trie, 0, sizeof(*trie));
+}
+
+/* Adds the node for keys [low, high) starting at depth, followed by its children in order */
+static int iman_name_trie_add_node(struct iman_name_trie *trie, const char *heap, const struct iman_name_trie_key *keys, uint32_t low, uint32_t high, uint32_t depth) {
+    struct iman_name_trie_node *node;
+    uint32_t index, end, child;
+    
+    if (trie->node_count >= trie->size) {
+        uint32_t new_size = trie->size ? trie->size * 2 : IMAN_NAME_TRIE_BASE_NODES;
+        struct iman_name_trie_node *nodes = realloc(trie->nodes, new_size * sizeof(*nodes));
+        
+        if (nodes == NULL)
+            return IMAN_FALSE;
+        
+        trie->nodes = nodes;
+        trie->size = new_size;
+    }
+    
+    /* The root has an empty label, every other node takes the longest prefix its keys share */
+    end = depth;
+    
+    if (low < high && trie->node_count != 0) {
+        end = iman_name_trie_common_prefix(heap, &keys[low], &keys[high - 1]);
+        
+        if (end - depth > IMAN_NAME_TRIE_MAX_LABEL)
+            end = depth + IMAN_NAME_TRIE_MAX_LABEL;
+    }
+    
+    index = trie->node_count++;
+    node = &trie->nodes[index];
+    node->label_offset = low < high ? keys[low].offset + depth : 0;
+    node->label_length = (uint8_t)(end - depth);
+    node->flags = 0;
+    node->name_length = 0;
+    
+    child = low;
+    
+    /* Sorted order puts a key that ends here ahead of everything that extends it */
+    if (child < high && keys[child].length == end) {
+        node->flags |= IMAN_NAME_TRIE_TERMINAL;
+        node->name_length = (uint16_t)end;
+        child++;
+    }
+    
+    while (child < high) {
+        unsigned char c = (unsigned char)tolower((unsigned char)heap[keys[child].offset + end]);
+        uint32_t next = child + 1;
+        
+        while (next < high && (unsigned char)tolower((unsigned char)heap[keys[next].offset + end]) == c) {
+            next++;
+        }
+        
+        if (iman_name_trie_add_node(trie, heap, keys, child, next, end) != IMAN_TRUE)
+            return IMAN_FALSE;
+        
+        child = next;
+    }
+    
+    /* The array may have moved while the children were added */
+    trie->nodes[index].subtree_end = trie->node_count;
+    return IMAN_TRUE;
+}
+
+static uint32_t iman_name_trie_common_prefix(const char *heap, const struct iman_name_trie_key *a, const struct iman_name_trie_key *b) {
+    uint32_t length = a->length < b->length ? a->length : b->length, x;
+    
+    for (x = 0; x < length; ++x) {
+        if (tolower((unsigned char)heap[a->offset + x]) != tolower((unsigned char)heap[b->offset + x]))
+            break;
+    }
+    
+    return x;
+}
+
+static int iman_name_trie_compare(const void *left, const void *right) {
+    const struct iman_name_trie_key *a = left, *b = right;
+    uint32_t common = iman_name_trie_common_prefix(iman_name_trie_sort_heap, a, b);
+    
+    if (common < a->length && common < b->length) {
+        int ca = tolower((unsigned char)iman_name_trie_sort_heap[a->offset + common]);
+        int cb = tolower((unsigned char)iman_name_trie_sort_heap[b->offset + common]);
+        
+        return ca < cb ? -1 : 1;
+    }
+    
+    if (a->length != b->length)
+        return a->length < b->length ? -1 : 1;
+    
+    return a->offset < b->offset ? -1 : (a->offset > b->offset ? 1 : 0);
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_NAME_TRIE_H
+#define _IMAN_NAME_TRIE_H
+
+struct iman_name_trie_key {
+    uint32_t offset;
+    uint32_t length;
+};
+
+/* Edge labels and terminal names are both spans of the name heap, nothing is copied */
+struct iman_name_trie_node {
+    uint32_t subtree_end;
+    uint32_t label_offset;
+    uint8_t label_length;
+    uint8_t flags;
+    uint16_t name_length;
+};
+
+/* Case-insensitive radix trie in preorder, so every prefix maps to one sorted, contiguous run of nodes */
+struct iman_name_trie {
+    struct iman_name_trie_node *nodes;
+    uint32_t node_count;
+    uint32_t size;
+};
+
+int iman_name_trie_build(struct iman_name_trie *trie, const char *heap, struct iman_name_trie_key *keys, uint32_t key_count);
+
+void iman_name_trie_release(struct iman_name_trie *trie);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,257 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "../iman.h"
+#include "iman_output.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define IMAN_OUTPUT_BUFFER_SIZE (1 << 20)
+#define IMAN_OUTPUT_MAX_VECTOR 32
+
+static void *iman_output_thread(void *argument);
+static int iman_output_submit(struct iman_output *output);
+static int iman_output_wait(struct iman_output *output);
+static int iman_output_write_all(struct iman_output *output, struct iovec *vector, int count);
+
+int iman_output_open(struct iman_output *output, const char *path) {
+    memset(output, 0, sizeof(*output));
+    
+    output->buffers[0].data = malloc(IMAN_OUTPUT_BUFFER_SIZE);
+    output->buffers[1].data = malloc(IMAN_OUTPUT_BUFFER_SIZE);
+    
+    if (output->buffers[0].data == NULL || output->buffers[1].data == NULL) {
+        free(output->buffers[0].data);
+        free(output->buffers[1].data);
+        return IMAN_FALSE;
+    }
+    
+    output->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    
+    if (output->fd < 0) {
+        free(output->buffers[0].data);
+        free(output->buffers[1].data);
+        return IMAN_FALSE;
+    }
+    
+    pthread_mutex_init(&output->lock, NULL);
+    pthread_cond_init(&output->changed, NULL);
+    
+    if (pthread_create(&output->thread, NULL, &iman_output_thread, output) != 0) {
+        pthread_cond_destroy(&output->changed);
+        pthread_mutex_destroy(&output->lock);
+        close(output->fd);
+        free(output->buffers[0].data);
+        free(output->buffers[1].data);
+        return IMAN_FALSE;
+    }
+    
+    return IMAN_TRUE;
+}
+
+int iman_output_write(struct iman_output *output, const void *data, size_t size) {
+    struct iovec vector;
+    
+    vector.iov_base = (void *)data;
+    vector.iov_len = size;
+    
+    return iman_output_writev(output, &vector, 1);
+}
+
+/* Small pieces are gathered into the active buffer, anything buffer sized goes straight out in one writev */
+int iman_output_writev(struct iman_output *output, const struct iovec *vector, int count) {
+    struct iman_output_buffer *buffer = &output->buffers[output->active];
+    struct iovec direct[IMAN_OUTPUT_MAX_VECTOR + 1];
+    size_t total = 0;
+    int x;
+    
+    for (x = 0; x < count; ++x) {
+        total += vector[x].iov_len;
+    }
+    
+    if (total <= IMAN_OUTPUT_BUFFER_SIZE - buffer->used) {
+        for (x = 0; x < count; ++x) {
+            memcpy(&buffer->data[buffer->used], vector[x].iov_base, vector[x].iov_len);
+            buffer->used += vector[x].iov_len;
+        }
+        
+        output->offset += total;
+        return IMAN_TRUE;
+    }
+    
+    if (total < IMAN_OUTPUT_BUFFER_SIZE) {
+        if (iman_output_submit(output) != IMAN_TRUE)
+            return IMAN_FALSE;
+        
+        return iman_output_writev(output, vector, count);
+    }
+    
+    if (count > IMAN_OUTPUT_MAX_VECTOR)
+        return IMAN_FALSE;
+    
+    /* Everything queued so far has to land first, the buffered bytes lead the vector */
+    if (iman_output_wait(output) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    direct[0].iov_base = buffer->data;
+    direct[0].iov_len = buffer->used;
+    memcpy(&direct[1], vector, (size_t)count * sizeof(*vector));
+    
+    if (iman_output_write_all(output, direct, count + 1) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    buffer->used = 0;
+    output->offset += total;
+    return IMAN_TRUE;
+}
+
+/* Contiguous room for size bytes in the active buffer, so a producer can fill it in place */
+void *iman_output_reserve(struct iman_output *output, size_t size) {
+    struct iman_output_buffer *buffer;
+    
+    if (size > IMAN_OUTPUT_BUFFER_SIZE)
+        return NULL;
+    
+    if (size > IMAN_OUTPUT_BUFFER_SIZE - output->buffers[output->active].used && iman_output_submit(output) != IMAN_TRUE)
+        return NULL;
+    
+    buffer = &output->buffers[output->active];
+    return &buffer->data[buffer->used];
+}
+
+void iman_output_commit(struct iman_output *output, size_t size) {
+    output->buffers[output->active].used += size;
+    output->offset += size;
+}
+
+int iman_output_close(struct iman_output *output) {
+    int result = IMAN_TRUE;
+    
+    if (output->buffers[output->active].used != 0 && iman_output_submit(output) != IMAN_TRUE)
+        result = IMAN_FALSE;
+    
+    pthread_mutex_lock(&output->lock);
+    output->stopping = IMAN_TRUE;
+    pthread_cond_broadcast(&output->changed);
+    pthread_mutex_unlock(&output->lock);
+    
+    pthread_join(output->thread, NULL);
+    
+    if (output->error != 0)
+        result = IMAN_FALSE;
+    
+    if (close(output->fd) != 0)
+        result = IMAN_FALSE;
+    
+    pthread_cond_destroy(&output->changed);
+    pthread_mutex_destroy(&output->lock);
+    
+    free(output->buffers[0].data);
+    free(output->buffers[1].data);
+    
+    output->buffers[0].data = NULL;
+    output->buffers[1].data = NULL;
+    
+    return result;
+}
+
+static void *iman_output_thread(void *argument) {
+    struct iman_output *output = argument;
+    
+    pthread_mutex_lock(&output->lock);
+    
+    for (;;) {
+        struct iman_output_buffer *buffer;
+        struct iovec vector;
+        int written;
+        
+        while (output->pending == IMAN_FALSE && output->stopping == IMAN_FALSE) {
+            pthread_cond_wait(&output->changed, &output->lock);
+        }
+        
+        if (output->pending == IMAN_FALSE)
+            break;
+        
+        /* The caller owns the active buffer, the other one is ours until pending drops */
+        buffer = &output->buffers[output->active ^ 1];
+        pthread_mutex_unlock(&output->lock);
+        
+        vector.iov_base = buffer->data;
+        vector.iov_len = buffer->used;
+        written = iman_output_write_all(output, &vector, 1);
+        
+        pthread_mutex_lock(&output->lock);
+        
+        if (written != IMAN_TRUE)
+            output->error = IMAN_TRUE;
+        
+        buffer->used = 0;
+        output->pending = IMAN_FALSE;
+        pthread_cond_broadcast(&output->changed);
+    }
+    
+    pthread_mutex_unlock(&output->lock);
+    return NULL;
+}
+
+/* Hands the active buffer to the thread and carries on in the other one */
+static int iman_output_submit(struct iman_output *output) {
+    if (iman_output_wait(output) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    pthread_mutex_lock(&output->lock);
+    output->pending = IMAN_TRUE;
+    output->active ^= 1;
+    pthread_cond_broadcast(&output->changed);
+    pthread_mutex_unlock(&output->lock);
+    
+    return IMAN_TRUE;
+}
+
+static int iman_output_wait(struct iman_output *output) {
+    int error;
+    
+    pthread_mutex_lock(&output->lock);
+    
+    while (output->pending != IMAN_FALSE) {
+        pthread_cond_wait(&output->changed, &output->lock);
+    }
+    
+    error = output->error;
+    pthread_mutex_unlock(&output->lock);
+    
+    return error == 0 ? IMAN_TRUE : IMAN_FALSE;
+}
+
+/* Only one thread writes at a time, the buffer hand over orders the syscall count updates */
+static int iman_output_write_all(struct iman_output *output, struct iovec *vector, int count) {
+    while (count > 0) {
+        ssize_t written = writev(output->fd, vector, count);
+        
+        output->syscalls++;
+        
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            
+            return IMAN_FALSE;
+        }
+        
+        /* Step over whatever the kernel took, a short write can stop part way into an entry */
+        while (count > 0 && (size_t)written >= vector->iov_len) {
+            written -= (ssize_t)vector->iov_len;
+            ++vector;
+            --count;
+        }
+        
+        if (count > 0) {
+            vector->iov_base = (char *)vector->iov_base + written;
+            vector->iov_len -= (size_t)written;
+        }
+    }
+    
+    return IMAN_TRUE;
+}
\ No newline at end of file
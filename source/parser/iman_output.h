@@ -0,0 +1,55 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_OUTPUT_H
+#define _IMAN_OUTPUT_H
+
+#include <pthread.h>
+#include <sys/uio.h>
+
+struct iman_output_buffer {
+    char *data;
+    size_t used;
+};
+
+/*
+ * Double buffered output file: the caller fills one buffer while a background thread writes
+ * the other out, so a file costs a write per buffer rather than one per record.
+ */
+struct iman_output {
+    int fd;
+    
+    struct iman_output_buffer buffers[2];
+    unsigned int active;
+    
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    
+    /* Guarded by lock: the inactive buffer is waiting on the thread, the thread should exit */
+    int pending;
+    int stopping;
+    int error;
+    
+    /* Bytes handed over so far, which is also the file offset of the next byte */
+    uint64_t offset;
+    
+    /* writev calls made, short writes and retries included */
+    uint64_t syscalls;
+};
+
+int iman_output_open(struct iman_output *output, const char *path);
+
+int iman_output_write(struct iman_output *output, const void *data, size_t size);
+
+int iman_output_writev(struct iman_output *output, const struct iovec *vector, int count);
+
+void *iman_output_reserve(struct iman_output *output, size_t size);
+
+void iman_output_commit(struct iman_output *output, size_t size);
+
+int iman_output_close(struct iman_output *output);
+
+#endif
\ No newline at end of file
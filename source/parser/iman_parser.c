@@ -4,11 +4,17 @@
  */
 
 #include "../iman.h"
+#include "../iman_mapping.h"
+#include "iman_diagnostics.h"
 #include "iman_lexer.h"
+#include "iman_arena.h"
 #include "iman_reference.h"
+#include "iman_form_parser.h"
+#include "iman_stats.h"
 #include "iman_parser.h"
 
 #define IMAN_REFERENCE_DESC_BASE_SIZE 2048
+#define IMAN_PARSER_BASE_RANGES 256
 
 struct iman_parser_field_handler {
     const char *name;
@@ -21,6 +27,7 @@ static int iman_parser_read_field(struct iman_parser *parser, unsigned int depth
 
 static int iman_parser_handle_forms(struct iman_parser *parser, unsigned int depth);
 static int iman_parser_handle_description(struct iman_parser *parser, unsigned int depth);
+static int iman_parser_read_description(struct iman_parser *parser, unsigned int depth);
 static int iman_parser_handle_exceptions(struct iman_parser *parser, unsigned int depth);
 static int iman_parser_handle_flags(struct iman_parser *parser, unsigned int depth);
 static int iman_parser_handle_operation(struct iman_parser *parser, unsigned int depth);
@@ -37,28 +44,93 @@ static const struct iman_parser_field_handler iman_major_field_handler_table[] =
     { NULL, NULL }
 };
 
-int iman_parser_initialise(struct iman_parser *parser, const char *filename) {
+void iman_parser_initialise_span(struct iman_parser *parser, const char *data, size_t size, unsigned int first_line, struct iman_arena *arena, struct iman_symbol_table *symbols) {
     memset(parser, 0, sizeof(*parser));
+    parser->block.arena = arena;
+    parser->block.symbols = symbols;
     
-    parser->lexer.source = fopen(filename, "rb");
+    iman_lexer_open_span(&parser->lexer, data, size, first_line);
+}
+
+/*
+ * Splits the source into independently parseable block ranges. A block starts at a zero-indent line
+ * whose previous non-blank line was indented; anything before the first block is folded into it.
+ */
+int iman_parser_split_blocks(const char *data, size_t size, struct iman_parser_range **pranges, unsigned int *pcount) {
+    struct iman_parser_range *ranges = NULL;
+    unsigned int count = 0, capacity = 0, line = 1;
+    int previous_indented = IMAN_TRUE;
+    size_t offset = 0;
+    
+    while (offset < size) {
+        const char *newline = memchr(&data[offset], '\n', size - offset);
+        size_t end = newline != NULL ? (size_t)(newline - data) : size;
+        
+        if (end > offset) {
+            int indented = data[offset] == '\t' ? IMAN_TRUE : IMAN_FALSE;
+            
+            if (indented == IMAN_FALSE && previous_indented == IMAN_TRUE) {
+                if (count >= capacity) {
+                    unsigned int new_capacity = capacity ? capacity * 2 : IMAN_PARSER_BASE_RANGES;
+                    struct iman_parser_range *new_ranges = realloc(ranges, new_capacity * sizeof(*ranges));
+                    
+                    if (new_ranges == NULL) {
+                        free(ranges);
+                        return IMAN_FALSE;
+                    }
+                    
+                    ranges = new_ranges;
+                    capacity = new_capacity;
+                }
+                
+                ranges[count].offset = count == 0 ? 0 : offset;
+                ranges[count].line = count == 0 ? 1 : line;
+                
+                if (count > 0)
+                    ranges[count - 1].length = offset - ranges[count - 1].offset;
+                
+                count++;
+            }
+            
+            previous_indented = indented;
+        }
+        
+        offset = end + 1;
+        line++;
+    }
     
-    if (parser->lexer.source == NULL)
-        return IMAN_FALSE;
+    if (count > 0) {
+        ranges[count - 1].length = size - ranges[count - 1].offset;
+    } else if (size > 0) {
+        /* No block start at all, hand the lot over so the parser can complain about it */
+        ranges = malloc(sizeof(*ranges));
+        
+        if (ranges == NULL)
+            return IMAN_FALSE;
+        
+        ranges[0].offset = 0;
+        ranges[0].length = size;
+        ranges[0].line = 1;
+        count = 1;
+    }
     
+    *pranges = ranges;
+    *pcount = count;
     return IMAN_TRUE;
 }
 
 void iman_parser_release(struct iman_parser *parser) {
-    if (parser->lexer.source != NULL) {
-        fclose(parser->lexer.source);
-        parser->lexer.source = NULL;
-    }
+    iman_lexer_close(&parser->lexer);
     
     return;
 }
 
 int iman_parser_is_eof(struct iman_parser *parser) {
-    return feof(parser->lexer.source) ? IMAN_TRUE : IMAN_FALSE;
+    return iman_lexer_is_eof(&parser->lexer);
+}
+
+void iman_parser_skip_blank_lines(struct iman_parser *parser) {
+    iman_lexer_skip_blank_lines(&parser->lexer);
 }
 
 int iman_parser_read_block(struct iman_parser *parser) {
@@ -74,7 +146,7 @@ int iman_parser_read_block(struct iman_parser *parser) {
     }
     
     if (term_count == 0) {
-        printf("Error (L%u: C%u): expected at least one term definition but didn't get any.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1);
+        IMAN_ERROR("Error (L%u: C%u): expected at least one term definition but didn't get any.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1);
         
         parser->status = IMAN_PARSER_STATUS_ERROR;
         return IMAN_FALSE;
@@ -93,12 +165,12 @@ int iman_parser_read_block(struct iman_parser *parser) {
 }
 
 static int iman_parser_read_term(struct iman_parser *parser) {
-    char *definition_title = NULL;
+    const char *definition_title = NULL;
     unsigned int title_length = 0;
     struct iman_reference_term_definition * new_def;
     
     if (iman_lexer_expect_line_start(&parser->lexer) != IMAN_TRUE) {
-        printf("Error (L%u: C%u): expected to start out on a new line but didn't.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1);
+        IMAN_ERROR("Error (L%u: C%u): expected to start out on a new line but didn't.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1);
         
         parser->status = IMAN_PARSER_STATUS_ERROR;
         return IMAN_FALSE;
@@ -108,33 +180,52 @@ static int iman_parser_read_term(struct iman_parser *parser) {
         return IMAN_FALSE;
     }
     
-    new_def = malloc(sizeof(struct iman_reference_term_definition));
+    new_def = iman_arena_alloc(parser->block.arena, sizeof(struct iman_reference_term_definition));
+    
+    if (new_def == NULL) {
+        IMAN_ERROR("Error: out of memory while reading a term\n");
+        
+        parser->status = IMAN_PARSER_STATUS_ERROR;
+        return IMAN_FALSE;
+    }
+    
     memset(new_def, 0, sizeof(struct iman_reference_term_definition));
     
     new_def->next = parser->block.terms;
     parser->block.terms = new_def;
     
     do {
-        char *name = NULL;
+        const char *name_span = NULL;
+        unsigned int name_length = 0;
+        char *name;
         
-        if (iman_lexer_expect_name(&parser->lexer, &name) != IMAN_TRUE) {
-            printf("Error (L%u: C%u): expected a name\n", parser->lexer.pos.line, parser->lexer.pos.column + 1);
+        if (iman_lexer_expect_name(&parser->lexer, &name_span, &name_length) != IMAN_TRUE) {
+            IMAN_ERROR("Error (L%u: C%u): expected a name\n", parser->lexer.pos.line, parser->lexer.pos.column + 1);
             
             parser->status = IMAN_PARSER_STATUS_ERROR;
             return IMAN_FALSE;
         }
         
-        printf("Name (L%u: C%u): %s\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, name);
+        IMAN_TRACE("Name (L%u: C%u): %.*s\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, (int)name_length, name_span);
         
         if (parser->block.terms->name_count >= IMAN_REFERENCE_TERM_MAX_NAMES) {
-            printf("Error (L%u: C%u): attempted to add one too many term aliases, the maximum being %d. The offender is: %s.\n", 
+            IMAN_ERROR("Error (L%u: C%u): attempted to add one too many term aliases, the maximum being %d. The offender is: %.*s.\n", 
                    parser->lexer.pos.line, 
                    parser->lexer.pos.column + 1, 
                    parser->block.terms->name_count, 
-                   name
+                   (int)name_length,
+                   name_span
             );
             
-            free(name);
+            parser->status = IMAN_PARSER_STATUS_ERROR;
+            return IMAN_FALSE;
+        }
+        
+        name = iman_arena_strndup(parser->block.arena, name_span, name_length);
+        
+        if (name == NULL) {
+            IMAN_ERROR("Error: out of memory while reading a term name\n");
+            
             parser->status = IMAN_PARSER_STATUS_ERROR;
             return IMAN_FALSE;
         }
@@ -144,24 +235,24 @@ static int iman_parser_read_term(struct iman_parser *parser) {
     } while(iman_lexer_accept_syntax(&parser->lexer, '/') != IMAN_FALSE);
     
     if (iman_lexer_accept_syntax(&parser->lexer, '=') != IMAN_TRUE) {
-        printf("Error (L%u: C%u): expected an equals sign (=) followed by the term definition\n", parser->lexer.pos.line, parser->lexer.pos.column + 1);
+        IMAN_ERROR("Error (L%u: C%u): expected an equals sign (=) followed by the term definition\n", parser->lexer.pos.line, parser->lexer.pos.column + 1);
         
         parser->status = IMAN_PARSER_STATUS_ERROR;
         return IMAN_FALSE;
     }
     
     if (iman_lexer_consume_remaining(&parser->lexer, &definition_title, &title_length) != IMAN_TRUE) {
-        printf("Error (L%u: C%u): expected the term's definition title.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1);
+        IMAN_ERROR("Error (L%u: C%u): expected the term's definition title.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1);
         
         parser->status = IMAN_PARSER_STATUS_ERROR;
         return IMAN_FALSE;
     }
     
-    printf("Title (L%u: C%u): %s\n", parser->lexer.pos.line, parser->lexer.pos.column + 1,  definition_title);
-    
-    memcpy(parser->block.terms->title, definition_title, title_length);
+    IMAN_TRACE("Title (L%u: C%u): %.*s\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, (int)title_length, definition_title);
     
-    /* definition_title is a static allocation, no need to free it */
+    /* definition_title points into the mapped source, which outlives the block */
+    parser->block.terms->title = definition_title;
+    parser->block.terms->title_length = title_length;
     
     return IMAN_TRUE;
 }
@@ -169,10 +260,16 @@ static int iman_parser_read_term(struct iman_parser *parser) {
 static int iman_parser_read_field(struct iman_parser *parser, unsigned int depth) {
     const struct iman_parser_field_handler *field_handler;
     unsigned int name_length = 0;
-    char * name = NULL;
+    const char * name = NULL;
     
     if (iman_lexer_expect_line_start(&parser->lexer) != IMAN_TRUE) {
-        printf("Error (L%u: C%u): expected to start on a new line but didn't.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1);
+        /* Running off the end of a block range is how a block ends when parsed on its own */
+        if (iman_lexer_is_eof(&parser->lexer) == IMAN_TRUE) {
+            parser->status = IMAN_PARSER_STATUS_SUCCESS;
+            return IMAN_FALSE;
+        }
+        
+        IMAN_ERROR("Error (L%u: C%u): expected to start on a new line but didn't.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1);
         
         parser->status = IMAN_PARSER_STATUS_ERROR;
         return IMAN_FALSE;
@@ -183,94 +280,172 @@ static int iman_parser_read_field(struct iman_parser *parser, unsigned int depth
     }
     
     if (iman_lexer_expect_keyword(&parser->lexer, &name, &name_length) != IMAN_TRUE) {
-        printf("Error (L%u: C%u): expected a field name but didn't get it.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1);
+        IMAN_ERROR("Error (L%u: C%u): expected a field name but didn't get it.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1);
         
         parser->status = IMAN_PARSER_STATUS_ERROR;
         return IMAN_FALSE;
     }
     
-    name[name_length] = '\0';
-    printf("Field name (L%u: C%u): %s\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, name);
+    IMAN_TRACE("Field name (L%u: C%u): %.*s\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, (int)name_length, name);
     
     for (field_handler = iman_major_field_handler_table; field_handler->name != NULL; ++field_handler) {
-        if (strcmp(field_handler->name, name) == 0) {
+        if (strncmp(field_handler->name, name, name_length) == 0 && field_handler->name[name_length] == '\0') {
             return field_handler->parse(parser, depth + 1);
         }
     }
     
-    printf("Error (L%u: C%u): this field name (%s) isn't recognised.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, name);
+    IMAN_ERROR("Error (L%u: C%u): this field name (%.*s) isn't recognised.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, (int)name_length, name);
     
     parser->status = IMAN_PARSER_STATUS_ERROR;
     return IMAN_FALSE;
 }
 
 static int iman_parser_handle_forms(struct iman_parser *parser, unsigned int depth) {
+    struct iman_reference_form_definition **tail = &parser->block.forms;
+    uint64_t start_time = 0;
+    
+    /* Forms are kept in source order, the writer relies on it */
+    while (*tail != NULL)
+        tail = &(*tail)->next_form;
+    
     while(iman_lexer_expect_line_start(&parser->lexer) == IMAN_TRUE) {
-        char *line = NULL;
-        unsigned int line_length = 0;
+        struct iman_reference_form_definition *form;
+        const char *line = NULL;
+        unsigned int line_length = 0, start_column;
+        char *form_text;
         
         if (iman_lexer_accept_indent(&parser->lexer, depth) != IMAN_TRUE)
             break;
         
         if (iman_lexer_consume_remaining(&parser->lexer, &line, &line_length) != IMAN_TRUE) {
-            printf("Error (L%u: C%u): expected a line of text, with an indent depth of at least %d tabs.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, depth);
+            IMAN_ERROR("Error (L%u: C%u): expected a line of text, with an indent depth of at least %d tabs.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, depth);
             
             parser->status = IMAN_PARSER_STATUS_ERROR;
             return IMAN_FALSE;
         }
         
-        printf("Form line (L%u: C%u): %s\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, line);
+        IMAN_TRACE("Form line (L%u: C%u): %.*s\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, (int)line_length, line);
+        
+        if (line_length == 0)
+            continue;
+        
+        start_column = parser->lexer.pos.column - line_length;
+        
+        /* The form parser wants a terminated line; the copy, and the spans into it, go when the arena is reset */
+        form = iman_arena_alloc(parser->block.arena, sizeof(*form));
+        form_text = iman_arena_strndup(parser->block.arena, line, line_length);
+        
+        if (form == NULL || form_text == NULL) {
+            IMAN_ERROR("Error: out of memory while reading a form\n");
+            
+            parser->status = IMAN_PARSER_STATUS_ERROR;
+            return IMAN_FALSE;
+        }
+        
+        memset(form, 0, sizeof(*form));
+        
+        if (parser->stats != NULL)
+            start_time = iman_stats_now();
+        
+        if (iman_parse_form(form_text, parser->lexer.pos.line, start_column + 1, parser->block.symbols, form) != IMAN_TRUE) {
+            IMAN_ERROR("Error (L%u: C%u): this instruction form couldn't be parsed.\n", parser->lexer.pos.line, start_column + 1);
+            
+            parser->status = IMAN_PARSER_STATUS_ERROR;
+            return IMAN_FALSE;
+        }
+        
+        if (parser->stats != NULL) {
+            parser->stats->nanoseconds[IMAN_STATS_PHASE_FORMS] += iman_stats_now() - start_time;
+            parser->stats->counters[IMAN_STATS_FORMS]++;
+        }
+        
+        *tail = form;
+        tail = &form->next_form;
     }
     
     return IMAN_TRUE;
 }
 
 static int iman_parser_handle_description(struct iman_parser *parser, unsigned int depth) {
+    uint64_t start_time;
+    int result;
+    
+    if (parser->stats == NULL)
+        return iman_parser_read_description(parser, depth);
+    
+    start_time = iman_stats_now();
+    result = iman_parser_read_description(parser, depth);
+    parser->stats->nanoseconds[IMAN_STATS_PHASE_DESCRIPTION] += iman_stats_now() - start_time;
+    
+    return result;
+}
+
+static int iman_parser_read_description(struct iman_parser *parser, unsigned int depth) {
     if (parser->block.desc.buffer != NULL) {
-        printf("Error (L%u: C%u): redeclaration of the description.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1);
+        IMAN_ERROR("Error (L%u: C%u): redeclaration of the description.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1);
+        
+        parser->status = IMAN_PARSER_STATUS_ERROR;
+        return IMAN_FALSE;
+    }
+    
+    parser->block.desc.buffer = iman_arena_alloc(parser->block.arena, IMAN_REFERENCE_DESC_BASE_SIZE);
+    
+    if (parser->block.desc.buffer == NULL) {
+        IMAN_ERROR("Error: out of memory while reading a description\n");
         
         parser->status = IMAN_PARSER_STATUS_ERROR;
         return IMAN_FALSE;
     }
     
-    parser->block.desc.buffer = malloc(IMAN_REFERENCE_DESC_BASE_SIZE);
     parser->block.desc.size = IMAN_REFERENCE_DESC_BASE_SIZE;
     parser->block.desc.offset = 0;
-    memset(parser->block.desc.buffer, 0, IMAN_REFERENCE_DESC_BASE_SIZE);
+    parser->block.desc.buffer[0] = '\0';
     
     while(iman_lexer_expect_line_start(&parser->lexer) == IMAN_TRUE) {
-        char *line = NULL;
+        const char *line = NULL;
         unsigned int line_length = 0;
         
         if (iman_lexer_accept_indent(&parser->lexer, depth) != IMAN_TRUE)
             break;
         
         if (iman_lexer_consume_remaining(&parser->lexer, &line, &line_length) != IMAN_TRUE) {
-            printf("Error (L%u: C%u): expected a line of text, with an indent depth of at least %d tabs.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, depth);
+            IMAN_ERROR("Error (L%u: C%u): expected a line of text, with an indent depth of at least %d tabs.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, depth);
             
             parser->status = IMAN_PARSER_STATUS_ERROR;
             return IMAN_FALSE;
         }
         
-        printf("Description line (L%u: C%u): %s\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, line);
+        IMAN_TRACE("Description line (L%u: C%u): %.*s\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, (int)line_length, line);
         
-        if ((parser->block.desc.offset + line_length + 1) > parser->block.desc.size) {
+        /* Room for the line, its newline and the terminator the writer copies out */
+        if ((parser->block.desc.offset + line_length + 2) > parser->block.desc.size) {
             unsigned int new_size = parser->block.desc.size * 2;
-            char *new_block = malloc(new_size);
+            char *new_block;
             
-            memset(new_block, 0, new_size);
-            memcpy(new_block, parser->block.desc.buffer, parser->block.desc.offset);
+            while (new_size < parser->block.desc.offset + line_length + 2)
+                new_size *= 2;
             
-            free(parser->block.desc.buffer);
+            new_block = iman_arena_grow(parser->block.arena, parser->block.desc.buffer, parser->block.desc.offset, new_size);
+            
+            if (new_block == NULL) {
+                IMAN_ERROR("Error: out of memory while reading a description\n");
+                
+                parser->status = IMAN_PARSER_STATUS_ERROR;
+                return IMAN_FALSE;
+            }
             
             parser->block.desc.buffer = new_block;
             parser->block.desc.size = new_size;
+            
+            if (parser->stats != NULL)
+                parser->stats->counters[IMAN_STATS_DESCRIPTION_GROWS]++;
         }
         
         memcpy(&parser->block.desc.buffer[parser->block.desc.offset], line, line_length);
         
         parser->block.desc.offset += line_length + 1;
         parser->block.desc.buffer[parser->block.desc.offset - 1] = '\n';
+        parser->block.desc.buffer[parser->block.desc.offset] = '\0';
     }
     
     return IMAN_TRUE;
@@ -278,20 +453,20 @@ static int iman_parser_handle_description(struct iman_parser *parser, unsigned i
 
 static int iman_parser_handle_exceptions(struct iman_parser *parser, unsigned int depth) {
     while(iman_lexer_expect_line_start(&parser->lexer) == IMAN_TRUE) {
-        char *line = NULL;
+        const char *line = NULL;
         unsigned int line_length = 0;
         
         if (iman_lexer_accept_indent(&parser->lexer, depth) != IMAN_TRUE)
             break;
         
         if (iman_lexer_consume_remaining(&parser->lexer, &line, &line_length) != IMAN_TRUE) {
-            printf("Error (L%u: C%u): expected a line of text, with an indent depth of at least %d tabs.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, depth);
+            IMAN_ERROR("Error (L%u: C%u): expected a line of text, with an indent depth of at least %d tabs.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, depth);
             
             parser->status = IMAN_PARSER_STATUS_ERROR;
             return IMAN_FALSE;
         }
         
-        printf("Exceptions line (L%u: C%u): %s\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, line);
+        IMAN_TRACE("Exceptions line (L%u: C%u): %.*s\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, (int)line_length, line);
     }
     
     return IMAN_TRUE;
@@ -299,20 +474,20 @@ static int iman_parser_handle_exceptions(struct iman_parser *parser, unsigned in
 
 static int iman_parser_handle_flags(struct iman_parser *parser, unsigned int depth) {
     while(iman_lexer_expect_line_start(&parser->lexer) == IMAN_TRUE) {
-        char *line = NULL;
+        const char *line = NULL;
         unsigned int line_length = 0;
         
         if (iman_lexer_accept_indent(&parser->lexer, depth) != IMAN_TRUE)
             break;
         
         if (iman_lexer_consume_remaining(&parser->lexer, &line, &line_length) != IMAN_TRUE) {
-            printf("Error (L%u: C%u): expected a line of text, with an indent depth of at least %d tabs.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, depth);
+            IMAN_ERROR("Error (L%u: C%u): expected a line of text, with an indent depth of at least %d tabs.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, depth);
             
             parser->status = IMAN_PARSER_STATUS_ERROR;
             return IMAN_FALSE;
         }
         
-        printf("Flags line (L%u: C%u): %s\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, line);
+        IMAN_TRACE("Flags line (L%u: C%u): %.*s\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, (int)line_length, line);
     }
     
     return IMAN_TRUE;
@@ -320,20 +495,20 @@ static int iman_parser_handle_flags(struct iman_parser *parser, unsigned int dep
 
 static int iman_parser_handle_operation(struct iman_parser *parser, unsigned int depth) {
     while(iman_lexer_expect_line_start(&parser->lexer) == IMAN_TRUE) {
-        char *line = NULL;
+        const char *line = NULL;
         unsigned int line_length = 0;
         
         if (iman_lexer_accept_indent(&parser->lexer, depth) != IMAN_TRUE)
             break;
         
         if (iman_lexer_consume_remaining(&parser->lexer, &line, &line_length) != IMAN_TRUE) {
-            printf("Error (L%u: C%u): expected a line of text, with an indent depth of at least %d tabs.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, depth);
+            IMAN_ERROR("Error (L%u: C%u): expected a line of text, with an indent depth of at least %d tabs.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, depth);
             
             parser->status = IMAN_PARSER_STATUS_ERROR;
             return IMAN_FALSE;
         }
         
-        printf("Operation line (L%u: C%u): %s\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, line);
+        IMAN_TRACE("Operation line (L%u: C%u): %.*s\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, (int)line_length, line);
     }
     
     return IMAN_TRUE;
@@ -341,20 +516,20 @@ static int iman_parser_handle_operation(struct iman_parser *parser, unsigned int
 
 static int iman_parser_handle_meta(struct iman_parser *parser, unsigned int depth) {
     while(iman_lexer_expect_line_start(&parser->lexer) == IMAN_TRUE) {
-        char *line = NULL;
+        const char *line = NULL;
         unsigned int line_length = 0;
         
         if (iman_lexer_accept_indent(&parser->lexer, depth) != IMAN_TRUE)
             break;
         
         if (iman_lexer_consume_remaining(&parser->lexer, &line, &line_length) != IMAN_TRUE) {
-            printf("Error (L%u: C%u): expected a line of text, with an indent depth of at least %d tabs.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, depth);
+            IMAN_ERROR("Error (L%u: C%u): expected a line of text, with an indent depth of at least %d tabs.\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, depth);
             
             parser->status = IMAN_PARSER_STATUS_ERROR;
             return IMAN_FALSE;
         }
         
-        printf("meta line (L%u: C%u): %s\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, line);
+        IMAN_TRACE("meta line (L%u: C%u): %.*s\n", parser->lexer.pos.line, parser->lexer.pos.column + 1, (int)line_length, line);
     }
     
     return IMAN_TRUE;
@@ -17,14 +17,27 @@ struct iman_parser {
     enum iman_parser_status status;
     
     struct iman_reference_block block;
+    
+    /* Set by the caller to collect timings and counters, NULL otherwise */
+    struct iman_stats *stats;
+};
+
+struct iman_parser_range {
+    size_t offset;
+    size_t length;
+    unsigned int line;
 };
 
-int iman_parser_initialise(struct iman_parser *parser, const char *filename);
+void iman_parser_initialise_span(struct iman_parser *parser, const char *data, size_t size, unsigned int first_line, struct iman_arena *arena, struct iman_symbol_table *symbols);
+
+int iman_parser_split_blocks(const char *data, size_t size, struct iman_parser_range **pranges, unsigned int *pcount);
 
 void iman_parser_release(struct iman_parser *parser);
 
 int iman_parser_is_eof(struct iman_parser *parser);
 
+void iman_parser_skip_blank_lines(struct iman_parser *parser);
+
 int iman_parser_read_block(struct iman_parser *parser);
 
 #endif
\ No newline at end of file
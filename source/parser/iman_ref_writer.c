@@ -4,108 +4,1412 @@
  */
 
 #include "../iman.h"
+#include "iman_diagnostics.h"
 #include "iman_reference.h"
 #include "iman_binary_writer.h"
+#include "iman_name_hash.h"
+#include "iman_name_trie.h"
+#include "iman_trigram.h"
+#include "iman_facet.h"
+#include "iman_dictionary.h"
+#include "iman_output.h"
+#include "iman_symbols.h"
+#include "../iman_mapping.h"
+#include "iman_manifest.h"
 #include "iman_ref_writer.h"
+#include "../iman_hash.h"
 #include <zlib.h>
+#include <unistd.h>
 
-#define IMAN_MAX_PATH 1024
+#define IMAN_REF_WRITER_TEMP_EXT ".tmp"
+#define IMAN_REF_WRITER_BASE_NAMES 1024
+#define IMAN_REF_WRITER_BASE_BLOCKS 256
+#define IMAN_REF_WRITER_BASE_BUFFER 16384
+#define IMAN_REF_WRITER_MAX_SECTIONS 8
 
-static int write_index_entry(struct iman_ref_writer *writer, const char *name, long offset);
-static int write_table_entry(struct iman_ref_writer *writer, struct iman_reference_block *block, long block_offset);
+struct iman_ref_section {
+    uint32_t id;
+    const char *data;
+    size_t size;
+};
+
+static int reserve_buffer(struct iman_ref_buffer *buffer, uint32_t length);
+static int add_form_text(struct iman_ref_buffer *text, const struct iman_reference_text *value, uint32_t *poffset);
+static int build_form_text(struct iman_ref_record *record, const struct iman_reference_form_definition *forms, uint32_t *pcount);
+static void put_form_record(struct iman_binary_writer *binary_writer, struct iman_ref_buffer *text, const struct iman_reference_form_definition *form);
+static int copy_block_symbols(struct iman_ref_record *record, const struct iman_symbol_table *symbols);
+static int map_record_symbols(struct iman_ref_writer *writer, const struct iman_ref_record *record);
+static int remap_form_symbols(struct iman_ref_writer *writer, char *payload, uint32_t length, uint32_t symbol_count);
+static int build_symbol_section(struct iman_ref_writer *writer, char **pdata, size_t *psize);
+static uint32_t read_uint32(const char *data);
+static int add_name_entry(struct iman_ref_writer *writer, const char *name, uint32_t length);
+static struct iman_ref_writer_block *add_block_entry(struct iman_ref_writer *writer);
+static int add_block_payload(struct iman_ref_writer *writer, const char *payload, uint32_t length);
+static int write_table(struct iman_ref_writer *writer);
+static int open_deflater(z_stream *deflater);
+static int compress_block(struct iman_ref_writer *writer, z_stream *deflater, const struct iman_ref_writer_block *block, uint32_t *psize);
+static void drain_table(struct iman_ref_writer *writer);
+static int write_index(struct iman_ref_writer *writer, struct iman_output *output, uint32_t magic, const struct iman_ref_section *sections, unsigned int section_count);
+static int write_manifest(struct iman_ref_writer *writer, const char *symbols, size_t symbols_size);
+static int open_output(struct iman_output *output, const char *path);
+static int close_output(struct iman_ref_writer *writer, struct iman_output *output);
+static int replace_file(const char *path, int keep);
+static void release_writer(struct iman_ref_writer *writer);
+static int build_name_hash_section(struct iman_ref_writer *writer, char **pdata, size_t *psize);
+static int build_name_trie_section(struct iman_ref_writer *writer, char **pdata, size_t *psize);
+static int build_block_directory_section(struct iman_ref_writer *writer, char **pdata, size_t *psize);
+static int write_search_file(struct iman_ref_writer *writer);
+static const char *block_payload(struct iman_ref_writer *writer, const struct iman_ref_writer_block *block, z_stream *inflater);
+static const char *find_payload_field(const char *payload, uint32_t length, uint32_t id, uint32_t *pfield_length);
+static int build_table_info_section(struct iman_ref_writer *writer, char *data, size_t *psize);
+static int compare_name_entries(const void *left, const void *right);
+static int same_name(struct iman_ref_writer *writer, const struct iman_ref_writer_name *a, const struct iman_ref_writer_name *b);
 
 int iman_ref_writer_open(struct iman_ref_writer *writer, const char *target_dir, const char *arch_name) {
-    char path_buffer[IMAN_MAX_PATH];
-    
     memset(writer, 0, sizeof (*writer));
+    iman_symbol_table_initialise(&writer->symbols);
+    
+    if (snprintf(writer->index_path, IMAN_REF_WRITER_MAX_PATH, "%s/%s" IMAN_REF_INDEX_EXT, target_dir, arch_name) >= IMAN_REF_WRITER_MAX_PATH ||
+        snprintf(writer->table_path, IMAN_REF_WRITER_MAX_PATH, "%s/%s" IMAN_REF_TABLE_EXT, target_dir, arch_name) >= IMAN_REF_WRITER_MAX_PATH ||
+        snprintf(writer->manifest_path, IMAN_REF_WRITER_MAX_PATH, "%s/%s" IMAN_REF_MANIFEST_EXT, target_dir, arch_name) >= IMAN_REF_WRITER_MAX_PATH ||
+        snprintf(writer->search_path, IMAN_REF_WRITER_MAX_PATH, "%s/%s" IMAN_REF_SEARCH_EXT, target_dir, arch_name) >= IMAN_REF_WRITER_MAX_PATH) {
+        IMAN_ERROR("Error: output path is too long\n");
+        return IMAN_FALSE;
+    }
     
-    if (snprintf(path_buffer, IMAN_MAX_PATH, "%s/%s" IMAN_REF_INDEX_EXT, target_dir, arch_name) >= IMAN_MAX_PATH) {
-        puts("Error: output index path is too long");
+    if (open_output(&writer->index_output, writer->index_path) != IMAN_TRUE) {
+        IMAN_ERROR("Error: unable to open index output file %s\n", writer->index_path);
         return IMAN_FALSE;
     }
     
-    writer->index_output = fopen(path_buffer, "wb");
+    IMAN_INFO("Info: index file is %s\n", writer->index_path);
     
-    if (writer->index_output == NULL) {
-        printf("Error: unable to open index output file %s\n", path_buffer);
+    if (open_output(&writer->table_output, writer->table_path) != IMAN_TRUE) {
+        IMAN_ERROR("Error: unable to open table output file %s\n", writer->table_path);
+        iman_output_close(&writer->index_output);
+        replace_file(writer->index_path, IMAN_FALSE);
         return IMAN_FALSE;
     }
     
-    printf("Info: index file is %s\n", path_buffer);
+    IMAN_INFO("Info: table file is %s\n", writer->table_path);
+    
+    return IMAN_TRUE;
+}
+
+int iman_ref_writer_close(struct iman_ref_writer *writer) {
+    struct iman_ref_section sections[IMAN_REF_WRITER_MAX_SECTIONS];
+    unsigned int section_count = 0;
+    char table_info[IMAN_TABLE_INFO_SIZE];
+    size_t table_info_size = 0;
+    char *name_hash = NULL;
+    size_t name_hash_size = 0;
+    char *symbols = NULL;
+    size_t symbols_size = 0;
+    char *name_trie = NULL;
+    size_t name_trie_size = 0;
+    char *directory = NULL;
+    size_t directory_size = 0;
+    int result = IMAN_TRUE, manifest_result = IMAN_FALSE;
+    
+    if (write_table(writer) != IMAN_TRUE) {
+        IMAN_ERROR("Error: unable to write the reference table\n");
+        result = IMAN_FALSE;
+    } else if (build_name_hash_section(writer, &name_hash, &name_hash_size) != IMAN_TRUE) {
+        result = IMAN_FALSE;
+    } else if (build_symbol_section(writer, &symbols, &symbols_size) != IMAN_TRUE) {
+        IMAN_ERROR("Error: unable to build the symbol section\n");
+        result = IMAN_FALSE;
+    } else if (build_name_trie_section(writer, &name_trie, &name_trie_size) != IMAN_TRUE) {
+        result = IMAN_FALSE;
+    } else if (build_block_directory_section(writer, &directory, &directory_size) != IMAN_TRUE) {
+        result = IMAN_FALSE;
+    } else if (write_search_file(writer) != IMAN_TRUE) {
+        IMAN_ERROR("Error: unable to write the search index\n");
+        result = IMAN_FALSE;
+    } else {
+        build_table_info_section(writer, table_info, &table_info_size);
+        
+        sections[section_count].id = IMAN_SECTION_ID_TABLE_INFO;
+        sections[section_count].data = table_info;
+        sections[section_count].size = table_info_size;
+        section_count++;
+        
+        if (writer->dictionary.offset != 0) {
+            sections[section_count].id = IMAN_SECTION_ID_DICTIONARY;
+            sections[section_count].data = writer->dictionary.buffer;
+            sections[section_count].size = writer->dictionary.offset;
+            section_count++;
+        }
+        
+        sections[section_count].id = IMAN_SECTION_ID_NAME_HASH;
+        sections[section_count].data = name_hash;
+        sections[section_count].size = name_hash_size;
+        section_count++;
+        
+        sections[section_count].id = IMAN_SECTION_ID_NAME_HEAP;
+        sections[section_count].data = writer->name_heap.buffer;
+        sections[section_count].size = writer->name_heap.offset;
+        section_count++;
+        
+        sections[section_count].id = IMAN_SECTION_ID_SYMBOLS;
+        sections[section_count].data = symbols;
+        sections[section_count].size = symbols_size;
+        section_count++;
+        
+        sections[section_count].id = IMAN_SECTION_ID_NAME_TRIE;
+        sections[section_count].data = name_trie;
+        sections[section_count].size = name_trie_size;
+        section_count++;
+        
+        sections[section_count].id = IMAN_SECTION_ID_BLOCK_DIRECTORY;
+        sections[section_count].data = directory;
+        sections[section_count].size = directory_size;
+        section_count++;
+        
+        result = write_index(writer, &writer->index_output, IMAN_INDEX_MAGIC, sections, section_count);
+    }
+    
+    if (result == IMAN_TRUE)
+        manifest_result = write_manifest(writer, symbols, symbols_size);
+    
+    free(name_hash);
+    free(symbols);
+    free(name_trie);
+    free(directory);
+    release_writer(writer);
+    
+    if (close_output(writer, &writer->index_output) != IMAN_TRUE)
+        result = IMAN_FALSE;
+    
+    if (close_output(writer, &writer->table_output) != IMAN_TRUE)
+        result = IMAN_FALSE;
+    
+    /* A failed build leaves the previous table, index, search index and manifest untouched */
+    if (replace_file(writer->table_path, result) != IMAN_TRUE || replace_file(writer->index_path, result) != IMAN_TRUE ||
+        replace_file(writer->search_path, result) != IMAN_TRUE) {
+        IMAN_ERROR("Error: unable to replace the previous table and index\n");
+        result = IMAN_FALSE;
+    }
+    
+    if (result != IMAN_TRUE) {
+        replace_file(writer->manifest_path, IMAN_FALSE);
+        return result;
+    }
     
-    if (snprintf(path_buffer, IMAN_MAX_PATH, "%s/%s" IMAN_REF_TABLE_EXT, target_dir, arch_name) >= IMAN_MAX_PATH) {
-        puts("Error: output table path is too long");
+    /* A stale manifest would describe the old table, so it goes even when the new one couldn't be written */
+    if (manifest_result != IMAN_TRUE || replace_file(writer->manifest_path, IMAN_TRUE) != IMAN_TRUE) {
+        IMAN_INFO("Warning: unable to write the build manifest, the next build will be a full one\n");
+        replace_file(writer->manifest_path, IMAN_FALSE);
+        unlink(writer->manifest_path);
+    }
+    
+    return result;
+}
+
+/* Throws the whole build away without training, compressing or writing the manifest */
+void iman_ref_writer_abort(struct iman_ref_writer *writer) {
+    release_writer(writer);
+    
+    close_output(writer, &writer->index_output);
+    close_output(writer, &writer->table_output);
+    
+    replace_file(writer->table_path, IMAN_FALSE);
+    replace_file(writer->index_path, IMAN_FALSE);
+    replace_file(writer->search_path, IMAN_FALSE);
+    replace_file(writer->manifest_path, IMAN_FALSE);
+}
+
+/* Trains the dictionary on every payload and lays out where each block will be deflated to */
+int iman_ref_writer_train(struct iman_ref_writer *writer) {
+    z_stream deflater;
+    size_t staging_size = 0;
+    uint32_t x;
+    
+    if (writer->table.trained == IMAN_TRUE)
+        return IMAN_TRUE;
+    
+    /* An incremental build keeps the old dictionary, the reused blocks were deflated against it */
+    if (writer->dictionary_reused != IMAN_TRUE) {
+        if (reserve_buffer(&writer->dictionary, IMAN_TABLE_DICTIONARY_SIZE) != IMAN_TRUE)
+            return IMAN_FALSE;
+        
+        if (iman_dictionary_train(writer->payloads.buffer, writer->payloads.offset, writer->dictionary.buffer, IMAN_TABLE_DICTIONARY_SIZE, &writer->dictionary.offset) != IMAN_TRUE)
+            return IMAN_FALSE;
+        
+        IMAN_INFO("Info: trained a %u byte table dictionary\n", writer->dictionary.offset);
+    }
+    
+    memset(&deflater, 0, sizeof(deflater));
+    
+    if (open_deflater(&deflater) != IMAN_TRUE) {
+        IMAN_ERROR("Error: unable to initialise the table compressor\n");
         return IMAN_FALSE;
     }
     
-    writer->table_output = fopen(path_buffer, "wb");
+    /* The bound only depends on the stream parameters, so every block gets a fixed slot up front */
+    for (x = 0; x < writer->blocks.count; ++x) {
+        struct iman_ref_writer_block *block = &writer->blocks.entries[x];
+        
+        if (block->table_entry != NULL)
+            continue;
+        
+        block->staged_offset = staging_size;
+        staging_size += IMAN_TABLE_BLOCK_HEADER_SIZE + deflateBound(&deflater, block->payload_length);
+    }
+    
+    deflateEnd(&deflater);
+    writer->table.staging = malloc(staging_size > 0 ? staging_size : 1);
+    
+    if (writer->table.staging == NULL)
+        return IMAN_FALSE;
+    
+    pthread_mutex_init(&writer->table.lock, NULL);
+    writer->table.next_block = 0;
+    writer->table.next_write = 0;
+    writer->table.writing = IMAN_FALSE;
+    writer->table.error = IMAN_FALSE;
+    writer->table.trained = IMAN_TRUE;
     
-    if (writer->table_output == NULL) {
-        printf("Error: unable to open table output file %s\n", path_buffer);
-        fclose(writer->index_output);
+    return IMAN_TRUE;
+}
+
+/* Deflates blocks until none are left unclaimed, any number of threads can run this at once with a stream each */
+int iman_ref_writer_compress(struct iman_ref_writer *writer) {
+    z_stream deflater;
+    int result;
+    
+    memset(&deflater, 0, sizeof(deflater));
+    
+    if (open_deflater(&deflater) != IMAN_TRUE) {
+        IMAN_ERROR("Error: unable to initialise the table compressor\n");
+        
+        pthread_mutex_lock(&writer->table.lock);
+        writer->table.error = IMAN_TRUE;
+        pthread_mutex_unlock(&writer->table.lock);
         return IMAN_FALSE;
     }
     
-    printf("Info: table file is %s\n", path_buffer);
+    for (;;) {
+        struct iman_ref_writer_block *block = NULL;
+        uint32_t size;
+        
+        pthread_mutex_lock(&writer->table.lock);
+        
+        while (writer->table.error == IMAN_FALSE && writer->table.next_block < writer->blocks.count) {
+            block = &writer->blocks.entries[writer->table.next_block++];
+            
+            if (block->table_entry == NULL)
+                break;
+            
+            block = NULL;
+        }
+        
+        pthread_mutex_unlock(&writer->table.lock);
+        
+        if (block == NULL)
+            break;
+        
+        if (compress_block(writer, &deflater, block, &size) != IMAN_TRUE) {
+            pthread_mutex_lock(&writer->table.lock);
+            writer->table.error = IMAN_TRUE;
+            pthread_mutex_unlock(&writer->table.lock);
+            break;
+        }
+        
+        pthread_mutex_lock(&writer->table.lock);
+        block->table_size = size;
+        drain_table(writer);
+        pthread_mutex_unlock(&writer->table.lock);
+    }
+    
+    deflateEnd(&deflater);
+    
+    /* Reused blocks after the last fresh one are written by whichever thread gets here */
+    pthread_mutex_lock(&writer->table.lock);
+    drain_table(writer);
+    result = writer->table.error == IMAN_FALSE ? IMAN_TRUE : IMAN_FALSE;
+    pthread_mutex_unlock(&writer->table.lock);
+    
+    return result;
+}
+
+int iman_ref_writer_add_record(struct iman_ref_writer *writer, const struct iman_ref_record *record) {
+    uint32_t offset = 0, x;
+    
+    for (x = 0; x < record->name_count; ++x) {
+        const char *name = &record->names.buffer[offset];
+        uint32_t length = (uint32_t)strlen(name);
+        
+        if (add_name_entry(writer, name, length) != IMAN_TRUE) {
+            IMAN_ERROR("Error: unable to add an index entry for %s\n", name);
+            return IMAN_FALSE;
+        }
+        
+        offset += length + 1;
+    }
+    
+    if (map_record_symbols(writer, record) != IMAN_TRUE) {
+        IMAN_ERROR("Error: unable to add a block's symbols to the index\n");
+        return IMAN_FALSE;
+    }
+    
+    if (add_block_payload(writer, record->payload.buffer, record->payload.offset) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    writer->blocks.entries[writer->blocks.count - 1].source_hash = record->source_hash;
+    
+    if (record->symbol_count == 0)
+        return IMAN_TRUE;
+    
+    /* Records are merged in source order, so index-wide ids come out the same on every build */
+    return remap_form_symbols(writer, &writer->payloads.buffer[writer->blocks.entries[writer->blocks.count - 1].payload_offset], record->payload.offset, record->symbol_count);
+}
+
+/* Interns the previous build's symbols first so the ids inside reused blocks keep their meaning */
+int iman_ref_writer_seed(struct iman_ref_writer *writer, const struct iman_manifest *manifest) {
+    uint32_t x;
+    
+    writer->dictionary.offset = 0;
+    
+    if (manifest->dictionary.size != 0) {
+        if (reserve_buffer(&writer->dictionary, manifest->dictionary.size) != IMAN_TRUE)
+            return IMAN_FALSE;
+        
+        memcpy(writer->dictionary.buffer, manifest->dictionary.data, manifest->dictionary.size);
+        writer->dictionary.offset = manifest->dictionary.size;
+    }
+    
+    writer->dictionary_reused = IMAN_TRUE;
+    
+    for (x = 0; x < manifest->symbols.count; ++x) {
+        const char *name = iman_manifest_symbol(manifest, x);
+        uint16_t id;
+        
+        if (name == NULL || iman_symbol_intern(&writer->symbols, name, (uint32_t)strlen(name), &id) != IMAN_TRUE || id != x)
+            return IMAN_FALSE;
+    }
     
     return IMAN_TRUE;
 }
 
-int iman_ref_writer_close(struct iman_ref_writer *writer) {
-    fclose(writer->index_output);
-    fclose(writer->table_output);
+int iman_ref_writer_add_reused(struct iman_ref_writer *writer, const struct iman_manifest_block *block) {
+    struct iman_ref_writer_block *entry;
+    uint32_t offset = 0, x;
+    
+    for (x = 0; x < block->name_count; ++x) {
+        const char *name = &block->names[offset];
+        uint32_t length = (uint32_t)strlen(name);
+        
+        if (add_name_entry(writer, name, length) != IMAN_TRUE) {
+            IMAN_ERROR("Error: unable to add an index entry for %s\n", name);
+            return IMAN_FALSE;
+        }
+        
+        offset += length + 1;
+    }
+    
+    entry = add_block_entry(writer);
+    
+    if (entry == NULL)
+        return IMAN_FALSE;
+    
+    entry->source_hash = block->source_hash;
+    entry->payload_length = block->payload_length;
+    entry->table_entry = block->table_entry;
+    entry->table_size = block->table_size;
+    
+    if (block->payload_length > writer->max_block_size)
+        writer->max_block_size = block->payload_length;
     
     return IMAN_TRUE;
 }
 
-int iman_ref_writer_add(struct iman_ref_writer *writer, struct iman_reference_block *block) {
+int iman_ref_record_serialise(struct iman_ref_record *record, struct iman_reference_block *block) {
     struct iman_reference_term_definition *term;
-    long block_offset;
+    const struct iman_reference_form_definition *form;
+    struct iman_binary_writer binary_writer;
+    uint32_t desc_length = block->desc.buffer != NULL ? block->desc.offset + 1 : 0;
+    uint32_t form_count = 0, forms_length = 0, payload_length;
     
-    block_offset = ftell(writer->table_output);
+    record->names.offset = 0;
+    record->name_count = 0;
+    record->payload.offset = 0;
+    record->symbols.offset = 0;
+    record->symbol_count = 0;
     
     for(term = block->terms; term != NULL; term = term->next) {
         unsigned int x;
         
         for (x = 0; x < term->name_count; ++x) {
-            if (write_index_entry(writer, term->names[x], block_offset) != IMAN_TRUE) {
-                printf("Error: unable to write an index entry for %s\n", term->names[x]);
+            uint32_t length = (uint32_t)strlen(term->names[x]) + 1;
+            
+            if (reserve_buffer(&record->names, length) != IMAN_TRUE)
                 return IMAN_FALSE;
-            }
+            
+            memcpy(&record->names.buffer[record->names.offset], term->names[x], length);
+            record->names.offset += length;
+            record->name_count++;
         }
     }
     
-    return write_table_entry(writer, block, block_offset);
+    if (block->symbols != NULL && copy_block_symbols(record, block->symbols) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    if (build_form_text(record, block->forms, &form_count) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    if (form_count != 0)
+        forms_length = IMAN_FORMS_HEADER_SIZE + form_count * IMAN_FORM_RECORD_SIZE + record->form_text.offset;
+    
+    payload_length = IMAN_TABLE_FIELD_HEADER_SIZE + desc_length + IMAN_TABLE_FIELD_ALIGNMENT;
+    
+    if (form_count != 0)
+        payload_length += IMAN_TABLE_FIELD_HEADER_SIZE + forms_length + IMAN_TABLE_FIELD_ALIGNMENT;
+    
+    if (reserve_buffer(&record->payload, payload_length) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    /* The uncompressed fields of the block, compression waits for the dictionary */
+    iman_binary_writer_initialise(&binary_writer, record->payload.buffer, record->payload.size);
+    iman_binary_writer_put_uint32(&binary_writer, IMAN_FIELD_ID_DESCRIPTION);
+    iman_binary_writer_put_uint32(&binary_writer, desc_length);
+    
+    if (desc_length != 0)
+        iman_binary_writer_put_bytes(&binary_writer, block->desc.buffer, desc_length);
+    
+    iman_binary_writer_pad(&binary_writer, IMAN_TABLE_FIELD_ALIGNMENT);
+    
+    /* Fixed size records the reader can index straight out of the inflated block */
+    if (form_count != 0) {
+        iman_binary_writer_put_uint32(&binary_writer, IMAN_FIELD_ID_FORMS);
+        iman_binary_writer_put_uint32(&binary_writer, forms_length);
+        iman_binary_writer_put_uint32(&binary_writer, form_count);
+        iman_binary_writer_put_uint32(&binary_writer, IMAN_FORMS_HEADER_SIZE + form_count * IMAN_FORM_RECORD_SIZE);
+        
+        for (form = block->forms; form != NULL; form = form->next_form) {
+            put_form_record(&binary_writer, &record->form_text, form);
+        }
+        
+        iman_binary_writer_put_bytes(&binary_writer, record->form_text.buffer, record->form_text.offset);
+        iman_binary_writer_pad(&binary_writer, IMAN_TABLE_FIELD_ALIGNMENT);
+    }
+    
+    record->payload.offset = (uint32_t)binary_writer.position;
+    return IMAN_TRUE;
+}
+
+void iman_ref_record_release(struct iman_ref_record *record) {
+    free(record->names.buffer);
+    free(record->payload.buffer);
+    free(record->form_text.buffer);
+    free(record->symbols.buffer);
+    
+    memset(record, 0, sizeof(*record));
+}
+
+/* Collects the free text the forms refer to, each string stored once and NUL terminated */
+static int build_form_text(struct iman_ref_record *record, const struct iman_reference_form_definition *forms, uint32_t *pcount) {
+    const struct iman_reference_form_definition *form;
+    uint32_t count = 0, offset;
+    
+    record->form_text.offset = 0;
+    
+    for (form = forms; form != NULL; form = form->next_form, ++count) {
+        if (form->operand.count > IMAN_FORM_MAX_OPERANDS || form->clobber.count > IMAN_FORM_MAX_CLOBBERS || form->feature.count > IMAN_FORM_MAX_FEATURES)
+            return IMAN_FALSE;
+        
+        if (add_form_text(&record->form_text, &form->mnemonic, &offset) != IMAN_TRUE ||
+            add_form_text(&record->form_text, &form->opcode, &offset) != IMAN_TRUE ||
+            add_form_text(&record->form_text, &form->description, &offset) != IMAN_TRUE)
+            return IMAN_FALSE;
+    }
+    
+    /* Text is referenced with 16-bit offsets */
+    if (record->form_text.offset > UINT16_MAX) {
+        IMAN_ERROR("Error: the forms of this block have too much text\n");
+        return IMAN_FALSE;
+    }
+    
+    *pcount = count;
+    return IMAN_TRUE;
+}
+
+static int add_form_text(struct iman_ref_buffer *text, const struct iman_reference_text *value, uint32_t *poffset) {
+    uint32_t offset = 0;
+    
+    /* Blocks only hold a handful of forms, a linear search is plenty */
+    while (offset < text->offset) {
+        uint32_t existing_length = (uint32_t)strlen(&text->buffer[offset]);
+        
+        if (existing_length == value->length && memcmp(&text->buffer[offset], value->text, value->length) == 0) {
+            *poffset = offset;
+            return IMAN_TRUE;
+        }
+        
+        offset += existing_length + 1;
+    }
+    
+    if (reserve_buffer(text, value->length + 1) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    memcpy(&text->buffer[text->offset], value->text, value->length);
+    text->buffer[text->offset + value->length] = '\0';
+    
+    *poffset = text->offset;
+    text->offset += value->length + 1;
+    
+    return IMAN_TRUE;
+}
+
+static void put_form_record(struct iman_binary_writer *binary_writer, struct iman_ref_buffer *text, const struct iman_reference_form_definition *form) {
+    uint32_t offset = 0;
+    unsigned int x;
+    uint8_t modes = 0;
+    
+    if (form->feature.mode64)
+        modes |= IMAN_FORM_MODE_64;
+    
+    if (form->feature.mode32)
+        modes |= IMAN_FORM_MODE_32;
+    
+    if (form->feature.mode16)
+        modes |= IMAN_FORM_MODE_16;
+    
+    /* Every string is already in the heap, so these lookups can't fail */
+    add_form_text(text, &form->mnemonic, &offset);
+    iman_binary_writer_put_uint16(binary_writer, (uint16_t)offset);
+    add_form_text(text, &form->opcode, &offset);
+    iman_binary_writer_put_uint16(binary_writer, (uint16_t)offset);
+    add_form_text(text, &form->description, &offset);
+    iman_binary_writer_put_uint16(binary_writer, (uint16_t)offset);
+    
+    iman_binary_writer_put_uint16(binary_writer, form->width > 0 ? (uint16_t)form->width : 0);
+    iman_binary_writer_put_uint8(binary_writer, modes);
+    iman_binary_writer_put_uint8(binary_writer, (uint8_t)form->feature.count);
+    iman_binary_writer_put_uint8(binary_writer, (uint8_t)form->operand.count);
+    iman_binary_writer_put_uint8(binary_writer, (uint8_t)form->clobber.count);
+    
+    for (x = 0; x < IMAN_FORM_MAX_OPERANDS; ++x) {
+        iman_binary_writer_put_uint16(binary_writer, x < form->operand.count ? form->operand.type[x] : 0);
+    }
+    
+    for (x = 0; x < IMAN_FORM_MAX_CLOBBERS; ++x) {
+        iman_binary_writer_put_uint16(binary_writer, x < form->clobber.count ? form->clobber.type[x] : 0);
+    }
+    
+    for (x = 0; x < IMAN_FORM_MAX_FEATURES; ++x) {
+        iman_binary_writer_put_uint16(binary_writer, x < form->feature.count ? form->feature.name[x] : 0);
+    }
+}
+
+static int copy_block_symbols(struct iman_ref_record *record, const struct iman_symbol_table *symbols) {
+    if (symbols->count == 0)
+        return IMAN_TRUE;
+    
+    /* The table's text is already every name in id order, each one NUL terminated */
+    if (reserve_buffer(&record->symbols, symbols->text_used) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    memcpy(record->symbols.buffer, symbols->text, symbols->text_used);
+    record->symbols.offset = symbols->text_used;
+    record->symbol_count = symbols->count;
+    
+    return IMAN_TRUE;
+}
+
+static int map_record_symbols(struct iman_ref_writer *writer, const struct iman_ref_record *record) {
+    uint32_t offset = 0, x;
+    
+    if (record->symbol_count > writer->symbol_map.size) {
+        uint16_t *ids = realloc(writer->symbol_map.ids, record->symbol_count * sizeof(uint16_t));
+        
+        if (ids == NULL)
+            return IMAN_FALSE;
+        
+        writer->symbol_map.ids = ids;
+        writer->symbol_map.size = record->symbol_count;
+    }
+    
+    for (x = 0; x < record->symbol_count; ++x) {
+        const char *name = &record->symbols.buffer[offset];
+        uint32_t length = (uint32_t)strlen(name);
+        
+        if (iman_symbol_intern(&writer->symbols, name, length, &writer->symbol_map.ids[x]) != IMAN_TRUE)
+            return IMAN_FALSE;
+        
+        offset += length + 1;
+    }
+    
+    return IMAN_TRUE;
+}
+
+/* Rewrites the block-local type ids of a stored payload's form records into index-wide ids */
+static int remap_form_symbols(struct iman_ref_writer *writer, char *payload, uint32_t length, uint32_t symbol_count) {
+    uint32_t field_length, count, x, y;
+    char *forms = (char *)find_payload_field(payload, length, IMAN_FIELD_ID_FORMS, &field_length), *record;
+    
+    if (forms == NULL)
+        return IMAN_TRUE;
+    
+    count = read_uint32(forms);
+    record = &forms[IMAN_FORMS_HEADER_SIZE];
+    
+    for (x = 0; x < count; ++x, record += IMAN_FORM_RECORD_SIZE) {
+        /* Operands, clobbers and features are contiguous u16 arrays of four */
+        for (y = 0; y < IMAN_FORM_MAX_OPERANDS + IMAN_FORM_MAX_CLOBBERS + IMAN_FORM_MAX_FEATURES; ++y) {
+            char *slot = &record[12 + 2 * y];
+            uint16_t id = (uint16_t)((unsigned char)slot[0] | (unsigned char)slot[1] << 8);
+            
+            if (id >= symbol_count)
+                continue;
+            
+            id = writer->symbol_map.ids[id];
+            slot[0] = (char)(id & 0xFF);
+            slot[1] = (char)(id >> 8);
+        }
+    }
+    
+    return IMAN_TRUE;
+}
+
+static const char *find_payload_field(const char *payload, uint32_t length, uint32_t id, uint32_t *pfield_length) {
+    uint32_t offset = 0;
+    
+    while (offset + IMAN_TABLE_FIELD_HEADER_SIZE <= length) {
+        uint32_t field_id = read_uint32(&payload[offset]);
+        uint32_t field_length = read_uint32(&payload[offset + 4]);
+        
+        offset += IMAN_TABLE_FIELD_HEADER_SIZE;
+        
+        if (field_length > length - offset)
+            return NULL;
+        
+        if (field_id == id) {
+            *pfield_length = field_length;
+            return &payload[offset];
+        }
+        
+        offset += (field_length + IMAN_TABLE_FIELD_ALIGNMENT - 1) & ~(uint32_t)(IMAN_TABLE_FIELD_ALIGNMENT - 1);
+    }
+    
+    return NULL;
 }
 
-static int write_index_entry(struct iman_ref_writer *writer, const char *name, long offset) {
+static int build_symbol_section(struct iman_ref_writer *writer, char **pdata, size_t *psize) {
     struct iman_binary_writer binary_writer;
-    char buffer[64];
+    uint32_t text_offset = IMAN_SYMBOLS_HEADER_SIZE + writer->symbols.count * sizeof(uint32_t), x;
+    size_t size = text_offset + writer->symbols.text_used;
+    char *data = malloc(size + 1);
     
-    iman_binary_writer_initialise(&binary_writer, buffer, sizeof(buffer));
+    if (data == NULL)
+        return IMAN_FALSE;
+    
+    iman_binary_writer_initialise(&binary_writer, data, size);
+    iman_binary_writer_put_uint32(&binary_writer, writer->symbols.count);
+    iman_binary_writer_put_uint32(&binary_writer, text_offset);
+    
+    for (x = 0; x < writer->symbols.count; ++x) {
+        iman_binary_writer_put_uint32(&binary_writer, writer->symbols.offsets[x]);
+    }
+    
+    if (writer->symbols.text_used != 0)
+        iman_binary_writer_put_bytes(&binary_writer, writer->symbols.text, writer->symbols.text_used);
+    
+    *pdata = data;
+    *psize = size;
+    return IMAN_TRUE;
+}
+
+static uint32_t read_uint32(const char *data) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    
+    return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static int add_name_entry(struct iman_ref_writer *writer, const char *name, uint32_t length) {
+    struct iman_ref_writer_name *entry;
+    
+    if (writer->names.count >= writer->names.size) {
+        uint32_t new_size = writer->names.size ? writer->names.size * 2 : IMAN_REF_WRITER_BASE_NAMES;
+        struct iman_ref_writer_name *entries = realloc(writer->names.entries, new_size * sizeof(*entries));
+        
+        if (entries == NULL)
+            return IMAN_FALSE;
+        
+        writer->names.entries = entries;
+        writer->names.size = new_size;
+    }
+    
+    if (reserve_buffer(&writer->name_heap, length) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    entry = &writer->names.entries[writer->names.count++];
+    entry->hash = iman_hash_name(name, length);
+    entry->name_offset = writer->name_heap.offset;
+    entry->name_length = length;
+    entry->block_index = writer->blocks.count;
+    
+    memcpy(&writer->name_heap.buffer[writer->name_heap.offset], name, length);
+    writer->name_heap.offset += length;
+    
+    return IMAN_TRUE;
+}
+
+static struct iman_ref_writer_block *add_block_entry(struct iman_ref_writer *writer) {
+    struct iman_ref_writer_block *entry;
+    
+    if (writer->blocks.count >= writer->blocks.size) {
+        uint32_t new_size = writer->blocks.size ? writer->blocks.size * 2 : IMAN_REF_WRITER_BASE_BLOCKS;
+        struct iman_ref_writer_block *entries = realloc(writer->blocks.entries, new_size * sizeof(*entries));
+        
+        if (entries == NULL)
+            return NULL;
+        
+        writer->blocks.entries = entries;
+        writer->blocks.size = new_size;
+    }
+    
+    entry = &writer->blocks.entries[writer->blocks.count++];
+    memset(entry, 0, sizeof(*entry));
     
-    iman_binary_writer_put_fixed_string(&binary_writer, name, IMAN_INDEX_NAME_WIDTH);
-    iman_binary_writer_put_uint32(&binary_writer, (uint32_t)offset);
+    return entry;
+}
 
-    return fwrite(binary_writer.buffer, binary_writer.position, 1, writer->index_output) == 1 ? IMAN_TRUE : IMAN_FALSE;
+static int add_block_payload(struct iman_ref_writer *writer, const char *payload, uint32_t length) {
+    struct iman_ref_writer_block *entry;
+    
+    if (reserve_buffer(&writer->payloads, length) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    entry = add_block_entry(writer);
+    
+    if (entry == NULL)
+        return IMAN_FALSE;
+    
+    memcpy(&writer->payloads.buffer[writer->payloads.offset], payload, length);
+    
+    entry->payload_offset = writer->payloads.offset;
+    entry->payload_length = length;
+    
+    writer->payloads.offset += length;
+    
+    if (length > writer->max_block_size)
+        writer->max_block_size = length;
+    
+    return IMAN_TRUE;
+}
+
+static int write_table(struct iman_ref_writer *writer) {
+    /* Normally the build's worker pool has deflated and written everything already, whatever is left is done here */
+    if (iman_ref_writer_train(writer) != IMAN_TRUE || iman_ref_writer_compress(writer) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    return writer->table.next_write == writer->blocks.count ? IMAN_TRUE : IMAN_FALSE;
 }
 
-static int write_table_entry(struct iman_ref_writer *writer, struct iman_reference_block *block, long block_offset) {
+/*
+ * Called with the lock held. A block is ready once its table size is known, the ready ones at the front are
+ * written in source order by one thread at a time, the lock is dropped around each write so the others keep going.
+ */
+static void drain_table(struct iman_ref_writer *writer) {
+    while (writer->table.writing == IMAN_FALSE && writer->table.error == IMAN_FALSE && writer->table.next_write < writer->blocks.count) {
+        struct iman_ref_writer_block *block = &writer->blocks.entries[writer->table.next_write];
+        const char *entry = block->table_entry != NULL ? block->table_entry : &writer->table.staging[block->staged_offset];
+        int result;
+        
+        if (block->table_size == 0)
+            break;
+        
+        writer->table.next_write++;
+        writer->table.writing = IMAN_TRUE;
+        pthread_mutex_unlock(&writer->table.lock);
+        
+        /* The running output offset stands in for ftell */
+        block->table_offset = (uint32_t)writer->table_output.offset;
+        result = iman_output_write(&writer->table_output, entry, block->table_size);
+        
+        pthread_mutex_lock(&writer->table.lock);
+        writer->table.writing = IMAN_FALSE;
+        
+        if (result != IMAN_TRUE)
+            writer->table.error = IMAN_TRUE;
+    }
+}
+
+/* Raw deflate, the block header already records both sizes */
+static int open_deflater(z_stream *deflater) {
+    return deflateInit2(deflater, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 9, Z_DEFAULT_STRATEGY) == Z_OK ? IMAN_TRUE : IMAN_FALSE;
+}
+
+static int compress_block(struct iman_ref_writer *writer, z_stream *deflater, const struct iman_ref_writer_block *block, uint32_t *psize) {
     struct iman_binary_writer binary_writer;
-    char buffer[32];
+    uint32_t bound = (uint32_t)deflateBound(deflater, block->payload_length);
+    uint32_t compressed_size;
+    char *entry = &writer->table.staging[block->staged_offset];
+    
+    /* Each block is deflated on its own so a reader only inflates what it asked for */
+    if (deflateReset(deflater) != Z_OK)
+        return IMAN_FALSE;
+    
+    if (writer->dictionary.offset != 0 && deflateSetDictionary(deflater, (const Bytef *)writer->dictionary.buffer, writer->dictionary.offset) != Z_OK)
+        return IMAN_FALSE;
+    
+    deflater->next_in = (Bytef *)&writer->payloads.buffer[block->payload_offset];
+    deflater->avail_in = block->payload_length;
+    deflater->next_out = (Bytef *)&entry[IMAN_TABLE_BLOCK_HEADER_SIZE];
+    deflater->avail_out = bound;
+    
+    if (deflate(deflater, Z_FINISH) != Z_STREAM_END) {
+        IMAN_ERROR("Error: unable to compress a table block\n");
+        return IMAN_FALSE;
+    }
+    
+    compressed_size = bound - deflater->avail_out;
+    
+    /* The header goes in front once the size is known */
+    iman_binary_writer_initialise(&binary_writer, entry, IMAN_TABLE_BLOCK_HEADER_SIZE);
+    iman_binary_writer_put_uint32(&binary_writer, compressed_size);
+    iman_binary_writer_put_uint32(&binary_writer, block->payload_length);
+    
+    /* Only set under the lock, it marks the block as ready to write */
+    *psize = IMAN_TABLE_BLOCK_HEADER_SIZE + compressed_size;
+    return IMAN_TRUE;
+}
+
+static int reserve_buffer(struct iman_ref_buffer *buffer, uint32_t length) {
+    uint32_t new_size = buffer->size ? buffer->size : IMAN_REF_WRITER_BASE_BUFFER;
+    char *new_buffer;
     
-    IMAN_UNUSED(block_offset);
+    if (buffer->offset + length <= buffer->size)
+        return IMAN_TRUE;
+    
+    while (buffer->offset + length > new_size) {
+        new_size *= 2;
+    }
+    
+    new_buffer = realloc(buffer->buffer, new_size);
+    
+    if (new_buffer == NULL)
+        return IMAN_FALSE;
+    
+    buffer->buffer = new_buffer;
+    buffer->size = new_size;
+    return IMAN_TRUE;
+}
+
+static int write_index(struct iman_ref_writer *writer, struct iman_output *output, uint32_t magic, const struct iman_ref_section *sections, unsigned int section_count) {
+    static const char padding[IMAN_INDEX_SECTION_ALIGNMENT];
+    struct iman_binary_writer binary_writer;
+    char buffer[IMAN_INDEX_HEADER_SIZE + IMAN_REF_WRITER_MAX_SECTIONS * IMAN_INDEX_SECTION_ENTRY_SIZE];
+    struct iovec vector[1 + 2 * IMAN_REF_WRITER_MAX_SECTIONS];
+    int vector_count = 0;
+    size_t offset;
+    unsigned int x;
     
     iman_binary_writer_initialise(&binary_writer, buffer, sizeof(buffer));
-    iman_binary_writer_put_uint32(&binary_writer, IMAN_FIELD_ID_DESCRIPTION);
-    iman_binary_writer_put_uint32(&binary_writer, block->desc.offset + 1);
+    iman_binary_writer_put_uint32(&binary_writer, magic);
+    iman_binary_writer_put_uint32(&binary_writer, IMAN_INDEX_VERSION);
+    iman_binary_writer_put_uint32(&binary_writer, section_count);
+    iman_binary_writer_put_uint32(&binary_writer, writer->blocks.count);
+    
+    offset = IMAN_INDEX_HEADER_SIZE + section_count * IMAN_INDEX_SECTION_ENTRY_SIZE;
+    
+    for (x = 0; x < section_count; ++x) {
+        iman_binary_writer_put_uint32(&binary_writer, sections[x].id);
+        iman_binary_writer_put_uint32(&binary_writer, (uint32_t)offset);
+        iman_binary_writer_put_uint32(&binary_writer, (uint32_t)sections[x].size);
+        iman_binary_writer_put_uint32(&binary_writer, 0);
+        
+        offset += (sections[x].size + IMAN_INDEX_SECTION_ALIGNMENT - 1) & ~(size_t)(IMAN_INDEX_SECTION_ALIGNMENT - 1);
+    }
+    
+    vector[vector_count].iov_base = binary_writer.buffer;
+    vector[vector_count].iov_len = binary_writer.position;
+    vector_count++;
+    
+    /* The whole index goes out as one gather list, sections are never copied together */
+    for (x = 0; x < section_count; ++x) {
+        size_t pad = (IMAN_INDEX_SECTION_ALIGNMENT - sections[x].size % IMAN_INDEX_SECTION_ALIGNMENT) % IMAN_INDEX_SECTION_ALIGNMENT;
+        
+        vector[vector_count].iov_base = (void *)sections[x].data;
+        vector[vector_count].iov_len = sections[x].size;
+        vector_count++;
+        
+        vector[vector_count].iov_base = (void *)padding;
+        vector[vector_count].iov_len = pad;
+        vector_count++;
+    }
+    
+    return iman_output_writev(output, vector, vector_count);
+}
+
+/* Per block source hashes and table spans, plus everything needed to splice those blocks into the next build */
+static int write_manifest(struct iman_ref_writer *writer, const char *symbols, size_t symbols_size) {
+    struct iman_ref_section sections[IMAN_REF_WRITER_MAX_SECTIONS];
+    struct iman_binary_writer binary_writer;
+    struct iman_ref_buffer names;
+    struct iman_output output;
+    unsigned int section_count = 0;
+    size_t blocks_size = (size_t)writer->blocks.count * IMAN_MANIFEST_BLOCK_SIZE;
+    char *blocks = malloc(blocks_size + 1);
+    uint32_t x, name = 0;
+    int result = IMAN_FALSE;
+    
+    memset(&names, 0, sizeof(names));
     
-    if (fwrite(binary_writer.buffer, binary_writer.position, 1, writer->table_output) != 1) {
+    if (blocks == NULL)
         return IMAN_FALSE;
+    
+    iman_binary_writer_initialise(&binary_writer, blocks, blocks_size);
+    
+    for (x = 0; x < writer->blocks.count; ++x) {
+        const struct iman_ref_writer_block *block = &writer->blocks.entries[x];
+        uint32_t name_offset = names.offset, name_count = 0;
+        
+        /* Name entries are still in block order, only a copy gets sorted for the name hash */
+        for (; name < writer->names.count && writer->names.entries[name].block_index == x; ++name, ++name_count) {
+            const struct iman_ref_writer_name *entry = &writer->names.entries[name];
+            
+            if (reserve_buffer(&names, entry->name_length + 1) != IMAN_TRUE)
+                goto done;
+            
+            memcpy(&names.buffer[names.offset], &writer->name_heap.buffer[entry->name_offset], entry->name_length);
+            names.buffer[names.offset + entry->name_length] = '\0';
+            names.offset += entry->name_length + 1;
+        }
+        
+        iman_binary_writer_put_uint32(&binary_writer, (uint32_t)block->source_hash);
+        iman_binary_writer_put_uint32(&binary_writer, (uint32_t)(block->source_hash >> 32));
+        iman_binary_writer_put_uint32(&binary_writer, block->table_offset);
+        iman_binary_writer_put_uint32(&binary_writer, block->table_size);
+        iman_binary_writer_put_uint32(&binary_writer, block->payload_length);
+        iman_binary_writer_put_uint32(&binary_writer, name_offset);
+        iman_binary_writer_put_uint32(&binary_writer, name_count);
+        iman_binary_writer_put_uint32(&binary_writer, 0);
+    }
+    
+    sections[section_count].id = IMAN_SECTION_ID_BLOCKS;
+    sections[section_count].data = blocks;
+    sections[section_count].size = blocks_size;
+    section_count++;
+    
+    sections[section_count].id = IMAN_SECTION_ID_NAME_HEAP;
+    sections[section_count].data = names.buffer;
+    sections[section_count].size = names.offset;
+    section_count++;
+    
+    if (writer->dictionary.offset != 0) {
+        sections[section_count].id = IMAN_SECTION_ID_DICTIONARY;
+        sections[section_count].data = writer->dictionary.buffer;
+        sections[section_count].size = writer->dictionary.offset;
+        section_count++;
+    }
+    
+    sections[section_count].id = IMAN_SECTION_ID_SYMBOLS;
+    sections[section_count].data = symbols;
+    sections[section_count].size = symbols_size;
+    section_count++;
+    
+    if (open_output(&output, writer->manifest_path) != IMAN_TRUE)
+        goto done;
+    
+    result = write_index(writer, &output, IMAN_MANIFEST_MAGIC, sections, section_count);
+    
+    if (close_output(writer, &output) != IMAN_TRUE)
+        result = IMAN_FALSE;
+    
+done:
+    free(blocks);
+    free(names.buffer);
+    return result;
+}
+
+static int open_output(struct iman_output *output, const char *path) {
+    char temp_path[IMAN_REF_WRITER_MAX_PATH + sizeof(IMAN_REF_WRITER_TEMP_EXT)];
+    
+    snprintf(temp_path, sizeof(temp_path), "%s" IMAN_REF_WRITER_TEMP_EXT, path);
+    return iman_output_open(output, temp_path);
+}
+
+static int close_output(struct iman_ref_writer *writer, struct iman_output *output) {
+    int result = iman_output_close(output);
+    
+    writer->written.bytes += output->offset;
+    writer->written.syscalls += output->syscalls;
+    return result;
+}
+
+static void release_writer(struct iman_ref_writer *writer) {
+    free(writer->names.entries);
+    free(writer->name_heap.buffer);
+    free(writer->blocks.entries);
+    free(writer->payloads.buffer);
+    free(writer->table.staging);
+    free(writer->inflated.buffer);
+    free(writer->dictionary.buffer);
+    
+    free(writer->symbol_map.ids);
+    iman_symbol_table_release(&writer->symbols);
+    
+    if (writer->table.trained == IMAN_TRUE)
+        pthread_mutex_destroy(&writer->table.lock);
+}
+
+/* Moves a finished output over its final path, or throws it away */
+static int replace_file(const char *path, int keep) {
+    char temp_path[IMAN_REF_WRITER_MAX_PATH + sizeof(IMAN_REF_WRITER_TEMP_EXT)];
+    
+    snprintf(temp_path, sizeof(temp_path), "%s" IMAN_REF_WRITER_TEMP_EXT, path);
+    
+    if (keep != IMAN_TRUE) {
+        unlink(temp_path);
+        return IMAN_TRUE;
     }
     
-    if (fwrite(block->desc.buffer, block->desc.offset + 1, 1, writer->table_output) != 1) {
+    return rename(temp_path, path) == 0 ? IMAN_TRUE : IMAN_FALSE;
+}
+
+static int build_table_info_section(struct iman_ref_writer *writer, char *data, size_t *psize) {
+    struct iman_binary_writer binary_writer;
+    
+    iman_binary_writer_initialise(&binary_writer, data, IMAN_TABLE_INFO_SIZE);
+    iman_binary_writer_put_uint32(&binary_writer, IMAN_TABLE_COMPRESSION_DEFLATE);
+    iman_binary_writer_put_uint32(&binary_writer, writer->max_block_size);
+    iman_binary_writer_put_uint32(&binary_writer, 0);
+    iman_binary_writer_put_uint32(&binary_writer, 0);
+    
+    *psize = binary_writer.position;
+    return IMAN_TRUE;
+}
+
+static int build_name_hash_section(struct iman_ref_writer *writer, char **pdata, size_t *psize) {
+    struct iman_binary_writer binary_writer;
+    struct iman_name_hash table;
+    struct iman_ref_writer_name **unique = NULL;
+    uint64_t *hashes = NULL;
+    uint32_t x, unique_count = 0;
+    size_t size;
+    char *data = NULL;
+    int result = IMAN_FALSE;
+    
+    unique = malloc((writer->names.count + 1) * sizeof(*unique));
+    hashes = malloc((writer->names.count + 1) * sizeof(*hashes));
+    
+    if (unique == NULL || hashes == NULL) {
+        IMAN_ERROR("Error: out of memory while building the name index\n");
+        goto done;
+    }
+    
+    for (x = 0; x < writer->names.count; ++x) {
+        unique[x] = &writer->names.entries[x];
+    }
+    
+    /* Group equal names together, keeping the first definition of each */
+    qsort(unique, writer->names.count, sizeof(*unique), &compare_name_entries);
+    
+    for (x = 0; x < writer->names.count; ++x) {
+        struct iman_ref_writer_name *entry = unique[x];
+        
+        if (unique_count > 0 && same_name(writer, unique[unique_count - 1], entry) == IMAN_TRUE) {
+            IMAN_INFO("Warning: %.*s is defined more than once, the index keeps the first definition\n",
+                (int)entry->name_length,
+                &writer->name_heap.buffer[entry->name_offset]
+            );
+            
+            continue;
+        }
+        
+        unique[unique_count] = entry;
+        hashes[unique_count] = entry->hash;
+        unique_count++;
+    }
+    
+    if (iman_name_hash_build(&table, hashes, unique_count) != IMAN_TRUE)
+        goto done;
+    
+    size = IMAN_NAME_HASH_HEADER_SIZE + table.bucket_count * IMAN_NAME_HASH_BUCKET_SIZE;
+    size = (size + IMAN_NAME_HASH_SLOT_SIZE - 1) & ~(size_t)(IMAN_NAME_HASH_SLOT_SIZE - 1);
+    size += unique_count * IMAN_NAME_HASH_SLOT_SIZE;
+    
+    data = calloc(size, 1);
+    
+    if (data == NULL) {
+        iman_name_hash_release(&table);
+        goto done;
+    }
+    
+    iman_binary_writer_initialise(&binary_writer, data, size);
+    iman_binary_writer_put_uint32(&binary_writer, unique_count);
+    iman_binary_writer_put_uint32(&binary_writer, table.bucket_count);
+    iman_binary_writer_put_uint32(&binary_writer, table.seed);
+    iman_binary_writer_put_uint32(&binary_writer, 0);
+    
+    for (x = 0; x < table.bucket_count; ++x) {
+        iman_binary_writer_put_uint32(&binary_writer, table.displacements[x]);
+    }
+    
+    /* Slots start on their own alignment so no slot straddles a cache line */
+    for (x = 0; x < unique_count; ++x) {
+        struct iman_ref_writer_name *entry = unique[x];
+        
+        binary_writer.position = size - (unique_count - table.key_slots[x]) * IMAN_NAME_HASH_SLOT_SIZE;
+        
+        iman_binary_writer_put_uint32(&binary_writer, entry->name_offset);
+        iman_binary_writer_put_uint32(&binary_writer, entry->name_length);
+        iman_binary_writer_put_uint32(&binary_writer, writer->blocks.entries[entry->block_index].table_offset);
+        iman_binary_writer_put_uint32(&binary_writer, entry->block_index);
+    }
+    
+    iman_name_hash_release(&table);
+    
+    *pdata = data;
+    *psize = size;
+    result = IMAN_TRUE;
+    
+done:
+    free(unique);
+    free(hashes);
+    return result;
+}
+
+static int build_name_trie_section(struct iman_ref_writer *writer, char **pdata, size_t *psize) {
+    struct iman_binary_writer binary_writer;
+    struct iman_name_trie trie;
+    struct iman_name_trie_key *keys = malloc((writer->names.count + 1) * sizeof(*keys));
+    uint32_t x;
+    size_t size;
+    char *data;
+    
+    if (keys == NULL) {
+        IMAN_ERROR("Error: out of memory while building the completion trie\n");
+        return IMAN_FALSE;
+    }
+    
+    for (x = 0; x < writer->names.count; ++x) {
+        keys[x].offset = writer->names.entries[x].name_offset;
+        keys[x].length = writer->names.entries[x].name_length;
+    }
+    
+    if (iman_name_trie_build(&trie, writer->name_heap.buffer, keys, writer->names.count) != IMAN_TRUE) {
+        free(keys);
+        return IMAN_FALSE;
+    }
+    
+    free(keys);
+    
+    size = IMAN_NAME_TRIE_HEADER_SIZE + (size_t)trie.node_count * IMAN_NAME_TRIE_NODE_SIZE;
+    data = malloc(size);
+    
+    if (data == NULL) {
+        iman_name_trie_release(&trie);
+        return IMAN_FALSE;
+    }
+    
+    iman_binary_writer_initialise(&binary_writer, data, size);
+    iman_binary_writer_put_uint32(&binary_writer, trie.node_count);
+    iman_binary_writer_put_uint32(&binary_writer, 0);
+    
+    for (x = 0; x < trie.node_count; ++x) {
+        const struct iman_name_trie_node *node = &trie.nodes[x];
+        
+        iman_binary_writer_put_uint32(&binary_writer, node->subtree_end);
+        iman_binary_writer_put_uint32(&binary_writer, node->label_offset);
+        iman_binary_writer_put_uint8(&binary_writer, node->label_length);
+        iman_binary_writer_put_uint8(&binary_writer, node->flags);
+        iman_binary_writer_put_uint16(&binary_writer, node->name_length);
+    }
+    
+    IMAN_INFO("Info: completion trie has %u nodes\n", trie.node_count);
+    iman_name_trie_release(&trie);
+    
+    *pdata = data;
+    *psize = size;
+    return IMAN_TRUE;
+}
+
+static int build_block_directory_section(struct iman_ref_writer *writer, char **pdata, size_t *psize) {
+    struct iman_binary_writer binary_writer;
+    size_t size = (size_t)writer->blocks.count * IMAN_BLOCK_DIRECTORY_ENTRY_SIZE;
+    char *data = malloc(size + 1);
+    uint32_t x, name = 0;
+    
+    if (data == NULL)
+        return IMAN_FALSE;
+    
+    iman_binary_writer_initialise(&binary_writer, data, size);
+    
+    /* Name entries are still in block order, the first one of each block names it */
+    for (x = 0; x < writer->blocks.count; ++x) {
+        const struct iman_ref_writer_name *entry = NULL;
+        
+        for (; name < writer->names.count && writer->names.entries[name].block_index <= x; ++name) {
+            if (entry == NULL && writer->names.entries[name].block_index == x)
+                entry = &writer->names.entries[name];
+        }
+        
+        iman_binary_writer_put_uint32(&binary_writer, writer->blocks.entries[x].table_offset);
+        iman_binary_writer_put_uint32(&binary_writer, entry != NULL ? entry->name_offset : 0);
+        iman_binary_writer_put_uint32(&binary_writer, entry != NULL ? entry->name_length : 0);
+    }
+    
+    *pdata = data;
+    *psize = size;
+    return IMAN_TRUE;
+}
+
+/* Trigram postings over every block's description and the form facets, kept in a file of their own so lookups never map them */
+static int write_search_file(struct iman_ref_writer *writer) {
+    struct iman_ref_section sections[IMAN_REF_WRITER_MAX_SECTIONS];
+    struct iman_trigram_text *texts = calloc(writer->blocks.count + 1, sizeof(*texts));
+    struct iman_facet_forms *forms = calloc(writer->blocks.count + 1, sizeof(*forms));
+    struct iman_trigram_index index;
+    struct iman_facet_index facets;
+    struct iman_output output;
+    z_stream inflater;
+    uint32_t inflated_size = 0, x;
+    int result = IMAN_FALSE;
+    
+    memset(&inflater, 0, sizeof(inflater));
+    
+    if (texts == NULL || forms == NULL || inflateInit2(&inflater, -MAX_WBITS) != Z_OK) {
+        free(texts);
+        free(forms);
+        return IMAN_FALSE;
+    }
+    
+    /* Reused blocks are inflated side by side, sized up front so the texts never move */
+    for (x = 0; x < writer->blocks.count; ++x) {
+        if (writer->blocks.entries[x].table_entry != NULL)
+            inflated_size += writer->blocks.entries[x].payload_length;
+    }
+    
+    writer->inflated.offset = 0;
+    
+    if (reserve_buffer(&writer->inflated, inflated_size) != IMAN_TRUE)
+        goto done;
+    
+    /* The trailing NUL of a description isn't searched */
+    for (x = 0; x < writer->blocks.count; ++x) {
+        uint32_t payload_length = writer->blocks.entries[x].payload_length;
+        const char *payload = block_payload(writer, &writer->blocks.entries[x], &inflater);
+        
+        if (payload == NULL)
+            goto done;
+        
+        texts[x].text = find_payload_field(payload, payload_length, IMAN_FIELD_ID_DESCRIPTION, &texts[x].length);
+        forms[x].field = find_payload_field(payload, payload_length, IMAN_FIELD_ID_FORMS, &forms[x].length);
+        
+        if (texts[x].text == NULL)
+            goto done;
+        
+        if (texts[x].length != 0)
+            texts[x].length--;
+    }
+    
+    if (iman_trigram_index_build(&index, texts, writer->blocks.count) != IMAN_TRUE)
+        goto done;
+    
+    if (iman_facet_index_build(&facets, forms, writer->blocks.count) != IMAN_TRUE) {
+        iman_trigram_index_release(&index);
+        goto done;
+    }
+    
+    IMAN_INFO("Info: search index has %u trigrams and %u bytes of postings\n", index.key_count, (uint32_t)index.postings_size);
+    IMAN_INFO("Info: facet index has %u values over %u forms\n", facets.key_count, facets.form_count);
+    
+    sections[0].id = IMAN_SECTION_ID_SEARCH_KEYS;
+    sections[0].data = index.keys;
+    sections[0].size = index.keys_size;
+    
+    sections[1].id = IMAN_SECTION_ID_SEARCH_POSTINGS;
+    sections[1].data = index.postings;
+    sections[1].size = index.postings_size;
+    
+    sections[2].id = IMAN_SECTION_ID_FACET_KEYS;
+    sections[2].data = facets.keys;
+    sections[2].size = facets.keys_size;
+    
+    sections[3].id = IMAN_SECTION_ID_FACET_BITMAPS;
+    sections[3].data = facets.bitmaps;
+    sections[3].size = facets.bitmaps_size;
+    
+    sections[4].id = IMAN_SECTION_ID_FACET_BLOCKS;
+    sections[4].data = facets.blocks;
+    sections[4].size = facets.blocks_size;
+    
+    if (open_output(&output, writer->search_path) == IMAN_TRUE) {
+        result = write_index(writer, &output, IMAN_SEARCH_MAGIC, sections, 5);
+        
+        if (close_output(writer, &output) != IMAN_TRUE)
+            result = IMAN_FALSE;
+    }
+    
+    iman_trigram_index_release(&index);
+    iman_facet_index_release(&facets);
+    
+done:
+    inflateEnd(&inflater);
+    free(texts);
+    free(forms);
+    return result;
+}
+
+/* Freshly parsed blocks still have their payload, reused ones are inflated */
+static const char *block_payload(struct iman_ref_writer *writer, const struct iman_ref_writer_block *block, z_stream *inflater) {
+    const char *payload;
+    
+    if (block->table_entry == NULL) {
+        payload = &writer->payloads.buffer[block->payload_offset];
+    } else {
+        payload = &writer->inflated.buffer[writer->inflated.offset];
+        
+        /* Raw deflate never asks for its dictionary, it has to be in place before inflating */
+        if (inflateReset(inflater) != Z_OK)
+            return NULL;
+        
+        if (writer->dictionary.offset != 0 && inflateSetDictionary(inflater, (const Bytef *)writer->dictionary.buffer, writer->dictionary.offset) != Z_OK)
+            return NULL;
+        
+        inflater->next_in = (Bytef *)&block->table_entry[IMAN_TABLE_BLOCK_HEADER_SIZE];
+        inflater->avail_in = block->table_size - IMAN_TABLE_BLOCK_HEADER_SIZE;
+        inflater->next_out = (Bytef *)payload;
+        inflater->avail_out = block->payload_length;
+        
+        if (inflate(inflater, Z_FINISH) != Z_STREAM_END || inflater->avail_out != 0)
+            return NULL;
+        
+        writer->inflated.offset += block->payload_length;
+    }
+    
+    return payload;
+}
+
+static int compare_name_entries(const void *left, const void *right) {
+    const struct iman_ref_writer_name *a = *(struct iman_ref_writer_name * const *)left;
+    const struct iman_ref_writer_name *b = *(struct iman_ref_writer_name * const *)right;
+    
+    if (a->hash != b->hash)
+        return a->hash < b->hash ? -1 : 1;
+    
+    if (a->name_length != b->name_length)
+        return a->name_length < b->name_length ? -1 : 1;
+    
+    /* Equal names fall back to definition order so the first one survives */
+    if (a->block_index != b->block_index)
+        return a->block_index < b->block_index ? -1 : 1;
+    
+    return a->name_offset < b->name_offset ? -1 : (a->name_offset > b->name_offset ? 1 : 0);
+}
+
+static int same_name(struct iman_ref_writer *writer, const struct iman_ref_writer_name *a, const struct iman_ref_writer_name *b) {
+    uint32_t x;
+    
+    if (a->hash != b->hash || a->name_length != b->name_length)
         return IMAN_FALSE;
+    
+    for (x = 0; x < a->name_length; ++x) {
+        if (tolower((unsigned char)writer->name_heap.buffer[a->name_offset + x]) != tolower((unsigned char)writer->name_heap.buffer[b->name_offset + x]))
+            return IMAN_FALSE;
     }
     
     return IMAN_TRUE;
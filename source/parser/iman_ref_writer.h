@@ -6,15 +6,138 @@
 #ifndef _IMAN_REF_WRITER_H
 #define _IMAN_REF_WRITER_H
 
+#define IMAN_REF_WRITER_MAX_PATH 1024
+
+struct iman_ref_writer_name {
+    uint64_t hash;
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint32_t block_index;
+};
+
+struct iman_ref_writer_block {
+    uint64_t source_hash;
+    uint32_t payload_offset;
+    uint32_t payload_length;
+    uint32_t table_offset;
+    uint32_t table_size;
+    
+    /* Set for a block carried over from the previous build, its table entry is copied as it is */
+    const char *table_entry;
+    
+    /* Where a fresh block's table entry is deflated to before it is written out */
+    size_t staged_offset;
+};
+
+struct iman_ref_buffer {
+    char *buffer;
+    uint32_t size;
+    uint32_t offset;
+};
+
+/* A block serialised away from the writer, so blocks can be prepared on worker threads */
+struct iman_ref_record {
+    /* Every alias of every term, each one NUL terminated */
+    struct iman_ref_buffer names;
+    uint32_t name_count;
+    
+    struct iman_ref_buffer payload;
+    
+    /* Text heap for the forms field, built before the payload so its size is known */
+    struct iman_ref_buffer form_text;
+    
+    /* The block's own symbol names in id order, remapped to index-wide ids when added */
+    struct iman_ref_buffer symbols;
+    uint32_t symbol_count;
+    
+    /* Hash of the block's source text, recorded in the manifest */
+    uint64_t source_hash;
+};
+
 struct iman_ref_writer {
-    FILE *table_output;
-    FILE *index_output;
+    struct iman_output table_output;
+    struct iman_output index_output;
+    
+    /* Everything is written next to the final paths and only renamed over them once complete */
+    char table_path[IMAN_REF_WRITER_MAX_PATH];
+    char index_path[IMAN_REF_WRITER_MAX_PATH];
+    char manifest_path[IMAN_REF_WRITER_MAX_PATH];
+    char search_path[IMAN_REF_WRITER_MAX_PATH];
+    
+    /* Blocks stay uncompressed until close so the dictionary can be trained on all of them */
+    struct {
+        struct iman_ref_writer_block *entries;
+        uint32_t count;
+        uint32_t size;
+    } blocks;
+    
+    struct iman_ref_buffer payloads;
+    
+    /* Every term alias seen so far, hashed into the index on close */
+    struct {
+        struct iman_ref_writer_name *entries;
+        uint32_t count;
+        uint32_t size;
+    } names;
+    
+    struct iman_ref_buffer name_heap;
+    
+    /* Operand, clobber and feature names across every block, ids are assigned in source order */
+    struct iman_symbol_table symbols;
+    
+    struct {
+        uint16_t *ids;
+        uint32_t size;
+    } symbol_map;
+    
+    /*
+     * Each payload is deflated on its own against the shared dictionary, by every thread in iman_ref_writer_compress.
+     * Finished blocks go to the table output in source order as soon as the ones before them are done, so its
+     * thread writes the file out while the rest are still being deflated.
+     */
+    struct {
+        char *staging;
+        pthread_mutex_t lock;
+        uint32_t next_block;
+        uint32_t next_write;
+        int writing;
+        int trained;
+        int error;
+    } table;
+    
+    struct iman_ref_buffer inflated;
+    struct iman_ref_buffer dictionary;
+    
+    /* Carried over from the previous build, so reused blocks still inflate */
+    int dictionary_reused;
+    
+    uint32_t max_block_size;
+    
+    /* Totals over every output file once it is closed, for --stats */
+    struct {
+        uint64_t bytes;
+        uint64_t syscalls;
+    } written;
 };
 
 int iman_ref_writer_open(struct iman_ref_writer *writer, const char *target_dir, const char *arch_name);
 
 int iman_ref_writer_close(struct iman_ref_writer *writer);
 
-int iman_ref_writer_add(struct iman_ref_writer *writer, struct iman_reference_block *block);
+void iman_ref_writer_abort(struct iman_ref_writer *writer);
+
+int iman_ref_writer_train(struct iman_ref_writer *writer);
+
+int iman_ref_writer_compress(struct iman_ref_writer *writer);
+
+int iman_ref_writer_add_record(struct iman_ref_writer *writer, const struct iman_ref_record *record);
+
+int iman_ref_writer_seed(struct iman_ref_writer *writer, const struct iman_manifest *manifest);
+
+int iman_ref_writer_add_reused(struct iman_ref_writer *writer, const struct iman_manifest_block *block);
+
+int iman_ref_record_serialise(struct iman_ref_record *record, struct iman_reference_block *block);
+
+void iman_ref_record_release(struct iman_ref_record *record);
 
 #endif
\ No newline at end of file
@@ -4,35 +4,20 @@
  */
 
 #include "../iman.h"
+#include "iman_arena.h"
+#include "iman_symbols.h"
 #include "iman_reference.h"
 
 void iman_reference_block_release(struct iman_reference_block *block) {
-    struct iman_reference_term_definition *term = block->terms;
-    struct iman_reference_form_definition *form = block->forms;
+    if (block->arena != NULL)
+        iman_arena_reset(block->arena);
     
-    if (block->desc.buffer != NULL) {
-        free(block->desc.buffer);
-        block->desc.buffer = NULL;
-    }
+    if (block->symbols != NULL)
+        iman_symbol_table_reset(block->symbols);
     
-    while(term != NULL) {
-        struct iman_reference_term_definition *next = term->next;
-        unsigned int x;
-        
-        for (x = 0; x < term->name_count; ++x) {
-            free(term->names[x]);
-        }
-        
-        free(term);
-        term = next;
-    }
-    
-    while(form != NULL) {
-        struct iman_reference_form_definition *next = form->next_form;
-        
-        free(form);
-        form = next;
-    }
+    block->desc.buffer = NULL;
+    block->desc.size = 0;
+    block->desc.offset = 0;
     
     block->terms = NULL;
     block->forms = NULL;
@@ -7,15 +7,9 @@
 #define _IMAN_REFERENCE_H
 
 #define IMAN_REFERENCE_TERM_MAX_NAMES 8
-#define IMAN_REFERENCE_TITLE_MAX_SIZE 256
-#define IMAN_REFERENCE_MNEMONIC_SIZE 32
 #define IMAN_REFERENCE_MAX_OPERANDS 4
 #define IMAN_REFERENCE_MAX_CLOBBERS 4
-#define IMAN_REFERENCE_OPERAND_LENGTH 8
 #define IMAN_REFERENCE_MAX_FEATURES 4
-#define IMAN_REFERENCE_FEATURE_LENGTH 8
-#define IMAN_REFERENCE_MAX_OPCODE_SIZE 32
-#define IMAN_REFERENCE_MAX_DESCRIPTION 256
 
 struct iman_reference_term_definition {
     struct iman_reference_term_definition *next;
@@ -23,43 +17,62 @@ struct iman_reference_term_definition {
     unsigned int name_count;
     char *names[IMAN_REFERENCE_TERM_MAX_NAMES];
     
-    char title[IMAN_REFERENCE_TITLE_MAX_SIZE];
+    /* Span into the mapped source, not NUL terminated */
+    const char *title;
+    unsigned int title_length;
+};
+
+/* Text spans point into the block arena's copy of the form line and aren't NUL terminated */
+struct iman_reference_text {
+    const char *text;
+    unsigned int length;
 };
 
 struct iman_reference_form_definition {
     struct iman_reference_form_definition *next_form;
     
-    char mnemonic[IMAN_REFERENCE_MNEMONIC_SIZE];
+    struct iman_reference_text mnemonic;
     
     /* Instruction width, -1 for variable/unknown; used for GAS-style suffix */
     int width;
     
+    /* Types and feature names are ids in the block's symbol table */
     struct {
         unsigned int mode64:1, mode32:1, mode16:1;
         
         unsigned int count;
         
         /* e.g. AVX, AES etc */
-        char name[IMAN_REFERENCE_MAX_FEATURES][IMAN_REFERENCE_FEATURE_LENGTH];
+        uint16_t name[IMAN_REFERENCE_MAX_FEATURES];
     } feature;
     
     struct {
         unsigned int count;
-        char type[IMAN_REFERENCE_MAX_OPERANDS][IMAN_REFERENCE_OPERAND_LENGTH];
+        uint16_t type[IMAN_REFERENCE_MAX_OPERANDS];
     } operand;
     
     struct {
         unsigned int count;
-        char type[IMAN_REFERENCE_MAX_CLOBBERS][IMAN_REFERENCE_OPERAND_LENGTH];
+        uint16_t type[IMAN_REFERENCE_MAX_CLOBBERS];
     } clobber;
     
-    char opcode[IMAN_REFERENCE_MAX_OPCODE_SIZE];
+    struct iman_reference_text opcode;
     
-    char description[IMAN_REFERENCE_MAX_DESCRIPTION];
+    struct iman_reference_text description;
 };
 
+struct iman_arena;
+struct iman_symbol_table;
+
 struct iman_reference_block {
     struct iman_reference_block * next_block;
+    
+    /* Everything hanging off the block is carved out of this, it's reset in one go on release */
+    struct iman_arena *arena;
+    
+    /* Names the forms refer to by id, cleared along with the arena */
+    struct iman_symbol_table *symbols;
+    
     struct iman_reference_term_definition *terms;
     
     struct {
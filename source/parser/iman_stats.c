@@ -0,0 +1,92 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "../iman.h"
+#include "iman_diagnostics.h"
+#include "iman_stats.h"
+#include <time.h>
+
+struct iman_stats_name {
+    const char *name;
+    const char *help;
+};
+
+static const char * const iman_stats_phase_names[IMAN_STATS_PHASE_COUNT] = {
+    "split", "parse", "merge", "compress", "write", "total", "lex", "forms", "description"
+};
+
+static const struct iman_stats_name iman_stats_counter_names[IMAN_STATS_COUNTER_COUNT] = {
+    { "bytes_read",        "Source bytes read" },
+    { "lines",             "Source lines lexed" },
+    { "blocks",            "Blocks parsed" },
+    { "blocks_reused",     "Blocks reused from the previous build" },
+    { "forms",             "Form lines parsed" },
+    { "description_grows", "Times a description buffer was doubled" },
+    { "bytes_written",     "Bytes written to the output files" },
+    { "write_syscalls",    "writev calls made for the output files" }
+};
+
+uint64_t iman_stats_now(void) {
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+void iman_stats_merge(struct iman_stats *stats, const struct iman_stats *other) {
+    unsigned int x;
+    
+    for (x = 0; x < IMAN_STATS_PHASE_COUNT; ++x) {
+        stats->nanoseconds[x] += other->nanoseconds[x];
+    }
+    
+    for (x = 0; x < IMAN_STATS_COUNTER_COUNT; ++x) {
+        stats->counters[x] += other->counters[x];
+    }
+}
+
+/* Printed whatever the diagnostic level, asking for it is reason enough */
+void iman_stats_print(const struct iman_stats *stats) {
+    unsigned int x;
+    
+    iman_diagnostic_print("Stats: phase timings\n");
+    
+    for (x = 0; x < IMAN_STATS_PHASE_COUNT; ++x) {
+        iman_diagnostic_print("    %-18s %12.6fs\n", iman_stats_phase_names[x], (double)stats->nanoseconds[x] / 1e9);
+    }
+    
+    iman_diagnostic_print("Stats: counters\n");
+    
+    for (x = 0; x < IMAN_STATS_COUNTER_COUNT; ++x) {
+        iman_diagnostic_print("    %-18s %12lu\n", iman_stats_counter_names[x].name, (unsigned long)stats->counters[x]);
+    }
+}
+
+/* OpenMetrics text exposition: one gauge family for the phases, a counter family per counter */
+int iman_stats_write_openmetrics(const struct iman_stats *stats, const char *path) {
+    FILE *output = fopen(path, "w");
+    unsigned int x;
+    
+    if (output == NULL)
+        return IMAN_FALSE;
+    
+    fprintf(output, "# TYPE iman_parser_phase_seconds gauge\n# UNIT iman_parser_phase_seconds seconds\n"
+        "# HELP iman_parser_phase_seconds Monotonic clock time spent in each build phase.\n");
+    
+    for (x = 0; x < IMAN_STATS_PHASE_COUNT; ++x) {
+        fprintf(output, "iman_parser_phase_seconds{phase=\"%s\"} %.9f\n", iman_stats_phase_names[x], (double)stats->nanoseconds[x] / 1e9);
+    }
+    
+    for (x = 0; x < IMAN_STATS_COUNTER_COUNT; ++x) {
+        const struct iman_stats_name *name = &iman_stats_counter_names[x];
+        
+        fprintf(output, "# TYPE iman_parser_%s counter\n# HELP iman_parser_%s %s.\niman_parser_%s_total %lu\n",
+            name->name, name->name, name->help, name->name, (unsigned long)stats->counters[x]);
+    }
+    
+    fprintf(output, "# EOF\n");
+    
+    return fclose(output) == 0 ? IMAN_TRUE : IMAN_FALSE;
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_STATS_H
+#define _IMAN_STATS_H
+
+enum iman_stats_phase {
+    /* Wall clock time of each step of a build, in the order they run */
+    IMAN_STATS_PHASE_SPLIT = 0,
+    IMAN_STATS_PHASE_PARSE,
+    IMAN_STATS_PHASE_MERGE,
+    IMAN_STATS_PHASE_COMPRESS,
+    IMAN_STATS_PHASE_WRITE,
+    IMAN_STATS_PHASE_TOTAL,
+    
+    /* Summed over the parse workers; lexing is whatever part of a block isn't forms or description */
+    IMAN_STATS_PHASE_LEX,
+    IMAN_STATS_PHASE_FORMS,
+    IMAN_STATS_PHASE_DESCRIPTION,
+    
+    IMAN_STATS_PHASE_COUNT
+};
+
+enum iman_stats_counter {
+    IMAN_STATS_BYTES_READ = 0,
+    IMAN_STATS_LINES,
+    IMAN_STATS_BLOCKS,
+    IMAN_STATS_BLOCKS_REUSED,
+    IMAN_STATS_FORMS,
+    IMAN_STATS_DESCRIPTION_GROWS,
+    IMAN_STATS_BYTES_WRITTEN,
+    IMAN_STATS_WRITE_SYSCALLS,
+    
+    IMAN_STATS_COUNTER_COUNT
+};
+
+struct iman_stats {
+    uint64_t nanoseconds[IMAN_STATS_PHASE_COUNT];
+    uint64_t counters[IMAN_STATS_COUNTER_COUNT];
+};
+
+uint64_t iman_stats_now(void);
+
+void iman_stats_merge(struct iman_stats *stats, const struct iman_stats *other);
+
+void iman_stats_print(const struct iman_stats *stats);
+
+int iman_stats_write_openmetrics(const struct iman_stats *stats, const char *path);
+
+#endif
\ No newline at end of file
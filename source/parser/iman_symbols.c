@@ -0,0 +1,138 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "../iman.h"
+#include "iman_symbols.h"
+
+#define IMAN_SYMBOL_BASE_SLOTS 64
+#define IMAN_SYMBOL_BASE_TEXT 1024
+
+static uint32_t iman_symbol_hash(const char *name, uint32_t length);
+static int iman_symbol_grow_slots(struct iman_symbol_table *table);
+
+void iman_symbol_table_initialise(struct iman_symbol_table *table) {
+    memset(table, 0, sizeof(*table));
+}
+
+/* Forgets every symbol but keeps the storage, so a table reused per block stops allocating */
+void iman_symbol_table_reset(struct iman_symbol_table *table) {
+    if (table->slots != NULL)
+        memset(table->slots, 0, table->slot_count * sizeof(uint32_t));
+    
+    table->count = 0;
+    table->text_used = 0;
+}
+
+void iman_symbol_table_release(struct iman_symbol_table *table) {
+    free(table->text);
+    free(table->offsets);
+    free(table->slots);
+    
+    memset(table, 0, sizeof(*table));
+}
+
+int iman_symbol_intern(struct iman_symbol_table *table, const char *name, uint32_t length, uint16_t *pid) {
+    uint32_t slot, id;
+    
+    /* Keep the load factor at or under a half */
+    if ((table->count + 1) * 2 > table->slot_count && iman_symbol_grow_slots(table) != IMAN_TRUE)
+        return IMAN_FALSE;
+    
+    for (slot = iman_symbol_hash(name, length) & (table->slot_count - 1); table->slots[slot] != 0; slot = (slot + 1) & (table->slot_count - 1)) {
+        const char *existing = &table->text[table->offsets[table->slots[slot] - 1]];
+        
+        if (strncmp(existing, name, length) == 0 && existing[length] == '\0') {
+            *pid = (uint16_t)(table->slots[slot] - 1);
+            return IMAN_TRUE;
+        }
+    }
+    
+    if (table->count >= IMAN_SYMBOL_MAX_COUNT)
+        return IMAN_FALSE;
+    
+    if (table->count >= table->capacity) {
+        uint32_t new_capacity = table->capacity ? table->capacity * 2 : IMAN_SYMBOL_BASE_SLOTS;
+        uint32_t *offsets = realloc(table->offsets, new_capacity * sizeof(uint32_t));
+        
+        if (offsets == NULL)
+            return IMAN_FALSE;
+        
+        table->offsets = offsets;
+        table->capacity = new_capacity;
+    }
+    
+    if (table->text_used + length + 1 > table->text_size) {
+        uint32_t new_size = table->text_size ? table->text_size : IMAN_SYMBOL_BASE_TEXT;
+        char *text;
+        
+        while (table->text_used + length + 1 > new_size) {
+            new_size *= 2;
+        }
+        
+        text = realloc(table->text, new_size);
+        
+        if (text == NULL)
+            return IMAN_FALSE;
+        
+        table->text = text;
+        table->text_size = new_size;
+    }
+    
+    id = table->count++;
+    
+    memcpy(&table->text[table->text_used], name, length);
+    table->text[table->text_used + length] = '\0';
+    table->offsets[id] = table->text_used;
+    table->text_used += length + 1;
+    table->slots[slot] = id + 1;
+    
+    *pid = (uint16_t)id;
+    return IMAN_TRUE;
+}
+
+const char *iman_symbol_name(const struct iman_symbol_table *table, uint16_t id) {
+    if (id >= table->count)
+        return NULL;
+    
+    return &table->text[table->offsets[id]];
+}
+
+/* FNV-1a, symbols are case sensitive so there's no folding here */
+static uint32_t iman_symbol_hash(const char *name, uint32_t length) {
+    uint32_t hash = 2166136261u, x;
+    
+    for (x = 0; x < length; ++x) {
+        hash ^= (unsigned char)name[x];
+        hash *= 16777619u;
+    }
+    
+    return hash;
+}
+
+static int iman_symbol_grow_slots(struct iman_symbol_table *table) {
+    uint32_t new_count = table->slot_count ? table->slot_count * 2 : IMAN_SYMBOL_BASE_SLOTS;
+    uint32_t *slots = calloc(new_count, sizeof(uint32_t));
+    uint32_t id;
+    
+    if (slots == NULL)
+        return IMAN_FALSE;
+    
+    for (id = 0; id < table->count; ++id) {
+        const char *name = &table->text[table->offsets[id]];
+        uint32_t slot = iman_symbol_hash(name, (uint32_t)strlen(name)) & (new_count - 1);
+        
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (new_count - 1);
+        }
+        
+        slots[slot] = id + 1;
+    }
+    
+    free(table->slots);
+    table->slots = slots;
+    table->slot_count = new_count;
+    
+    return IMAN_TRUE;
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_SYMBOLS_H
+#define _IMAN_SYMBOLS_H
+
+#define IMAN_SYMBOL_MAX_COUNT 65535
+
+/* Interns short names (operand types, clobbers, CPUID features) as dense 16-bit ids, in first-seen order */
+struct iman_symbol_table {
+    char *text;
+    uint32_t text_size;
+    uint32_t text_used;
+    
+    /* Text offset of each id */
+    uint32_t *offsets;
+    uint32_t count;
+    uint32_t capacity;
+    
+    /* Open addressed, each slot holds id + 1 so zero means empty */
+    uint32_t *slots;
+    uint32_t slot_count;
+};
+
+void iman_symbol_table_initialise(struct iman_symbol_table *table);
+
+void iman_symbol_table_reset(struct iman_symbol_table *table);
+
+void iman_symbol_table_release(struct iman_symbol_table *table);
+
+int iman_symbol_intern(struct iman_symbol_table *table, const char *name, uint32_t length, uint16_t *pid);
+
+const char *iman_symbol_name(const struct iman_symbol_table *table, uint16_t id);
+
+#endif
\ No newline at end of file
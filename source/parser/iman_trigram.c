@@ -0,0 +1,248 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#include "../iman.h"
+#include "iman_diagnostics.h"
+#include "iman_binary_writer.h"
+#include "iman_trigram.h"
+
+#define IMAN_TRIGRAM_BASE_SLOTS 16384
+
+struct iman_trigram_key {
+    uint32_t trigram;
+    uint32_t count;
+    
+    /* Last block counted or written, plus one so zero means none yet */
+    uint32_t last_block;
+    
+    uint32_t sparse_size;
+    uint32_t offset;
+    uint32_t position;
+    int bitmap;
+};
+
+struct iman_trigram_table {
+    struct iman_trigram_key *keys;
+    uint32_t count;
+    uint32_t size;
+    
+    /* Open addressed, each slot holds key index + 1 */
+    uint32_t *slots;
+    uint32_t slot_count;
+};
+
+static struct iman_trigram_key *iman_trigram_find(struct iman_trigram_table *table, uint32_t trigram);
+static int iman_trigram_grow(struct iman_trigram_table *table);
+static uint32_t iman_trigram_varint_size(uint32_t value);
+static int iman_trigram_compare(const void *left, const void *right);
+
+/* qsort has no context argument, the keys are only needed while sorting */
+static const struct iman_trigram_key *iman_trigram_compare_keys;
+
+int iman_trigram_index_build(struct iman_trigram_index *index, const struct iman_trigram_text *texts, uint32_t text_count) {
+    struct iman_trigram_table table;
+    struct iman_binary_writer binary_writer;
+    uint32_t *order = NULL, bitmap_size = (text_count + 7) / 8, block, x;
+    size_t offset = 0;
+    int result = IMAN_FALSE;
+    
+    memset(index, 0, sizeof(*index));
+    memset(&table, 0, sizeof(table));
+    
+    /* First pass counts the blocks behind each trigram and sizes its delta encoded posting list */
+    for (block = 0; block < text_count; ++block) {
+        const unsigned char *text = (const unsigned char *)texts[block].text;
+        uint32_t trigram = 0;
+        
+        for (x = 0; x < texts[block].length; ++x) {
+            struct iman_trigram_key *key;
+            
+            trigram = (trigram >> 8 | (uint32_t)tolower(text[x]) << 16) & 0xFFFFFF;
+            
+            if (x < 2)
+                continue;
+            
+            key = iman_trigram_find(&table, trigram);
+            
+            if (key == NULL)
+                goto done;
+            
+            if (key->last_block == block + 1)
+                continue;
+            
+            key->sparse_size += iman_trigram_varint_size(key->last_block != 0 ? block - (key->last_block - 1) : block);
+            key->last_block = block + 1;
+            key->count++;
+        }
+    }
+    
+    order = malloc((table.count + 1) * sizeof(uint32_t));
+    
+    if (order == NULL)
+        goto done;
+    
+    for (x = 0; x < table.count; ++x) {
+        order[x] = x;
+    }
+    
+    /* Keys are binary searched by the reader */
+    iman_trigram_compare_keys = table.keys;
+    qsort(order, table.count, sizeof(uint32_t), &iman_trigram_compare);
+    iman_trigram_compare_keys = NULL;
+    
+    /* A common trigram is cheaper as a bitmap over every block */
+    for (x = 0; x < table.count; ++x) {
+        struct iman_trigram_key *key = &table.keys[order[x]];
+        
+        key->bitmap = key->sparse_size > bitmap_size ? IMAN_TRUE : IMAN_FALSE;
+        key->offset = (uint32_t)offset;
+        key->position = (uint32_t)offset;
+        key->last_block = 0;
+        offset += key->bitmap ? bitmap_size : key->sparse_size;
+    }
+    
+    index->postings = calloc(offset + 1, 1);
+    index->postings_size = offset;
+    index->keys_size = (size_t)table.count * IMAN_SEARCH_KEY_SIZE;
+    index->keys = malloc(index->keys_size + 1);
+    index->key_count = table.count;
+    
+    if (index->postings == NULL || index->keys == NULL)
+        goto done;
+    
+    /* Second pass writes each block into the posting lists, blocks arrive in increasing order */
+    for (block = 0; block < text_count; ++block) {
+        const unsigned char *text = (const unsigned char *)texts[block].text;
+        uint32_t trigram = 0;
+        
+        for (x = 0; x < texts[block].length; ++x) {
+            struct iman_trigram_key *key;
+            uint32_t delta;
+            
+            trigram = (trigram >> 8 | (uint32_t)tolower(text[x]) << 16) & 0xFFFFFF;
+            
+            if (x < 2)
+                continue;
+            
+            key = iman_trigram_find(&table, trigram);
+            
+            if (key->last_block == block + 1)
+                continue;
+            
+            if (key->bitmap) {
+                index->postings[key->offset + block / 8] |= (char)(1 << (block % 8));
+            } else {
+                for (delta = key->last_block != 0 ? block - (key->last_block - 1) : block; delta >= 0x80; delta >>= 7) {
+                    index->postings[key->position++] = (char)(delta | 0x80);
+                }
+                
+                index->postings[key->position++] = (char)delta;
+            }
+            
+            key->last_block = block + 1;
+        }
+    }
+    
+    iman_binary_writer_initialise(&binary_writer, index->keys, index->keys_size);
+    
+    for (x = 0; x < table.count; ++x) {
+        const struct iman_trigram_key *key = &table.keys[order[x]];
+        
+        iman_binary_writer_put_uint32(&binary_writer, key->trigram | (key->bitmap ? IMAN_SEARCH_KEY_BITMAP : 0));
+        iman_binary_writer_put_uint32(&binary_writer, key->offset);
+        iman_binary_writer_put_uint32(&binary_writer, key->count);
+    }
+    
+    result = IMAN_TRUE;
+
+done:
+    if (result != IMAN_TRUE) {
+        IMAN_ERROR("Error: out of memory while building the search index\n");
+        iman_trigram_index_release(index);
+    }
+    
+    free(order);
+    free(table.keys);
+    free(table.slots);
+    return result;
+}
+
+void iman_trigram_index_release(struct iman_trigram_index *index) {
+    free(index->keys);
+    free(index->postings);
+    
+    memset(index, 0, sizeof(*index));
+}
+
+static struct iman_trigram_key *iman_trigram_find(struct iman_trigram_table *table, uint32_t trigram) {
+    uint32_t slot;
+    
+    if (table->count * 2 >= table->slot_count && iman_trigram_grow(table) != IMAN_TRUE)
+        return NULL;
+    
+    for (slot = (trigram * 0x9E3779B1u) & (table->slot_count - 1); table->slots[slot] != 0; slot = (slot + 1) & (table->slot_count - 1)) {
+        struct iman_trigram_key *key = &table->keys[table->slots[slot] - 1];
+        
+        if (key->trigram == trigram)
+            return key;
+    }
+    
+    if (table->count >= table->size) {
+        uint32_t new_size = table->size ? table->size * 2 : IMAN_TRIGRAM_BASE_SLOTS / 2;
+        struct iman_trigram_key *keys = realloc(table->keys, new_size * sizeof(*keys));
+        
+        if (keys == NULL)
+            return NULL;
+        
+        table->keys = keys;
+        table->size = new_size;
+    }
+    
+    memset(&table->keys[table->count], 0, sizeof(*table->keys));
+    table->keys[table->count].trigram = trigram;
+    table->slots[slot] = ++table->count;
+    
+    return &table->keys[table->count - 1];
+}
+
+static int iman_trigram_grow(struct iman_trigram_table *table) {
+    uint32_t slot_count = table->slot_count ? table->slot_count * 2 : IMAN_TRIGRAM_BASE_SLOTS, x;
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    
+    if (slots == NULL)
+        return IMAN_FALSE;
+    
+    for (x = 0; x < table->count; ++x) {
+        uint32_t slot = (table->keys[x].trigram * 0x9E3779B1u) & (slot_count - 1);
+        
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        
+        slots[slot] = x + 1;
+    }
+    
+    free(table->slots);
+    table->slots = slots;
+    table->slot_count = slot_count;
+    return IMAN_TRUE;
+}
+
+static uint32_t iman_trigram_varint_size(uint32_t value) {
+    uint32_t size = 1;
+    
+    for (; value >= 0x80; value >>= 7) {
+        size++;
+    }
+    
+    return size;
+}
+
+static int iman_trigram_compare(const void *left, const void *right) {
+    uint32_t a = iman_trigram_compare_keys[*(const uint32_t *)left].trigram;
+    uint32_t b = iman_trigram_compare_keys[*(const uint32_t *)right].trigram;
+    
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
\ No newline at end of file
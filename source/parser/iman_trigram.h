@@ -0,0 +1,28 @@
+/*
+ * iman - instruction set manual utility
+ * Andrew Watts - 2015 <andrew@andrewwatts.info>
+ */
+
+#ifndef _IMAN_TRIGRAM_H
+#define _IMAN_TRIGRAM_H
+
+struct iman_trigram_text {
+    const char *text;
+    uint32_t length;
+};
+
+/* Serialised trigram keys and posting lists, one text per block */
+struct iman_trigram_index {
+    char *keys;
+    size_t keys_size;
+    uint32_t key_count;
+    
+    char *postings;
+    size_t postings_size;
+};
+
+int iman_trigram_index_build(struct iman_trigram_index *index, const struct iman_trigram_text *texts, uint32_t text_count);
+
+void iman_trigram_index_release(struct iman_trigram_index *index);
+
+#endif
\ No newline at end of file
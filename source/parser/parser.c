@@ -4,78 +4,450 @@
  */
 
 #include "../iman.h"
+#include "../iman_mapping.h"
+#include "../iman_hash.h"
+#include "iman_diagnostics.h"
 #include "iman_lexer.h"
+#include "iman_arena.h"
+#include "iman_symbols.h"
 #include "iman_reference.h"
+#include "iman_output.h"
+#include "iman_manifest.h"
 #include "iman_ref_writer.h"
+#include "iman_embed.h"
+#include "iman_bundle_writer.h"
+#include "iman_stats.h"
 #include "iman_parser.h"
+#include <pthread.h>
+#include <unistd.h>
 
 #define IMAN_INSN_FILENAME "instruction.iman"
 #define MAX_PATH_LENGTH 1024
+#define MAX_WORKER_THREADS 64
 
-static int iman_build_table(char *source_name, char *output_dir, char *arch);
+struct iman_build_result {
+    int status;
+    int has_block;
+    struct iman_ref_record record;
+    
+    /* Unchanged since the previous build, the block is copied from the old table instead of parsed */
+    int reused;
+    struct iman_manifest_block previous;
+};
+
+/* Block ranges are handed out to the workers one at a time, results are kept in source order */
+struct iman_build_job {
+    const char *data;
+    const struct iman_parser_range *ranges;
+    unsigned int range_count;
+    
+    struct iman_build_result *results;
+    
+    pthread_mutex_t lock;
+    unsigned int next_range;
+    
+    /* Each worker counts into its own copy and merges it in here under the lock, NULL without --stats */
+    struct iman_stats *stats;
+};
+
+static int iman_build_table(char *source_name, char *output_dir, char *arch, int full, struct iman_stats *stats);
+static unsigned int iman_build_find_reused(struct iman_build_job *job, const struct iman_manifest *manifest);
+static void *iman_build_worker(void *argument);
+static void *iman_build_compress_worker(void *argument);
+static void iman_build_range(struct iman_build_job *job, unsigned int index, struct iman_arena *arena, struct iman_symbol_table *symbols, struct iman_stats *stats);
+static unsigned int iman_build_thread_count(unsigned int range_count);
+static unsigned int iman_build_count_lines(const char *data, size_t length);
 
 int main(int argc, char **argv) {
+    enum iman_diagnostic_level level = IMAN_DIAGNOSTIC_INFO;
     char path_buffer[MAX_PATH_LENGTH];
+    const char *embed_path = NULL, *metrics_path = NULL;
+    struct iman_stats stats;
+    int first = 1, full = IMAN_FALSE, print_stats = IMAN_FALSE, bundle = IMAN_FALSE, result;
     
-    if (argc != 4) {
-        printf("Usage: %s sourcedir arch targetdir\nGenerates the index and compressed reference table.\n",
+    /* Flags come ahead of the positional arguments */
+    for (; first < argc && argv[first][0] == '-'; ++first) {
+        if (strcmp(argv[first], "-q") == 0 || strcmp(argv[first], "--quiet") == 0) {
+            level = IMAN_DIAGNOSTIC_QUIET;
+        } else if (strcmp(argv[first], "-v") == 0 || strcmp(argv[first], "--trace") == 0) {
+            level = IMAN_DIAGNOSTIC_TRACE;
+        } else if (strcmp(argv[first], "-f") == 0 || strcmp(argv[first], "--full") == 0) {
+            full = IMAN_TRUE;
+        } else if ((strcmp(argv[first], "-e") == 0 || strcmp(argv[first], "--embed") == 0) && first + 1 < argc) {
+            embed_path = argv[++first];
+        } else if (strcmp(argv[first], "-b") == 0 || strcmp(argv[first], "--bundle") == 0) {
+            bundle = IMAN_TRUE;
+        } else if (strcmp(argv[first], "-s") == 0 || strcmp(argv[first], "--stats") == 0) {
+            print_stats = IMAN_TRUE;
+        } else if ((strcmp(argv[first], "-m") == 0 || strcmp(argv[first], "--metrics") == 0) && first + 1 < argc) {
+            metrics_path = argv[++first];
+        } else {
+            break;
+        }
+    }
+    
+    if (argc - first != 3) {
+        printf("Usage: %s [-q|--quiet] [-v|--trace] [-f|--full] [-e|--embed source.c] [-b|--bundle] [-s|--stats] [-m|--metrics file] sourcedir arch targetdir\n"
+            "Generates the index and compressed reference table.\n"
+            "Blocks unchanged since the last build are reused unless --full is given.\n"
+            "--embed also writes the built files out as a C source to link into iman.\n"
+            "--bundle rewrites " IMAN_REF_BUNDLE_FILE " in targetdir to hold every architecture built there,\n"
+            "once it exists every later build keeps it up to date.\n"
+            "--stats prints phase timings and counters, --metrics writes them as OpenMetrics text.\n",
             argc > 0 ? argv[0] : "iman-parser"
         );
         
         return -1;
     }
     
-    if (snprintf(path_buffer, MAX_PATH_LENGTH, "%s/%s/" IMAN_INSN_FILENAME, argv[1], argv[2]) >= MAX_PATH_LENGTH) {
-        printf("Error: specified path %s was too long\n", argv[1]);
+    iman_diagnostic_initialise(level);
+    
+    if (snprintf(path_buffer, MAX_PATH_LENGTH, "%s/%s/" IMAN_INSN_FILENAME, argv[first], argv[first + 1]) >= MAX_PATH_LENGTH) {
+        IMAN_ERROR("Error: specified path %s was too long\n", argv[first]);
+        iman_diagnostic_flush();
         return -1;
     }
     
-    return iman_build_table(path_buffer, argv[3], argv[2]);
+    memset(&stats, 0, sizeof(stats));
+    result = iman_build_table(path_buffer, argv[first + 2], argv[first + 1], full, print_stats == IMAN_TRUE || metrics_path != NULL ? &stats : NULL);
+    
+    if (result == 0 && print_stats == IMAN_TRUE)
+        iman_stats_print(&stats);
+    
+    if (result == 0 && metrics_path != NULL && iman_stats_write_openmetrics(&stats, metrics_path) != IMAN_TRUE) {
+        IMAN_ERROR("Error: unable to write the metrics to %s\n", metrics_path);
+        result = -7;
+    }
+    
+    if (result == 0 && embed_path != NULL && iman_embed_write(embed_path, argv[first + 2], argv[first + 1]) != IMAN_TRUE)
+        result = -6;
+    
+    /* iman reads a bundle ahead of the separate files, so one left by an earlier --bundle build is rewritten too */
+    if (result == 0 && (bundle == IMAN_TRUE || iman_bundle_exists(argv[first + 2]) == IMAN_TRUE) && iman_bundle_write(argv[first + 2]) != IMAN_TRUE)
+        result = -8;
+    
+    iman_diagnostic_flush();
+    return result;
 }
 
-static int iman_build_table(char *source_name, char *output_dir, char *arch) {
-    struct iman_parser parser;
+static int iman_build_table(char *source_name, char *output_dir, char *arch, int full, struct iman_stats *stats) {
+    struct iman_mapping source;
     struct iman_ref_writer writer;
-    int result = 0;
+    struct iman_manifest manifest;
+    struct iman_build_job job;
+    struct iman_parser_range *ranges = NULL;
+    pthread_t threads[MAX_WORKER_THREADS];
+    unsigned int range_count = 0, reused_count = 0, thread_count, x;
+    int result = 0, incremental = IMAN_FALSE;
+    uint64_t started = iman_stats_now(), split_done, parse_done, merge_done, compress_done;
     
-    if (iman_parser_initialise(&parser, source_name) != IMAN_TRUE) {
-        printf("Error: unable to open source file %s\n", source_name);
+    if (iman_mapping_open(&source, source_name, IMAN_MAPPING_ACCESS_SEQUENTIAL) != IMAN_TRUE) {
+        IMAN_ERROR("Error: unable to open source file %s\n", source_name);
         return -1;
     }
     
     if (iman_ref_writer_open(&writer, output_dir, arch) != IMAN_TRUE) {
-        iman_parser_release(&parser);
+        iman_mapping_close(&source);
         return -2;
     }
     
-    printf("Info: starting to parse %s\n", source_name);
+    IMAN_INFO("Info: starting to parse %s\n", source_name);
+    
+    if (iman_parser_split_blocks((const char *)source.data, source.size, &ranges, &range_count) != IMAN_TRUE) {
+        IMAN_ERROR("Error: unable to split the source into blocks\n");
+        iman_ref_writer_abort(&writer);
+        iman_mapping_close(&source);
+        return -3;
+    }
+    
+    split_done = iman_stats_now();
+    
+    memset(&job, 0, sizeof(job));
+    job.data = (const char *)source.data;
+    job.ranges = ranges;
+    job.range_count = range_count;
+    job.stats = stats;
+    job.results = calloc(range_count + 1, sizeof(struct iman_build_result));
+    pthread_mutex_init(&job.lock, NULL);
+    
+    if (job.results == NULL) {
+        IMAN_ERROR("Error: out of memory\n");
+        range_count = 0;
+        result = -3;
+    }
+    
+    if (full == IMAN_FALSE && range_count != 0 && iman_manifest_open(&manifest, output_dir, arch) == IMAN_TRUE) {
+        reused_count = iman_build_find_reused(&job, &manifest);
+        incremental = IMAN_TRUE;
+        
+        /* Mostly new source is better served by a freshly trained dictionary and compact symbol ids */
+        if (reused_count * 2 < range_count || iman_ref_writer_seed(&writer, &manifest) != IMAN_TRUE) {
+            for (x = 0; x < range_count; ++x) {
+                job.results[x].reused = IMAN_FALSE;
+            }
+            
+            iman_manifest_close(&manifest);
+            incremental = IMAN_FALSE;
+            reused_count = 0;
+        }
+    }
+    
+    if (incremental == IMAN_TRUE)
+        IMAN_INFO("Info: reusing %u of %u blocks from the previous build\n", reused_count, range_count);
+    
+    /* The calling thread works too, so one thread means no extra threads at all */
+    thread_count = iman_build_thread_count(range_count);
+    
+    for (x = 1; x < thread_count; ++x) {
+        if (pthread_create(&threads[x], NULL, &iman_build_worker, &job) != 0)
+            break;
+    }
+    
+    thread_count = x;
+    iman_build_worker(&job);
     
+    for (x = 1; x < thread_count; ++x) {
+        pthread_join(threads[x], NULL);
+    }
     
-    while(iman_parser_is_eof(&parser) == IMAN_FALSE) {
-        if (iman_parser_read_block(&parser) != IMAN_TRUE) {
-            /*long offset, end = ftell(parser.lexer.source);*/
-            iman_reference_block_release(&parser.block);
+    parse_done = iman_stats_now();
+    
+    /* Merge in source order so the output doesn't depend on scheduling */
+    for (x = 0; x < range_count; ++x) {
+        struct iman_build_result *block_result = &job.results[x];
+        
+        if (block_result->status != IMAN_TRUE) {
             result = -3;
             break;
         }
         
-        printf("Info: parsed block %s\n", parser.block.terms->names[0]);
+        if (block_result->reused == IMAN_TRUE) {
+            if (iman_ref_writer_add_reused(&writer, &block_result->previous) != IMAN_TRUE) {
+                result = -4;
+                break;
+            }
+            
+            IMAN_TRACE("Info: reused block %s\n", block_result->previous.names);
+            continue;
+        }
+        
+        if (block_result->has_block == IMAN_FALSE)
+            continue;
         
-        if (iman_ref_writer_add(&writer, &parser.block) != IMAN_TRUE) {
-            iman_reference_block_release(&parser.block);
+        IMAN_TRACE("Info: parsed block %s\n", block_result->record.names.buffer);
+        
+        if (iman_ref_writer_add_record(&writer, &block_result->record) != IMAN_TRUE) {
             result = -4;
             break;
         }
         
-        printf("Info: wrote block %s\n", parser.block.terms->names[0]);
+        IMAN_TRACE("Info: wrote block %s\n", block_result->record.names.buffer);
+    }
+    
+    merge_done = iman_stats_now();
+    
+    for (x = 0; x < range_count; ++x) {
+        iman_ref_record_release(&job.results[x].record);
+    }
+    
+    pthread_mutex_destroy(&job.lock);
+    free(job.results);
+    free(ranges);
+    
+    /* Once the dictionary has seen every block the pool deflates the table, close writes it in source order */
+    if (result == 0 && iman_ref_writer_train(&writer) == IMAN_TRUE) {
+        thread_count = iman_build_thread_count(writer.blocks.count);
         
-        fflush(writer.index_output);
-        fflush(writer.table_output);
+        for (x = 1; x < thread_count; ++x) {
+            if (pthread_create(&threads[x], NULL, &iman_build_compress_worker, &writer) != 0)
+                break;
+        }
+        
+        thread_count = x;
+        iman_ref_writer_compress(&writer);
         
-        iman_reference_block_release(&parser.block);
+        for (x = 1; x < thread_count; ++x) {
+            pthread_join(threads[x], NULL);
+        }
     }
     
-    iman_parser_release(&parser);
-    iman_ref_writer_close(&writer);
+    compress_done = iman_stats_now();
+    
+    /* A build with a bad block keeps the previous outputs rather than replacing them with a partial one */
+    if (result != 0) {
+        iman_ref_writer_abort(&writer);
+    } else if (iman_ref_writer_close(&writer) != IMAN_TRUE) {
+        IMAN_ERROR("Error: unable to write the reference index\n");
+        result = -5;
+    }
+    
+    /* Reused blocks point into the old table, so it stays mapped until the writer is done */
+    if (incremental == IMAN_TRUE)
+        iman_manifest_close(&manifest);
+    
+    if (stats != NULL) {
+        uint64_t finished = iman_stats_now();
+        
+        stats->nanoseconds[IMAN_STATS_PHASE_SPLIT] = split_done - started;
+        stats->nanoseconds[IMAN_STATS_PHASE_PARSE] = parse_done - split_done;
+        stats->nanoseconds[IMAN_STATS_PHASE_MERGE] = merge_done - parse_done;
+        stats->nanoseconds[IMAN_STATS_PHASE_COMPRESS] = compress_done - merge_done;
+        stats->nanoseconds[IMAN_STATS_PHASE_WRITE] = finished - compress_done;
+        stats->nanoseconds[IMAN_STATS_PHASE_TOTAL] = finished - started;
+        stats->counters[IMAN_STATS_BYTES_READ] = source.size;
+        stats->counters[IMAN_STATS_BLOCKS_REUSED] = reused_count;
+        stats->counters[IMAN_STATS_BYTES_WRITTEN] = writer.written.bytes;
+        stats->counters[IMAN_STATS_WRITE_SYSCALLS] = writer.written.syscalls;
+    }
+    
+    iman_mapping_close(&source);
     return result;
+}
+
+/* Matches every range against the previous build by the hash of its source text */
+static unsigned int iman_build_find_reused(struct iman_build_job *job, const struct iman_manifest *manifest) {
+    unsigned int count = 0, x;
+    
+    for (x = 0; x < job->range_count; ++x) {
+        const struct iman_parser_range *range = &job->ranges[x];
+        struct iman_build_result *result = &job->results[x];
+        
+        result->reused = iman_manifest_find(manifest, iman_hash_data(&job->data[range->offset], range->length), &result->previous);
+        
+        if (result->reused == IMAN_TRUE)
+            count++;
+    }
+    
+    return count;
+}
+
+static void *iman_build_worker(void *argument) {
+    struct iman_build_job *job = argument;
+    struct iman_arena arena;
+    struct iman_symbol_table symbols;
+    struct iman_stats stats;
+    
+    /* One arena and symbol table per worker, reset after each block so the parse loop settles down to no allocations */
+    iman_arena_initialise(&arena);
+    iman_symbol_table_initialise(&symbols);
+    memset(&stats, 0, sizeof(stats));
+    
+    for (;;) {
+        unsigned int index;
+        
+        pthread_mutex_lock(&job->lock);
+        index = job->next_range++;
+        pthread_mutex_unlock(&job->lock);
+        
+        if (index >= job->range_count)
+            break;
+        
+        iman_build_range(job, index, &arena, &symbols, job->stats != NULL ? &stats : NULL);
+    }
+    
+    if (job->stats != NULL) {
+        pthread_mutex_lock(&job->lock);
+        iman_stats_merge(job->stats, &stats);
+        pthread_mutex_unlock(&job->lock);
+    }
+    
+    iman_symbol_table_release(&symbols);
+    iman_arena_release(&arena);
+    return NULL;
+}
+
+/* Errors are kept on the writer, close reports them */
+static void *iman_build_compress_worker(void *argument) {
+    iman_ref_writer_compress(argument);
+    return NULL;
+}
+
+static void iman_build_range(struct iman_build_job *job, unsigned int index, struct iman_arena *arena, struct iman_symbol_table *symbols, struct iman_stats *stats) {
+    const struct iman_parser_range *range = &job->ranges[index];
+    struct iman_build_result *result = &job->results[index];
+    struct iman_parser parser;
+    uint64_t started = 0, inner = 0;
+    
+    result->status = IMAN_TRUE;
+    result->has_block = IMAN_FALSE;
+    
+    if (result->reused == IMAN_TRUE)
+        return;
+    
+    iman_parser_initialise_span(&parser, &job->data[range->offset], range->length, range->line, arena, symbols);
+    parser.stats = stats;
+    
+    /* Forms and descriptions time themselves, lexing gets the rest of the block */
+    if (stats != NULL) {
+        started = iman_stats_now();
+        inner = stats->nanoseconds[IMAN_STATS_PHASE_FORMS] + stats->nanoseconds[IMAN_STATS_PHASE_DESCRIPTION];
+    }
+    
+    iman_parser_skip_blank_lines(&parser);
+    
+    if (iman_parser_is_eof(&parser) == IMAN_TRUE) {
+        iman_parser_release(&parser);
+        return;
+    }
+    
+    if (iman_parser_read_block(&parser) != IMAN_TRUE) {
+        result->status = IMAN_FALSE;
+    } else if (iman_ref_record_serialise(&result->record, &parser.block) != IMAN_TRUE) {
+        IMAN_ERROR("Error: unable to serialise a block\n");
+        result->status = IMAN_FALSE;
+    } else {
+        result->has_block = IMAN_TRUE;
+        result->record.source_hash = iman_hash_data(&job->data[range->offset], range->length);
+        
+        /* A range holds exactly one block, anything left over is malformed */
+        iman_parser_skip_blank_lines(&parser);
+        
+        if (iman_parser_is_eof(&parser) == IMAN_FALSE) {
+            IMAN_ERROR("Error (L%u: C%u): expected a new term definition.\n", parser.lexer.pos.line, parser.lexer.pos.column + 1);
+            result->status = IMAN_FALSE;
+        }
+    }
+    
+    if (stats != NULL) {
+        inner = stats->nanoseconds[IMAN_STATS_PHASE_FORMS] + stats->nanoseconds[IMAN_STATS_PHASE_DESCRIPTION] - inner;
+        stats->nanoseconds[IMAN_STATS_PHASE_LEX] += iman_stats_now() - started - inner;
+        stats->counters[IMAN_STATS_BLOCKS]++;
+        
+        stats->counters[IMAN_STATS_LINES] += iman_build_count_lines(&job->data[range->offset], range->length);
+    }
+    
+    iman_reference_block_release(&parser.block);
+    iman_parser_release(&parser);
+}
+
+static unsigned int iman_build_thread_count(unsigned int range_count) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int count = online > 0 ? (unsigned int)online : 1;
+    
+    if (count > MAX_WORKER_THREADS)
+        count = MAX_WORKER_THREADS;
+    
+    if (count > range_count)
+        count = range_count > 0 ? range_count : 1;
+    
+    return count;
+}
+
+/* The lexer's line number also steps on every read past the end, so lines are counted from the source */
+static unsigned int iman_build_count_lines(const char *data, size_t length) {
+    const char *end = data + length;
+    unsigned int count = 0;
+    
+    while (data < end) {
+        const char *newline = memchr(data, '\n', (size_t)(end - data));
+        
+        count++;
+        
+        if (newline == NULL)
+            break;
+        
+        data = newline + 1;
+    }
+    
+    return count;
 }
\ No newline at end of file
@@ -0,0 +1,58 @@
+# Builds the reference, breaks one block and checks the rebuild leaves the first build's outputs alone
+# Expects IMAN_PARSER, REFERENCE and WORK_DIR to be set with -D
+
+set(SOURCE_DIR ${WORK_DIR}/source)
+set(OUTPUT_DIR ${WORK_DIR}/output)
+set(OUTPUTS intel.table intel.index intel.search intel.manifest)
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${SOURCE_DIR}/intel ${OUTPUT_DIR})
+configure_file(${REFERENCE} ${SOURCE_DIR}/intel/instruction.iman COPYONLY)
+
+execute_process(COMMAND ${IMAN_PARSER} -q -f ${SOURCE_DIR} intel ${OUTPUT_DIR} RESULT_VARIABLE result)
+
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "the first build failed with ${result}")
+endif()
+
+foreach(output ${OUTPUTS})
+    file(MD5 ${OUTPUT_DIR}/${output} hash_${output})
+endforeach()
+
+# An unknown field name fails just the block it is in
+file(READ ${SOURCE_DIR}/intel/instruction.iman text)
+string(FIND "${text}" "\tflags\n" position)
+
+if(position LESS 0)
+    message(FATAL_ERROR "the reference has no flags field to break")
+endif()
+
+string(SUBSTRING "${text}" 0 ${position} head)
+math(EXPR position "${position} + 7")
+string(SUBSTRING "${text}" ${position} -1 tail)
+file(WRITE ${SOURCE_DIR}/intel/instruction.iman "${head}\tbroken\n${tail}")
+
+# Once as a full build and once as an incremental one
+foreach(flags "-q;-f" "-q")
+    execute_process(COMMAND ${IMAN_PARSER} ${flags} ${SOURCE_DIR} intel ${OUTPUT_DIR} RESULT_VARIABLE result ERROR_QUIET)
+    
+    if(result EQUAL 0)
+        message(FATAL_ERROR "the build with a broken block succeeded")
+    endif()
+    
+    foreach(output ${OUTPUTS})
+        file(MD5 ${OUTPUT_DIR}/${output} hash)
+        
+        if(NOT hash STREQUAL hash_${output})
+            message(FATAL_ERROR "${output} changed after the failed build")
+        endif()
+    endforeach()
+    
+    file(GLOB leftovers ${OUTPUT_DIR}/*.tmp)
+    
+    if(leftovers)
+        message(FATAL_ERROR "the failed build left ${leftovers} behind")
+    endif()
+endforeach()
+
+file(REMOVE_RECURSE ${WORK_DIR})
\ No newline at end of file
@@ -6,12 +6,21 @@
  */
 
 #include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
 #include "../iman.h"
+#include "../iman_hash.h"
 
 #define IMAN_INTELF2I_COLUMN_COUNT 6
-#define IMAN_INTELF2I_LINE_SIZE 2048
 #define IMAN_INTELF2I_MAX_OPERANDS 8
 
+/* Twice the operand limit, so the per line operand set stays sparse */
+#define IMAN_INTELF2I_OPERAND_SLOTS 16
+
+/* Input is read and output written a block at a time, a line only has to fit in the read block */
+#define IMAN_INTELF2I_READ_SIZE (1 << 20)
+#define IMAN_INTELF2I_WRITE_SIZE (1 << 20)
+
 struct intelf2i_form {
     
     struct {
@@ -20,11 +29,25 @@ struct intelf2i_form {
     
     unsigned int operand_count;
     char *operand[IMAN_INTELF2I_MAX_OPERANDS];
+    size_t operand_length[IMAN_INTELF2I_MAX_OPERANDS];
+    
+    /* Operand names hashed for the description's @N substitution, each slot holds an operand index plus one */
+    unsigned char operand_slots[IMAN_INTELF2I_OPERAND_SLOTS];
 };
 
-typedef void (*intelf2i_column_handler_func)(char *column, struct intelf2i_form *form);
+/* Converted lines are assembled straight into one block and written out when it fills */
+struct intelf2i_output {
+    char *data;
+    size_t used;
+    size_t size;
+    
+    int error;
+};
+
+typedef void (*intelf2i_column_handler_func)(char *column, struct intelf2i_form *form, struct intelf2i_output *output);
 
-static void intelf2i_parse_line(char * line);
+static int intelf2i_convert(int fd, char *input, struct intelf2i_output *output);
+static void intelf2i_parse_line(char * line, struct intelf2i_output *output);
 static int intelf2i_consume_tab(char **line, char **column);
 
 static int intelf2i_split(char **value, char delimiter, char **start);
@@ -32,14 +55,24 @@ static int intelf2i_split_trim(char **value, char delimiter, char **start);
 static void intelf2i_to_lower(char *value);
 static void intelf2i_trim_tail(char *value);
 
-static void intelf2i_column_opcode(char *column, struct intelf2i_form *form);
-static void intelf2i_column_form(char *column, struct intelf2i_form *form);
-static void intelf2i_column_encoding(char *column, struct intelf2i_form *form);
-static void intelf2i_column_64bit_mode(char *column, struct intelf2i_form *form);
-static void intelf2i_column_longmode(char *column, struct intelf2i_form *form);
-static void intelf2i_column_description(char *column, struct intelf2i_form *form);
+static void intelf2i_column_opcode(char *column, struct intelf2i_form *form, struct intelf2i_output *output);
+static void intelf2i_column_form(char *column, struct intelf2i_form *form, struct intelf2i_output *output);
+static void intelf2i_column_encoding(char *column, struct intelf2i_form *form, struct intelf2i_output *output);
+static void intelf2i_column_64bit_mode(char *column, struct intelf2i_form *form, struct intelf2i_output *output);
+static void intelf2i_column_longmode(char *column, struct intelf2i_form *form, struct intelf2i_output *output);
+static void intelf2i_column_description(char *column, struct intelf2i_form *form, struct intelf2i_output *output);
+
+static const char *intelf2i_classify_operand(const char *operand, int *psize);
+static void intelf2i_add_operand(struct intelf2i_form *form, char *operand);
+static int intelf2i_find_operand(const struct intelf2i_form *form, const char *word, size_t length, unsigned int *pindex);
+static void intelf2i_emit_description_word(char *word_start, unsigned int length, struct intelf2i_form *form, struct intelf2i_output *output);
 
-static void intelf2i_emit_description_word(char *word_start, unsigned int length, struct intelf2i_form *form);
+static void intelf2i_emit(struct intelf2i_output *output, const char *text, size_t length);
+static void intelf2i_emit_string(struct intelf2i_output *output, const char *text);
+static void intelf2i_emit_char(struct intelf2i_output *output, char c);
+static void intelf2i_emit_unsigned(struct intelf2i_output *output, unsigned int value);
+static void intelf2i_flush(struct intelf2i_output *output);
+static int intelf2i_write_all(int fd, const char *data, size_t size);
 
 /* Reorders the output rows in line with the format */
 static const unsigned int column_handler_remap_index[IMAN_INTELF2I_COLUMN_COUNT] = {
@@ -51,6 +84,15 @@ static const unsigned int column_handler_remap_index[IMAN_INTELF2I_COLUMN_COUNT]
     2, /* Encoding (unused) */
 };
 
+/* Short type names for the sized immediate, register or memory and register operands, by kind then width */
+static const char * const operand_type_names[3][4] = {
+    { "i8", "i16", "i32", "i64" },
+    { "v8", "v16", "v32", "v64" },
+    { "r8", "r16", "r32", "r64" }
+};
+
+static const int operand_type_sizes[4] = { 8, 16, 32, 64 };
+
 static const intelf2i_column_handler_func column_handler_table[IMAN_INTELF2I_COLUMN_COUNT] = {
     &intelf2i_column_opcode,
     &intelf2i_column_form,
@@ -60,18 +102,95 @@ static const intelf2i_column_handler_func column_handler_table[IMAN_INTELF2I_COL
     &intelf2i_column_description
 };
 
-static char line_buffer[IMAN_INTELF2I_LINE_SIZE];
-
 int main(void) {
+    struct intelf2i_output output;
+    char *input = malloc(IMAN_INTELF2I_READ_SIZE + 1);
+    int result;
+    
+    output.data = malloc(IMAN_INTELF2I_WRITE_SIZE);
+    output.used = 0;
+    output.size = IMAN_INTELF2I_WRITE_SIZE;
+    output.error = IMAN_FALSE;
+    
+    if (input == NULL || output.data == NULL) {
+        fprintf(stderr, "Error: unable to allocate the conversion buffers\n");
+        free(input);
+        free(output.data);
+        return 1;
+    }
+    
+    result = intelf2i_convert(STDIN_FILENO, input, &output);
+    intelf2i_flush(&output);
     
-    while(fgets(line_buffer, sizeof(line_buffer), stdin) != NULL) {
-        intelf2i_parse_line(line_buffer);
+    if (output.error == IMAN_TRUE) {
+        fprintf(stderr, "Error: unable to write the converted forms\n");
+        result = IMAN_FALSE;
     }
     
-    return 0;
+    free(input);
+    free(output.data);
+    return result == IMAN_TRUE ? 0 : 1;
 }
 
-static void intelf2i_parse_line(char * line) {
+/*
+ * Reads fd a block at a time and converts every whole line in the block where it lies, the partial
+ * line at the end moves to the front for the next read. A line too long for the block is skipped.
+ */
+static int intelf2i_convert(int fd, char *input, struct intelf2i_output *output) {
+    size_t used = 0;
+    int discarding = IMAN_FALSE;
+    
+    for (;;) {
+        char *start = input, *end, *newline;
+        ssize_t count = read(fd, input + used, IMAN_INTELF2I_READ_SIZE - used);
+        
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            
+            fprintf(stderr, "Error: unable to read the form table\n");
+            return IMAN_FALSE;
+        }
+        
+        if (count == 0)
+            break;
+        
+        end = input + used + count;
+        
+        while ((newline = memchr(start, '\n', (size_t)(end - start))) != NULL) {
+            *newline = '\0';
+            
+            if (discarding == IMAN_TRUE)
+                discarding = IMAN_FALSE;
+            else
+                intelf2i_parse_line(start, output);
+            
+            start = newline + 1;
+        }
+        
+        used = (size_t)(end - start);
+        
+        if (used == IMAN_INTELF2I_READ_SIZE) {
+            if (discarding != IMAN_TRUE)
+                fprintf(stderr, "Error: skipping a line longer than %d bytes\n", IMAN_INTELF2I_READ_SIZE);
+            
+            discarding = IMAN_TRUE;
+            used = 0;
+        } else if (start != input) {
+            memmove(input, start, used);
+        }
+    }
+    
+    /* The last line doesn't need a newline */
+    if (used != 0 && discarding != IMAN_TRUE) {
+        input[used] = '\0';
+        intelf2i_parse_line(input, output);
+    }
+    
+    return IMAN_TRUE;
+}
+
+static void intelf2i_parse_line(char * line, struct intelf2i_output *output) {
     unsigned int position;
     char *columns[IMAN_INTELF2I_COLUMN_COUNT];
     struct intelf2i_form form;
@@ -87,17 +206,17 @@ static void intelf2i_parse_line(char * line) {
     
     memset(&form, 0, sizeof(form));
     
-    putchar('[');
+    intelf2i_emit_char(output, '[');
     
     /* Valid line, emit the converted version */
     for(position = 0; position < IMAN_INTELF2I_COLUMN_COUNT; ++position) {
         unsigned int translated = column_handler_remap_index[position];
         char *column = columns[translated];
         
-        column_handler_table[translated](column, &form);
+        column_handler_table[translated](column, &form, output);
     }
     
-    printf(" ]\n");
+    intelf2i_emit(output, " ]\n", 3);
 }
 
 static int intelf2i_consume_tab(char **line, char **column) {
@@ -175,7 +294,7 @@ static int intelf2i_split_trim(char **value, char delimiter, char **start) {
     for(; scan >= *start; --scan) {
         if (*scan != ' ') {
             *(scan + 1) = '\0';
-
+            
             return IMAN_TRUE;
         }
     }
@@ -195,6 +314,9 @@ static void intelf2i_to_lower(char *value) {
 static void intelf2i_trim_tail(char *value) {
     unsigned int x, length = strlen(value);
     
+    if (length == 0)
+        return;
+    
     for(x = length - 1; x != 0; --x) {
         if (value[x] != ' ') {
             value[x + 1] = '\0';
@@ -206,13 +328,15 @@ static void intelf2i_trim_tail(char *value) {
     value[0] = '\0';
 }
 
-static void intelf2i_column_opcode(char *column, struct intelf2i_form *form) {
+static void intelf2i_column_opcode(char *column, struct intelf2i_form *form, struct intelf2i_output *output) {
     IMAN_UNUSED(form);
     
-    printf(" (%s),", column);
+    intelf2i_emit(output, " (", 2);
+    intelf2i_emit_string(output, column);
+    intelf2i_emit(output, "),", 2);
 }
 
-static void intelf2i_column_form(char *column, struct intelf2i_form *form) {
+static void intelf2i_column_form(char *column, struct intelf2i_form *form, struct intelf2i_output *output) {
     char *instr_name = NULL;
     char *operand = NULL;
     int operand_size = -1;
@@ -221,101 +345,73 @@ static void intelf2i_column_form(char *column, struct intelf2i_form *form) {
     
     intelf2i_to_lower(instr_name);
     
-    printf(" (%s), ( ", instr_name);
+    intelf2i_emit(output, " (", 2);
+    intelf2i_emit_string(output, instr_name);
+    intelf2i_emit(output, "), ( ", 5);
     
     do {
         if (intelf2i_split_trim(&column, ',', &operand) == IMAN_TRUE) {
             int local_op_size = -1;
             
-            form->operand[form->operand_count++] = operand;
+            if (form->operand_count < IMAN_INTELF2I_MAX_OPERANDS)
+                intelf2i_add_operand(form, operand);
             
-            if (strncmp(operand, "imm8", 4) == 0) {
-                operand = "i8";
-                local_op_size = 8;
-            } else if (strncmp(operand, "imm16", 5) == 0) {
-                operand = "i16";
-                local_op_size = 16;
-            } else if (strncmp(operand, "imm32", 5) == 0){
-                operand = "i32";
-                local_op_size = 32;
-            } else if (strncmp(operand, "imm64", 5) == 0) {
-                operand = "i64";
-                local_op_size = 64;
-            } else if (strncmp(operand, "r/m8", 4) == 0) {
-                operand = "v8";
-                local_op_size = 8;
-            } else if (strncmp(operand, "r/m16", 5) == 0) {
-                operand = "v16";
-                local_op_size = 16;
-            } else if (strncmp(operand, "r/m32", 5) == 0) {
-                operand = "v32";
-                local_op_size = 32;
-            } else if (strncmp(operand, "r/m64", 5) == 0) {
-                operand = "v64";
-                local_op_size = 64;
-            } else if (strncmp(operand, "r8", 2) == 0) {
-                operand = "r8";
-                local_op_size = 8;
-            } else if (strncmp(operand, "r16", 3) == 0) {
-                operand = "r16";
-                local_op_size = 16;
-            } else if (strncmp(operand, "r32", 3) == 0) {
-                operand = "r32";
-                local_op_size = 32;
-            } else if (strncmp(operand, "r64", 3) == 0) {
-                operand = "r64";
-                local_op_size = 64;
-            }
-            
-            printf("%s", operand);
+            intelf2i_emit_string(output, intelf2i_classify_operand(operand, &local_op_size));
             
             if (operand_size == -1) {
                 operand_size = local_op_size;
             }
         }
         
-    } while(*column != '\0' && printf(", ") > 0);
+        if (*column != '\0')
+            intelf2i_emit(output, ", ", 2);
+        
+    } while(*column != '\0');
     
     /* The last parentheses are for clobbers */
-    if (operand_size != -1)
-        printf(" ), (%d), (),", operand_size);
-    else
-        printf(" ), (), (),");
+    if (operand_size != -1) {
+        intelf2i_emit(output, " ), (", 5);
+        intelf2i_emit_unsigned(output, (unsigned int)operand_size);
+        intelf2i_emit(output, "), (),", 6);
+    } else {
+        intelf2i_emit(output, " ), (), (),", 11);
+    }
 }
 
-static void intelf2i_column_encoding(char *column, struct intelf2i_form *form) {
+static void intelf2i_column_encoding(char *column, struct intelf2i_form *form, struct intelf2i_output *output) {
     /* This is currently useless due to needing a secondary table */
     IMAN_UNUSED(column);
     IMAN_UNUSED(form);
+    IMAN_UNUSED(output);
 }
 
-static void intelf2i_column_64bit_mode(char *column, struct intelf2i_form *form) {
+static void intelf2i_column_64bit_mode(char *column, struct intelf2i_form *form, struct intelf2i_output *output) {
     if (strcmp(column, "Valid") == 0) {
-        printf(" ( 64;");
+        intelf2i_emit(output, " ( 64;", 6);
         form->modes.longlong = 1;
     } else {
-        printf(" ( ");
+        intelf2i_emit(output, " ( ", 3);
     }
 }
 
-static void intelf2i_column_longmode(char *column, struct intelf2i_form *form) {
+static void intelf2i_column_longmode(char *column, struct intelf2i_form *form, struct intelf2i_output *output) {
     if (strcmp(column, "Valid") == 0) {
-        printf(" 32; 16 ), (),");
+        intelf2i_emit(output, " 32; 16 ), (),", 14);
         form->modes.protected = 1;
         form->modes.real = 1;
     } else {
-        printf(" ), (),");
+        intelf2i_emit(output, " ), (),", 7);
     }
 }
 
-static void intelf2i_column_description(char *column, struct intelf2i_form *form) {
+static void intelf2i_column_description(char *column, struct intelf2i_form *form, struct intelf2i_output *output) {
     unsigned int length = strlen(column);
-        
-    IMAN_UNUSED(form);
+    
     /* Remove the full stop */
-    column[length - 1] = '\0';
+    if (length != 0)
+        column[length - 1] = '\0';
     
-    printf(" (");
+    intelf2i_emit(output, " (", 2);
     
     while(*column != '\0') {
         char *word_start;
@@ -326,34 +422,173 @@ static void intelf2i_column_description(char *column, struct intelf2i_form *form
         
         word_start = column;
         
-        for (; *column != '\0'; ++column) {
-            if (*column == ' ') {
-                *column = '\0';
-                ++column;
-                break;
-            }
-        }
+        for (; *column != '\0' && *column != ' '; ++column)
+            ;
+        
+        word_len = column - word_start;
         
-        word_len = (column - word_start) - 1;
+        if (*column == ' ')
+            *column++ = '\0';
         
-        intelf2i_emit_description_word(word_start, word_len, form);
+        intelf2i_emit_description_word(word_start, word_len, form, output);
         
         if (*column != '\0')
-            putchar(' ');
+            intelf2i_emit_char(output, ' ');
+    }
+    
+    intelf2i_emit_char(output, ')');
+}
+
+/*
+ * Renames the sized operand spellings the Intel tables start an operand with, imm<size>, r/m<size> and
+ * r<size>, and gives their size; anything else is returned as it is.
+ */
+static const char *intelf2i_classify_operand(const char *operand, int *psize) {
+    const char *scan = operand;
+    unsigned int kind, size;
+    
+    switch (scan[0]) {
+        case 'i':
+            if (scan[1] != 'm' || scan[2] != 'm')
+                return operand;
+            
+            kind = 0;
+            scan += 3;
+            break;
+        
+        case 'r':
+            kind = scan[1] == '/' && scan[2] == 'm' ? 1 : 2;
+            scan += kind == 1 ? 3 : 1;
+            break;
+        
+        default:
+            return operand;
+    }
+    
+    switch (scan[0]) {
+        case '8': size = 0; break;
+        case '1': size = scan[1] == '6' ? 1 : 4; break;
+        case '3': size = scan[1] == '2' ? 2 : 4; break;
+        case '6': size = scan[1] == '4' ? 3 : 4; break;
+        default:  size = 4; break;
+    }
+    
+    if (size == 4)
+        return operand;
+    
+    *psize = operand_type_sizes[size];
+    return operand_type_names[kind][size];
+}
+
+/* Keyed on the name alone, so zmm1 in a description finds the operand zmm1 {k1}{z}; a repeated name keeps its first index */
+static void intelf2i_add_operand(struct intelf2i_form *form, char *operand) {
+    unsigned int index = form->operand_count++, existing;
+    size_t length = strcspn(operand, " {");
+    uint32_t slot;
+    
+    form->operand[index] = operand;
+    form->operand_length[index] = length;
+    
+    if (length == 0 || intelf2i_find_operand(form, operand, length, &existing) == IMAN_TRUE)
+        return;
+    
+    for (slot = (uint32_t)iman_hash_data(operand, length); form->operand_slots[slot % IMAN_INTELF2I_OPERAND_SLOTS] != 0; ++slot)
+        ;
+    
+    form->operand_slots[slot % IMAN_INTELF2I_OPERAND_SLOTS] = (unsigned char)(index + 1);
+}
+
+static int intelf2i_find_operand(const struct intelf2i_form *form, const char *word, size_t length, unsigned int *pindex) {
+    uint32_t slot;
+    
+    if (form->operand_count == 0)
+        return IMAN_FALSE;
+    
+    for (slot = (uint32_t)iman_hash_data(word, length); form->operand_slots[slot % IMAN_INTELF2I_OPERAND_SLOTS] != 0; ++slot) {
+        unsigned int index = form->operand_slots[slot % IMAN_INTELF2I_OPERAND_SLOTS] - 1u;
+        
+        if (form->operand_length[index] == length && memcmp(form->operand[index], word, length) == 0) {
+            *pindex = index;
+            return IMAN_TRUE;
+        }
     }
     
-    printf(")");
+    return IMAN_FALSE;
 }
 
-static void intelf2i_emit_description_word(char *word_start, unsigned int length, struct intelf2i_form *form) {
-    unsigned int offset;
+static void intelf2i_emit_description_word(char *word_start, unsigned int length, struct intelf2i_form *form, struct intelf2i_output *output) {
+    unsigned int index;
     
-    for(offset = 0; offset < form->operand_count; ++offset) {
-        if (strncmp(form->operand[offset], word_start, length) == 0) {
-            printf("@%u", offset);
+    if (length != 0 && intelf2i_find_operand(form, word_start, length, &index) == IMAN_TRUE) {
+        intelf2i_emit_char(output, '@');
+        intelf2i_emit_unsigned(output, index);
+        return;
+    }
+    
+    intelf2i_emit(output, word_start, length);
+}
+
+static void intelf2i_emit(struct intelf2i_output *output, const char *text, size_t length) {
+    if (length > output->size - output->used) {
+        intelf2i_flush(output);
+        
+        /* Only a single piece bigger than the whole block goes out on its own */
+        if (length > output->size) {
+            if (intelf2i_write_all(STDOUT_FILENO, text, length) != IMAN_TRUE)
+                output->error = IMAN_TRUE;
+            
             return;
         }
     }
     
-    printf("%s", word_start);
+    memcpy(&output->data[output->used], text, length);
+    output->used += length;
+}
+
+static void intelf2i_emit_string(struct intelf2i_output *output, const char *text) {
+    intelf2i_emit(output, text, strlen(text));
+}
+
+static void intelf2i_emit_char(struct intelf2i_output *output, char c) {
+    if (output->used == output->size)
+        intelf2i_flush(output);
+    
+    output->data[output->used++] = c;
+}
+
+static void intelf2i_emit_unsigned(struct intelf2i_output *output, unsigned int value) {
+    char digits[16];
+    unsigned int count = 0;
+    
+    do {
+        digits[sizeof(digits) - ++count] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    
+    intelf2i_emit(output, &digits[sizeof(digits) - count], count);
+}
+
+static void intelf2i_flush(struct intelf2i_output *output) {
+    if (output->used != 0 && intelf2i_write_all(STDOUT_FILENO, output->data, output->used) != IMAN_TRUE)
+        output->error = IMAN_TRUE;
+    
+    output->used = 0;
+}
+
+static int intelf2i_write_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            
+            return IMAN_FALSE;
+        }
+        
+        data += written;
+        size -= (size_t)written;
+    }
+    
+    return IMAN_TRUE;
 }
\ No newline at end of file